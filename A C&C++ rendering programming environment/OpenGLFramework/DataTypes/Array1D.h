@@ -35,6 +35,9 @@ public:
   // Set the array size
   void SetSize( unsigned int n );
 
+  // Forget all the elements (the memory stays allocated for reuse)
+  inline void Clear( void ) { size = 0; }
+
   // Add a new array element to the end of the array (returns index of added element)
   unsigned int Add(const T&);
 
@@ -18,18 +18,20 @@
 
 extern ProgramSearchPaths *paths;
 
-Texture::Texture(int width, int height) :
-	width(width), height(height), type( TEXTURE_TYPE_UNKNOWN ), fileName(0),
-		wrap_u( TEXTURE_CLAMP ), wrap_v( TEXTURE_CLAMP )
+Texture::Texture(int width, int height, int storageFormat) :
+	texels(0), fileName(0), width(width), height(height), type( TEXTURE_TYPE_UNKNOWN ),
+		layout( TEXTURE_LAYOUT_LINEAR ), tilesX(0), rgbScale(1), wrap_u( TEXTURE_CLAMP ), wrap_v( TEXTURE_CLAMP )
 {
-	// Allocate memory
-	image1D = new RGBAColor[width*height];
-	image2D = new RGBAColor *[height];
-	for (int i=0;i<height;i++)
-		image2D[i] = image1D+i*width;
+	// Allocate memory, and start with opaque black (like RGBAColor's constructor)
+	Allocate( storageFormat );
+	RGBAColor black;
+	for (int y=0; y < height; y++)
+		for (int x=0; x < width; x++)
+			SetTexel( x, y, black );
 }
 
-Texture::Texture(char *filename, float scale) : wrap_u( TEXTURE_CLAMP ), wrap_v( TEXTURE_CLAMP )
+Texture::Texture(char *filename, float scale) : texels(0), fileName(0), type( TEXTURE_TYPE_UNKNOWN ),
+	layout( TEXTURE_LAYOUT_LINEAR ), tilesX(0), rgbScale(1), wrap_u( TEXTURE_CLAMP ), wrap_v( TEXTURE_CLAMP )
 {
 	char *ptr;
 
@@ -73,6 +75,20 @@ Texture::Texture(char *filename, float scale) : wrap_u( TEXTURE_CLAMP ), wrap_v(
 	else if (type == TEXTURE_TYPE_CSV) LoadCSV( fileName, scale );
 }
 
+// Set up (uninitialized) storage for width x height texels, in a linear layout
+void Texture::Allocate( int storageFormat )
+{
+	storage = storageFormat;
+	texelBytes = ( storage == TEXTURE_STORAGE_RGBA8 ? 4 : (storage == TEXTURE_STORAGE_RGBA16F ? 8 : 16) );
+	texels = (unsigned char *)malloc( NumStoredTexels( TEXTURE_LAYOUT_LINEAR )*texelBytes );
+	if (!texels)
+	{
+		printf("Error in Texture::Allocate():  Unable to allocate %d x %d texture!\n", width, height );
+		exit(0);
+	}
+}
+
+// 8-bit images are kept as they are, with the scale applied when texels are read
 void Texture::LoadRGB( char *filename, float scale )
 {
 	int components;
@@ -84,104 +100,60 @@ void Texture::LoadRGB( char *filename, float scale )
 		exit(0);
 	}
 
-	// Allocate memory
-	image1D = new RGBAColor[width*height];
-	image2D = new RGBAColor *[height];
-	for (int i=0;i<height;i++)
-		image2D[i] = image1D+i*width;
-
-	unsigned char *ptr = data;
-	for (int i=0; i < height; i++) 
-	{
-		for (int j=0; j < width; j++) 
-		{
-			if (components < 3)
-				image2D[i][j] = Color( scale*ptr[0]/255.0f, scale*ptr[0]/255.0f, scale*ptr[0]/255.0f );
-			else if (components == 3)
-				image2D[i][j] = Color( scale*ptr[0]/255.0f, scale*ptr[1]/255.0f, scale*ptr[2]/255.0f );
-			else 
-				image2D[i][j] = RGBAColor( scale*ptr[0]/255.0f, scale*ptr[1]/255.0f, scale*ptr[2]/255.0f, ptr[3]/255.0f );
-			ptr += 4; //components;
-		}
-    }
-
-	free( data );
+	// ReadRGB() always gives 4 bytes per texel, so we can use its data as is.
+	//    Only 4 component images have a real alpha channel.
+	storage = TEXTURE_STORAGE_RGBA8;
+	texelBytes = 4;
+	texels = data;
+	rgbScale = scale;
+	if (components < 4)
+		for (int i=0; i < width*height; i++)
+			texels[4*i+3] = 255;
 }
 
 
+// PPMs are decoded straight into 4 byte texels (with opaque alpha)
 void Texture::LoadPPM( char *filename, float scale )
 {
-	int mode, img_max;
-	char buf[256];
-
-	FILE *f = fopen( filename, "rb" );
-	fgets( buf, 256, f );
-	mode = buf[1]-'0';
-	if (mode != 3 && mode != 6)
+	ImageInfo info;
+	if (!ReadImageInfo( filename, &info ) || info.isHDR)
 	{
-		printf("Error in Texture::LoadPPM():  Only P3 and P6 .ppm files supported!\n");
+		printf("Error in Texture::LoadPPM(): Unable to read '%s'!\n", filename );
 		exit(0);
 	}
-	// Discard any comments here.
-	fgets(buf, 256, f);
-	while (buf[0] == '#')
-		fgets(buf, 256, f);
-	// read the width and height
-	sscanf( buf, "%d %d", &width, &height );
-	// read the max component field
-	fscanf(f, "%d ", &img_max);
-    if ((mode==6 && img_max > 255) || (img_max <= 0))
+
+	width  = info.width;
+	height = info.height;
+	Allocate( TEXTURE_STORAGE_RGBA8 );
+	rgbScale = scale;
+	if (!DecodeImage( filename, texels, width*4, IMAGE_PIXELS_RGBA8, true ))
 	{
-		printf("Error in Texture::LoadPPM():  Invalid value for .ppm maximum image color!\n");
+		printf("Error in Texture::LoadPPM(): Unable to decode '%s'!\n", filename );
 		exit(0);
 	}
-
-	// Allocate memory
-	image1D = new RGBAColor[width*height];
-	image2D = new RGBAColor *[height];
-	for (int i=0;i<height;i++)
-		image2D[i] = image1D+i*width;
-
-	unsigned int r,g,b;
-	for (int i=0; i < height; i++) 
-	{
-		for (int j=0; j < width; j++) 
-		{
-			if (mode==6)  /* RAW mode */
-				{ r = fgetc(f); g = fgetc(f); b = fgetc(f); }
-			else          /* ASCII mode */
-				fscanf(f, "%d %d %d", &r, &g, &b);
-			image2D[height-i-1][j] = Color( scale*r/(float)img_max, scale*g/(float)img_max, scale*b/(float)img_max );
-		}
-    }
-	fclose( f );
 }
 
 
+// HDR images are kept as half floats, which is plenty for lighting data
 void Texture::LoadHDR( char *filename, float scale )
 {
-	float *data = ReadHDR( filename, &width, &height );
+	unsigned short *data = ReadHDRHalf( filename, &width, &height );
 	if (!data)
 	{
 		printf("Unknown error while loading '%s'!\n", filename);
 		exit(0);
 	}
 
-	// Allocate memory
-	image1D = new RGBAColor[width*height];
-	image2D = new RGBAColor *[height];
-	for (int i=0;i<height;i++)
-		image2D[i] = image1D+i*width;
-
-	float *ptr = data;
-	for (int i=0; i < height; i++) 
+	Allocate( TEXTURE_STORAGE_RGBA16F );
+	rgbScale = scale;
+	unsigned short *dst = (unsigned short *)texels;
+	for (int i=0; i < width*height; i++)
 	{
-		for (int j=0; j < width; j++) 
-		{
-			image2D[i][j] = Color( scale*ptr[0], scale*ptr[1], scale*ptr[2] );
-			ptr+=3;
-		}
-    }
+		dst[4*i+0] = data[3*i+0];
+		dst[4*i+1] = data[3*i+1];
+		dst[4*i+2] = data[3*i+2];
+		dst[4*i+3] = 0x3C00;   // 1.0
+	}
 
 	free( data );
 }
@@ -212,20 +184,17 @@ void Texture::LoadCSV( char *filename, float scale )
 	printf("%d %d %f %f %f %f\n", width, height, fTexRange[0], fTexRange[1], fTexRange[2], fTexRange[3] );
 
 	// Allocate memory
-	image1D = new RGBAColor[width*height];
-	image2D = new RGBAColor *[height];
-	for (int i=0;i<height;i++)
-		image2D[i] = image1D+i*width;
+	Allocate( TEXTURE_STORAGE_RGBA32F );
 
 	for (j=0; j<height; j++)
 	{
 		for (i=0; i<width-1; i++)
 		{
 			fscanf( fDataFile, "%f,", &fData );
-			image2D[j][i] = Color( fData, fData, fData );
+			SetTexel( i, j, Color( fData, fData, fData ) );
 		}
 		fscanf( fDataFile, "%f", &fData );
-		image2D[j][width-1] = Color( fData, fData, fData );
+		SetTexel( width-1, j, Color( fData, fData, fData ) );
 	}
 
 	fclose( fDataFile );
@@ -241,7 +210,135 @@ Texture::Texture(FILE *f, Scene *s)
 
 Texture::~Texture()
 {
+	if (texels) free( texels );
+	for (unsigned int i=0; i < mipLevels.Size(); i++)
+		delete mipLevels[i];
+}
+
+
+void Texture::SetLayout( int newLayout )
+{
+	if (newLayout == layout) return;
+
+	tilesX = (width + (1 << TEXTURE_TILE_BITS) - 1) >> TEXTURE_TILE_BITS;
+	unsigned char *newTexels = (unsigned char *)calloc( NumStoredTexels( newLayout ), texelBytes );
+	if (!newTexels)
+	{
+		printf("Error in Texture::SetLayout():  Unable to allocate %d x %d texture!\n", width, height );
+		exit(0);
+	}
+	for (int y=0; y < height; y++)
+		for (int x=0; x < width; x++)
+			memcpy( newTexels + TexelIndex( x, y, newLayout )*texelBytes, 
+				    texels + TexelIndex( x, y, layout )*texelBytes, texelBytes );
+
+	free( texels );
+	texels = newTexels;
+	layout = newLayout;
+	for (unsigned int i=0; i < mipLevels.Size(); i++)
+		mipLevels[i]->SetLayout( newLayout );
+}
+
+
+// Each level averages 2x2 texels of the one above it.  For odd sizes, the
+//    last row or column of the larger level is counted twice.
+void Texture::BuildMipmaps( void )
+{
+	for (unsigned int i=0; i < mipLevels.Size(); i++)
+		delete mipLevels[i];
+	mipLevels.Clear();
+
+	const Texture *src = this;
+	while (src->width > 1 || src->height > 1)
+	{
+		int w = (src->width > 1 ? src->width/2 : 1);
+		int h = (src->height > 1 ? src->height/2 : 1);
+		Texture *mip = new Texture( w, h, storage );
+		mip->rgbScale = rgbScale;
+		mip->SetLayout( layout );
+
+		for (int y=0; y < h; y++)
+		{
+			int y0 = 2*y, y1 = (2*y+1 < src->height ? 2*y+1 : src->height-1);
+			for (int x=0; x < w; x++)
+			{
+				int x0 = 2*x, x1 = (2*x+1 < src->width ? 2*x+1 : src->width-1);
+				mip->SetTexel( x, y, (src->GetTexel( x0, y0 ) + src->GetTexel( x1, y0 ) + 
+									  src->GetTexel( x0, y1 ) + src->GetTexel( x1, y1 )) * 0.25f );
+			}
+		}
+
+		mipLevels.Add( mip );
+		src = mip;
+	}
+}
+
+
+void Texture::SetTexel( int x, int y, const RGBAColor &c )
+{
+	unsigned char *t = texels + TexelIndex( x, y, layout )*texelBytes;
+	float inv = (rgbScale != 0 ? 1.0f/rgbScale : 0.0f);
+	if (storage == TEXTURE_STORAGE_RGBA8)
+	{
+		float rgba[4] = { c.Red()*inv, c.Green()*inv, c.Blue()*inv, c.Alpha() };
+		for (int i=0; i < 4; i++)
+			t[i] = (unsigned char)( rgba[i] <= 0 ? 0 : (rgba[i] >= 1 ? 255 : rgba[i]*255.0f + 0.5f) );
+	}
+	else if (storage == TEXTURE_STORAGE_RGBA16F)
+	{
+		unsigned short *h = (unsigned short *)t;
+		h[0] = FloatToHalf( c.Red()*inv );
+		h[1] = FloatToHalf( c.Green()*inv );
+		h[2] = FloatToHalf( c.Blue()*inv );
+		h[3] = FloatToHalf( c.Alpha() );
+	}
+	else
+	{
+		float *f = (float *)t;
+		f[0] = c.Red()*inv;
+		f[1] = c.Green()*inv;
+		f[2] = c.Blue()*inv;
+		f[3] = c.Alpha();
+	}
+}
+
+
+// The storage format is checked once per row, rather than once per texel
+void Texture::GetRow( int y, int x, int count, RGBAColor *out ) const
+{
+	if (layout != TEXTURE_LAYOUT_LINEAR)
+	{
+		for (int i=0; i < count; i++)
+			out[i] = GetTexel( x+i, y );
+		return;
+	}
+
+	const unsigned char *t = texels + ((size_t)y*width + x)*texelBytes;
+	if (storage == TEXTURE_STORAGE_RGBA8)
+	{
+		float s = rgbScale * (1.0f/255.0f);
+		for (int i=0; i < count; i++, t+=4)
+			out[i] = RGBAColor( t[0]*s, t[1]*s, t[2]*s, t[3]*(1.0f/255.0f) );
+	}
+	else if (storage == TEXTURE_STORAGE_RGBA16F)
+	{
+		const unsigned short *h = (const unsigned short *)t;
+		for (int i=0; i < count; i++, h+=4)
+			out[i] = RGBAColor( rgbScale*HalfToFloat(h[0]), rgbScale*HalfToFloat(h[1]), 
+			                    rgbScale*HalfToFloat(h[2]), HalfToFloat(h[3]) );
+	}
+	else
+	{
+		const float *f = (const float *)t;
+		for (int i=0; i < count; i++, f+=4)
+			out[i] = RGBAColor( rgbScale*f[0], rgbScale*f[1], rgbScale*f[2], f[3] );
+	}
+}
 
+void Texture::GetBlock( int x, int y, int w, int h, RGBAColor *out ) const
+{
+	for (int j=0; j < h; j++)
+		GetRow( y+j, x, w, out + j*w );
 }
 
 
@@ -261,12 +358,113 @@ Color Texture::IndexTextureAt(float x, float y) const
 	};
 
 	if (w<1||w>width-2||h<1||h>height-2)
-		return image2D[(int)h][(int)w];
+		return GetTexel( (int)w, (int)h );
+
+	// Fetch the 2x2 neighborhood
+	RGBAColor n[4];
+	GetBlock( (int)w, (int)h, 2, 2, n );
 
 	float facW = w-floor(w);
 	float facH = h-floor(h);
-	return (image2D[(int)h][(int)w]*(1-facH)+image2D[1+(int)h][(int)w]*facH)*(1-facW) +
-		   (image2D[(int)h][1+(int)w]*(1-facH)+image2D[1+(int)h][1+(int)w]*facH)*facW;
+	return (n[0]*(1-facH)+n[2]*facH)*(1-facW) +
+		   (n[1]*(1-facH)+n[3]*facH)*facW;
+}
+
+// Bilinear lookups for n (up to TEXTURE_SAMPLE_LANES) lanes, each from its own
+//    mip level.  The results go in rgba[channel][lane].
+void Texture::SampleLanes( int n, const float *u, const float *v, const int *level, 
+						   float rgba[4][TEXTURE_SAMPLE_LANES] ) const
+{
+	const Texture *lvl[TEXTURE_SAMPLE_LANES];
+	float fracX[TEXTURE_SAMPLE_LANES], fracY[TEXTURE_SAMPLE_LANES];
+	int x0[TEXTURE_SAMPLE_LANES], y0[TEXTURE_SAMPLE_LANES];
+	int x1[TEXTURE_SAMPLE_LANES], y1[TEXTURE_SAMPLE_LANES];
+	float corner[4][4][TEXTURE_SAMPLE_LANES];   // [corner][channel][lane]
+
+	// Find the 2x2 footprints (the same coordinates as IndexTextureAt())
+	for (int i=0; i < n; i++)
+	{
+		lvl[i] = GetLevel( level[i] );
+		int maxX = lvl[i]->width-1, maxY = lvl[i]->height-1;
+		float x = Wrap( u[i]*maxX, maxX, wrap_u );
+		float y = Wrap( v[i]*maxY, maxY, wrap_v );
+		x0[i] = (int)x;
+		y0[i] = (int)y;
+		fracX[i] = x - x0[i];
+		fracY[i] = y - y0[i];
+		x1[i] = (x0[i] < maxX ? x0[i]+1 : maxX);
+		y1[i] = (y0[i] < maxY ? y0[i]+1 : maxY);
+	}
+
+	// Fetch the texels
+	for (int i=0; i < n; i++)
+	{
+		RGBAColor c[4] = { lvl[i]->GetTexel( x0[i], y0[i] ), lvl[i]->GetTexel( x1[i], y0[i] ),
+			               lvl[i]->GetTexel( x0[i], y1[i] ), lvl[i]->GetTexel( x1[i], y1[i] ) };
+		for (int k=0; k < 4; k++)
+		{
+			corner[k][0][i] = c[k].Red();
+			corner[k][1][i] = c[k].Green();
+			corner[k][2][i] = c[k].Blue();
+			corner[k][3][i] = c[k].Alpha();
+		}
+	}
+
+	// Blend them, one channel of all lanes at a time
+	for (int ch=0; ch < 4; ch++)
+		for (int i=0; i < n; i++)
+		{
+			float top    = corner[0][ch][i] + (corner[1][ch][i] - corner[0][ch][i]) * fracX[i];
+			float bottom = corner[2][ch][i] + (corner[3][ch][i] - corner[2][ch][i]) * fracX[i];
+			rgba[ch][i] = top + (bottom - top) * fracY[i];
+		}
+}
+
+void Texture::SampleBilinear( int count, const float *u, const float *v, RGBAColor *out, int level ) const
+{
+	int levels[TEXTURE_SAMPLE_LANES];
+	float rgba[4][TEXTURE_SAMPLE_LANES];
+
+	level = (level < 0 ? 0 : (level >= GetNumLevels() ? GetNumLevels()-1 : level));
+	for (int i=0; i < TEXTURE_SAMPLE_LANES; i++)
+		levels[i] = level;
+
+	for (int first=0; first < count; first += TEXTURE_SAMPLE_LANES)
+	{
+		int n = (count-first < TEXTURE_SAMPLE_LANES ? count-first : TEXTURE_SAMPLE_LANES);
+		SampleLanes( n, u+first, v+first, levels, rgba );
+		for (int i=0; i < n; i++)
+			out[first+i] = RGBAColor( rgba[0][i], rgba[1][i], rgba[2][i], rgba[3][i] );
+	}
+}
+
+void Texture::SampleTrilinear( int count, const float *u, const float *v, const float *lod, RGBAColor *out ) const
+{
+	int lower[TEXTURE_SAMPLE_LANES], upper[TEXTURE_SAMPLE_LANES];
+	float blend[TEXTURE_SAMPLE_LANES];
+	float rgba0[4][TEXTURE_SAMPLE_LANES], rgba1[4][TEXTURE_SAMPLE_LANES];
+	int maxLevel = GetNumLevels()-1;
+
+	for (int first=0; first < count; first += TEXTURE_SAMPLE_LANES)
+	{
+		int n = (count-first < TEXTURE_SAMPLE_LANES ? count-first : TEXTURE_SAMPLE_LANES);
+		for (int i=0; i < n; i++)
+		{
+			float l = lod[first+i];
+			l = (l < 0 ? 0 : (l > maxLevel ? maxLevel : l));
+			lower[i] = (int)l;
+			upper[i] = (lower[i] < maxLevel ? lower[i]+1 : maxLevel);
+			blend[i] = l - lower[i];
+		}
+
+		SampleLanes( n, u+first, v+first, lower, rgba0 );
+		SampleLanes( n, u+first, v+first, upper, rgba1 );
+		for (int ch=0; ch < 4; ch++)
+			for (int i=0; i < n; i++)
+				rgba0[ch][i] += (rgba1[ch][i] - rgba0[ch][i]) * blend[i];
+		for (int i=0; i < n; i++)
+			out[first+i] = RGBAColor( rgba0[0][i], rgba0[1][i], rgba0[2][i], rgba0[3][i] );
+	}
 }
 
 float Texture::AlphaAt( float x, float y ) const
@@ -284,7 +482,7 @@ float Texture::AlphaAt( float x, float y ) const
 		case TEXTURE_MIRROR:	h = (int)Mirror( y*(height-1), height-1 );	break;	
 	};
 
-	return image2D[h][w].Alpha();
+	return GetTexel( w, h ).Alpha();
 }
 
 
@@ -306,11 +504,12 @@ void Texture::Save(char* filename, float gamma)
 	for (int j=height-1;j>=0;j--)
 		for (int i=0;i<width;i++)
 		{
-			float tmp = pow( image2D[j][i].Red(), 1.0f/gamma );
+			RGBAColor texel = GetTexel( i, j );
+			float tmp = pow( texel.Red(), 1.0f/gamma );
 			r = (int)(tmp*255);
-			tmp = pow( image2D[j][i].Green(), 1.0f/gamma );
+			tmp = pow( texel.Green(), 1.0f/gamma );
 			g = (int)(tmp*255);
-			tmp = pow( image2D[j][i].Blue(), 1.0f/gamma );
+			tmp = pow( texel.Blue(), 1.0f/gamma );
 			b = (int)(tmp*255);
 			r = ( r>255 ? 255 : (r<0 ? 0 : r) );
 			g = ( g>255 ? 255 : (g<0 ? 0 : g) );
@@ -324,6 +523,14 @@ void Texture::Save(char* filename, float gamma)
 }
 
 
+float Texture::Wrap( float coord, int max, int mode ) const
+{
+	if (max <= 0) return 0;
+	if (mode == TEXTURE_REPEAT) return Repeat( coord, max );
+	if (mode == TEXTURE_MIRROR) return Mirror( coord, max );
+	return Clamp( coord, max );
+}
+
 float Texture::Clamp( float coord, int max ) const
 {
 	// Pretty simple, check if < 0, then check if > max
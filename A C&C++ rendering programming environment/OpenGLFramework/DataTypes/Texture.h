@@ -19,6 +19,8 @@
 #include "DataTypes/RGBAColor.h"
 #include "Utils/TextParsing.h"
 #include "Utils/ImageIO/imageIO.h"
+#include "Utils/halfFloat.h"
+#include "DataTypes/Array1D.h"
 
 class Scene;
 
@@ -34,13 +36,32 @@ class Scene;
 #define TEXTURE_CLAMP         1
 #define TEXTURE_MIRROR        2
 
+// How texels are stored in memory.  Lookups decode them to floats.
+#define TEXTURE_STORAGE_RGBA8     0   // 4 bytes per texel, each in [0..1]
+#define TEXTURE_STORAGE_RGBA16F   1   // 8 bytes per texel, half floats
+#define TEXTURE_STORAGE_RGBA32F   2   // 16 bytes per texel, floats
+
+// How texels are ordered in memory.  The tiled layout stores 8x8 tiles
+//    with the texels of each tile in Morton (Z) order, so a 2x2 bilinear
+//    footprint almost always falls in one or two cache lines whatever 
+//    direction the lookups are moving in.
+#define TEXTURE_LAYOUT_LINEAR     0   // row after row
+#define TEXTURE_LAYOUT_TILED      1   // Morton ordered 8x8 tiles
+#define TEXTURE_TILE_BITS         3   // log2 of the tile width
+
+// Number of lookups the batched samplers work on together
+#define TEXTURE_SAMPLE_LANES      8
+
 class Texture
 {
 private:
-	RGBAColor* image1D;   // image1D[i]    accesses location (i%width, i/width)
-    RGBAColor** image2D;  // image2D[y][x] accesses location (x,y)
+	unsigned char *texels;  // texel (x,y) starts at texels[(y*width+x)*texelBytes]
 	char *fileName;
     int width, height, type;
+	int storage, texelBytes;
+	int layout, tilesX;     // TEXTURE_LAYOUT_*, and tiles per row when tiled
+	float rgbScale;         // scale applied to RGB (not alpha) of stored texels
+	Array1D< Texture * > mipLevels;   // levels 1, 2, ... from BuildMipmaps()
 	unsigned char interpolationMethod;
 	unsigned char wrap_u, wrap_v;
 
@@ -48,12 +69,19 @@ private:
 	float Repeat( float coord, int max ) const;
 	float Mirror( float coord, int max ) const;
 
+	void Allocate( int storageFormat );
+	inline size_t TexelIndex( int x, int y, int inLayout ) const;
+	inline size_t NumStoredTexels( int inLayout ) const;
+	inline RGBAColor DecodeTexel( const unsigned char *t ) const;
+	float Wrap( float coord, int max, int mode ) const;
+	void SampleLanes( int n, const float *u, const float *v, const int *level, float rgba[4][TEXTURE_SAMPLE_LANES] ) const;
+
 	void LoadPPM( char *filename, float scale );
 	void LoadRGB( char *filename, float scale );
 	void LoadHDR( char *filename, float scale );
 	void LoadCSV( char *filename, float scale );
 public:
-    Texture(int width, int height);
+    Texture(int width, int height, int storageFormat=TEXTURE_STORAGE_RGBA32F);
 	Texture(char *filename, float scale=1.0);  // loads a PPM file
 	Texture(FILE *f, Scene *s);
     ~Texture();
@@ -62,13 +90,44 @@ public:
 	inline int GetWidth() const  { return width;  }
 	inline int GetHeight() const { return height; }
 
+	// How the texels are stored (one of the TEXTURE_STORAGE_* values) and
+	//    how much memory they take.  8-bit files are stored as RGBA8, .hdr
+	//    files as RGBA16F, and everything else as RGBA32F.
+	inline int GetStorageFormat() const       { return storage; }
+	inline size_t GetStorageBytes() const     { return NumStoredTexels( layout )*texelBytes; }
+
+	// Change how texels are ordered in memory (see TEXTURE_LAYOUT_*).  This
+	//    changes nothing else:  all accessors work with either layout.
+	void SetLayout( int newLayout );
+	inline int GetLayout() const              { return layout; }
+
+	// Build a box filtered mip chain (down to 1x1) for the batched samplers.
+	//    Level 0 is this texture.
+	void BuildMipmaps( void );
+	inline int GetNumLevels() const           { return 1 + mipLevels.Size(); }
+	inline const Texture *GetLevel( int lvl ) const { return lvl ? mipLevels[lvl-1] : this; }
+
 	inline void SetWrapS( int wrapMode )  { wrap_u = wrapMode; } 
 	inline void SetWrapT( int wrapMode )  { wrap_v = wrapMode; } 
 
 	inline bool HasAlpha( void ) const { return type == TEXTURE_TYPE_RGBA; }
 
-	// Returns the value at (x,y) with no interpolation!
-    inline RGBAColor& operator()(int x, int y) { return image2D[y][x]; }
+	// Read or write a single texel, with no interpolation!
+	inline RGBAColor GetTexel( int x, int y ) const;
+	void SetTexel( int x, int y, const RGBAColor &c );
+
+	// Decode 'count' texels of row y, starting at x, into 'out'.  The block
+	//    version decodes a w x h region (row by row) with its corner at (x,y).
+	//    Both are much faster than repeated GetTexel() calls.
+	void GetRow( int y, int x, int count, RGBAColor *out ) const;
+	void GetBlock( int x, int y, int w, int h, RGBAColor *out ) const;
+
+	// Returns the value at (x,y) with no interpolation!  Since texels are
+	//    not stored as RGBAColors, this returns a reference-like object that
+	//    can be read from (as an RGBAColor) or assigned to.
+	class TexelRef;
+    inline TexelRef operator()(int x, int y);
+	inline RGBAColor operator()(int x, int y) const  { return GetTexel( x, y ); }
 
 	// Returns the value interpolated to (x,y)
 	//   NOTE: this operator assumes x, y in [0..1] covers the entire texture!
@@ -76,8 +135,16 @@ public:
 	Color IndexTextureAt(float x, float y) const;
 	float AlphaAt( float x, float y ) const;
 
+	// Batched versions of IndexTextureAt(), for 'count' lookups at (u[i],v[i]).
+	//    Lookups are done TEXTURE_SAMPLE_LANES at a time, with the texel
+	//    math arranged so the compiler can vectorize it.  Unlike 
+	//    IndexTextureAt(), texels at the edges are interpolated too.  The
+	//    trilinear version blends mip levels at a (fractional) level 'lod[i]'.
+	void SampleBilinear( int count, const float *u, const float *v, RGBAColor *out, int level=0 ) const;
+	void SampleTrilinear( int count, const float *u, const float *v, const float *lod, RGBAColor *out ) const;
+
 	// Assumes x & y are in [0..1] (not outside!)
-	inline Color FastIndexTextureAt(float x, float y) const { return image2D[(int)(y*(height-1))][(int)(x*(width-1))]; }
+	inline Color FastIndexTextureAt(float x, float y) const { return GetTexel( (int)(x*(width-1)), (int)(y*(height-1)) ); }
 
 	// This is going away soon.  Just for testing.
 	void Save(char* filename, float gamma=1.0f);
@@ -86,5 +153,72 @@ public:
 };
 
 
+class Texture::TexelRef
+{
+public:
+	TexelRef( Texture *tex, int x, int y ) : tex(tex), x(x), y(y) {}
+
+	inline operator RGBAColor() const                     { return tex->GetTexel( x, y ); }
+	inline TexelRef &operator=( const RGBAColor &c )      { tex->SetTexel( x, y, c ); return *this; }
+	inline TexelRef &operator=( const TexelRef &t )       { tex->SetTexel( x, y, (RGBAColor)t ); return *this; }
+
+	inline float Red() const                              { return tex->GetTexel( x, y ).Red(); }
+	inline float Green() const                            { return tex->GetTexel( x, y ).Green(); }
+	inline float Blue() const                             { return tex->GetTexel( x, y ).Blue(); }
+	inline float Alpha() const                            { return tex->GetTexel( x, y ).Alpha(); }
+private:
+	Texture *tex;
+	int x, y;
+};
+
+inline Texture::TexelRef Texture::operator()(int x, int y) 
+{ 
+	return TexelRef( this, x, y ); 
+}
+
+// Where texel (x,y) is (or would be) stored in a given layout, counting in texels
+inline size_t Texture::TexelIndex( int x, int y, int inLayout ) const
+{
+	if (inLayout == TEXTURE_LAYOUT_LINEAR)
+		return (size_t)y*width + x;
+
+	// Spread 3 bits apart, for interleaving x and y bits within a tile
+	static const unsigned char spread[8] = { 0, 1, 4, 5, 16, 17, 20, 21 };
+	const int mask = (1 << TEXTURE_TILE_BITS) - 1;
+	size_t tile = (size_t)(y >> TEXTURE_TILE_BITS)*tilesX + (x >> TEXTURE_TILE_BITS);
+	return (tile << (2*TEXTURE_TILE_BITS)) | spread[x & mask] | (spread[y & mask] << 1);
+}
+
+// Tiled layouts are padded out to whole tiles
+inline size_t Texture::NumStoredTexels( int inLayout ) const
+{
+	if (inLayout == TEXTURE_LAYOUT_LINEAR)
+		return (size_t)width*height;
+	int tilesY = (height + (1 << TEXTURE_TILE_BITS) - 1) >> TEXTURE_TILE_BITS;
+	return ((size_t)tilesX*tilesY) << (2*TEXTURE_TILE_BITS);
+}
+
+inline RGBAColor Texture::DecodeTexel( const unsigned char *t ) const
+{
+	if (storage == TEXTURE_STORAGE_RGBA8)
+	{
+		float s = rgbScale * (1.0f/255.0f);
+		return RGBAColor( t[0]*s, t[1]*s, t[2]*s, t[3]*(1.0f/255.0f) );
+	}
+	else if (storage == TEXTURE_STORAGE_RGBA16F)
+	{
+		const unsigned short *h = (const unsigned short *)t;
+		return RGBAColor( rgbScale*HalfToFloat(h[0]), rgbScale*HalfToFloat(h[1]), 
+			              rgbScale*HalfToFloat(h[2]), HalfToFloat(h[3]) );
+	}
+	const float *f = (const float *)t;
+	return RGBAColor( rgbScale*f[0], rgbScale*f[1], rgbScale*f[2], f[3] );
+}
+
+inline RGBAColor Texture::GetTexel( int x, int y ) const
+{
+	return DecodeTexel( texels + TexelIndex( x, y, layout )*texelBytes );
+}
+
 
 #endif
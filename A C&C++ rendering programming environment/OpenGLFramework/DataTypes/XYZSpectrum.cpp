@@ -0,0 +1,61 @@
+/******************************************************************/
+/* XYZSpectrum.cpp                                                */
+/* -------------                                                  */
+/*                                                                */
+/* The CIE 1931 2-degree standard observer's color matching       */
+/*    functions, sampled every 5 nm from 375 to 780 nm.  (These   */
+/*    are the tables XYZSpectrum.h describes.)                    */
+/******************************************************************/
+
+#include "XYZSpectrum.h"
+
+const float XYZSpectrum::xStimulus[XYZSpectrum::numBins] = {
+	/* 375 */  0.0007416f, 0.001368f, 0.002236f, 0.004243f, 0.00765f, 0.01431f,
+	/* 405 */  0.02319f, 0.04351f, 0.07763f, 0.13438f, 0.21477f, 0.2839f,
+	/* 435 */  0.3285f, 0.34828f, 0.34806f, 0.3362f, 0.3187f, 0.2908f,
+	/* 465 */  0.2511f, 0.19536f, 0.1421f, 0.09564f, 0.05795f, 0.03201f,
+	/* 495 */  0.0147f, 0.0049f, 0.0024f, 0.0093f, 0.0291f, 0.06327f,
+	/* 525 */  0.1096f, 0.1655f, 0.22575f, 0.2904f, 0.3597f, 0.43345f,
+	/* 555 */  0.51205f, 0.5945f, 0.6784f, 0.7621f, 0.8425f, 0.9163f,
+	/* 585 */  0.9786f, 1.0263f, 1.0567f, 1.0622f, 1.0456f, 1.0026f,
+	/* 615 */  0.9384f, 0.85445f, 0.7514f, 0.6424f, 0.5419f, 0.4479f,
+	/* 645 */  0.3608f, 0.2835f, 0.2187f, 0.1649f, 0.1212f, 0.0874f,
+	/* 675 */  0.0636f, 0.04677f, 0.0329f, 0.0227f, 0.01584f, 0.011359f,
+	/* 705 */  0.008111f, 0.00579f, 0.004109f, 0.002899f, 0.002049f, 0.00144f,
+	/* 735 */  0.001f, 0.00069f, 0.000476f, 0.000332f, 0.000235f, 0.000166f,
+	/* 765 */  0.000117f, 0.000083f, 0.000059f, 0.000042f
+};
+
+const float XYZSpectrum::yStimulus[XYZSpectrum::numBins] = {
+	/* 375 */  0.00002202f, 0.000039f, 0.000064f, 0.00012f, 0.000217f, 0.000396f,
+	/* 405 */  0.00064f, 0.00121f, 0.00218f, 0.004f, 0.0073f, 0.0116f,
+	/* 435 */  0.01684f, 0.023f, 0.0298f, 0.038f, 0.048f, 0.06f,
+	/* 465 */  0.0739f, 0.09098f, 0.1126f, 0.13902f, 0.1693f, 0.20802f,
+	/* 495 */  0.2586f, 0.323f, 0.4073f, 0.503f, 0.6082f, 0.71f,
+	/* 525 */  0.7932f, 0.862f, 0.91485f, 0.954f, 0.9803f, 0.99495f,
+	/* 555 */  1.0f, 0.995f, 0.9786f, 0.952f, 0.9154f, 0.87f,
+	/* 585 */  0.8163f, 0.757f, 0.6949f, 0.631f, 0.5668f, 0.503f,
+	/* 615 */  0.4412f, 0.381f, 0.321f, 0.265f, 0.217f, 0.175f,
+	/* 645 */  0.1382f, 0.107f, 0.0816f, 0.061f, 0.04458f, 0.032f,
+	/* 675 */  0.0232f, 0.017f, 0.01192f, 0.00821f, 0.005723f, 0.004102f,
+	/* 705 */  0.002929f, 0.002091f, 0.001484f, 0.001047f, 0.00074f, 0.00052f,
+	/* 735 */  0.000361f, 0.000249f, 0.000172f, 0.00012f, 0.000085f, 0.00006f,
+	/* 765 */  0.000042f, 0.00003f, 0.000021f, 0.000015f
+};
+
+const float XYZSpectrum::zStimulus[XYZSpectrum::numBins] = {
+	/* 375 */  0.003486f, 0.00645f, 0.01055f, 0.02005f, 0.03621f, 0.06785f,
+	/* 405 */  0.1102f, 0.2074f, 0.3713f, 0.6456f, 1.03905f, 1.3856f,
+	/* 435 */  1.62296f, 1.74706f, 1.7826f, 1.77211f, 1.7441f, 1.6692f,
+	/* 465 */  1.5281f, 1.28764f, 1.0419f, 0.81295f, 0.6162f, 0.46518f,
+	/* 495 */  0.3533f, 0.272f, 0.2123f, 0.1582f, 0.1117f, 0.07825f,
+	/* 525 */  0.05725f, 0.04216f, 0.02984f, 0.0203f, 0.0134f, 0.00875f,
+	/* 555 */  0.00575f, 0.0039f, 0.00275f, 0.0021f, 0.0018f, 0.00165f,
+	/* 585 */  0.0014f, 0.0011f, 0.001f, 0.0008f, 0.0006f, 0.00034f,
+	/* 615 */  0.00024f, 0.00019f, 0.0001f, 0.00005f, 0.00003f, 0.00002f,
+	/* 645 */  0.00001f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+	/* 675 */  0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+	/* 705 */  0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+	/* 735 */  0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+	/* 765 */  0.0f, 0.0f, 0.0f, 0.0f
+};
@@ -15,82 +15,111 @@
 #include <ctype.h>
 #include "glTexture.h"
 #include "Utils/ImageIO/imageIO.h"
+#include "Utils/textureCompressor.h"
+#include "Utils/mipmapGenerator.h"
+#include "Utils/glStateCache.h"
+#include "Utils/parallelFor.h"
+#include "Utils/textureContainer.h"
 
+bool GLTexture::releaseCPUCopies = true;
+size_t GLTexture::totalCPUBytes = 0;
+size_t GLTexture::totalGPUBytes = 0;
+unsigned int GLTexture::currentFrame = 0;
+
+// Streamed textures are loaded on another thread, so the totals need a lock
+static ParallelMutex textureStatsLock;
 
 GLTexture::GLTexture( int width, int height, int depth ) : width(width), 
 	height(height), depth(depth), fileName(0), imgData(0), texID(0),
-	initialized(false), internalImageType(TEXTURE_TYPE_UNKNOWN), usingMipmaps(false)
+	initialized(false), internalImageType(TEXTURE_TYPE_UNKNOWN), usingMipmaps(false),
+	streamed(false), mipFlags(MIPMAP_DEFAULT), cpuCopyFlags(0), cpuBytes(0), gpuBytes(0),
+	streamLevel(0), bindCount(0), lastUsedFrame(0), droppedLevels(0), evicted(false),
+	arrayID(0), arrayLayer(0), wantsArray(false), preparedBC(0), preparedMips(0), container(0)
 {
 	name = strdup( "<Unnamed Texture>" );
 }
 
 
-GLTexture::GLTexture( char *filename, unsigned int flags, bool processLater ) 
+GLTexture::GLTexture( char *filename, unsigned int flags, bool processLater ) :
+	imgData(0), width(0), height(0), texID(0), cpuBytes(0), gpuBytes(0), 
+	streamLevel(0), bindCount(0), lastUsedFrame(0), droppedLevels(0), evicted(false),
+	arrayID(0), arrayLayer(0), wantsArray(false), preparedBC(0), preparedMips(0), container(0)
 {
+	initialized = false;   // Read by UploadImage(), below
 	usingMipmaps = false;
 	if ( (flags & TEXTURE_MIN_LINEAR_MIP_LINEAR) || (flags & TEXTURE_MIN_LINEAR_MIP_NEAR) ||
 		 (flags & TEXTURE_MIN_NEAR_MIP_LINEAR)   || (flags & TEXTURE_MIN_NEAR_MIP_NEAR) )
 		 usingMipmaps = true;
+	mipFlags = MIPMAP_DEFAULT;
+	if (flags & TEXTURE_MIP_KAISER)              mipFlags |= MIPMAP_KAISER;
+	if (flags & TEXTURE_MIP_LINEAR_DATA)         mipFlags |= MIPMAP_LINEAR_DATA;
+	if (flags & TEXTURE_MIP_PRESERVE_COVERAGE)   mipFlags |= MIPMAP_PRESERVE_COVERAGE;
+	cpuCopyFlags = flags & (TEXTURE_KEEP_CPU_COPY | TEXTURE_RELEASE_CPU_COPY);
 
 	fileName = strdup( filename );
 	name = strdup( "<Unnamed Texture>" );
 
-	// Identify the type of file
-	char *ptr = strrchr( filename, '.' );
-	char buf[16];
-	strncpy( buf, ptr, 16 );
-	for (int i=0;i<16;i++)
-		buf[i] = tolower( buf[i] );
-	if (!strcmp(buf, ".ppm"))			internalImageType = TEXTURE_TYPE_PPM;
-	else if (!strcmp(buf, ".rgb"))		internalImageType = TEXTURE_TYPE_RGB;
-	else if (!strcmp(buf, ".rgba"))		internalImageType = TEXTURE_TYPE_RGBA;
-	else if (!strcmp(buf, ".hdr"))		internalImageType = TEXTURE_TYPE_HDR;
-	else if (!strcmp(buf, ".bmp"))		internalImageType = TEXTURE_TYPE_BMP;
-
-	// All these functions have *fatal errors* given bad files.
-	if (internalImageType == TEXTURE_TYPE_PPM) LoadPPM( fileName );
-	else if (internalImageType == TEXTURE_TYPE_RGB) LoadRGB( fileName );
-	else if (internalImageType == TEXTURE_TYPE_RGBA) LoadRGB( fileName );
-	else if (internalImageType == TEXTURE_TYPE_BMP) LoadBMP( fileName );
-	else if (internalImageType == TEXTURE_TYPE_HDR) 
-	{
-		printf("***Error: GLTexture class currently does not support .hdr files!\n");
-		exit(0);
+	// Identify the type of file from its first bytes (which also gives us 
+	//    its size).  If that fails, go by the extension, and let the loader
+	//    complain about the file.
+	ImageInfo info;
+	if (ReadImageInfo( filename, &info ))
+	{
+		width  = info.width;
+		height = info.height;
+		if (info.format == IMAGE_FORMAT_PPM)        internalImageType = TEXTURE_TYPE_PPM;
+		else if (info.format == IMAGE_FORMAT_BMP)   internalImageType = TEXTURE_TYPE_BMP;
+		else if (info.format == IMAGE_FORMAT_HDR)   internalImageType = TEXTURE_TYPE_HDR;
+		else if (info.format == IMAGE_FORMAT_KTX)   internalImageType = TEXTURE_TYPE_KTX;
+		else                                        internalImageType = info.hasAlpha ? TEXTURE_TYPE_RGBA : TEXTURE_TYPE_RGB;
+	}
+	else
+	{
+		char *ptr = strrchr( filename, '.' );
+		char buf[16];
+		strncpy( buf, ptr ? ptr : "", 16 );
+		for (int i=0;i<16;i++)
+			buf[i] = tolower( buf[i] );
+		if (!strcmp(buf, ".ppm"))			internalImageType = TEXTURE_TYPE_PPM;
+		else if (!strcmp(buf, ".rgb"))		internalImageType = TEXTURE_TYPE_RGB;
+		else if (!strcmp(buf, ".rgba"))		internalImageType = TEXTURE_TYPE_RGBA;
+		else if (!strcmp(buf, ".hdr"))		internalImageType = TEXTURE_TYPE_HDR;
+		else if (!strcmp(buf, ".bmp"))		internalImageType = TEXTURE_TYPE_BMP;
+		else if (!strcmp(buf, ".ktx"))		internalImageType = TEXTURE_TYPE_KTX;
+		else                                internalImageType = TEXTURE_TYPE_UNKNOWN;
 	}
 
-	// At this point (due to fatal errors, above) we know we have a valid texture.
-	glPixelFormat = ( internalImageType != TEXTURE_TYPE_RGBA ? GL_RGB : GL_RGBA );
+	// KTX files give their own formats
+	if (internalImageType != TEXTURE_TYPE_KTX)
+		glPixelFormat = ( internalImageType != TEXTURE_TYPE_RGBA ? GL_RGB : GL_RGBA );
+	if (internalImageType != TEXTURE_TYPE_HDR && internalImageType != TEXTURE_TYPE_KTX)
+		glInternalFormat = glPixelFormat;
 
 	// The only type currently allowed...
 	glTextureType  = GL_TEXTURE_2D;
 
+	// Loading has *fatal errors* given bad files.  The pixels aren't read
+	//    here:  textures made with processLater are built while the scene
+	//    is read, before GLEW is initialized, and both the layout HDR
+	//    images decode into and whether to decode straight into a pixel
+	//    buffer depend on the extensions.  So files are decoded when
+	//    uploaded, or by PrepareImage() (which the scene runs in parallel 
+	//    before uploading).  Streamed textures are loaded by a TextureStreamer.
+	streamed = processLater && (flags & TEXTURE_STREAM);
+
 	// Generate a GL structure for this texture
 	if (!processLater)
 	{
 		glGenTextures( 1, &texID );
 		glBindTexture( glTextureType, texID );
-		switch (glTextureType) {
-			case GL_TEXTURE_1D:
-				glTexImage1D( glTextureType, 0, glPixelFormat, width, 0, 
-							  glPixelFormat, glPixelStorage, imgData );
-				break;
-			case GL_TEXTURE_2D:
-				if (!usingMipmaps)
-					glTexImage2D( glTextureType, 0, (glPixelFormat==GL_RGB ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT1_EXT), 
-							  width, height, 0, glPixelFormat, glPixelStorage, imgData );
-				else
-					gluBuild2DMipmaps( glTextureType, (glPixelFormat==GL_RGB ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT1_EXT), 
-							  width, height, glPixelFormat, glPixelStorage, imgData );
-				break;
-			case GL_TEXTURE_3D:
-				glTexImage3D( glTextureType, 0, glPixelFormat, width, height, depth, 0, 
-							  glPixelFormat, glPixelStorage, imgData );
-				break;
-			default:
-				printf("***Error: Unhandled texture type encountered when loading '%s'!\n", fileName );
-				exit(0);
-				break;
+		if ( (glTextureType != GL_TEXTURE_1D) && 
+			 (glTextureType != GL_TEXTURE_2D) && 
+			 (glTextureType != GL_TEXTURE_3D) )
+		{
+			printf("***Error: Unhandled texture type encountered when loading '%s'!\n", fileName );
+			exit(0);
 		}
+		UploadImage();
 	}
 	else if ( (glTextureType != GL_TEXTURE_1D) && 
 			  (glTextureType != GL_TEXTURE_2D) && 
@@ -145,9 +174,12 @@ GLTexture::GLTexture( char *filename, unsigned int flags, bool processLater )
 
 GLTexture::~GLTexture()
 {
+	FreeImageData();
+	SetGPUBytes( 0 );
 	if (fileName) free(fileName);
-	if (imgData) free(imgData);
-	glDeleteTextures( 1, &texID );
+	if (preparedBC) delete preparedBC;
+	if (preparedMips) delete preparedMips;
+	glState.DeleteTextures( 1, &texID );
 }
 
 
@@ -157,71 +189,618 @@ void GLTexture::Preprocess( void )
 
 	glGenTextures( 1, &texID );
 	glBindTexture( glTextureType, texID );
+	if (!streamed)
+		UploadImage();
+	else
+		UploadPlaceholder();
+	SetTextureParameters();
+
+	initialized = true;
+}
+
+// Set the filtering and wrap modes of the bound texture
+void GLTexture::SetTextureParameters( void )
+{
+	glTexParameteri( glTextureType, GL_TEXTURE_MIN_FILTER, minFilter );
+	glTexParameteri( glTextureType, GL_TEXTURE_MAG_FILTER, magFilter );
+	glTexParameteri( glTextureType, GL_TEXTURE_WRAP_S, sWrap );
+	if (glTextureType!=GL_TEXTURE_1D) 
+		glTexParameteri( glTextureType, GL_TEXTURE_WRAP_T, tWrap );
+	if (glTextureType==GL_TEXTURE_3D)
+		glTexParameteri( glTextureType, GL_TEXTURE_WRAP_R, rWrap=GL_CLAMP );
+}
+
+// A stand-in for the real image, while it's streamed in or after eviction
+void GLTexture::UploadPlaceholder( void )
+{
+	unsigned char gray[4] = { 128, 128, 128, 255 };
+	glTexImage2D( glTextureType, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, gray );
+	glTexParameteri( glTextureType, GL_TEXTURE_MAX_LEVEL, 0 );
+}
+
+
+// Do the CPU work for uploading a 2D image:  block compress it (see 
+//    Utils/textureCompressor.h) rather than leaving that to the driver,
+//    so RGBA textures keep their alpha and warm loads just read the
+//    compressed mipmaps from disk.  Without compression support, just
+//    build the mipmaps (see Utils/mipmapGenerator.h).
+void GLTexture::PrepareImage( void )
+{
+	if (preparedBC || preparedMips || (initialized && !streamed)) return;
+
+	// The decode deferred from the constructor, unless the upload will
+	//    decode straight into a pixel buffer
+	if (!imgData && !container && !streamed && !CanDecodeIntoPBO())
+		LoadImageData();
+	if (!imgData) return;
+	if (glTextureType != GL_TEXTURE_2D || glPixelStorage != GL_UNSIGNED_BYTE) return;
+
+	int components = (glPixelFormat==GL_RGB ? 3 : 4);
+	if (GLEW_EXT_texture_compression_s3tc)
+		preparedBC = compressedTextures.GetCompressed( (components==3 ? BC_FORMAT_BC1 : BC_FORMAT_BC3),
+			                                           (unsigned char *)imgData, width, height,
+													   components, usingMipmaps, mipFlags );
+	else if (usingMipmaps)
+		preparedMips = GenerateMipmaps( (unsigned char *)imgData, width, height, components, mipFlags );
+}
+
+// Hand imgData to OpenGL (into the bound texture)
+void GLTexture::UploadImage( void )
+{
+	if (!imgData && !container && CanDecodeIntoPBO() && DecodeIntoPBO())
+	{
+		ComputeGPUBytes();
+		streamLevel = -1;
+		return;
+	}
+	LoadImageData();
+
+	if (glTextureType == GL_TEXTURE_2D)
+		PrepareImage();
+
+	ComputeGPUBytes();
+
 	if (glTextureType == GL_TEXTURE_1D)
-		glTexImage1D( glTextureType, 0, glPixelFormat, width, 0, 
+		glTexImage1D( glTextureType, 0, glInternalFormat, width, 0, 
 					  glPixelFormat, glPixelStorage, imgData );
+	else if (preparedBC)
+	{
+		preparedBC->Upload( glTextureType );
+		delete preparedBC;
+		preparedBC = 0;
+	}
+	else if (preparedMips)
+	{
+		// Small mipmaps have rows that aren't a multiple of 4 bytes
+		glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+		for (unsigned int i=0; i < preparedMips->GetNumLevels(); i++)
+			glTexImage2D( glTextureType, i, glInternalFormat, 
+			          preparedMips->GetLevelWidth(i), preparedMips->GetLevelHeight(i), 0, 
+					  glPixelFormat, glPixelStorage, preparedMips->GetLevelData(i) );
+		glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+		glTexParameteri( glTextureType, GL_TEXTURE_MAX_LEVEL, preparedMips->GetNumLevels()-1 );
+		delete preparedMips;
+		preparedMips = 0;
+	}
+	else if (container)
+	{
+		container->Upload( glTextureType );
+		if (container->GetNumLevels() == 1 && usingMipmaps && !container->IsCompressed() && GLEW_EXT_framebuffer_object)
+		{
+			glGenerateMipmapEXT( glTextureType );
+			glTexParameteri( glTextureType, GL_TEXTURE_MAX_LEVEL, 1000 );
+		}
+	}
 	else if (glTextureType == GL_TEXTURE_2D)
 		if (!usingMipmaps)
-			glTexImage2D( glTextureType, 0, (glPixelFormat==GL_RGB ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : 
-			          GL_COMPRESSED_RGBA_S3TC_DXT1_EXT), 
+			glTexImage2D( glTextureType, 0, glInternalFormat, 
+			          width, height, 0, glPixelFormat, glPixelStorage, imgData );
+		else if (glPixelStorage != GL_UNSIGNED_BYTE && GLEW_EXT_framebuffer_object)
+		{
+			// GLU can't build mipmaps of half float or RGB9E5 data
+			glTexImage2D( glTextureType, 0, glInternalFormat, 
 			          width, height, 0, glPixelFormat, glPixelStorage, imgData );
+			glGenerateMipmapEXT( glTextureType );
+		}
 		else
-			gluBuild2DMipmaps( glTextureType, (glPixelFormat==GL_RGB ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : 
-			          GL_COMPRESSED_RGBA_S3TC_DXT1_EXT), 
+			gluBuild2DMipmaps( glTextureType, glInternalFormat, 
 					  width, height, glPixelFormat, glPixelStorage, imgData );
 	else if (glTextureType == GL_TEXTURE_3D)
-		glTexImage3D( glTextureType, 0, glPixelFormat, width, height, depth, 0, 
+		glTexImage3D( glTextureType, 0, glInternalFormat, width, height, depth, 0, 
 					  glPixelFormat, glPixelStorage, imgData );
 
-	glTexParameteri( glTextureType, GL_TEXTURE_MIN_FILTER, minFilter );
-	glTexParameteri( glTextureType, GL_TEXTURE_MAG_FILTER, magFilter );
-	glTexParameteri( glTextureType, GL_TEXTURE_WRAP_S, sWrap );
-	if (glTextureType!=GL_TEXTURE_1D) 
-		glTexParameteri( glTextureType, GL_TEXTURE_WRAP_T, tWrap );
-	if (glTextureType==GL_TEXTURE_3D)
-		glTexParameteri( glTextureType, GL_TEXTURE_WRAP_R, rWrap=GL_CLAMP );
+	streamLevel = -1;
+	ApplyCPUCopyPolicy();
+}
 
-	initialized = true;
+// Note how much GPU memory the (prepared) image takes
+void GLTexture::ComputeGPUBytes( void )
+{
+	textureStatsLock.Lock();
+	totalGPUBytes -= gpuBytes;
+	gpuBytes = 0;
+	if (preparedBC)
+		for (unsigned int i=0; i < preparedBC->GetNumLevels(); i++)
+			gpuBytes += preparedBC->GetLevelBytes(i);
+	else if (preparedMips)
+		for (unsigned int i=0; i < preparedMips->GetNumLevels(); i++)
+			gpuBytes += (size_t)preparedMips->GetLevelWidth(i) * preparedMips->GetLevelHeight(i) * GPUTexelBytes();
+	else if (container && container->IsCompressed())
+		for (unsigned int i=0; i < container->GetNumLevels(); i++)
+			gpuBytes += container->GetLevelBytes(i);
+	else if (container)
+	{
+		for (unsigned int i=0; i < container->GetNumLevels(); i++)
+			gpuBytes += (size_t)container->GetLevelWidth(i) * container->GetLevelHeight(i) * GPUTexelBytes();
+		if (usingMipmaps && container->GetNumLevels() == 1) gpuBytes += gpuBytes / 3;
+	}
+	else
+	{
+		gpuBytes = (size_t)width * (glTextureType == GL_TEXTURE_1D ? 1 : height) * 
+			       (glTextureType == GL_TEXTURE_3D ? depth : 1) * GPUTexelBytes();
+		if (usingMipmaps) gpuBytes += gpuBytes / 3;
+	}
+	totalGPUBytes += gpuBytes;
+	textureStatsLock.Unlock();
 }
 
+// Is the CPU copy freed after upload?  (Not if asked to keep it, or if 
+//    we couldn't get it back.)
+bool GLTexture::ReleasesCPUCopy( void ) const
+{
+	bool release = releaseCPUCopies;
+	if (cpuCopyFlags & TEXTURE_KEEP_CPU_COPY)         release = false;
+	else if (cpuCopyFlags & TEXTURE_RELEASE_CPU_COPY) release = true;
+	return release && fileName;
+}
 
-void GLTexture::LoadRGB( char *filename )
+void GLTexture::ApplyCPUCopyPolicy( void )
 {
-	int components;
-	imgData = (void *)ReadRGB(filename, &width, &height, &components, true);
-	glPixelStorage = GL_UNSIGNED_BYTE; 
+	if (ReleasesCPUCopy())
+		FreeImageData();
+}
+
 
-	if (!imgData)
+// Read the file and do all the CPU work for uploading it.  (KTX files
+//    need no work, but we read them in here rather than when uploading.)
+void GLTexture::StreamDecode( void )
+{
+	LoadImageData();
+	if (container) container->Touch();
+	PrepareImage();
+	streamLevel = NumStreamLevels()-1;
+}
+
+int GLTexture::NumStreamLevels( void )
+{
+	if (preparedBC)   return preparedBC->GetNumLevels();
+	if (preparedMips) return preparedMips->GetNumLevels();
+	if (container)    return container->GetNumLevels();
+	return 1;
+}
+
+size_t GLTexture::NextStreamLevelBytes( void )
+{
+	if (streamLevel < 0) return 0;
+	if (preparedBC)   return preparedBC->GetLevelBytes( streamLevel );
+	if (preparedMips) return (size_t)preparedMips->GetLevelWidth( streamLevel ) * 
+							 preparedMips->GetLevelHeight( streamLevel ) * preparedMips->GetComponents();
+	if (container)    return container->GetLevelBytes( streamLevel );
+	return (size_t)width * height * ImageTexelBytes();
+}
+
+// Copy data into the pixel buffer 'pbo' (if there is one), and return
+//    the pointer to hand to glTexImage2D():  the offset into the bound
+//    buffer, or the data itself.  The upload then doesn't wait for the
+//    GPU to take the data.
+const void *GLTexture::StageUpload( GLuint pbo, const void *data, size_t bytes )
+{
+	if (!pbo) return data;
+	glState.BindBuffer( GL_PIXEL_UNPACK_BUFFER, pbo );
+	glBufferData( GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW );
+	void *ptr = glMapBuffer( GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY );
+	if (!ptr)
 	{
-		printf("Error in Texture::LoadRGB(): Unknown error in ReadRGB! (NULL return)\n");
-		exit(0);
+		glState.BindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+		return data;
+	}
+	memcpy( ptr, data, bytes );
+	glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER );
+	return 0;
+}
+
+// Upload the next (finer) mip level, and let OpenGL use it and all the
+//    coarser levels sent earlier.  Returns the bytes uploaded.
+size_t GLTexture::StreamNextLevel( GLuint pbo )
+{
+	if (streamLevel < 0 || !initialized) return 0;
+
+	int lvl = streamLevel;
+	size_t bytes = NextStreamLevelBytes();
+	int numLevels = NumStreamLevels();
+	glState.BindTexture( glTextureType, texID );
+	if (preparedBC)
+		glCompressedTexImage2D( glTextureType, lvl, BCGLFormat( preparedBC->GetFormat() ),
+			                    preparedBC->GetLevelWidth( lvl ), preparedBC->GetLevelHeight( lvl ), 0,
+								(GLsizei)bytes, StageUpload( pbo, preparedBC->GetLevelData( lvl ), bytes ) );
+	else if (preparedMips)
+	{
+		glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+		glTexImage2D( glTextureType, lvl, glInternalFormat, 
+			          preparedMips->GetLevelWidth( lvl ), preparedMips->GetLevelHeight( lvl ), 0, 
+					  glPixelFormat, glPixelStorage, StageUpload( pbo, preparedMips->GetLevelData( lvl ), bytes ) );
+		glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
 	}
+	else if (container && container->IsCompressed())
+		glCompressedTexImage2D( glTextureType, lvl, glInternalFormat, 
+			                    container->GetLevelWidth( lvl ), container->GetLevelHeight( lvl ), 0,
+								(GLsizei)bytes, StageUpload( pbo, container->GetLevelData( lvl ), bytes ) );
+	else if (container)
+		glTexImage2D( glTextureType, lvl, glInternalFormat, 
+			          container->GetLevelWidth( lvl ), container->GetLevelHeight( lvl ), 0, 
+					  glPixelFormat, glPixelStorage, StageUpload( pbo, container->GetLevelData( lvl ), bytes ) );
+	else
+		glTexImage2D( glTextureType, 0, glInternalFormat, width, height, 0, 
+			          glPixelFormat, glPixelStorage, StageUpload( pbo, imgData, bytes ) );
+	if (pbo) glState.BindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+
+	if (numLevels == 1 && usingMipmaps && !(container && container->IsCompressed()) && GLEW_EXT_framebuffer_object)
+	{
+		// Formats we didn't build mipmaps for (e.g., HDR)
+		glGenerateMipmapEXT( glTextureType );
+		glTexParameteri( glTextureType, GL_TEXTURE_MAX_LEVEL, 1000 );
+	}
+	else
+		glTexParameteri( glTextureType, GL_TEXTURE_MAX_LEVEL, numLevels-1 );
+	glTexParameteri( glTextureType, GL_TEXTURE_BASE_LEVEL, lvl );
+
+	streamLevel--;
+	if (streamLevel < 0)
+	{
+		ComputeGPUBytes();
+		if (preparedBC) delete preparedBC;
+		if (preparedMips) delete preparedMips;
+		preparedBC = 0;
+		preparedMips = 0;
+		ApplyCPUCopyPolicy();
+	}
+	return bytes;
 }
 
 
-void GLTexture::LoadPPM( char *filename )
+// Can the texture be dropped or evicted?  It has to be all on the GPU
+//    (not streaming in), and we need its file to reload it later.
+bool GLTexture::IsResident( void ) const
 {
-	int mode;
-	imgData = (void *)ReadPPM( filename, &mode, &width, &height, true );
-	glPixelStorage = GL_UNSIGNED_BYTE; 
+	return initialized && streamLevel < 0 && !evicted && fileName && 
+		   glTextureType == GL_TEXTURE_2D;
+}
 
-	if (!imgData)
+bool GLTexture::CanDropMipLevel( void ) const
+{
+	return IsResident() && usingMipmaps && (width >> droppedLevels) > 1 && 
+		   (height >> droppedLevels) > 1;
+}
+
+bool GLTexture::CanBeArrayLayer( void ) const
+{
+	return glTextureType == GL_TEXTURE_2D && glPixelStorage == GL_UNSIGNED_BYTE;
+}
+
+bool GLTexture::SameArrayFormat( const GLTexture *other ) const
+{
+	return CanBeArrayLayer() && other->CanBeArrayLayer() &&
+		   width == other->width && height == other->height && 
+		   glPixelFormat == other->glPixelFormat && usingMipmaps == other->usingMipmaps &&
+		   mipFlags == other->mipFlags && minFilter == other->minFilter && 
+		   magFilter == other->magFilter && sWrap == other->sWrap && tWrap == other->tWrap;
+}
+
+// Bytes per pixel of data in glPixelFormat and glPixelStorage
+int GLTexture::PixelBytes( void ) const
+{
+	int components = (glPixelFormat==GL_RGBA ? 4 : 3);
+	if (glPixelStorage == GL_UNSIGNED_INT_5_9_9_9_REV_EXT) return 4;
+	if (glPixelStorage == GL_HALF_FLOAT_ARB)               return 2*components;
+	if (glPixelStorage == GL_FLOAT)                        return 4*components;
+	return components;
+}
+
+void GLTexture::SetGPUBytes( size_t bytes )
+{
+	textureStatsLock.Lock();
+	totalGPUBytes += bytes - gpuBytes;
+	gpuBytes = bytes;
+	textureStatsLock.Unlock();
+}
+
+// Move to a new GL texture object (with the same parameters), so all the 
+//    old one's memory is freed.  Leaves the new object bound.
+void GLTexture::ReplaceTextureObject( void )
+{
+	glState.DeleteTextures( 1, &texID );
+	glState.Invalidate( GLSTATE_TEXTURES );
+	glGenTextures( 1, &texID );
+	glState.BindTexture( glTextureType, texID );
+	SetTextureParameters();
+}
+
+// Throw away the finest mip level.  The coarser levels are read back and 
+//    moved up a level in a new texture object, since OpenGL can only free
+//    a level by reallocating the texture.  Returns the bytes freed.
+size_t GLTexture::DropTopMipLevel( void )
+{
+	if (!CanDropMipLevel()) return 0;
+
+	GLint compressed, format, levelWidth[32], levelHeight[32], levelBytes[32];
+	unsigned char *levelData[32];
+	glState.BindTexture( glTextureType, texID );
+	glGetTexLevelParameteriv( glTextureType, 0, GL_TEXTURE_COMPRESSED_ARB, &compressed );
+	glGetTexLevelParameteriv( glTextureType, 0, GL_TEXTURE_INTERNAL_FORMAT, &format );
+
+	// Read back every level but the top
+	int numLevels = 1;
+	size_t bytes = 0;
+	glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+	for (int lvl=1; lvl < 32; lvl++, numLevels++)
 	{
-		printf("Error in Texture::LoadPPM(): Unknown error in ReadPPM! (NULL return)\n");
-		exit(0);
+		glGetTexLevelParameteriv( glTextureType, lvl, GL_TEXTURE_WIDTH, &levelWidth[lvl] );
+		glGetTexLevelParameteriv( glTextureType, lvl, GL_TEXTURE_HEIGHT, &levelHeight[lvl] );
+		if (levelWidth[lvl] <= 0 || levelHeight[lvl] <= 0) break;
+		if (compressed)
+			glGetTexLevelParameteriv( glTextureType, lvl, GL_TEXTURE_COMPRESSED_IMAGE_SIZE_ARB, &levelBytes[lvl] );
+		else
+			levelBytes[lvl] = levelWidth[lvl] * levelHeight[lvl] * PixelBytes();
+		levelData[lvl] = (unsigned char *)malloc( levelBytes[lvl] );
+		if (compressed) glGetCompressedTexImage( glTextureType, lvl, levelData[lvl] );
+		else            glGetTexImage( glTextureType, lvl, glPixelFormat, glPixelStorage, levelData[lvl] );
+		bytes += compressed ? levelBytes[lvl] : (size_t)levelWidth[lvl] * levelHeight[lvl] * GPUTexelBytes();
+		if (levelWidth[lvl] == 1 && levelHeight[lvl] == 1) { numLevels++; break; }
+	}
+	glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+	if (numLevels < 2) return 0;
+
+	// ...and upload them one level up
+	ReplaceTextureObject();
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+	for (int lvl=1; lvl < numLevels; lvl++)
+	{
+		if (compressed)
+			glCompressedTexImage2D( glTextureType, lvl-1, format, levelWidth[lvl], levelHeight[lvl], 0, 
+				                    levelBytes[lvl], levelData[lvl] );
+		else
+			glTexImage2D( glTextureType, lvl-1, format, levelWidth[lvl], levelHeight[lvl], 0, 
+				          glPixelFormat, glPixelStorage, levelData[lvl] );
+		free( levelData[lvl] );
+	}
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+	glTexParameteri( glTextureType, GL_TEXTURE_BASE_LEVEL, 0 );
+	glTexParameteri( glTextureType, GL_TEXTURE_MAX_LEVEL, numLevels-2 );
+
+	size_t freed = gpuBytes > bytes ? gpuBytes - bytes : 0;
+	SetGPUBytes( bytes );
+	droppedLevels++;
+	return freed;
+}
+
+// Replace the texture by a 1x1 placeholder.  Returns the bytes freed.
+size_t GLTexture::Evict( void )
+{
+	if (!IsResident()) return 0;
+	size_t freed = gpuBytes > 4 ? gpuBytes - 4 : 0;
+	ReplaceTextureObject();
+	UploadPlaceholder();
+	SetGPUBytes( 4 );
+	evicted = true;
+	droppedLevels = 0;
+	return freed;
+}
+
+// Get ready to stream the whole texture back in.  Until it's done, the
+//    current (dropped or placeholder) texture is still used.
+void GLTexture::Reload( void )
+{
+	if (!fileName || !initialized || streamLevel >= 0) return;
+	streamed = true;
+	streamLevel = 0;
+	evicted = false;
+	droppedLevels = 0;
+}
+
+void GLTexture::LoadImageData( void )
+{
+	if (imgData || container || !fileName) return;
+	if (internalImageType == TEXTURE_TYPE_KTX) LoadKTX( fileName );
+	else if (internalImageType != TEXTURE_TYPE_UNKNOWN) DecodeFile();
+	if (!imgData && !container) return;
+
+	textureStatsLock.Lock();
+	cpuBytes = container ? container->GetFileBytes() : (size_t)width * height * ImageTexelBytes();
+	totalCPUBytes += cpuBytes;
+	textureStatsLock.Unlock();
+}
+
+void GLTexture::FreeImageData( void )
+{
+	if (!imgData && !container) return;
+	if (imgData) free( imgData );
+	if (container) delete container;
+	imgData = 0;
+	container = 0;
+	textureStatsLock.Lock();
+	totalCPUBytes -= cpuBytes;
+	cpuBytes = 0;
+	textureStatsLock.Unlock();
+}
+
+const void *GLTexture::GetImageData( void )
+{
+	if (!imgData && !container && fileName)
+		LoadImageData();
+	return imgData;
+}
+
+void GLTexture::ReleaseImageData( void )
+{
+	if (fileName) FreeImageData();
+}
+
+// The layout DecodeFile() asked for
+int GLTexture::ImageTexelBytes( void ) const
+{
+	int components = (glPixelFormat==GL_RGBA ? 4 : 3);
+	if (glPixelStorage == GL_UNSIGNED_INT_5_9_9_9_REV_EXT) return 4;
+	if (glPixelStorage == GL_HALF_FLOAT_ARB)               return 2*components;
+	if (glPixelStorage == GL_FLOAT)                        return 4*components;
+	return components;
+}
+
+// Drivers generally pad 3 component formats out to 4
+int GLTexture::GPUTexelBytes( void ) const
+{
+	if (glInternalFormat == GL_RGB16F_ARB)    return 8;
+	if (glInternalFormat == GL_RGB32F_ARB)    return 16;
+	return 4;
+}
+
+void GLTexture::PrintMemoryStats( FILE *f )
+{
+	textureStatsLock.Lock();
+	size_t cpu = totalCPUBytes, gpu = totalGPUBytes;
+	textureStatsLock.Unlock();
+	fprintf( f, "Texture memory: %.2f MB of CPU copies, about %.2f MB on the GPU\n",
+		     cpu/1048576.0, gpu/1048576.0 );
+}
+
+
+// The ImageIO pixel layout to decode into, for the glPixelStorage the 
+//    image is uploaded with.  HDR images are stored on the GPU in a compact
+//    float format, RGB9E5 (4 bytes per texel) or RGB16F (6 bytes), rather 
+//    than full floats, and DecodeImage() converts to these directly.
+int GLTexture::ChooseDecodeLayout( void )
+{
+	if (internalImageType != TEXTURE_TYPE_HDR)
+	{
+		glPixelStorage = GL_UNSIGNED_BYTE;
+		return glPixelFormat == GL_RGBA ? IMAGE_PIXELS_RGBA8 : IMAGE_PIXELS_RGB8;
 	}
+	if (GLEW_EXT_texture_shared_exponent)
+	{
+		glPixelStorage = GL_UNSIGNED_INT_5_9_9_9_REV_EXT;
+		glInternalFormat = GL_RGB9_E5_EXT;
+		return IMAGE_PIXELS_RGB9E5;
+	}
+	if (GLEW_ARB_half_float_pixel && GLEW_ARB_texture_float)
+	{
+		glPixelStorage = GL_HALF_FLOAT_ARB;
+		glInternalFormat = GL_RGB16F_ARB;
+		return IMAGE_PIXELS_RGB16F;
+	}
+	glPixelStorage = GL_FLOAT;
+	glInternalFormat = GLEW_ARB_texture_float ? GL_RGB16F_ARB : GL_RGB;
+	return IMAGE_PIXELS_RGB32F;
 }
 
+// Whether rows are decoded bottom to top.  PPM and HDR textures always 
+//    have been, BMP and SGI ones haven't (so they appear upside down 
+//    compared to the others).  Scenes are built around this, so keep it.
+bool GLTexture::FlipsRows( void ) const
+{
+	return internalImageType == TEXTURE_TYPE_PPM || internalImageType == TEXTURE_TYPE_HDR;
+}
 
-void GLTexture::LoadBMP( char *filename )
+void GLTexture::DecodeFile( void )
 {
-	imgData = (void *)ReadBMP( filename, &width, &height, true );
-	glPixelStorage = GL_UNSIGNED_BYTE; 
+	ImageInfo info;
+	if (!ReadImageInfo( fileName, &info ) || info.format == IMAGE_FORMAT_KTX)
+	{
+		printf("Error in Texture::DecodeFile(): Unable to read '%s'!\n", fileName );
+		exit(0);
+	}
 
-	if (!imgData)
+	int layout = ChooseDecodeLayout();
+	width  = info.width;
+	height = info.height;
+	imgData = malloc( (size_t)width * height * ImagePixelBytes( layout ) );
+	if (!imgData || !DecodeImage( fileName, imgData, width * ImagePixelBytes( layout ), layout, FlipsRows() ))
 	{
-		printf("Error in Texture::LoadBMP(): Unknown error in ReadBMP! (NULL return)\n");
+		printf("Error in Texture::DecodeFile(): Unable to decode '%s'!\n", fileName );
 		exit(0);
 	}
 }
 
+// Decoding straight into a pixel buffer saves the copy into imgData, but
+//    only works when nothing else needs imgData:  it isn't kept, and the
+//    CPU doesn't compress the image or build its mipmaps.
+bool GLTexture::CanDecodeIntoPBO( void ) const
+{
+	if (glTextureType != GL_TEXTURE_2D || !GLEW_ARB_pixel_buffer_object || !ReleasesCPUCopy()) 
+		return false;
+	if (internalImageType == TEXTURE_TYPE_KTX || internalImageType == TEXTURE_TYPE_UNKNOWN) 
+		return false;
+	if (internalImageType != TEXTURE_TYPE_HDR && (usingMipmaps || GLEW_EXT_texture_compression_s3tc))
+		return false;
+	return !usingMipmaps || GLEW_EXT_framebuffer_object;
+}
+
+// Decode the file into a mapped pixel buffer, and upload from that into 
+//    the bound texture.  Returns false (having uploaded nothing) if the 
+//    buffer can't be mapped.
+bool GLTexture::DecodeIntoPBO( void )
+{
+	int layout = ChooseDecodeLayout();
+	int rowPitch = (width * ImagePixelBytes( layout ) + 3) & ~3;   // GL_UNPACK_ALIGNMENT is 4
+
+	GLuint pbo;
+	glGenBuffers( 1, &pbo );
+	glState.BindBuffer( GL_PIXEL_UNPACK_BUFFER, pbo );
+	glBufferData( GL_PIXEL_UNPACK_BUFFER, (size_t)rowPitch * height, NULL, GL_STREAM_DRAW );
+	void *ptr = glMapBuffer( GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY );
+	bool ok = ptr != 0;
+	if (ptr)
+	{
+		if (!DecodeImage( fileName, ptr, rowPitch, layout, FlipsRows() ))
+		{
+			printf("Error in Texture::DecodeIntoPBO(): Unable to decode '%s'!\n", fileName );
+			exit(0);
+		}
+		ok = glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER ) == GL_TRUE;
+	}
+	if (ok)
+	{
+		glTexImage2D( glTextureType, 0, glInternalFormat, width, height, 0, 
+			          glPixelFormat, glPixelStorage, 0 );
+		if (usingMipmaps)
+			glGenerateMipmapEXT( glTextureType );
+	}
+	glState.BindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+	glState.DeleteBuffers( 1, &pbo );
+	return ok;
+}
+
+
+// KTX files hold the data exactly as it's uploaded (usually compressed,
+//    with all the mipmaps), so there's nothing to do but map the file.
+void GLTexture::LoadKTX( char *filename )
+{
+	container = new TextureContainer();
+	if (!container->Open( filename ))
+	{
+		printf("Error in Texture::LoadKTX(): Unable to load '%s'!\n", filename );
+		exit(0);
+	}
+
+	width  = container->GetWidth();
+	height = container->GetHeight();
+	glInternalFormat = container->GetGLInternalFormat();
+	if (container->IsCompressed())
+	{
+		glPixelFormat  = container->GetGLBaseInternalFormat();
+		glPixelStorage = GL_UNSIGNED_BYTE;
+	}
+	else
+	{
+		glPixelFormat  = container->GetGLFormat();
+		glPixelStorage = container->GetGLType();
+	}
+}
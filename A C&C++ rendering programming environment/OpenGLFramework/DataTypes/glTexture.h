@@ -19,6 +19,10 @@
 #include <GL/glew.h>
 #include <GL/glut.h>
 
+class BCTexture;
+class MipmapChain;
+class TextureContainer;
+
 
 #define TEXTURE_TYPE_UNKNOWN  0
 #define TEXTURE_TYPE_PPM      1
@@ -26,6 +30,7 @@
 #define TEXTURE_TYPE_RGBA     3
 #define TEXTURE_TYPE_HDR      4
 #define TEXTURE_TYPE_BMP      5
+#define TEXTURE_TYPE_KTX      6
 
 class GLTexture
 {
@@ -33,17 +38,81 @@ private:
 	char *fileName, *name;
 	void *imgData;
     int width, height, depth, internalImageType;
-	int glPixelFormat, glPixelStorage;
+	int glPixelFormat, glPixelStorage, glInternalFormat;
 	int glTextureType;
 	GLint minFilter, magFilter;
 	GLint sWrap, tWrap, rWrap;
 	GLuint texID;
-	bool initialized, usingMipmaps;
-
-	void LoadPPM( char *filename );
-	void LoadRGB( char *filename );
-	void LoadBMP( char *filename );
-	//void LoadHDR( char *filename );
+	bool initialized, usingMipmaps, streamed;
+	unsigned int mipFlags, cpuCopyFlags;
+	size_t cpuBytes, gpuBytes;
+
+	// For streamed textures, the next mip level to upload (-1 when done), 
+	//    and how often TextureID() was called since the streamer last asked
+	int streamLevel;
+	mutable unsigned int bindCount;
+
+	// For the texture budget:  the frame TextureID() was last called in, 
+	//    how many top mip levels have been dropped, and whether the texture
+	//    was evicted (replaced by a 1x1 placeholder)
+	mutable unsigned int lastUsedFrame;
+	int droppedLevels;
+	bool evicted;
+	static unsigned int currentFrame;
+
+	// The texture array (and layer) holding a copy of this texture, if any
+	GLuint arrayID;
+	int arrayLayer;
+	bool wantsArray;
+
+	// Whether textures without a TEXTURE_*_CPU_COPY flag free imgData after
+	//    upload, and the totals reported by GetTotal*Bytes()
+	static bool releaseCPUCopies;
+	static size_t totalCPUBytes, totalGPUBytes;
+
+	// Compressed data or mipmaps built by PrepareImage(), not yet uploaded
+	BCTexture *preparedBC;
+	MipmapChain *preparedMips;
+
+	// KTX files (see Utils/textureContainer.h) are mapped, not read into imgData
+	TextureContainer *container;
+
+	// Reading files.  Images (other than KTX) are decoded by the ImageIO
+	//    DecodeImage() straight into imgData, or into a mapped pixel buffer
+	//    when nothing needs a CPU copy (see DecodeIntoPBO()).
+	int ChooseDecodeLayout( void );
+	bool FlipsRows( void ) const;
+	void DecodeFile( void );
+	void LoadKTX( char *filename );
+	bool CanDecodeIntoPBO( void ) const;
+	bool DecodeIntoPBO( void );
+
+	// Send imgData to the currently bound GL texture
+	void UploadImage( void );
+
+	// (Re)load imgData from fileName, and free it
+	void LoadImageData( void );
+	void FreeImageData( void );
+
+	// Bytes per texel of imgData, and (roughly) on the GPU
+	int ImageTexelBytes( void ) const;
+	int GPUTexelBytes( void ) const;
+
+	// Bookkeeping once all of the image is on the GPU
+	void ComputeGPUBytes( void );
+	bool ReleasesCPUCopy( void ) const;
+	void ApplyCPUCopyPolicy( void );
+
+	// Helpers for streaming
+	int NumStreamLevels( void );
+	const void *StageUpload( GLuint pbo, const void *data, size_t bytes );
+
+	// Helpers for the texture budget
+	int PixelBytes( void ) const;
+	void SetGPUBytes( size_t bytes );
+	void SetTextureParameters( void );
+	void UploadPlaceholder( void );
+	void ReplaceTextureObject( void );
 public:
 	GLTexture( int width=-1, int height=-1, int depth=-1 );
     GLTexture( char *filename, unsigned int flags=0, bool processLater=false );
@@ -57,8 +126,86 @@ public:
 	//   a later "preprocess" pass after GL has been initialized.
 	void Preprocess( void );
 
-	// Returns the GL handle for this texture
-	inline GLint TextureID() const { return texID; }
+	// The CPU-heavy part of Preprocess() (decoding the file, compressing, 
+	//    and building mipmaps).  This makes no GL calls (but must follow
+	//    glewInit()), so different textures can be prepared on different
+	//    threads before calling Preprocess() on each.
+	void PrepareImage( void );
+
+	// By default, the CPU copy of the image is freed once it's been sent to
+	//    OpenGL.  GetImageData() re-reads the file if needed.  The layout is
+	//    as passed to glTexImage2D() (see glPixelFormat and glPixelStorage).
+	//    KTX files have no image to return (they're already GPU-ready).
+	const void *GetImageData( void );
+	void ReleaseImageData( void );
+	static inline void SetReleaseCPUCopies( bool release ) { releaseCPUCopies = release; }
+
+	// Memory used by this texture, or by all of them, in system RAM and 
+	//    (estimated from the texture formats) on the GPU.
+	inline size_t GetCPUBytes( void ) const            { return cpuBytes; }
+	inline size_t GetGPUBytes( void ) const            { return gpuBytes; }
+	static inline size_t GetTotalCPUBytes( void )      { return totalCPUBytes; }
+	static inline size_t GetTotalGPUBytes( void )      { return totalGPUBytes; }
+	static void PrintMemoryStats( FILE *f );
+
+	// Streaming.  Textures created with TEXTURE_STREAM (and processLater)
+	//    don't read their file in the constructor.  Preprocess() gives them
+	//    a 1x1 gray placeholder, and a TextureStreamer (Utils/textureStreamer.h)
+	//    reads the file on another thread and then uploads the mipmaps one at
+	//    a time, coarsest first.  TextureID() stays the same throughout.
+	inline bool IsStreamed( void ) const               { return streamed; }
+	inline bool IsStreamingDone( void ) const          { return streamLevel < 0; }
+	void StreamDecode( void );                         // Any thread.  No GL calls.
+	size_t NextStreamLevelBytes( void );               // Size of the next upload
+	size_t StreamNextLevel( GLuint pbo=0 );            // Upload it (via 'pbo', if given)
+	inline unsigned int TakeBindCount( void )          { unsigned int c = bindCount; bindCount = 0; return c; }
+
+	// Memory budget support (see Utils/textureBudget.h).  DropTopMipLevel()
+	//    and Evict() free GPU memory by moving the texture to a new, smaller
+	//    GL texture object, so TextureID() changes.  They return the bytes 
+	//    freed.  Reload() streams the full texture back in (the texture must
+	//    then be Add()ed to a TextureStreamer).
+	static inline void SetCurrentFrame( unsigned int frame ) { currentFrame = frame; }
+	inline unsigned int GetLastUsedFrame( void ) const { return lastUsedFrame; }
+	inline int GetDroppedLevels( void ) const          { return droppedLevels; }
+	inline bool IsEvicted( void ) const                { return evicted; }
+	bool IsResident( void ) const;                     // Fully loaded, and can be dropped/evicted?
+	bool CanDropMipLevel( void ) const;
+	size_t DropTopMipLevel( void );
+	size_t Evict( void );
+	void Reload( void );
+
+	// Texture arrays (see Utils/textureArrayBuilder.h).  Textures that some
+	//    material wants to use from an array are copied into one during the
+	//    scene's Preprocess(), along with others of the same size and format.
+	//    They still have their own GL texture, too.
+	inline void RequestArrayLayer( void )              { wantsArray = true; }
+	inline bool WantsArrayLayer( void ) const          { return wantsArray; }
+	inline void SetArrayLayer( GLuint id, int layer )  { arrayID = id; arrayLayer = layer; }
+	inline GLuint GetArrayID( void ) const             { return arrayID; }
+	inline int GetArrayLayer( void ) const             { return arrayLayer; }
+
+	// Can this be a layer of a texture array at all (a 2D texture with
+	//    8-bit data)?  And can the two textures share one?  (Both can be
+	//    layers, with the same size, format, filtering, and wrapping.)
+	bool CanBeArrayLayer( void ) const;
+	bool SameArrayFormat( const GLTexture *other ) const;
+
+	// Formats and GL parameters
+	inline int GetPixelFormat( void ) const            { return glPixelFormat; }
+	inline int GetPixelStorage( void ) const           { return glPixelStorage; }
+	inline int GetInternalFormat( void ) const         { return glInternalFormat; }
+	inline bool UsesMipmaps( void ) const              { return usingMipmaps; }
+	inline unsigned int GetMipFlags( void ) const      { return mipFlags; }
+	inline GLint GetMinFilter( void ) const            { return minFilter; }
+	inline GLint GetMagFilter( void ) const            { return magFilter; }
+	inline GLint GetWrapS( void ) const                { return sWrap; }
+	inline GLint GetWrapT( void ) const                { return tWrap; }
+
+	// Returns the GL handle for this texture.  (Calls are counted, so the
+	//    streamer can favor textures that are actually being drawn, and 
+	//    stamped with the frame, so the budget can find unused ones.)
+	inline GLint TextureID() const { bindCount++; lastUsedFrame = currentFrame; return texID; }
 
 	// Get size of the texture
 	inline int GetWidth()  const   { return width;  }  // Valid for 1D, 2D, or 3D textures
@@ -96,6 +243,12 @@ public:
 #define TEXTURE_MIN_LINEAR_MIP_LINEAR                        0x20000
 #define TEXTURE_INTERNAL_RGB                                 0x40000
 #define TEXTURE_INTERNAL_RGBA                                0x80000
+#define TEXTURE_MIP_KAISER                                  0x100000
+#define TEXTURE_MIP_LINEAR_DATA                             0x200000
+#define TEXTURE_MIP_PRESERVE_COVERAGE                       0x400000
+#define TEXTURE_KEEP_CPU_COPY                               0x800000
+#define TEXTURE_RELEASE_CPU_COPY                           0x1000000
+#define TEXTURE_STREAM                                     0x2000000
 
 
 
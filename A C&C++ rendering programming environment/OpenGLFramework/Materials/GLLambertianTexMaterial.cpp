@@ -6,6 +6,7 @@
 #include "GLLambertianTexMaterial.h"
 #include "DataTypes/glTexture.h"
 #include "Utils/ImageIO/imageIO.h"
+#include "Utils/glStateCache.h"
 
 
 void GLLambertianTexMaterial::Enable( Scene *s, unsigned int flags )
@@ -17,9 +18,9 @@ void GLLambertianTexMaterial::Enable( Scene *s, unsigned int flags )
 	glMaterialf( whichFace, GL_SHININESS, shininess );
 	if (tex)
 	{
-		glActiveTexture( GL_TEXTURE0 );
-		glBindTexture( GL_TEXTURE_2D, tex->TextureID() );
-		glEnable( GL_TEXTURE_2D );
+		glState.ActiveTexture( GL_TEXTURE0 );
+		glState.BindTexture( GL_TEXTURE_2D, tex->TextureID() );
+		glState.Enable( GL_TEXTURE_2D );
 	}
 }
 
@@ -27,9 +28,9 @@ void GLLambertianTexMaterial::Disable( void )
 {
 	if (tex)
 	{
-		glActiveTexture( GL_TEXTURE0 );
-		glBindTexture( GL_TEXTURE_2D, 0 );
-		glDisable( GL_TEXTURE_2D );
+		glState.ActiveTexture( GL_TEXTURE0 );
+		glState.BindTexture( GL_TEXTURE_2D, 0 );
+		glState.Disable( GL_TEXTURE_2D );
 	}
 }
 
@@ -4,6 +4,7 @@
 #include "GLMaterial.h"
 #include "Utils/ImageIO/imageIO.h"
 #include "Scene/Scene.h"
+#include "Utils/glStateCache.h"
 
 typedef struct {
   GLfloat ambient[4];
@@ -137,36 +138,36 @@ char predefinedNames[19][80] = {
 
 void GLMaterial::SetupShadowMap( GLenum texUnit, GLuint texID, float *matrix )
 {
-	glActiveTexture( texUnit );
-	glBindTexture( GL_TEXTURE_2D, texID );
+	glState.ActiveTexture( texUnit );
+	glState.BindTexture( GL_TEXTURE_2D, texID );
 	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_R_TO_TEXTURE );
-	glTexGeni( GL_S, GL_TEXTURE_GEN_MODE, GL_EYE_LINEAR );
-	glTexGeni( GL_T, GL_TEXTURE_GEN_MODE, GL_EYE_LINEAR );
-	glTexGeni( GL_R, GL_TEXTURE_GEN_MODE, GL_EYE_LINEAR );
-	glTexGeni( GL_Q, GL_TEXTURE_GEN_MODE, GL_EYE_LINEAR );
+	glState.TexGenMode( GL_S, GL_EYE_LINEAR );
+	glState.TexGenMode( GL_T, GL_EYE_LINEAR );
+	glState.TexGenMode( GL_R, GL_EYE_LINEAR );
+	glState.TexGenMode( GL_Q, GL_EYE_LINEAR );
 	glTexGenfv( GL_S, GL_EYE_PLANE, &matrix[0] );
 	glTexGenfv( GL_T, GL_EYE_PLANE, &matrix[4] );
 	glTexGenfv( GL_R, GL_EYE_PLANE, &matrix[8] );
 	glTexGenfv( GL_Q, GL_EYE_PLANE, &matrix[12] );
-	glEnable( GL_TEXTURE_2D );
-	glEnable( GL_TEXTURE_GEN_S );
-	glEnable( GL_TEXTURE_GEN_T );
-	glEnable( GL_TEXTURE_GEN_R );
-	glEnable( GL_TEXTURE_GEN_Q );
-	glActiveTexture( GL_TEXTURE0 );
+	glState.Enable( GL_TEXTURE_2D );
+	glState.Enable( GL_TEXTURE_GEN_S );
+	glState.Enable( GL_TEXTURE_GEN_T );
+	glState.Enable( GL_TEXTURE_GEN_R );
+	glState.Enable( GL_TEXTURE_GEN_Q );
+	glState.ActiveTexture( GL_TEXTURE0 );
 }
 
 void GLMaterial::DisableShadowMap( GLenum texUnit )
 {
-	glActiveTexture( texUnit );
-	glDisable( GL_TEXTURE_2D );
-	glDisable( GL_TEXTURE_GEN_S );
-	glDisable( GL_TEXTURE_GEN_T );
-	glDisable( GL_TEXTURE_GEN_R );
-	glDisable( GL_TEXTURE_GEN_Q );
+	glState.ActiveTexture( texUnit );
+	glState.Disable( GL_TEXTURE_2D );
+	glState.Disable( GL_TEXTURE_GEN_S );
+	glState.Disable( GL_TEXTURE_GEN_T );
+	glState.Disable( GL_TEXTURE_GEN_R );
+	glState.Disable( GL_TEXTURE_GEN_Q );
 	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE );
-	glBindTexture( GL_TEXTURE_2D, 0 );
-	glActiveTexture( GL_TEXTURE0 );
+	glState.BindTexture( GL_TEXTURE_2D, 0 );
+	glState.ActiveTexture( GL_TEXTURE0 );
 }
 
 
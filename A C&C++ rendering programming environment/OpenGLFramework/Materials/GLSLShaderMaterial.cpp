@@ -15,37 +15,60 @@
 #include "GLSLShaderMaterial.h"
 #include "Utils/ImageIO/imageIO.h"
 #include "Utils/glslProgram.h"
+#include "Utils/glStateCache.h"
+#include "Utils/shaderPermutationCache.h"
+#include "Utils/shIrradiance.h"
+#include "Utils/virtualTexture.h"
 #include "DataTypes/glTexture.h"
 
+// One permutation of this material's shader, and where the material's
+//    uniforms live in it.  Programs may be shared with other materials, so
+//    the material's own values are uploaded whenever it is enabled.
+class GLSLShaderVariant
+{
+public:
+	GLSLProgram *program;
+	Array1D<int> floatHandles, texHandles, constHandles;
+
+	// For textures bound from a texture array, the "<sampler>Layer" uniform
+	Array1D<int> layerHandles;
+
+	// SH_NUM_COEFFS handles (one per array element) for each irradiance binding
+	Array1D<int> shHandles;
+
+	// For each virtual texture:  <name>PageTable, <name>Cache, <name>Info,
+	//    <name>Tile, and <name>Size
+	Array1D<int> vtHandles;
+};
+
 void GLSLShaderMaterial::SetupShadowMap( GLenum texUnit, GLuint texID, float *matrix )
 {
 	shader->BindAndEnableTexture( "shadowMap", texID, texUnit, GL_TEXTURE_2D );
 	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_R_TO_TEXTURE );
 	glPushMatrix();
 	glLoadIdentity();
-	glTexGeni( GL_S, GL_TEXTURE_GEN_MODE, GL_EYE_LINEAR );
-	glTexGeni( GL_T, GL_TEXTURE_GEN_MODE, GL_EYE_LINEAR );
-	glTexGeni( GL_R, GL_TEXTURE_GEN_MODE, GL_EYE_LINEAR );
-	glTexGeni( GL_Q, GL_TEXTURE_GEN_MODE, GL_EYE_LINEAR );
+	glState.TexGenMode( GL_S, GL_EYE_LINEAR );
+	glState.TexGenMode( GL_T, GL_EYE_LINEAR );
+	glState.TexGenMode( GL_R, GL_EYE_LINEAR );
+	glState.TexGenMode( GL_Q, GL_EYE_LINEAR );
 	glTexGenfv( GL_S, GL_EYE_PLANE, &matrix[0] );
 	glTexGenfv( GL_T, GL_EYE_PLANE, &matrix[4] );
 	glTexGenfv( GL_R, GL_EYE_PLANE, &matrix[8] );
 	glTexGenfv( GL_Q, GL_EYE_PLANE, &matrix[12] );
-	glEnable( GL_TEXTURE_GEN_S );
-	glEnable( GL_TEXTURE_GEN_T );
-	glEnable( GL_TEXTURE_GEN_R );
-	glEnable( GL_TEXTURE_GEN_Q );
+	glState.Enable( GL_TEXTURE_GEN_S );
+	glState.Enable( GL_TEXTURE_GEN_T );
+	glState.Enable( GL_TEXTURE_GEN_R );
+	glState.Enable( GL_TEXTURE_GEN_Q );
 	glPopMatrix();
-	shader->SetParameter( "useShadowMap", 1 );
 }
 
 void GLSLShaderMaterial::DisableShadowMap( GLenum texUnit )
 {
-	glActiveTexture( texUnit );
-	glDisable( GL_TEXTURE_GEN_S );
-	glDisable( GL_TEXTURE_GEN_T );
-	glDisable( GL_TEXTURE_GEN_R );
-	glDisable( GL_TEXTURE_GEN_Q );
+	glState.ActiveTexture( texUnit );
+	glState.Disable( GL_TEXTURE_GEN_S );
+	glState.Disable( GL_TEXTURE_GEN_T );
+	glState.Disable( GL_TEXTURE_GEN_R );
+	glState.Disable( GL_TEXTURE_GEN_Q );
 	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE );
 	shader->DisableTexture( texUnit, GL_TEXTURE_2D );
 }
@@ -54,42 +77,123 @@ void GLSLShaderMaterial::DisableShadowMap( GLenum texUnit )
 
 void GLSLShaderMaterial::Enable( Scene *s, unsigned int flags )
 {
-	if (!shader) return;
+	if (!variant[0]) return;
+
+	usingVTFeedback = (flags & MATL_FLAGS_VTFEEDBACK) && variant[2];
+	usingShadows = !usingVTFeedback && (flags & MATL_FLAGS_USESHADOWMAP) && variant[1];
+	GLSLShaderVariant *v = variant[ usingVTFeedback ? 2 : (usingShadows ? 1 : 0) ];
+	shader = v->program;
+
+	// Don't stall the frame waiting on the compiler.  Draw with something
+	//    cheap until our program is done.
+	activeFallback = 0;
+	if (shader->IsLinkPending() && !shader->PollLink())
+	{
+		activeFallback = s->GetDefaultMaterial();
+		activeFallback->Enable( s, flags & ~(MATL_FLAGS_USESHADOWMAP | MATL_FLAGS_VTFEEDBACK) );
+		return;
+	}
 
-	usingShadows  = (flags & MATL_FLAGS_USESHADOWMAP)  && ( SHADERMATL_ALLOWS_SHADOWMAPUSE & propertyFlags ); 
+	// Another material sharing our program may have been the one to find it
+	//    linked, so check whether we've reported, not whether we just polled
+	if (!reportedReady) ReportShaderReady( s );
 
 	shader->EnableShader();
-	shader->SetParameter( "lightIntensity", s->GetLightIntensityModifier() );
+	for (unsigned int i=0; i<bindPtrs.Size(); i++)
+		shader->SetParameterByHandlev( v->floatHandles[i], 1, bindPtrs[i] );
+	for (unsigned int i=0; i<bindTexNames.Size(); i++)
+		if (bindTexNames[i])
+		{
+			// Textures from an array all bind the same GL texture, so only
+			//    the layer changes between materials
+			if (v->layerHandles[i] >= 0 && bindTexs[i]->GetArrayID())
+			{
+				bindTexTargets[i] = GL_TEXTURE_2D_ARRAY_EXT;
+				shader->BindAndEnableTextureByHandle( v->texHandles[i], bindTexs[i]->GetArrayID(), GL_TEXTURE0+i, GL_TEXTURE_2D_ARRAY_EXT );
+				shader->SetParameterByHandle( v->layerHandles[i], (float)bindTexs[i]->GetArrayLayer() );
+			}
+			else
+			{
+				bindTexTargets[i] = GL_TEXTURE_2D;
+				shader->BindAndEnableTextureByHandle( v->texHandles[i], bindTexs[i]->TextureID(), GL_TEXTURE0+i, GL_TEXTURE_2D );
+			}
+		}
+	for (unsigned int i=0; i<bindConstNames.Size(); i++)
+		if (bindConstColors[i])
+			shader->SetParameterByHandlev( v->constHandles[i], 4, bindConstColors[i]->GetDataPtr() );
+	for (unsigned int i=0; i<bindSHNames.Size(); i++)
+		for (int j=0; j<SH_NUM_COEFFS; j++)
+			shader->SetParameterByHandlev( v->shHandles[i*SH_NUM_COEFFS+j], 3, (float *)bindSHCoeffs[i] + 3*j );
+	for (unsigned int i=0; i<bindVTNames.Size(); i++)
+	{
+		float info[4], tile[4], size[4];
+		bindVTs[i]->GetShaderConstants( info, tile, size );
+		shader->BindAndEnableTextureByHandle( v->vtHandles[5*i+0], bindVTs[i]->GetPageTableID(), GL_TEXTURE0+bindVTUnits[i], GL_TEXTURE_2D );
+		shader->BindAndEnableTextureByHandle( v->vtHandles[5*i+1], bindVTs[i]->GetCacheID(), GL_TEXTURE0+bindVTUnits[i]+1, GL_TEXTURE_2D );
+		shader->SetParameterByHandlev( v->vtHandles[5*i+2], 4, info );
+		shader->SetParameterByHandlev( v->vtHandles[5*i+3], 4, tile );
+		shader->SetParameterByHandlev( v->vtHandles[5*i+4], 4, size );
+	}
+
+	// The feedback pass draws with color writes off, except for us
+	if (usingVTFeedback)
+		glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
+
+	// The light intensity and lights come from frameConstants.glsl (the
+	//    per-frame uniform block, or gl_LightSource without one), and the
+	//    shadowed permutation is compiled with USE_SHADOW_MAP
 	if (usingShadows)
 		SetupShadowMap( GL_TEXTURE7, s->GetShadowMapID(), s->GetShadowMapTransposeMatrix() );
-	else
-		shader->SetParameter( "useShadowMap", 0 );
 }
 
 void GLSLShaderMaterial::Disable( void )
 {
-	if (!shader) return;
+	if (!variant[0]) return;
+	if (activeFallback)
+	{
+		activeFallback->Disable();
+		activeFallback = 0;
+		return;
+	}
 
 	if (usingShadows) DisableShadowMap( GL_TEXTURE7 );
+	for (unsigned int i=0; i<bindTexNames.Size(); i++)
+		if (bindTexNames[i])
+			shader->DisableTexture( GL_TEXTURE0+i, bindTexTargets[i] );
+	for (unsigned int i=0; i<bindVTNames.Size(); i++)
+	{
+		shader->DisableTexture( GL_TEXTURE0+bindVTUnits[i], GL_TEXTURE_2D );
+		shader->DisableTexture( GL_TEXTURE0+bindVTUnits[i]+1, GL_TEXTURE_2D );
+	}
+	if (usingVTFeedback)
+		glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
 	shader->DisableShader();
 }
 
 
 GLSLShaderMaterial::GLSLShaderMaterial( char *matlName ) : 
 	Material( matlName ), shader(0), propertyFlags(SHADERMATL_NO_SPECIAL_BITS),
-	vertFile(0), geomFile(0), fragFile(0)
+	vertFile(0), geomFile(0), fragFile(0), usingVTFeedback(false),
+	preprocessed(false), activeFallback(0), compileSubmitTime(0), reportedReady(false)
 {
-	
+	variant[0] = variant[1] = variant[2] = 0;
 }
 
 GLSLShaderMaterial::~GLSLShaderMaterial()
 {
-	if (shader) delete shader;
+	// The programs belong to the scene (and may be shared), not to us
+	if (variant[0]) delete variant[0];
+	if (variant[1]) delete variant[1];
+	if (variant[2]) delete variant[2];
 	if (vertFile) free( vertFile );
 	if (geomFile) free( geomFile );
 	if (fragFile) free( fragFile );
 	for (unsigned int i=0; i<bindNames.Size();i++)
 		free( bindNames[i] );
+	for (unsigned int i=0; i<bindSHNames.Size();i++)
+		free( bindSHNames[i] );
+	for (unsigned int i=0; i<bindVTNames.Size();i++)
+		free( bindVTNames[i] );
 }
 
 
@@ -98,14 +202,20 @@ GLSLShaderMaterial::GLSLShaderMaterial( FILE *f, Scene *s ) :
 	vertFile(0), geomFile(0), fragFile(0), geomSettingsUpdated(false),
 	geomInputType(GL_TRIANGLES), geomOutputType(GL_TRIANGLE_STRIP),
 	geomMaxEmittedVerts(0), enables(GLSL_NO_SPECIAL_STATE),
-	disables(GLSL_NO_SPECIAL_STATE)
+	disables(GLSL_NO_SPECIAL_STATE), usingVTFeedback(false),
+	preprocessed(false), activeFallback(0), compileSubmitTime(0), reportedReady(false)
 {
+	variant[0] = variant[1] = variant[2] = 0;
 	bindTexNames.SetSize( 8 );
 	bindTexs.SetSize( 8 );
+	bindTexArrays.SetSize( 8 );
+	bindTexTargets.SetSize( 8 );
 	for (unsigned int i=0; i<bindTexNames.Size();i++)
 	{
 		bindTexNames[i] = 0;
 		bindTexs[i] = 0;
+		bindTexArrays[i] = false;
+		bindTexTargets[i] = GL_TEXTURE_2D;
 	}
 
 	// Search the scene file.
@@ -203,8 +313,11 @@ GLSLShaderMaterial::GLSLShaderMaterial( FILE *f, Scene *s ) :
 				bindConstNames.Add( strdup( shaderVarName ) );
 				unsigned int idx = bindConstColors.Add( new Color( ptr ) );
 			}
-			else if (!strcmp(token, "tex"))
-			{ // Bind a texture
+			else if (!strcmp(token, "tex") || !strcmp(token, "texarray"))
+			{ // Bind a texture.  With "texarray", the shader's sampler is a
+			  //    sampler2DArray, and a float uniform named <sampler>Layer 
+			  //    says which layer has the texture.
+				bool fromArray = !strcmp(token, "texarray");
 				ptr = StripLeadingTokenToBuffer( ptr, token );
 				unsigned int texID = atoi(token);
 				if (texID < 0 || texID > bindTexNames.Size())
@@ -224,8 +337,42 @@ GLSLShaderMaterial::GLSLShaderMaterial( FILE *f, Scene *s ) :
 									   TEXTURE_REPEAT_S | TEXTURE_REPEAT_T | TEXTURE_MIN_LINEAR_MIP_LINEAR, 
 									   true ) );
 				bindTexs[texID] = tptr;
+				bindTexArrays[texID] = fromArray;
+				if (fromArray) tptr->RequestArrayLayer();
 				if (texFile) free( texFile );
 			}
+			else if (!strcmp(token, "shirradiance"))
+			{ // Bind the diffuse lighting from an HDR environment map, as a
+			  //    uniform vec3 array of SH coefficients
+				ptr = StripLeadingTokenToBuffer( ptr, token );
+				char *mapFile = s->paths->GetTexturePath( token );
+				const float *coeffs = shIrradiance.Get( mapFile ? mapFile : token );
+				if (coeffs)
+				{
+					bindSHNames.Add( strdup( shaderVarName ) );
+					bindSHCoeffs.Add( coeffs );
+				}
+				else Error("Unable to compute irradiance from '%s'!", token);
+				if (mapFile) free( mapFile );
+			}
+			else if (!strcmp(token, "vtex"))
+			{ // Bind a virtual texture (see Utils/virtualTexture.h).  Its page
+			  //    table and tile cache use texture units <unit> and <unit>+1.
+				ptr = StripLeadingTokenToBuffer( ptr, token );
+				int unit = atoi(token);
+				if (unit < 0 || unit > 5)
+					FatalError("Invalid texture unit for virtual texture loading shader: %s", token);
+				ptr = StripLeadingTokenToBuffer( ptr, token );
+				char *vtFile = s->paths->GetTexturePath( token );
+				VirtualTexture *vt = s->GetVirtualTextures()->Add( vtFile ? vtFile : token );
+				if (vt)
+				{
+					bindVTNames.Add( strdup( shaderVarName ) );
+					bindVTUnits.Add( unit );
+					bindVTs.Add( vt );
+				}
+				if (vtFile) free( vtFile );
+			}
 			else if (!strcmp(token, "vary"))
 			{ // Bind a variable defined earlier in the scene file
 				ptr = StripLeadingTokenToBuffer( ptr, token );
@@ -249,26 +396,139 @@ GLSLShaderMaterial::GLSLShaderMaterial( FILE *f, Scene *s ) :
 
 
 
-void GLSLShaderMaterial::Preprocess( Scene *s )
+// Which optional shader features does this material need?  (Shadows are
+//    chosen when enabled, so aren't included.)
+unsigned int GLSLShaderMaterial::GetFeatureBits( Scene *s )
 {
-	shader = new GLSLProgram( vertFile, geomFile, fragFile, true, shaderPath );
-	shader->SetProgramEnables( enables );
-	shader->SetProgramDisables( disables );
+	unsigned int features = SHADER_FEATURE_LIGHTS( s->GetNumLights() );
+	for (unsigned int i=0; i<bindTexNames.Size(); i++)
+		if (bindTexNames[i]) features |= SHADER_FEATURE_TEXTURED;
+	if (enables & GLSL_ALPHA_TEST) features |= SHADER_FEATURE_ALPHA_TEST;
+	if (s->HasFrameConstants()) features |= SHADER_FEATURE_FRAME_CONSTANTS;
+	return features;
+}
+
+// Find (or start building) the program for one permutation of our shader.
+GLSLShaderVariant *GLSLShaderMaterial::GetVariant( Scene *s, char *baseKey, unsigned int features )
+{
+	GLSLShaderVariant *v = new GLSLShaderVariant();
+	v->program = shaderPermutations.Find( baseKey, features );
+	if (v->program) return v;
+
+	char defines[256];
+	ShaderPermutationCache::BuildDefines( features, defines );
+	v->program = new GLSLProgram( true, shaderPath );
+	v->program->SetPreamble( defines );
+	if (vertFile) v->program->SetVertexShader( vertFile );
+	if (geomFile) v->program->SetGeometryShader( geomFile );
+	if (fragFile) v->program->SetFragmentShader( fragFile );
 	if (geomSettingsUpdated) 
+		v->program->GeometryShaderSettings( geomInputType, geomMaxEmittedVerts, geomOutputType );
+	v->program->SetProgramEnables( enables );
+	v->program->SetProgramDisables( disables );
+	v->program->StartLink();
+
+	shaderPermutations.Add( baseKey, features, v->program );
+	s->AddShader( v->program );
+	return v;
+}
+
+// Load the shader files and hand them to the driver, without waiting for
+//    the compiler.  Materials using the same files, state, and features 
+//    share programs, so only the first of them compiles anything.
+void GLSLShaderMaterial::StartShaderCompiles( Scene *s )
+{
+	if (variant[0]) return;
+
+	// Everything baked into the program, other than the feature bits
+	char baseKey[1024];
+	sprintf( baseKey, "%s|%s|%s|%x|%x|%x|%x|%d", 
+		     vertFile ? vertFile : "", geomFile ? geomFile : "", fragFile ? fragFile : "",
+			 enables, disables, geomSettingsUpdated ? geomInputType : 0, 
+			 geomSettingsUpdated ? geomOutputType : 0, geomSettingsUpdated ? geomMaxEmittedVerts : 0 );
+
+	reportedReady = false;
+	GetHighResolutionTime( &compileStart );
+	unsigned int features = GetFeatureBits( s );
+	variant[0] = GetVariant( s, baseKey, features );
+	if (propertyFlags & SHADERMATL_ALLOWS_SHADOWMAPUSE)
+		variant[1] = GetVariant( s, baseKey, features | SHADER_FEATURE_SHADOWED );
+	if (bindVTNames.Size() > 0)
+		variant[2] = GetVariant( s, baseKey, features | SHADER_FEATURE_VT_FEEDBACK );
+	shader = variant[0]->program;
+
+	TimerStruct now;
+	GetHighResolutionTime( &now );
+	compileSubmitTime = ConvertTimeDifferenceToSec( &now, &compileStart );
+	if (!shader->IsLinkPending()) ReportShaderReady( s );
+}
+
+// Print how long this material's shader took, from submitting it until 
+//    it was found to be ready (so this includes time spent waiting to be
+//    polled, which is at most a frame).  Every material reports once, even
+//    if it shares its program with others.
+void GLSLShaderMaterial::ReportShaderReady( Scene *s )
+{
+	reportedReady = true;
+	if (!s->IsVerbose()) return;
+
+	TimerStruct now;
+	GetHighResolutionTime( &now );
+	printf("    (-) Shader for material '%s' %s: %.2f ms to submit, ready after %.2f ms\n",
+		   GetName() ? GetName() : "<unnamed>", 
+		   shader->IsLinked() ? "linked" : "FAILED",
+		   1000.0f*compileSubmitTime, 
+		   1000.0f*ConvertTimeDifferenceToSec( &now, &compileStart ) );
+}
+
+void GLSLShaderMaterial::Preprocess( Scene *s )
+{
+	// Normally the scene already did this, but be safe if called alone
+	if (!variant[0]) StartShaderCompiles( s );
+	preprocessed = true;
+
+	// Look up all our uniforms now, so Enable() never searches by name.
+	for (int j=0; j<3; j++)
 	{
-		shader->GeometryShaderSettings( geomInputType, geomMaxEmittedVerts, geomOutputType );
-		shader->LinkProgram();
-	}
-	for (unsigned int i=0; i<bindNames.Size(); i++)
-		shader->SetupAutomaticBinding( bindNames[i], 1, bindPtrs[i] );
-	for (unsigned int i=0; i<bindTexNames.Size(); i++)
-		if (bindTexNames[i])
-			shader->SetupAutomaticTextureBinding( bindTexNames[i], bindTexs[i]->TextureID(), GL_TEXTURE0+i, GL_TEXTURE_2D );
-	for (unsigned int i=0; i<bindConstNames.Size(); i++)
-		if (bindConstColors[i])
-			shader->SetupAutomaticBinding( bindConstNames[i], 4, bindConstColors[i]->GetDataPtr() );
+		GLSLShaderVariant *v = variant[j];
+		if (!v) continue;
+		for (unsigned int i=0; i<bindNames.Size(); i++)
+			v->floatHandles.Add( v->program->GetParameterHandle( bindNames[i] ) );
+		for (unsigned int i=0; i<bindTexNames.Size(); i++)
+		{
+			v->texHandles.Add( bindTexNames[i] ? v->program->GetParameterHandle( bindTexNames[i] ) : -1 );
+			int layerHandle = -1;
+			if (bindTexNames[i] && bindTexArrays[i])
+			{
+				char layerName[256];
+				sprintf( layerName, "%.250sLayer", bindTexNames[i] );
+				layerHandle = v->program->GetParameterHandle( layerName );
+			}
+			v->layerHandles.Add( layerHandle );
+		}
+		for (unsigned int i=0; i<bindConstNames.Size(); i++)
+			v->constHandles.Add( v->program->GetParameterHandle( bindConstNames[i] ) );
+		for (unsigned int i=0; i<bindSHNames.Size(); i++)
+			for (int k=0; k<SH_NUM_COEFFS; k++)
+			{
+				char elemName[256];
+				sprintf( elemName, "%.240s[%d]", bindSHNames[i], k );
+				v->shHandles.Add( v->program->GetParameterHandle( elemName ) );
+			}
+		for (unsigned int i=0; i<bindVTNames.Size(); i++)
+		{
+			static const char *suffix[5] = { "PageTable", "Cache", "Info", "Tile", "Size" };
+			for (int k=0; k<5; k++)
+			{
+				char vtName[256];
+				sprintf( vtName, "%.240s%s", bindVTNames[i], suffix[k] );
+				v->vtHandles.Add( v->program->GetParameterHandle( vtName ) );
+			}
+		}
 
-	s->AddShader( shader );
+		// Shaders declaring the per-frame uniform block read the scene's buffer
+		v->program->BindUniformBlock( "FrameConstants", FRAME_CONSTANTS_BINDING );
+	}
 }
 
 
@@ -18,9 +18,12 @@
 #include "Material.h"
 #include "DataTypes/Array1D.h"
 #include "DataTypes/Color.h"
+#include "Utils/HighResolutionTimer.h"
 
 class GLTexture;
 class Scene;
+class GLSLShaderVariant;
+class VirtualTexture;
 
 #pragma warning( disable: 4996 )
 
@@ -45,8 +48,15 @@ private:
 	Array1D<float *> bindPtrs;
 	Array1D<char *>      bindTexNames;
 	Array1D<GLTexture *> bindTexs;
+	Array1D<bool>        bindTexArrays;   // Bound with "texarray"?
+	Array1D<GLenum>      bindTexTargets;  // What Enable() bound each to
 	Array1D<char *>	 bindConstNames;
 	Array1D<Color *> bindConstColors;
+	Array1D<char *>        bindSHNames;     // vec3[9] irradiance arrays (see Utils/shIrradiance.h)
+	Array1D<const float *> bindSHCoeffs;
+	Array1D<char *>          bindVTNames;   // Virtual textures (see Utils/virtualTexture.h)
+	Array1D<int>             bindVTUnits;   //    and the first of their two texture units
+	Array1D<VirtualTexture *> bindVTs;
 
 	unsigned int enables, disables;
 	bool geomSettingsUpdated;
@@ -54,7 +64,24 @@ private:
 	int geomMaxEmittedVerts;
 	char *vertFile, *geomFile, *fragFile;
 
-	bool usingShadows, usingCaustics;
+	bool usingShadows, usingCaustics, usingVTFeedback;
+
+	// Programs come from the shared permutation cache (see Utils/shaderPermutationCache.h).
+	//    variant[0] is compiled without shadow maps, variant[1] with (if allowed),
+	//    and variant[2] for the virtual texture feedback pass (if we use any).
+	//    'shader' points to whichever program was last enabled.
+	GLSLShaderVariant *variant[3];
+	unsigned int GetFeatureBits( Scene *s );
+	GLSLShaderVariant *GetVariant( Scene *s, char *baseKey, unsigned int features );
+
+	// The shaders compile in the background (see StartShaderCompiles()).  
+	//    Until they are ready, Enable() uses the scene's default material.
+	bool preprocessed;
+	Material *activeFallback;
+	TimerStruct compileStart;
+	float compileSubmitTime;
+	bool reportedReady;
+	void ReportShaderReady( Scene *s );
 
 	void SetupShadowMap( GLenum texUnit, GLuint texID, float *matrix );
 	void DisableShadowMap( GLenum texUnit );
@@ -88,8 +115,9 @@ public:
 	virtual GLTexture *GetMaterialTexture( void )		{ return NULL; }
 	virtual GLSLProgram *GetMaterialShader( void )		{ return shader; }
 
-	virtual bool NeedsPreprocessing( void )				{ return shader==NULL; }
+	virtual bool NeedsPreprocessing( void )				{ return !preprocessed; }
 	virtual void Preprocess( Scene *s );
+	virtual void StartShaderCompiles( Scene *s );
 
 };
 
@@ -25,6 +25,7 @@ class Scene;
 #define MATL_FLAGS_NONE					0x00000000
 #define MATL_FLAGS_USESHADOWMAP			0x00000001
 #define MATL_FLAGS_USECAUSTICMAP		0x00000002
+#define MATL_FLAGS_VTFEEDBACK			0x00000004   // Virtual texture feedback pass (Utils/virtualTexture.h)
 
 
 
@@ -50,6 +51,11 @@ public:
 	virtual bool NeedsPreprocessing( void )				{ return false; }
 	virtual void Preprocess( Scene * )                  { }
 
+	// Materials with shaders may start compiling them here, before anything
+	//   else in the scene is preprocessed, so the driver's compiler works 
+	//   while textures and meshes load.  Preprocess() is still called later.
+	virtual void StartShaderCompiles( Scene * )         { }
+
 	// Get or set the name of the material
 	inline char *GetName( void )                 { return name; }
 	inline void SetName( const char *newName )   { if (name) free (name);  name = strdup(newName); }
@@ -14,6 +14,7 @@
 #include "Utils/ModelIO/glm.h"
 #include "Scene/Scene.h"
 #include "Utils/ModelIO/SimpleModelLib.h"
+#include "Utils/glStateCache.h"
 
 #define BUFFER_OFFSET(x)   ((GLubyte*) NULL + (x))
 
@@ -165,24 +166,33 @@ void Mesh::Draw( Scene *s, unsigned int matlFlags, unsigned int optionFlags, boo
 	                displayListID );
 	else if (renderMode == MESH_RENDER_AS_VBO_VERTEX_ARRAY)	
 	{
+		// The half-edge library binds (and unbinds) its own buffers directly.
 		if (hem && !(optionFlags & OBJECT_OPTION_USE_LOWRES) )
+		{
 			hem->CallVBO( USE_TRIANGLES );
+			glState.Invalidate( GLSTATE_BUFFERS | GLSTATE_CLIENT_ARRAYS );
+		}
 		else if (hem_lowRes && (optionFlags & OBJECT_OPTION_USE_LOWRES))
+		{
 			hem_lowRes->CallVBO( USE_TRIANGLES );
+			glState.Invalidate( GLSTATE_BUFFERS | GLSTATE_CLIENT_ARRAYS );
+		}
 		else
 		{
-			glBindBuffer( GL_ARRAY_BUFFER, 
+			// Buffers are left bound after drawing, so consecutive draws of this 
+			//    mesh do not rebind them.  The vertex arrays are disabled, though,
+			//    as they would otherwise continue to point into our buffers.
+			glState.BindBuffer( GL_ARRAY_BUFFER, 
 				(optionFlags & OBJECT_OPTION_USE_LOWRES) ? interleavedVertDataVBO_low : interleavedVertDataVBO );
 			glInterleavedArrays( GL_N3F_V3F, 0, BUFFER_OFFSET(0) );
-			glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 
+			glState.Invalidate( GLSTATE_CLIENT_ARRAYS );  // glInterleavedArrays() changes these
+			glState.BindBuffer( GL_ELEMENT_ARRAY_BUFFER, 
 				(optionFlags & OBJECT_OPTION_USE_LOWRES) ? elementVBO_low : elementVBO );
 			glDrawElements( GL_TRIANGLES, 
 				(optionFlags & OBJECT_OPTION_USE_LOWRES) ? elementCount_low : elementCount, 
 				GL_UNSIGNED_INT, BUFFER_OFFSET(0) );
-			glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
-			glBindBuffer( GL_ARRAY_BUFFER, 0 );
-			glDisableClientState( GL_VERTEX_ARRAY );
-			glDisableClientState( GL_NORMAL_ARRAY );
+			glState.DisableClientState( GL_VERTEX_ARRAY );
+			glState.DisableClientState( GL_NORMAL_ARRAY );
 		}
 	}
 
@@ -31,6 +31,17 @@
 #include "Utils/ProgramPathLists.h"
 #include "Interface/SceneFileDefinedInteraction.h"
 #include "Utils/Trackball.h"
+#include "Utils/programBinaryCache.h"
+#include "Utils/shaderSourceCache.h"
+#include "Utils/shaderHotReload.h"
+#include "Utils/textureStreamer.h"
+#include "Utils/textureBudget.h"
+#include "Utils/textureArrayBuilder.h"
+#include "Utils/shaderPermutationCache.h"
+#include "Utils/textureCompressor.h"
+#include "Utils/shIrradiance.h"
+#include "Utils/virtualTexture.h"
+#include "Utils/parallelFor.h"
 
 // This is a big hack...  Sometimes the global scene pointer
 //    is needed before the Scene( filename ) constructor returns...
@@ -56,6 +67,8 @@ void Scene::SetupDefaultScenePaths( void )
 Scene::Scene() : 
 	camera(0), geometry(0),
 	screenWidth(256), screenHeight(256), 
+	frameUBO(0), frameData(0), hotReload(0), texStreamer(0), texBudget(0), texArrays(0),
+	virtualTextures(0),
 	verbose(true), sceneFileDataAccessed(false)
 {
 	paths = new ProgramSearchPaths();
@@ -69,6 +82,13 @@ Scene::~Scene()
 {
 	if (camera) delete camera;
 	if (geometry) delete geometry;
+	if (frameUBO) delete frameUBO;
+	if (frameData) free( frameData );
+	if (hotReload) delete hotReload;
+	if (texBudget) delete texBudget;
+	if (texArrays) delete texArrays;
+	if (texStreamer) delete texStreamer;
+	if (virtualTextures) delete virtualTextures;
 }
 
 // Set the camera to a new camera.
@@ -87,6 +107,73 @@ void Scene::SetupEnabledLightsWithCurrentModelview( void )
 			light[i]->SetLightUsingCurrentTransforms();
 }
 
+// Copy a color into a vec4 of the per-frame uniform buffer
+static void CopyFrameColor( float *dst, const Color &c )
+{
+	dst[0] = c.Red(); dst[1] = c.Green(); dst[2] = c.Blue(); dst[3] = c.Alpha();
+}
+
+// Gather the camera and light data every shader may want into one block
+//    and upload it to the current buffer in the ring.  This replaces dozens
+//    of glUniform*() calls per shader per frame with a single upload.
+void Scene::UpdateFrameConstants( void )
+{
+	if (!frameUBO || !frameUBO->IsValid()) return;
+
+	glGetFloatv( GL_MODELVIEW_MATRIX, frameData->viewMatrix );
+	glGetFloatv( GL_PROJECTION_MATRIX, frameData->projectionMatrix );
+
+	Matrix4x4 view( frameData->viewMatrix );
+	Matrix4x4 invView = view.Invert();
+	memcpy( frameData->inverseViewMatrix, invView.GetDataPtr(), 16*sizeof(float) );
+
+	// The eye sits at the origin of eye space
+	Point eye = invView * Point( 0, 0, 0 );
+	frameData->eyePosition[0] = eye.X();
+	frameData->eyePosition[1] = eye.Y();
+	frameData->eyePosition[2] = eye.Z();
+	frameData->eyePosition[3] = 1;
+
+	// We store the shadow map matrix transposed, shaders want it in GL order
+	Matrix4x4 shadMat = Matrix4x4( shadMapTransMatrix ).Transpose();
+	memcpy( frameData->shadowMatrix, shadMat.GetDataPtr(), 16*sizeof(float) );
+
+	// Pack the enabled lights.  Unlike fixed-function GL, these are not
+	//    limited to 8, only by FRAME_MAX_LIGHTS.
+	int numLights = 0;
+	for (unsigned int i=0; i<light.Size() && numLights < FRAME_MAX_LIGHTS; i++)
+	{
+		if (!light[i]->IsEnabled()) continue;
+		FrameLightData *l = &frameData->light[numLights++];
+
+		Point lPos = view * light[i]->GetCurrentPos();
+		l->position[0] = lPos.X();
+		l->position[1] = lPos.Y();
+		l->position[2] = lPos.Z();
+		l->position[3] = light[i]->GetOriginalPos().GetElement( 3 );  // 0 for directional lights
+
+		Vector lDir = view * light[i]->GetSpotDirection();
+		l->spotDirection[0] = lDir.X();
+		l->spotDirection[1] = lDir.Y();
+		l->spotDirection[2] = lDir.Z();
+		l->spotDirection[3] = cos( light[i]->GetSpotCutoff() * M_PI / 180.0 );
+
+		CopyFrameColor( l->ambient,  light[i]->GetAmbient() );
+		CopyFrameColor( l->diffuse,  light[i]->GetDiffuse() );
+		CopyFrameColor( l->specular, light[i]->GetSpecular() );
+
+		l->attenuation[0] = light[i]->GetAttenuation( 0 );
+		l->attenuation[1] = light[i]->GetAttenuation( 1 );
+		l->attenuation[2] = light[i]->GetAttenuation( 2 );
+		l->attenuation[3] = light[i]->GetSpotExponent();
+	}
+	frameData->lightInfo[0] = (float)numLights;
+	frameData->lightInfo[1] = GetLightIntensityModifier();
+	frameData->lightInfo[2] = frameData->lightInfo[3] = 0;
+
+	frameUBO->Update( frameData, FRAME_CONSTANTS_SIZE( numLights ) );
+}
+
 // This is called by the scene constructor.  You should never
 //    need to call this
 void Scene::SetupLightTrackball( int i, Trackball *ball )
@@ -158,7 +245,9 @@ void Scene::UnhandledKeyword( FILE *f, char *typeString, char *keyword )
 
 // A constructor to read a scene from a file
 Scene::Scene( char *filename, bool verbose ) : 
-	camera(0), geometry(0), screenWidth(256), screenHeight(256), verbose(verbose),
+	camera(0), geometry(0), screenWidth(256), screenHeight(256), 
+	frameUBO(0), frameData(0), hotReload(0), texStreamer(0), texBudget(0), texArrays(0),
+	virtualTextures(0), verbose(verbose),
 	sceneFileDataAccessed(false)
 {
 	// HACK!
@@ -275,10 +364,25 @@ Scene::Scene( char *filename, bool verbose ) :
 			{
 				char file[256];
 				ptr = StripLeadingTokenToBuffer( ptr, file );
+
+				// Optional keywords choose how mipmaps are built, and "nostream"
+				//    loads the texture before the first frame (see Preprocess())
+				unsigned int flags = TEXTURE_MIN_NEAR_MIP_NEAR | TEXTURE_STREAM;
+				char option[256];
+				ptr = StripLeadingTokenToBuffer( ptr, option );
+				while (option[0])
+				{
+					MakeLower( option );
+					if (!strcmp(option,"kaiser"))                                      flags |= TEXTURE_MIP_KAISER;
+					else if (!strcmp(option,"linear") || !strcmp(option,"normalmap"))  flags |= TEXTURE_MIP_LINEAR_DATA;
+					else if (!strcmp(option,"cutout"))                                 flags |= TEXTURE_MIP_PRESERVE_COVERAGE;
+					else if (!strcmp(option,"nostream"))                               flags &= ~TEXTURE_STREAM;
+					else Warning("Unknown texture option '%s' ignored!", option);
+					ptr = StripLeadingTokenToBuffer( ptr, option );
+				}
+
 				char *fullPath = paths->GetTexturePath( file );
-				GLTexture *tex = new GLTexture( fullPath, 
-					                            TEXTURE_MIN_NEAR_MIP_NEAR, 
-												true ); 
+				GLTexture *tex = new GLTexture( fullPath, flags, true ); 
 				tex->SetName( token );
 				free( fullPath );
 				fileTextures.Add( tex );
@@ -535,16 +639,61 @@ bool *Scene::GetSceneBoolVar  ( char *varName )
 	return 0;
 }
 
+// Once per frame, rebuild shaders whose files changed on disk, and swap in
+//    any rebuilds that have finished (see Utils/shaderHotReload.h).
+void Scene::UpdateShaderHotReload( void )
+{
+	if (hotReload) hotReload->Update( fileShaders );
+}
+
+void Scene::UpdateTextureStreaming( void )
+{
+	if (texBudget) texBudget->Update();
+	if (texStreamer && texStreamer->Update() && verbose)
+	{
+		printf("(-) ");
+		texStreamer->PrintStats( stdout );
+		if (texBudget)
+		{
+			printf("(-) ");
+			texBudget->PrintStats( stdout );
+		}
+	}
+}
+
+VirtualTextureManager *Scene::GetVirtualTextures( void )
+{
+	if (!virtualTextures) virtualTextures = new VirtualTextureManager();
+	return virtualTextures;
+}
+
+void Scene::UpdateVirtualTextures( void )
+{
+	if (virtualTextures) virtualTextures->Update( this );
+}
+
 // Reload all the shaders specified in the file.
 bool Scene::ReloadShaders( void )
 {
 	bool ok = true;
+
+	// Shared headers are only re-read once (and only if they changed), but
+	//    someone may have added a file that changes what an #include finds.
+	shaderSources.ForgetResolvedPaths();
 	for (unsigned int i=0; i<fileShaders.Size(); i++)
 		ok &= fileShaders[i]->ReloadShaders();
 	return ok;
 }
 
 
+// ParallelFor() callback:  the CPU side of setting up textures [first,last)
+static void PrepareTextureRange( int first, int last, void *data )
+{
+	Array1D<GLTexture *> *textures = (Array1D<GLTexture *> *)data;
+	for (int i=first; i < last; i++)
+		(*textures)[i]->PrepareImage();
+}
+
 // Some stuff cannot be done when the scene is initially loaded
 //   (e.g., texture setup).  This stuff needs to be done after the GL
 //   context is created.  The preprocess allows all scene objects a
@@ -559,17 +708,86 @@ void Scene::Preprocess( void )
 	gluQuadricTexture    ( quadObj, GLU_TRUE );
 
 	printf("(+) Preprocessing scene...\n");
+
+	// Shaders are compiled to read the per-frame uniform buffer only if
+	//    there is one, so make it first
+	if (GLEW_ARB_uniform_buffer_object)
+	{
+		if (verbose) printf("    (-) Creating per-frame uniform buffers...\n");
+		frameData = (FrameConstants *)calloc( 1, sizeof( FrameConstants ) );
+		frameUBO  = new UniformBufferRing( FRAME_CONSTANTS_BINDING, sizeof( FrameConstants ) );
+	}
+	else if (verbose)
+		printf("    (-) No uniform buffers, shaders will read the fixed-function lights...\n");
+
+	// Get the shader compiler going first, so it runs in parallel with 
+	//    the (CPU-bound) geometry and texture setup below.  Shaders that 
+	//    are still compiling when we start drawing are polled every frame,
+	//    and objects use the default material until they're ready.
+	if (verbose) printf("    (-) Submitting shaders for compilation...\n");
+	if (GLEW_KHR_parallel_shader_compile)
+		glMaxShaderCompilerThreadsKHR( 0xFFFFFFFF );
+	for (unsigned int i=0; i<fileMaterials.Size(); i++)
+		fileMaterials[i]->StartShaderCompiles( this );
+
 	if (verbose) printf("    (-) Preprocessing scene geometry...\n");
 	geometry->Preprocess( this );
 	if (verbose) printf("    (-) Setting up scene textures...\n");
+	ParallelFor( fileTextures.Size(), PrepareTextureRange, &fileTextures );
+	texArrays = new TextureArrayBuilder();
+	for (unsigned int i=0; i<fileTextures.Size(); i++)
+		if (fileTextures[i]->WantsArrayLayer())
+			texArrays->Add( fileTextures[i] );
+	texArrays->Build();
+	texStreamer = new TextureStreamer();
 	for (unsigned int i=0; i<fileTextures.Size(); i++)
+	{
 		fileTextures[i]->Preprocess();
+		if (fileTextures[i]->IsStreamed())
+			texStreamer->Add( fileTextures[i] );
+	}
+	int *budgetMB = GetSceneIntVar( "texturebudgetmb" );
+	texBudget = new TextureBudget( budgetMB && *budgetMB > 0 ? (size_t)*budgetMB * 1048576 : 0, texStreamer );
+	for (unsigned int i=0; i<fileTextures.Size(); i++)
+		texBudget->Add( fileTextures[i] );
+	if (virtualTextures)
+		virtualTextures->Preprocess( screenWidth, screenHeight );
 	if (verbose) printf("    (-) Checking if materials need preprocessing...\n");
 	for (unsigned int i=0; i<fileMaterials.Size(); i++)
 	{
 		if (fileMaterials[i]->NeedsPreprocessing()) 
 			fileMaterials[i]->Preprocess( this );
 	}
+	if (verbose) 
+	{
+		printf("    (-) ");
+		programCache.PrintStats( stdout );
+		printf("    (-) ");
+		shaderSources.PrintStats( stdout );
+		printf("    (-) ");
+		shaderPermutations.PrintStats( stdout );
+		printf("    (-) ");
+		compressedTextures.PrintStats( stdout );
+		if (shIrradiance.GetNumMaps() > 0)
+		{
+			printf("    (-) ");
+			shIrradiance.PrintStats( stdout );
+		}
+		printf("    (-) ");
+		GLTexture::PrintMemoryStats( stdout );
+		if (texArrays->GetNumArrays() > 0)
+		{
+			printf("    (-) ");
+			texArrays->PrintStats( stdout );
+		}
+		if (virtualTextures && virtualTextures->GetNumTextures() > 0)
+		{
+			printf("    (-) ");
+			virtualTextures->PrintStats( stdout );
+		}
+	}
+	hotReload = new ShaderHotReloader();
+
 	if (verbose) printf("(+) Done with Scene::Preprocess()!\n");
 
 	gluDeleteQuadric( quadObj );
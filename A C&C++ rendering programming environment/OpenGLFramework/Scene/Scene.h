@@ -25,9 +25,16 @@
 #include "Utils/ProgramPathLists.h"
 #include "Utils/Trackball.h"
 #include "Utils/glslProgram.h"
+#include "Utils/uniformBufferRing.h"
+#include "Scene/frameConstants.h"
 
 
 class FrameBuffer;
+class ShaderHotReloader;
+class TextureStreamer;
+class TextureBudget;
+class TextureArrayBuilder;
+class VirtualTextureManager;
 
 class Scene {
 /****************************************************************************/
@@ -67,6 +74,12 @@ public:
 	//   Usually this is called *immediately* after either of those functions.
 	void SetupEnabledLightsWithCurrentModelview( void );
 
+	// Fill the per-frame uniform buffer (see Scene/frameConstants.h) with the
+	//   current camera matrices, shadow map matrix, and all enabled lights.
+	//   Like the function above, call this right after LookAtMatrix(), with
+	//   the camera's projection and modelview matrices still current.
+	void UpdateFrameConstants( void );
+
 	// Draw all the geometry in the scene
 	inline void Draw( unsigned int matlFlags=MATL_FLAGS_NONE,      // Any special instructions for geometry materials?
 		              unsigned int optionFlags=OBJECT_OPTION_NONE, // Any optional instructions (e.g., use low res model)
@@ -124,6 +137,23 @@ public:
 	//   "reload-shaders" UI command, but you may need to call it at other times.
 	bool ReloadShaders( void );
 
+	// Rebuild (in the background) just the shaders whose files changed on
+	//   disk, and swap in the ones that are done.  Call at the start of
+	//   each frame.  See Utils/shaderHotReload.h.
+	void UpdateShaderHotReload( void );
+
+	// Upload more of the textures still streaming in (a few MB per frame),
+	//   and keep texture memory under the budget given by the scene file's
+	//   "texturebudgetmb" int variable (if any).  Call once per frame.  See
+	//   Utils/textureStreamer.h and Utils/textureBudget.h.
+	void UpdateTextureStreaming( void );
+
+	// Find which pages of the scene's virtual textures are on screen (by
+	//   drawing the scene small), and load and upload some more of them.
+	//   Call once per frame, after LookAtMatrix(), with the camera's
+	//   matrices still current.  See Utils/virtualTexture.h.
+	void UpdateVirtualTextures( void );
+
 
 /****************************************************************************/
 /* Functions you SHOULD NOT CALL unless you really know what you're doing,  */
@@ -143,6 +173,13 @@ public:
 	// Get the internal scene geometry.  
 	inline Group *GetGeometry( void ) const    { return geometry; }
 
+	// Should progress messages be printed?
+	inline bool IsVerbose( void ) const        { return verbose; }
+
+	// Is the per-frame uniform buffer (frameConstants.h) there to read?
+	//    Without it, shaders are compiled without USE_FRAME_CONSTANTS.
+	inline bool HasFrameConstants( void ) const { return frameUBO && frameUBO->IsValid(); }
+
 	// This is here as a stub (my research version of this code base uses this)
 	//   because removing calls to this was a bit of a pain.
 	inline float GetLightIntensityModifier( void ) const { return 1.0f; }
@@ -191,6 +228,9 @@ public:
 	Object *ExistingObjectFromFile( char *name );
 	GLLight *ExistingLightFromFile( char *name );
 
+	// Materials add their virtual textures to this (see Utils/virtualTexture.h)
+	VirtualTextureManager *GetVirtualTextures( void );
+
 	// The scene has a default material.  If a scene file does not specify
 	//    a material for a particular object, the default is used.  This
 	//    returns a pointer to this default material.
@@ -235,6 +275,26 @@ private:
 	GLuint shadowMapTexID;
 	float shadMapTransMatrix[16];
 
+	// Per-frame data shared by all shaders via a uniform buffer.  These are
+	//   only created (in Preprocess()) if ARB_uniform_buffer_object exists.
+	UniformBufferRing *frameUBO;
+	FrameConstants *frameData;
+
+	// Watches shader files for changes (created in Preprocess())
+	ShaderHotReloader *hotReload;
+
+	// Loads textures after the first frame (created in Preprocess())
+	TextureStreamer *texStreamer;
+
+	// Keeps texture memory under budget (created in Preprocess())
+	TextureBudget *texBudget;
+
+	// Texture arrays requested by materials (created in Preprocess())
+	TextureArrayBuilder *texArrays;
+
+	// Virtual textures used by materials (created when the first is loaded)
+	VirtualTextureManager *virtualTextures;
+
 /****************************************************************************/
 /* Internal data structures you may have use for.                           */
 /****************************************************************************/
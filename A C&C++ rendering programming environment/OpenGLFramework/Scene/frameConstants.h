@@ -0,0 +1,72 @@
+/******************************************************************/
+/* frameConstants.h                                               */
+/* -----------------------                                        */
+/*                                                                */
+/* The file defines the per-frame data (camera matrices, lights,  */
+/*    shadow map matrix) that the scene fills in once per frame   */
+/*    and uploads into a uniform buffer shared by all shaders.    */
+/*                                                                */
+/* The layout matches the GLSL "std140" rules, so a shader can    */
+/*    read the data by declaring (GLSL 1.40, or earlier versions  */
+/*    with #extension GL_ARB_uniform_buffer_object : enable):     */
+/*                                                                */
+/*    struct FrameLight {                                         */
+/*        vec4 position;      // Eye-space position               */
+/*        vec4 spotDirection; // Eye-space, w = cos(spot cutoff)  */
+/*        vec4 ambient, diffuse, specular;                        */
+/*        vec4 attenuation;   // const, linear, quad, spot exp.   */
+/*    };                                                          */
+/*    layout(std140) uniform FrameConstants {                     */
+/*        mat4 viewMatrix, projectionMatrix;                      */
+/*        mat4 inverseViewMatrix, shadowMatrix;                   */
+/*        vec4 eyePosition;   // World-space eye position         */
+/*        vec4 lightInfo;     // x = # lights, y = intensity mult */
+/*        FrameLight light[128];                                  */
+/*    };                                                          */
+/*                                                                */
+/* GLSLShaderMaterials bind this block to FRAME_CONSTANTS_BINDING */
+/*    automatically, if their shader declares it.                 */
+/*    The shaders in bin/shaders/normalSurfaceShaders #include    */
+/*    this declaration from frameConstants.glsl, which falls back */
+/*    to gl_LightSource when the scene compiles them without      */
+/*    USE_FRAME_CONSTANTS (no ARB_uniform_buffer_object).         */
+/******************************************************************/
+
+#ifndef __FRAMECONSTANTS_H__
+#define __FRAMECONSTANTS_H__
+
+// The uniform buffer binding point reserved for the per-frame data
+#define FRAME_CONSTANTS_BINDING    0
+
+// The number of lights in the uniform block.  Unlike fixed-function
+//    lighting, this is not limited to 8, but must match the shader's
+//    declaration (and the block must fit in GL_MAX_UNIFORM_BLOCK_SIZE,
+//    which is at least 16 KB).
+#define FRAME_MAX_LIGHTS           128
+
+typedef struct
+{
+	float position[4];
+	float spotDirection[4];
+	float ambient[4];
+	float diffuse[4];
+	float specular[4];
+	float attenuation[4];
+} FrameLightData;
+
+typedef struct
+{
+	float viewMatrix[16];
+	float projectionMatrix[16];
+	float inverseViewMatrix[16];
+	float shadowMatrix[16];
+	float eyePosition[4];
+	float lightInfo[4];
+	FrameLightData light[FRAME_MAX_LIGHTS];
+} FrameConstants;
+
+// Bytes of a FrameConstants structure that are used with 'n' lights
+#define FRAME_CONSTANTS_SIZE(n)    ( sizeof(FrameConstants) - (FRAME_MAX_LIGHTS-(n))*sizeof(FrameLightData) )
+
+#endif
+
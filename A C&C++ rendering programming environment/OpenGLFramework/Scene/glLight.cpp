@@ -107,6 +107,7 @@ void GLLight::SetAttenuation( float constant, float linear, float quadratic )
 	atten[0] = constant; 
 	atten[1] = linear; 
 	atten[2] = quadratic;
+	if (!HasFixedFunctionLight()) return;
 	glLightf( lightNum, GL_CONSTANT_ATTENUATION, atten[0] );
 	glLightf( lightNum, GL_LINEAR_ATTENUATION, atten[1] );
 	glLightf( lightNum, GL_QUADRATIC_ATTENUATION, atten[2] );
@@ -115,17 +116,18 @@ void GLLight::SetAttenuation( float constant, float linear, float quadratic )
 void GLLight::SetSpotCutoff( float degrees )
 {
 	spotCutoff = degrees;
-	glLightf( lightNum, GL_SPOT_CUTOFF, spotCutoff );
+	if (HasFixedFunctionLight()) glLightf( lightNum, GL_SPOT_CUTOFF, spotCutoff );
 }
 
 void GLLight::SetSpotExponent( float exponent ) 
 { 
 	spotExp = exponent; 
-	glLightf( lightNum, GL_SPOT_EXPONENT, spotExp );
+	if (HasFixedFunctionLight()) glLightf( lightNum, GL_SPOT_EXPONENT, spotExp );
 }
 
 void GLLight::SetLightUsingCurrentTransforms( void )
 {
+	if (!HasFixedFunctionLight()) return;
 	if (mat || ball)
 	{
 		glPushMatrix();
@@ -25,6 +25,11 @@ class Trackball;
 class Scene;
 class GLSLProgram;
 
+// OpenGL only guarantees 8 fixed-function lights (GL_LIGHT0..GL_LIGHT7).  
+//   Scenes may have more lights than this, but the extras are only visible
+//   to shaders that read the per-frame light data (see frameConstants.h).
+#define GLLIGHT_MAX_FIXED_FUNCTION   8
+
 class GLLight
 {
 private:
@@ -54,8 +59,9 @@ public:
 	GLLight( FILE *f, Scene *s );
 	~GLLight();
 
-	// Housekeeping details.  What GL light are we?
+	// Housekeeping details.  What GL light are we?  (And is there one?)
 	inline int GetLightNum( void ) const { return lightNum; }
+	inline bool HasFixedFunctionLight( void ) const { return lightNum < GL_LIGHT0 + GLLIGHT_MAX_FIXED_FUNCTION; }
 
 	// Every frame, the light position (and spot direction) may be modified by 
 	//   different modelview matrices.  In order to account for this, thie method
@@ -66,18 +72,27 @@ public:
 
 	// Functions to set various internal data.  Note:  These only call glLight*()
 	//   to set OpenGL state if the calls are not dependant on current matrix state.
-	void SetAmbient ( const Color &ambient )         { amb = ambient;   glLightfv ( lightNum, GL_AMBIENT, amb.GetDataPtr() );}
-	void SetDiffuse ( const Color &diffuse )         { dif = diffuse;   glLightfv ( lightNum, GL_DIFFUSE, dif.GetDataPtr() );}
-	void SetSpecular( const Color &specular )        { spec = specular; glLightfv ( lightNum, GL_SPECULAR, spec.GetDataPtr() );}
+	void SetAmbient ( const Color &ambient )         { amb = ambient;   if (HasFixedFunctionLight()) glLightfv ( lightNum, GL_AMBIENT, amb.GetDataPtr() );}
+	void SetDiffuse ( const Color &diffuse )         { dif = diffuse;   if (HasFixedFunctionLight()) glLightfv ( lightNum, GL_DIFFUSE, dif.GetDataPtr() );}
+	void SetSpecular( const Color &specular )        { spec = specular; if (HasFixedFunctionLight()) glLightfv ( lightNum, GL_SPECULAR, spec.GetDataPtr() );}
 	void SetPosition( const Point &position )        { pos = position; }
 	void SetSpotDirection( const Vector &spotDir )   { this->spotDir = spotDir; }
 	void SetSpotCutoff( float degrees=180.0f );
 	void SetSpotExponent( float exponent=0.0f );
 	void SetAttenuation( float constant=1.0f, float linear=0.0f, float quadratic=0.0f );
 
+	// Read back the light's parameters (e.g., to pass them to shaders)
+	inline const Color &GetAmbient( void ) const       { return amb; }
+	inline const Color &GetDiffuse( void ) const       { return dif; }
+	inline const Color &GetSpecular( void ) const      { return spec; }
+	inline const Vector &GetSpotDirection( void ) const { return spotDir; }
+	inline float GetSpotCutoff( void ) const           { return spotCutoff; }
+	inline float GetSpotExponent( void ) const         { return spotExp; }
+	inline float GetAttenuation( int i ) const         { return atten[i]; }
+
 	// Enable or disable the light
-	inline void Enable( void )  { if (!enabled) glEnable( lightNum ); enabled=true;  }
-	inline void Disable( void ) { if (enabled) glDisable( lightNum ); enabled=false; }
+	inline void Enable( void )  { if (!enabled && HasFixedFunctionLight()) glEnable( lightNum ); enabled=true;  }
+	inline void Disable( void ) { if (enabled && HasFixedFunctionLight()) glDisable( lightNum ); enabled=false; }
 	inline bool IsEnabled( void ) const { return enabled; }
 
 	// Perhaps one wants to use a trackball or other transformation to change the light position
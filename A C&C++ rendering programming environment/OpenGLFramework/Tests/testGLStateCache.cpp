@@ -0,0 +1,151 @@
+/***************************************************************************/
+/* testGLStateCache.cpp                                                    */
+/* ------------                                                            */
+/*                                                                         */
+/* Checks GLStateCache's issued/filtered counters, and that deletes clear  */
+/*     the shadowed bindings, against a mock OpenGL that just counts the   */
+/*     calls that reach it.  Needs no window or GL context.                */
+/*                                                                         */
+/* Build from the OpenGLFramework directory, without linking OpenGL or     */
+/*     GLEW (this file stands in for them), e.g.:                          */
+/*        g++ -DGL_GLEXT_PROTOTYPES -I. Tests/testGLStateCache.cpp         */
+/*            Utils/glStateCache.cpp -o testGLStateCache                   */
+/*     Prints each failed check, and returns nonzero if there were any.    */
+/***************************************************************************/
+
+#include <stdio.h>
+#include "Utils/glStateCache.h"
+
+static int glCalls = 0, failures = 0;
+static GLuint boundTexture[GLSTATE_MAX_TEXTURE_UNITS], boundArrayBuffer = 0;
+static GLenum mockUnit = GL_TEXTURE0;
+
+// The mock:  every entry point the cache uses counts as one call
+static void GLAPIENTRY MockUseProgram( GLuint )                        { glCalls++; }
+static void GLAPIENTRY MockActiveTexture( GLenum unit )                { glCalls++; mockUnit = unit; }
+static void GLAPIENTRY MockBindBuffer( GLenum target, GLuint id )      { glCalls++; if (target == GL_ARRAY_BUFFER) boundArrayBuffer = id; }
+static void GLAPIENTRY MockDeleteBuffers( GLsizei n, const GLuint *ids )
+{
+	glCalls++;
+	for (int i=0; i < n; i++)
+		if (ids[i] == boundArrayBuffer) boundArrayBuffer = 0;
+}
+
+// GLEW makes extension entry points function pointers (set below);
+//    without it they're plain functions
+#ifndef GLEW_GET_FUN
+extern "C" {
+void glUseProgram( GLuint p )                                { MockUseProgram( p ); }
+void glActiveTexture( GLenum u )                             { MockActiveTexture( u ); }
+void glBindBuffer( GLenum t, GLuint id )                     { MockBindBuffer( t, id ); }
+void glDeleteBuffers( GLsizei n, const GLuint *ids )         { MockDeleteBuffers( n, ids ); }
+}
+#endif
+
+extern "C" {
+void APIENTRY glBindTexture( GLenum, GLuint id )            { glCalls++; boundTexture[mockUnit-GL_TEXTURE0] = id; }
+void APIENTRY glDeleteTextures( GLsizei n, const GLuint *ids )
+{
+	glCalls++;
+	for (int i=0; i < n; i++)
+		for (int u=0; u < GLSTATE_MAX_TEXTURE_UNITS; u++)
+			if (boundTexture[u] == ids[i]) boundTexture[u] = 0;
+}
+void APIENTRY glTexGeni( GLenum, GLenum, GLint )             { glCalls++; }
+void APIENTRY glEnable( GLenum )                             { glCalls++; }
+void APIENTRY glDisable( GLenum )                            { glCalls++; }
+GLboolean APIENTRY glIsEnabled( GLenum )                     { glCalls++; return GL_FALSE; }
+void APIENTRY glEnableClientState( GLenum )                  { glCalls++; }
+void APIENTRY glDisableClientState( GLenum )                 { glCalls++; }
+void APIENTRY glBlendFunc( GLenum, GLenum )                  { glCalls++; }
+void APIENTRY glDepthFunc( GLenum )                          { glCalls++; }
+void APIENTRY glDepthMask( GLboolean )                       { glCalls++; }
+}
+
+static void Check( bool ok, const char *what, int line )
+{
+	if (ok) return;
+	printf("FAILED (line %d): %s\n", line, what );
+	failures++;
+}
+#define CHECK( x )  Check( (x), #x, __LINE__ )
+
+// The counters must agree with what actually reached the mock
+static void CheckCounts( GLStateCache &cache, unsigned int issued, unsigned int filtered, int line )
+{
+	Check( cache.GetIssuedCount() == issued, "issued count", line );
+	Check( cache.GetFilteredCount() == filtered, "filtered count", line );
+	Check( glCalls == (int)cache.GetIssuedCount(), "calls reaching GL == issued count", line );
+}
+
+int main( void )
+{
+#ifdef GLEW_GET_FUN
+	__glewUseProgram = MockUseProgram;
+	__glewActiveTexture = MockActiveTexture;
+	__glewBindBuffer = MockBindBuffer;
+	__glewDeleteBuffers = MockDeleteBuffers;
+#endif
+	GLStateCache cache;
+
+	// Unknown state always goes through, repeats are filtered
+	cache.UseProgram( 3 );
+	cache.UseProgram( 3 );
+	cache.UseProgram( 4 );
+	CheckCounts( cache, 2, 1, __LINE__ );
+
+	cache.Enable( GL_BLEND );
+	cache.Enable( GL_BLEND );
+	cache.Disable( GL_BLEND );
+	cache.BlendFunc( GL_ONE, GL_ONE );
+	cache.BlendFunc( GL_ONE, GL_ONE );
+	cache.DepthMask( GL_FALSE );
+	cache.DepthMask( GL_FALSE );
+	CheckCounts( cache, 6, 4, __LINE__ );
+
+	// Per-unit bindings:  binding the same texture to a unit twice never
+	//    even switches units
+	cache.BindTextureToUnit( GL_TEXTURE0, GL_TEXTURE_2D, 7 );
+	cache.BindTextureToUnit( GL_TEXTURE1, GL_TEXTURE_2D, 8 );
+	cache.BindTextureToUnit( GL_TEXTURE0, GL_TEXTURE_2D, 7 );
+	CheckCounts( cache, 10, 5, __LINE__ );
+
+	// Invalidate() forgets, so the next change is issued
+	cache.Invalidate( GLSTATE_PROGRAM );
+	cache.UseProgram( 4 );
+	CheckCounts( cache, 11, 5, __LINE__ );
+
+	// Deleting a bound texture leaves 0 bound; the name reused later must
+	//    be bound again, not filtered
+	GLuint tex = 7;
+	cache.DeleteTextures( 1, &tex );
+	int beforeBind = glCalls;
+	cache.BindTextureToUnit( GL_TEXTURE0, GL_TEXTURE_2D, 7 );
+	CHECK( glCalls > beforeBind );
+	CHECK( boundTexture[0] == 7 );
+
+	// Texture 8, still bound to unit 1, is unaffected
+	beforeBind = glCalls;
+	cache.BindTextureToUnit( GL_TEXTURE1, GL_TEXTURE_2D, 8 );
+	CHECK( glCalls == beforeBind );
+
+	// The same for buffers
+	GLuint buf = 5;
+	cache.BindBuffer( GL_ARRAY_BUFFER, buf );
+	cache.DeleteBuffers( 1, &buf );
+	CHECK( boundArrayBuffer == 0 );
+	beforeBind = glCalls;
+	cache.BindBuffer( GL_ARRAY_BUFFER, 5 );
+	CHECK( glCalls == beforeBind+1 && boundArrayBuffer == 5 );
+	cache.BindBuffer( GL_ARRAY_BUFFER, 0 );
+	cache.DeleteBuffers( 1, &buf );
+	beforeBind = glCalls;
+	cache.BindBuffer( GL_ARRAY_BUFFER, 0 );
+	CHECK( glCalls == beforeBind );
+
+	cache.ResetCounters();
+	CHECK( cache.GetIssuedCount() == 0 && cache.GetFilteredCount() == 0 );
+
+	printf( failures ? "testGLStateCache: %d FAILED\n" : "testGLStateCache: passed\n", failures );
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,211 @@
+/***************************************************************************/
+/* testImageLoaders.cpp                                                    */
+/* ------------                                                            */
+/*                                                                         */
+/* Runs the PPM and BMP loaders over the damaged and unusual files in      */
+/*     Tests/data/imageFuzz (truncated pixels and headers, huge or         */
+/*     overflowing sizes, comments everywhere, bad maximum values), and    */
+/*     checks each is either rejected by ReadImageInfo() or decoded        */
+/*     without writing outside the image.  Files that decode are read by   */
+/*     both DecodeImage() and ReadPPM()/ReadBMP(), which must agree.       */
+/*                                                                         */
+/* Build and run from the OpenGLFramework directory (ideally with a memory */
+/*     checker, e.g. g++'s -fsanitize=address,undefined):                  */
+/*        g++ -g -I. Tests/testImageLoaders.cpp Utils/ImageIO/*.cpp        */
+/*            Utils/parallelFor.cpp -lpthread -o testImageLoaders          */
+/*        ./testImageLoaders                                               */
+/*     Prints each failed check, and returns nonzero if there were any.    */
+/*     (The loaders' own warnings about damaged files are expected.)       */
+/*                                                                         */
+/* Any other files named on the command line are just run through the     */
+/*     loaders, so this can also be the target of a fuzzer.  New cases     */
+/*     for the corpus go in Tests/data/imageFuzz and the table below.      */
+/***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Utils/ImageIO/imageIO.h"
+
+#pragma warning( disable: 4996 )
+
+#define CORPUS_DIR   "Tests/data/imageFuzz/"
+
+// Bytes after each decoded image that must be left alone
+#define GUARD_BYTES  64
+
+// A file in the corpus, and its size if it should be accepted (else 0x0)
+typedef struct
+{
+	const char *file;
+	int width, height;
+} ImageFuzzCase;
+
+static ImageFuzzCase cases[] = {
+	{ "p6-comments.ppm",            4, 3 },   // Comments between every header field
+	{ "p3-comments.ppm",            2, 2 },   // ... and between ASCII pixels
+	{ "p6-truncated.ppm",           8, 8 },   // Pixels missing (the rest are black)
+	{ "p3-truncated.ppm",           3, 2 },
+	{ "p3-garbage.ppm",             2, 2 },   // A sample that isn't a number
+	{ "p5-16bit-truncated.pgm",     5, 4 },   // 16-bit samples, and missing
+	{ "p2-over-maxval.pgm",         3, 1 },   // Samples above the maximum value
+	{ "p3-maxval-1000.ppm",         1, 1 },   // Samples over 8 bits
+	{ "p4-padded.pbm",              9, 2 },   // Bit rows padded to whole bytes
+	{ "p6-oversized.ppm",           0, 0 },   // Too big to allocate
+	{ "p6-overflow.ppm",            0, 0 },   // width*height overflows 32 bits
+	{ "p6-longdigits.ppm",          0, 0 },   // More digits than an int holds
+	{ "p6-maxval-zero.ppm",         0, 0 },
+	{ "p6-maxval-big.ppm",          0, 0 },   // Over 16 bits
+	{ "p3-maxval-big.ppm",          0, 0 },   // ... in ASCII too
+	{ "p6-maxval-missing.ppm",      0, 0 },   // Header ends early
+	{ "empty.ppm",                  0, 0 },
+	{ "magic-only.ppm",             0, 0 },
+	{ "bmp-padded.bmp",             3, 2 },   // Rows padded to 4 bytes
+	{ "bmp-topdown.bmp",            3, 2 },   // Negative height:  rows top down
+	{ "bmp-truncated.bmp",          5, 5 },
+	{ "bmp-offbits-past-eof.bmp",   3, 2 },   // Pixels start past the end
+	{ "bmp-header-truncated.bmp",   0, 0 },
+	{ "bmp-oversized.bmp",          0, 0 },
+	{ "bmp-8bit.bmp",               0, 0 },   // Unsupported
+	{ "bmp-min-height.bmp",         0, 0 },   // Height of -2^31 (can't be negated)
+};
+
+// Spot checks of decoded pixels (RGB, top row first)
+typedef struct
+{
+	const char *file;
+	int x, y;
+	unsigned char rgb[3];
+} ImagePixelCheck;
+
+static ImagePixelCheck pixelChecks[] = {
+	{ "p3-comments.ppm",    0, 0, { 255,   0,   0 } },
+	{ "p3-comments.ppm",    1, 1, {  10,  20,  30 } },
+	{ "p3-garbage.ppm",     0, 0, {   1,   2,   3 } },
+	{ "p3-garbage.ppm",     1, 0, {   0,   0,   0 } },   // Everything after 'abc' is black
+	{ "p6-truncated.ppm",   7, 7, {   0,   0,   0 } },
+	{ "p4-padded.pbm",      0, 0, {   0,   0,   0 } },   // 1 bits are black
+	{ "p4-padded.pbm",      8, 0, {   0,   0,   0 } },
+	{ "p4-padded.pbm",      1, 0, { 255, 255, 255 } },
+	{ "p2-over-maxval.pgm", 1, 0, { 255, 255, 255 } },   // ASCII samples are rescaled...
+	{ "p2-over-maxval.pgm", 2, 0, { 255, 255, 255 } },   // ... and clamped, like raw ones
+	{ "p3-maxval-1000.ppm", 0, 0, { 255, 128,   0 } },
+};
+
+static int failures = 0;
+
+static void Check( bool ok, const char *what, const char *file )
+{
+	if (ok) return;
+	printf("FAILED (%s): %s\n", file, what );
+	failures++;
+}
+
+// Decode into a buffer with guard bytes after it.  NULL if DecodeImage() refused.
+static unsigned char *Decode( const char *path, const char *name, int width, int height, int layout )
+{
+	int pitch = width * ImagePixelBytes( layout );
+	unsigned char *buf = (unsigned char *)malloc( pitch*height + GUARD_BYTES );
+	memset( buf, 0xCD, pitch*height + GUARD_BYTES );
+	if (!DecodeImage( path, buf, pitch, layout ))
+	{
+		free( buf );
+		return 0;
+	}
+	bool guardOK = true;
+	for (int i=0; i < GUARD_BYTES; i++)
+		if (buf[pitch*height + i] != 0xCD) guardOK = false;
+	Check( guardOK, "DecodeImage() wrote past the end of the image", name );
+	return buf;
+}
+
+// Run every loader for this file's format over it.  Returns the RGB8 decode
+//    (or NULL, if the file was rejected).
+static unsigned char *RunLoaders( const char *path, const char *name, ImageInfo *info )
+{
+	if (!ReadImageInfo( path, info )) return 0;
+
+	unsigned char *rgb = Decode( path, name, info->width, info->height, IMAGE_PIXELS_RGB8 );
+	unsigned char *rgba = Decode( path, name, info->width, info->height, IMAGE_PIXELS_RGBA8 );
+	Check( rgb && rgba, "ReadImageInfo() accepted it, but DecodeImage() didn't", name );
+	if (!rgb || !rgba)
+	{
+		free( rgb );
+		free( rgba );
+		return 0;
+	}
+
+	int numPixels = info->width * info->height;
+	bool same = true;
+	for (int i=0; i < numPixels; i++)
+		if (memcmp( rgb + 3*i, rgba + 4*i, 3 ) || rgba[4*i+3] != 255) same = false;
+	Check( same, "RGB8 and RGBA8 decodes differ", name );
+	free( rgba );
+
+	// The older interfaces, which allocate the image themselves
+	int mode, w = 0, h = 0;
+	unsigned char *old = 0;
+	if (info->format == IMAGE_FORMAT_PPM)
+		old = ReadPPM( (char *)path, &mode, &w, &h );
+	else if (info->format == IMAGE_FORMAT_BMP)
+		old = ReadBMP( (char *)path, &w, &h, true );   // Top row first
+	if (old)
+	{
+		Check( w == info->width && h == info->height, "Read*() and ReadImageInfo() sizes differ", name );
+		Check( w != info->width || h != info->height || !memcmp( old, rgb, 3*numPixels ),
+			   "Read*() and DecodeImage() pixels differ", name );
+		free( old );
+	}
+	return rgb;
+}
+
+int main( int argc, char **argv )
+{
+	// Files from the command line:  they only need to not crash
+	if (argc > 1)
+	{
+		for (int i=1; i < argc; i++)
+		{
+			ImageInfo info;
+			free( RunLoaders( argv[i], argv[i], &info ) );
+		}
+		printf( failures ? "testImageLoaders: %d FAILED\n" : "testImageLoaders: done\n", failures );
+		return failures ? 1 : 0;
+	}
+
+	for (unsigned int i=0; i < sizeof( cases ) / sizeof( cases[0] ); i++)
+	{
+		char path[512];
+		sprintf( path, "%s%s", CORPUS_DIR, cases[i].file );
+		FILE *f = fopen( path, "rb" );
+		if (!f)
+		{
+			printf("Error: Unable to open '%s'!  (Run from the OpenGLFramework directory.)\n", path );
+			return 1;
+		}
+		fclose( f );
+
+		ImageInfo info;
+		unsigned char *rgb = RunLoaders( path, cases[i].file, &info );
+		if (!cases[i].width)
+			Check( !rgb, "should have been rejected", cases[i].file );
+		else if (!rgb)
+			Check( false, "should have been accepted", cases[i].file );
+		else
+		{
+			Check( info.width == cases[i].width && info.height == cases[i].height, "wrong size", cases[i].file );
+			for (unsigned int j=0; j < sizeof( pixelChecks ) / sizeof( pixelChecks[0] ); j++)
+			{
+				ImagePixelCheck *p = &pixelChecks[j];
+				if (strcmp( p->file, cases[i].file )) continue;
+				char what[128];
+				sprintf( what, "pixel (%d,%d) should be %d %d %d", p->x, p->y, p->rgb[0], p->rgb[1], p->rgb[2] );
+				Check( !memcmp( rgb + 3*(p->y*info.width + p->x), p->rgb, 3 ), what, cases[i].file );
+			}
+		}
+		free( rgb );
+	}
+
+	printf( failures ? "testImageLoaders: %d FAILED\n" : "testImageLoaders: passed\n", failures );
+	return failures ? 1 : 0;
+}
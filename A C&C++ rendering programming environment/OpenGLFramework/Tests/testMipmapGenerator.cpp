@@ -0,0 +1,195 @@
+/***************************************************************************/
+/* testMipmapGenerator.cpp                                                 */
+/* ------------                                                            */
+/*                                                                         */
+/* A byte-exact regression test for GenerateMipmaps() (mipmapGenerator.h). */
+/*     Builds the chains for a few fixed images (odd, non-power-of-two     */
+/*     sizes; sRGB and linear data; box and Kaiser filters; alpha coverage */
+/*     preservation) and compares every level against the golden bytes in */
+/*     Tests/data/mipmapGolden.txt.  Each chain is built twice, with SSE   */
+/*     and with MIPMAP_NO_SIMD, and both must match.                       */
+/*                                                                         */
+/* Build and run from the OpenGLFramework directory, e.g.:                 */
+/*        g++ -O2 -I. Tests/testMipmapGenerator.cpp Utils/mipmapGenerator.cpp */
+/*            Utils/parallelFor.cpp -lpthread -o testMipmapGenerator       */
+/*        ./testMipmapGenerator                                            */
+/*     Prints each mismatched level, and returns nonzero if there were     */
+/*     any.  After an intended change to the generator's output (bump      */
+/*     MIPMAP_GENERATOR_VERSION too!), "testMipmapGenerator -update"       */
+/*     rewrites the golden file.                                           */
+/***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Utils/mipmapGenerator.h"
+
+#pragma warning( disable: 4996 )
+
+#define GOLDEN_FILE       "Tests/data/mipmapGolden.txt"
+#define MAX_GOLDEN_LINES  256
+
+typedef struct
+{
+	const char *name;
+	int width, height, components;
+	unsigned int flags;
+} MipmapTestCase;
+
+static MipmapTestCase cases[] = {
+	{ "rgba-npot-box",        13,  7, 4, MIPMAP_DEFAULT },
+	{ "rgb-npot-kaiser",      11,  5, 3, MIPMAP_KAISER },
+	{ "gray-linear",          10,  3, 1, MIPMAP_LINEAR_DATA },
+	{ "rgba-coverage",        16, 12, 4, MIPMAP_PRESERVE_COVERAGE },
+	{ "la-coverage-kaiser",   15,  9, 2, MIPMAP_PRESERVE_COVERAGE | MIPMAP_KAISER },
+	{ "rgba-linear-kaiser",    6, 17, 4, MIPMAP_LINEAR_DATA | MIPMAP_KAISER },
+};
+
+static int failures = 0;
+static char *golden[MAX_GOLDEN_LINES];
+static int numGolden = 0;
+
+// A fixed, platform-independent image.  Alpha is a soft-edged disc (so the
+//    coverage cases have something to preserve), the rest is hashed noise
+//    over a gradient.
+static unsigned char *MakeImage( MipmapTestCase *t )
+{
+	unsigned char *img = (unsigned char *)malloc( t->width * t->height * t->components );
+	int alpha = (t->components == 2 || t->components == 4) ? t->components-1 : -1;
+	for (int y=0; y < t->height; y++)
+		for (int x=0; x < t->width; x++)
+			for (int c=0; c < t->components; c++)
+			{
+				unsigned int h = (unsigned int)(x*73856093) ^ (unsigned int)(y*19349663) ^ (unsigned int)(c*83492791);
+				h ^= h >> 13;  h *= 0x5bd1e995u;  h ^= h >> 15;
+				int v;
+				if (c == alpha)
+				{
+					int dx = 2*x+1 - t->width, dy = 2*y+1 - t->height;
+					v = 255 - (dx*dx + dy*dy) * 255 / (t->width*t->width/2 + 1);
+					v += (int)(h & 31) - 16;
+				}
+				else
+					v = (x * 255) / t->width / 2 + (int)(h & 127);
+				img[(y*t->width + x)*t->components + c] = (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+			}
+	return img;
+}
+
+// One level as a line of the golden file:  "<name> <level> <w>x<h> <hex bytes>"
+static char *LevelLine( const char *name, unsigned int lvl, MipmapChain *chain )
+{
+	int bytes = chain->GetLevelWidth( lvl ) * chain->GetLevelHeight( lvl ) * chain->GetComponents();
+	char *line = (char *)malloc( 128 + 2*bytes );
+	int len = sprintf( line, "%s %u %dx%d ", name, lvl, chain->GetLevelWidth( lvl ), chain->GetLevelHeight( lvl ) );
+	const unsigned char *data = chain->GetLevelData( lvl );
+	for (int i=0; i < bytes; i++)
+		len += sprintf( line+len, "%02x", data[i] );
+	return line;
+}
+
+// The golden line for a level, or NULL
+static char *FindGolden( const char *name, unsigned int lvl )
+{
+	char prefix[128];
+	sprintf( prefix, "%s %u ", name, lvl );
+	for (int i=0; i < numGolden; i++)
+		if (!strncmp( golden[i], prefix, strlen( prefix ) )) return golden[i];
+	return 0;
+}
+
+static bool ReadGolden( const char *filename )
+{
+	FILE *f = fopen( filename, "r" );
+	if (!f) return false;
+	static char buf[65536];
+	while (numGolden < MAX_GOLDEN_LINES && fgets( buf, sizeof( buf ), f ))
+	{
+		buf[strcspn( buf, "\r\n" )] = 0;
+		if (buf[0] && buf[0] != '#') golden[numGolden++] = strdup( buf );
+	}
+	fclose( f );
+	return true;
+}
+
+// Compare one chain against the golden file (or write it out, if 'out')
+static void CheckChain( MipmapTestCase *t, MipmapChain *chain, const char *path, FILE *out )
+{
+	int expectedLevels = 1, w = t->width, h = t->height;
+	while (w > 1 || h > 1) { w = w > 1 ? w/2 : 1;  h = h > 1 ? h/2 : 1;  expectedLevels++; }
+	if ((int)chain->GetNumLevels() != expectedLevels)
+	{
+		printf("FAILED: %s (%s) has %u levels, expected %d\n", t->name, path, chain->GetNumLevels(), expectedLevels );
+		failures++;
+	}
+
+	// Level 0 is the input, so it's checked too (it must not be modified)
+	for (unsigned int lvl=0; lvl < chain->GetNumLevels(); lvl++)
+	{
+		char *line = LevelLine( t->name, lvl, chain );
+		if (out)
+			fprintf( out, "%s\n", line );
+		else
+		{
+			char *expected = FindGolden( t->name, lvl );
+			if (!expected || strcmp( expected, line ))
+			{
+				printf("FAILED: %s (%s) level %u %s\n", t->name, path, lvl,
+					   expected ? "differs from the golden bytes" : "is missing from the golden file" );
+				failures++;
+			}
+		}
+		free( line );
+	}
+}
+
+int main( int argc, char **argv )
+{
+	bool update = argc > 1 && !strcmp( argv[1], "-update" );
+	const char *filename = (argc > 2) ? argv[2] : ((argc > 1 && !update) ? argv[1] : GOLDEN_FILE);
+	int numCases = sizeof( cases ) / sizeof( cases[0] );
+
+	// Updating writes the SIMD chains, then checks everything against them
+	if (update)
+	{
+		FILE *out = fopen( filename, "w" );
+		if (!out) { printf("Error: Unable to write '%s'!\n", filename );  return 1; }
+		fprintf( out, "# Golden mipmap levels for Tests/testMipmapGenerator.cpp (MIPMAP_GENERATOR_VERSION %d).\n", MIPMAP_GENERATOR_VERSION );
+		fprintf( out, "# Regenerate with \"testMipmapGenerator -update\", only after an intended change.\n" );
+		for (int i=0; i < numCases; i++)
+		{
+			unsigned char *img = MakeImage( &cases[i] );
+			MipmapChain *chain = GenerateMipmaps( img, cases[i].width, cases[i].height, cases[i].components, cases[i].flags );
+			CheckChain( &cases[i], chain, "SIMD", out );
+			delete chain;
+			free( img );
+		}
+		fclose( out );
+		printf("testMipmapGenerator: wrote '%s'\n", filename );
+	}
+
+	if (!ReadGolden( filename ))
+	{
+		printf("Error: Unable to read '%s'!  (Run from the OpenGLFramework directory.)\n", filename );
+		return 1;
+	}
+
+	for (int i=0; i < numCases; i++)
+	{
+		MipmapTestCase *t = &cases[i];
+		unsigned char *img = MakeImage( t );
+
+		MipmapChain *simd = GenerateMipmaps( img, t->width, t->height, t->components, t->flags );
+		CheckChain( t, simd, "SIMD", 0 );
+		delete simd;
+
+		MipmapChain *scalar = GenerateMipmaps( img, t->width, t->height, t->components, t->flags | MIPMAP_NO_SIMD );
+		CheckChain( t, scalar, "scalar", 0 );
+		delete scalar;
+
+		free( img );
+	}
+
+	printf( failures ? "testMipmapGenerator: %d FAILED\n" : "testMipmapGenerator: passed\n", failures );
+	return failures ? 1 : 0;
+}
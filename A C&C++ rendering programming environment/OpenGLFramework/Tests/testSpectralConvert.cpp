@@ -0,0 +1,133 @@
+/***************************************************************************/
+/* testSpectralConvert.cpp                                                 */
+/* ------------                                                            */
+/*                                                                         */
+/* Checks the batch conversions in spectralConvert.h against converting    */
+/*     one color at a time, with SpectralColor::ToXYZ() and                */
+/*     XYZSpectrum::ConvertXYZToRGB().  Every output must agree to within  */
+/*     float rounding.  The counts are chosen to leave 1, 2, or 3 spectra  */
+/*     for the scalar loop after the SSE one, to end partway through a     */
+/*     SpectralColor block (SPECTRAL_BLOCK, 256), and to be big enough to  */
+/*     be split across threads.                                            */
+/*                                                                         */
+/* Build and run from the OpenGLFramework directory twice, with SSE and    */
+/*     without (-DSPECTRAL_NO_SSE), e.g.:                                  */
+/*        g++ -O2 -I. Tests/testSpectralConvert.cpp Utils/spectralConvert.cpp */
+/*            DataTypes/XYZSpectrum.cpp Utils/parallelFor.cpp -lpthread    */
+/*            -o testSpectralConvert                                       */
+/*        ./testSpectralConvert                                            */
+/*     Prints each failed check, and returns nonzero if there were any.    */
+/***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "Utils/spectralConvert.h"
+
+// Spectra counts:  below one SSE group, each remainder mod 4, either side
+//    of the SpectralColor block size, and past SPECTRAL_CONVERT_GRAIN
+static int counts[] = { 1, 2, 3, 4, 5, 6, 7, 13, 255, 257, 1001, 4099, 10007 };
+
+// Extra floats between bins, beyond 'count', for the structure of arrays
+//    layout (so stride > count is exercised too)
+#define STRIDE_PAD   3
+
+static int failures = 0;
+
+// A repeatable random number in [0..1)
+static float TestRandom( unsigned int *state )
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return (*state >> 8) * (1.0f / 16777216.0f);
+}
+
+// Do a batch result and the one-at-a-time reference agree?  XYZ is a sum
+//    of non-negative terms here, so its size bounds the rounding error (and
+//    RGB's, times the largest matrix row).
+static bool Close( float value, float expected, const RGBColor &xyz )
+{
+	float scale = 1.0f + 6.0f * (fabsf( xyz.Red() ) + fabsf( xyz.Green() ) + fabsf( xyz.Blue() ));
+	return fabsf( value - expected ) <= 1e-5f * scale;
+}
+
+static void Check( bool ok, const char *what, int count, int i )
+{
+	if (ok) return;
+	if (failures < 20)
+		printf("FAILED (%d spectra):  %s, spectrum %d\n", count, what, i );
+	failures++;
+}
+
+static void TestCount( int count )
+{
+	unsigned int state = 2463534242u + count;
+	int stride = count + STRIDE_PAD;
+
+	// The same spectra as SpectralColors and structure of arrays.  The
+	//    batch starts one float in, so it isn't 16-byte aligned either.
+	SpectralColor *colors = new SpectralColor[count];
+	float *soaAlloc = (float *)malloc( (SPECTRALCOLORBINS*stride + 1)*sizeof(float) );
+	float *soa = soaAlloc + 1;
+	for (int i=0; i < count; i++)
+	{
+		float bins[SPECTRALCOLORBINS];
+		for (int b=0; b < SPECTRALCOLORBINS; b++)
+		{
+			bins[b] = 2.0f * TestRandom( &state );
+			soa[b*stride + i] = bins[b];
+		}
+		colors[i] = SpectralColor( bins );
+	}
+
+	float *out[6];
+	for (int j=0; j < 6; j++)
+		out[j] = (float *)malloc( count*sizeof(float) );
+	RGBColor *xyzColors = new RGBColor[count], *rgbColors = new RGBColor[count];
+
+	SpectraToXYZ( soa, stride, count, out[0], out[1], out[2] );
+	SpectraToRGB( soa, stride, count, out[3], out[4], out[5] );
+	SpectralColorsToXYZ( colors, count, xyzColors );
+	SpectralColorsToRGB( colors, count, rgbColors );
+
+	for (int i=0; i < count; i++)
+	{
+		RGBColor xyz = colors[i].ToXYZ();
+		RGBColor rgb = XYZSpectrum::ConvertXYZToRGB( xyz );
+		Check( Close( out[0][i], xyz.Red(), xyz ) && Close( out[1][i], xyz.Green(), xyz ) &&
+			   Close( out[2][i], xyz.Blue(), xyz ), "SpectraToXYZ() differs from ToXYZ()", count, i );
+		Check( Close( out[3][i], rgb.Red(), xyz ) && Close( out[4][i], rgb.Green(), xyz ) &&
+			   Close( out[5][i], rgb.Blue(), xyz ), "SpectraToRGB() differs from ConvertXYZToRGB()", count, i );
+		Check( Close( xyzColors[i].Red(), xyz.Red(), xyz ) && Close( xyzColors[i].Green(), xyz.Green(), xyz ) &&
+			   Close( xyzColors[i].Blue(), xyz.Blue(), xyz ), "SpectralColorsToXYZ() differs from ToXYZ()", count, i );
+		Check( Close( rgbColors[i].Red(), rgb.Red(), xyz ) && Close( rgbColors[i].Green(), rgb.Green(), xyz ) &&
+			   Close( rgbColors[i].Blue(), rgb.Blue(), xyz ), "SpectralColorsToRGB() differs from ConvertXYZToRGB()", count, i );
+	}
+
+	// XYZToRGB(), in place, from the batch XYZ
+	XYZToRGB( out[0], out[1], out[2], count, out[0], out[1], out[2] );
+	for (int i=0; i < count; i++)
+	{
+		RGBColor xyz = colors[i].ToXYZ();
+		RGBColor rgb = XYZSpectrum::ConvertXYZToRGB( xyz );
+		Check( Close( out[0][i], rgb.Red(), xyz ) && Close( out[1][i], rgb.Green(), xyz ) &&
+			   Close( out[2][i], rgb.Blue(), xyz ), "XYZToRGB() differs from ConvertXYZToRGB()", count, i );
+	}
+
+	for (int j=0; j < 6; j++)
+		free( out[j] );
+	free( soaAlloc );
+	delete [] colors;
+	delete [] xyzColors;
+	delete [] rgbColors;
+}
+
+int main( void )
+{
+	for (unsigned int i=0; i < sizeof( counts ) / sizeof( counts[0] ); i++)
+		TestCount( counts[i] );
+
+	printf( failures ? "testSpectralConvert: %d FAILED\n" : "testSpectralConvert: passed\n", failures );
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,168 @@
+/***************************************************************************/
+/* testVirtualTexturePages.cpp                                             */
+/* ------------                                                            */
+/*                                                                         */
+/* Checks VirtualPageTable's bookkeeping (virtualTexturePages.h):  that a  */
+/*     request also wants the coarser pages under it, the order missing    */
+/*     pages are listed in, which slots AllocateSlot() may (and may not)   */
+/*     take, CancelPage(), and the page table's fallback to the nearest    */
+/*     resident coarser page.  Needs no window or GL context.              */
+/*                                                                         */
+/* Build and run from the OpenGLFramework directory, e.g.:                 */
+/*        g++ -I. Tests/testVirtualTexturePages.cpp                        */
+/*            Utils/virtualTexturePages.cpp -o testVirtualTexturePages     */
+/*        ./testVirtualTexturePages                                        */
+/*     Prints each failed check, and returns nonzero if there were any.    */
+/***************************************************************************/
+
+#include <stdio.h>
+#include "Utils/virtualTexturePages.h"
+
+static int failures = 0;
+
+static void Check( bool ok, const char *what, int line )
+{
+	if (ok) return;
+	printf("FAILED (line %d): %s\n", line, what );
+	failures++;
+}
+
+#define CHECK( x )  Check( (x), #x, __LINE__ )
+
+static VirtualPage Page( int level, int x, int y )
+{
+	VirtualPage p;
+	p.level = level;  p.x = x;  p.y = y;
+	return p;
+}
+
+static bool SamePage( const VirtualPage &p, int level, int x, int y )
+{
+	return p.level == level && p.x == x && p.y == y;
+}
+
+// Is the page table entry for (level, x, y) the 4 given bytes?
+static bool EntryIs( const VirtualPageTable &table, int level, int x, int y,
+					 int slotX, int slotY, int fromLevel, int valid )
+{
+	const unsigned char *e = table.GetEntries( level ) + 4*(y*table.GetPagesX( level ) + x);
+	return e[0] == slotX && e[1] == slotY && e[2] == fromLevel && e[3] == valid;
+}
+
+int main( void )
+{
+	// 4x4 pages at the finest level, then 2x2 and 1x1, into a 2x2 slot cache
+	VirtualPageTable table( 4, 4, 3, 2, 2 );
+	CHECK( table.GetNumSlots() == 4 );
+
+	// Nothing's resident yet, so the table is all zeros
+	CHECK( table.UpdateEntries() == 0 );
+	CHECK( EntryIs( table, 0, 3, 3, 0, 0, 0, 0 ) );
+
+	// Requests also want every coarser page under them, stopping at the
+	//    first one already wanted (which just counts another request)
+	table.BeginFrame( 1 );
+	table.RequestPage( 0, 3, 2 );
+	CHECK( table.GetNumRequested() == 3 );
+	table.RequestPage( 0, 2, 2 );
+	table.RequestPage( 0, 2, 3 );
+	table.RequestPage( 0, 0, 0 );
+	table.RequestPage( 0, 0, 0 );
+	CHECK( table.GetNumRequested() == 7 );
+
+	// Out of range requests are ignored
+	table.RequestPage( 0, 4, 0 );
+	table.RequestPage( 3, 0, 0 );
+	CHECK( table.GetNumRequested() == 7 );
+
+	// Missing pages come coarsest first, then most requested, then in order:
+	//    (1,1,1) was wanted 3 times, (0,0,0) twice, the others once
+	VirtualPage missing[8];
+	CHECK( table.GetMissingPages( missing, 8 ) == 7 );
+	CHECK( SamePage( missing[0], 2, 0, 0 ) );
+	CHECK( SamePage( missing[1], 1, 1, 1 ) );
+	CHECK( SamePage( missing[2], 1, 0, 0 ) );
+	CHECK( SamePage( missing[3], 0, 0, 0 ) );
+	CHECK( SamePage( missing[4], 0, 2, 2 ) );
+	CHECK( SamePage( missing[5], 0, 3, 2 ) );
+	CHECK( SamePage( missing[6], 0, 2, 3 ) );
+	CHECK( table.GetMissingPages( missing, 2 ) == 2 );
+	CHECK( SamePage( missing[1], 1, 1, 1 ) );
+
+	// Load the first four; they fill the free slots in order
+	VirtualPage loads[4] = { Page( 2, 0, 0 ), Page( 1, 1, 1 ), Page( 1, 0, 0 ), Page( 0, 0, 0 ) };
+	for (int i=0; i < 4; i++)
+	{
+		CHECK( table.AllocateSlot( loads[i] ) == i );
+		table.MapPage( loads[i] );
+	}
+	CHECK( table.GetNumResident() == 4 );
+	CHECK( table.AllocateSlot( loads[1] ) == 1 );
+	CHECK( table.GetMissingPages( missing, 8 ) == 3 );
+
+	// Next frame, only the (2,2) branch is wanted.  With the cache full, the
+	//    least recently wanted page that isn't wanted now, and isn't the
+	//    coarsest level, goes:  (1,0,0) ties with (0,0,0), and is first.
+	table.BeginFrame( 2 );
+	table.RequestPage( 0, 2, 2 );
+	CHECK( table.AllocateSlot( Page( 0, 2, 2 ) ) == 2 );
+	table.MapPage( Page( 0, 2, 2 ) );
+	CHECK( table.GetNumEvicted() == 1 );
+	CHECK( !table.IsResident( 1, 0, 0 ) );
+	CHECK( table.GetSlot( 0, 2, 2 ) == 2 );
+
+	// Then (0,0,0), the last one that can go.  Its slot is reserved, but the
+	//    page isn't mapped (so not resident) until it's loaded.
+	CHECK( table.AllocateSlot( Page( 0, 3, 2 ) ) == 3 );
+	CHECK( !table.IsResident( 0, 3, 2 ) );
+	CHECK( !table.IsResident( 0, 0, 0 ) );
+
+	// Now nothing can be evicted:  slot 0 is the coarsest level, 1 and 2 are
+	//    wanted this frame, and 3 is still loading
+	CHECK( table.AllocateSlot( Page( 0, 1, 1 ) ) == -1 );
+
+	// Cancelling the load frees its slot again
+	table.CancelPage( Page( 0, 3, 2 ) );
+	CHECK( table.AllocateSlot( Page( 0, 1, 1 ) ) == 3 );
+
+	// ...but cancelling a page that's already mapped does nothing
+	table.CancelPage( Page( 0, 2, 2 ) );
+	CHECK( table.GetSlot( 0, 2, 2 ) == 2 );
+
+	// Each entry points at its own page, or the nearest resident coarser one.
+	//    (0,1,1) is still loading, and its parent (1,0,0) was evicted, so it
+	//    falls all the way back to the coarsest level, as does (0,0,0).
+	CHECK( table.UpdateEntries() == 3 );
+	CHECK( EntryIs( table, 0, 2, 2, 0, 1, 0, 255 ) );
+	CHECK( EntryIs( table, 0, 3, 3, 1, 0, 1, 255 ) );
+	CHECK( EntryIs( table, 0, 1, 1, 0, 0, 2, 255 ) );
+	CHECK( EntryIs( table, 0, 0, 0, 0, 0, 2, 255 ) );
+	CHECK( EntryIs( table, 1, 1, 1, 1, 0, 1, 255 ) );
+	CHECK( EntryIs( table, 1, 0, 0, 0, 0, 2, 255 ) );
+	CHECK( EntryIs( table, 2, 0, 0, 0, 0, 2, 255 ) );
+
+	// Once it's loaded, (0,1,1) gets its own entry
+	table.MapPage( Page( 0, 1, 1 ) );
+	CHECK( table.UpdateEntries() > 0 );
+	CHECK( EntryIs( table, 0, 1, 1, 1, 1, 0, 255 ) );
+	CHECK( EntryIs( table, 0, 0, 0, 0, 0, 2, 255 ) );
+
+	// In a frame wanting nothing, every slot is equally old, but the coarsest
+	//    level (slot 0) still stays
+	table.BeginFrame( 3 );
+	CHECK( table.AllocateSlot( Page( 0, 3, 3 ) ) == 1 );
+	CHECK( table.IsResident( 2, 0, 0 ) );
+
+	// A slot still loading is never taken, even when it's the oldest
+	table.BeginFrame( 4 );
+	CHECK( table.AllocateSlot( Page( 0, 0, 0 ) ) == 2 );
+	table.MapPage( Page( 0, 0, 0 ) );
+	CHECK( table.AllocateSlot( Page( 0, 1, 0 ) ) == 3 );
+	table.MapPage( Page( 0, 1, 0 ) );
+	table.BeginFrame( 5 );
+	CHECK( table.AllocateSlot( Page( 0, 2, 0 ) ) == 2 );
+	CHECK( table.AllocateSlot( Page( 0, 3, 3 ) ) == 1 );
+
+	printf( failures ? "testVirtualTexturePages: %d FAILED\n" : "testVirtualTexturePages: passed\n", failures );
+	return failures ? 1 : 0;
+}
@@ -12,111 +12,168 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "bmp.h"
+#include "imageDecode.h"
 
-int ReadInt(FILE *fp);
-void WriteInt(int x, FILE *fp);
-unsigned short int ReadUnsignedShort(FILE *fp);
-void WriteUnsignedShort(unsigned short int x, FILE *fp);
-unsigned int ReadUnsignedInt(FILE *fp);
-void WriteUnsignedInt(unsigned int x, FILE *fp);
+static int GetInt(const unsigned char *p);
+static void WriteInt(int x, FILE *fp);
+static unsigned short int GetUnsignedShort(const unsigned char *p);
+static void WriteUnsignedShort(unsigned short int x, FILE *fp);
+static unsigned int GetUnsignedInt(const unsigned char *p);
+static void WriteUnsignedInt(unsigned int x, FILE *fp);
 
 
-unsigned char *ReadBMP( char *f, int *width, int *height, bool invertY )
+/* Picks the fields out of the file and info headers (the first MYBMP_BF_OFF_BITS
+   bytes).  Returns GFXIO_OK, GFXIO_BADFILE (not a BMP), or GFXIO_UNSUPPORTED. */
+static int ParseBMPHeader( const unsigned char *hdr, int *width, int *height, 
+						   bool *topDown, unsigned int *offBits )
 {
-    unsigned char *img;
-	unsigned char *tmp;
-    int x, y;
-    int lineLength;
-    
-	FILE *fp;
-	char buf[1024];
-	unsigned short int bmpType, bmpReserved1, bmpReserved2;
-	unsigned int bmpSize, bmpOffBits;
+	unsigned short int bmpType = GetUnsignedShort(hdr+0);
+	unsigned int imgSize = GetUnsignedInt(hdr+14);
+	int imgWidth = GetInt(hdr+18);
+	int imgHeight = GetInt(hdr+22);
+	unsigned short int imgPlanes = GetUnsignedShort(hdr+26);
+	unsigned short int imgBitCount = GetUnsignedShort(hdr+28);
+	unsigned int imgCompression = GetUnsignedInt(hdr+30);
+	*offBits = GetUnsignedInt(hdr+10);
+
+    /* Check file header.  Newer info headers are longer, but start the same. */
+    if (bmpType != MYBMP_BF_TYPE || *offBits < MYBMP_BF_OFF_BITS)
+		return GFXIO_BADFILE;
+
+    /* Check info header.  A negative height means rows are stored top down. */
+	*topDown = imgHeight < 0;
+	if (*topDown) imgHeight = (imgHeight < -0x7FFFFFFF) ? 0 : -imgHeight;   /* -2^31 has no negation */
+    if( imgSize < MYBMP_BI_SIZE || imgWidth <= 0 || 
+		imgHeight <= 0 || imgPlanes != 1 || 
+		imgBitCount != 24 || imgCompression != MYBMP_BI_RGB ||
+		(long long)imgWidth * imgHeight > 0x7FFFFFFF / 4 )
+		return GFXIO_UNSUPPORTED;
 
-	unsigned int imgSize, imgSizeImage, imgCompression, imgClrUsed, imgClrImportant;
-	int imgWidth, imgHeight, imgXPelsPerMeter, imgYPelsPerMeter;
-	unsigned short int imgPlanes, imgBitCount;
+	*width = imgWidth;
+	*height = imgHeight;
+	return GFXIO_OK;
+}
 
-	fp = fopen( f, "rb" );
+/* Opens a BMP, checks its header, and seeks to the pixels.  Bad files are fatal. */
+static FILE *OpenBMP( const char *f, int *width, int *height, bool *topDown )
+{
+	unsigned char hdr[MYBMP_BF_OFF_BITS];
+	unsigned int offBits;
+	char buf[1024];
+	int err = GFXIO_BADFILE;
+
+	FILE *fp = fopen( f, "rb" );
 	if (!fp)
 	{
 		sprintf( buf, "ReadBMP() unable to open file '%s'!", f );
 		FatalError( buf );
 	}
 
-    /* Read file header */
-    bmpType = ReadUnsignedShort(fp);
-    bmpSize = ReadUnsignedInt(fp);
-    bmpReserved1 = ReadUnsignedShort(fp);
-    bmpReserved2 = ReadUnsignedShort(fp);
-    bmpOffBits = ReadUnsignedInt(fp);
-
-    /* Check file header */
-    if (bmpType != MYBMP_BF_TYPE || bmpOffBits != MYBMP_BF_OFF_BITS)
+	/* Read the file and info headers at once, then pick out the fields */
+	if (fread( hdr, 1, MYBMP_BF_OFF_BITS, fp ) == MYBMP_BF_OFF_BITS)
+		err = ParseBMPHeader( hdr, width, height, topDown, &offBits );
+	if (err == GFXIO_BADFILE)
 	{
 		sprintf( buf, "ReadBMP() encountered bad header in file '%s'!", f);
 		FatalError( buf );
 	}
-
-    /* Read info header */
-    imgSize = ReadUnsignedInt(fp);
-    imgWidth = ReadInt(fp);
-    imgHeight = ReadInt(fp);
-    imgPlanes = ReadUnsignedShort(fp);
-    imgBitCount = ReadUnsignedShort(fp);
-    imgCompression = ReadUnsignedInt(fp);
-    imgSizeImage = ReadUnsignedInt(fp);
-    imgXPelsPerMeter = ReadInt(fp);
-    imgYPelsPerMeter = ReadInt(fp);
-    imgClrUsed = ReadUnsignedInt(fp);
-    imgClrImportant = ReadUnsignedInt(fp);
-
-    /* Check info header */
-    if( imgSize != MYBMP_BI_SIZE || imgWidth <= 0 || 
-		imgHeight <= 0 || imgPlanes != 1 || 
-		imgBitCount != 24 || imgCompression != MYBMP_BI_RGB ||
-		imgSizeImage == 0 )
+	else if (err == GFXIO_UNSUPPORTED)
 	{
 		sprintf( buf, "ReadBMP() encountered unsupported bitmap type in '%s'!", f);
 		FatalError( buf );
 	}
-    
+
+    fseek(fp, (long) offBits, SEEK_SET);  
+	return fp;
+}
+
+/* The size of a BMP (for ReadImageInfo()) */
+bool ReadBMPInfo( FILE *fp, ImageInfo *info )
+{
+	unsigned char hdr[MYBMP_BF_OFF_BITS];
+	unsigned int offBits;
+	bool topDown;
+	if (fread( hdr, 1, MYBMP_BF_OFF_BITS, fp ) != MYBMP_BF_OFF_BITS)
+		return false;
+	if (ParseBMPHeader( hdr, &info->width, &info->height, &topDown, &offBits ) != GFXIO_OK)
+		return false;
+	info->components = 3;
+	return true;
+}
+
+/* Reads the pixels a row at a time (straight into the destination, if it
+   wants BGR), converting them into the destination (a short file leaves 
+   the rest black) */
+static void ReadBMPPixels( FILE *fp, const char *f, bool topDown, const ImageDest *d )
+{
+	char buf[1024];
+	bool truncated = false;
+
 	/* compute the line length */
-    lineLength = imgWidth * 3; 
+	int rowBytes = 3 * d->width;
+	int lineLength = rowBytes;
     if ((lineLength % 4) != 0) 
 		lineLength = (lineLength / 4 + 1) * 4;
 
-    /* Creates the image */
-    img = (unsigned char *) malloc( 3 * imgWidth * imgHeight * sizeof( unsigned char ) );
-	tmp = (unsigned char *) malloc( 3 * lineLength * sizeof( unsigned char ) );
-	if (!tmp || !img)
+	unsigned char *line = (unsigned char *) malloc( lineLength );
+	if (!line)
 		FatalError( "Unable to allocate memory in ReadBMP()!");
-   
-	/* Position the file after header.  Header should be 54 bytes long -- checked above */
-    fseek(fp, (long) bmpOffBits, SEEK_SET);  
-
-	/* Read the image */
-    for (y = 0; y < imgHeight; y++) {
-		int yy = invertY ? (imgHeight-1-y) : y;
-        fread(tmp, 1, lineLength, fp);
 
-        /* Copy into permanent structure */
-        for (x = 0; x < imgWidth; x++)
+	/* Rows are stored bottom up, unless the height was negative */
+    for (int fileRow = 0; fileRow < d->height; fileRow++) {
+		int y = topDown ? fileRow : (d->height-1-fileRow);
+		unsigned char *data = (d->layout == IMAGE_PIXELS_BGR8) ? ImageDestRow( d, y ) : line;
+		size_t got = truncated ? 0 : fread( data, 1, rowBytes, fp );
+		if (got < (size_t)rowBytes)
 		{
-			*(img+(yy*3*imgWidth)+3*x+2) = tmp[3*x+0]; 
-			*(img+(yy*3*imgWidth)+3*x+1) = tmp[3*x+1]; 
-			*(img+(yy*3*imgWidth)+3*x+0) = tmp[3*x+2]; 
+			if (!truncated)
+			{
+				sprintf( buf, "ReadBMP() found '%s' truncated!  Missing pixels are black.", f);
+				Warning( buf );
+			}
+			truncated = true;
+			memset( data+got, 0, rowBytes - got );
 		}
+		else if (lineLength > rowBytes)
+			fseek( fp, lineLength - rowBytes, SEEK_CUR );
+		WritePixelRow( d, y, data, IMAGE_PIXELS_BGR8 );
     }
 
+    free( line );
+}
+
+/* Decodes a BMP into the destination (for DecodeImage()) */
+void DecodeBMP( const char *f, const ImageDest *d )
+{
+	int width, height;
+	bool topDown;
+	FILE *fp = OpenBMP( f, &width, &height, &topDown );
+	if (width != d->width || height != d->height)
+		FatalError( "ReadBMP() found the size of '%s' changed while reading it!", (char *)f );
+	ReadBMPPixels( fp, f, topDown, d );
+	fclose( fp );
+}
+
+/* Rows come back in file order (bottom up) unless invertY is given */
+unsigned char *ReadBMP( char *f, int *width, int *height, bool invertY )
+{
+	bool topDown;
+	FILE *fp = OpenBMP( f, width, height, &topDown );
+
+    /* Creates the image */
+    unsigned char *img = (unsigned char *) malloc( 3 * (*width) * (*height) * sizeof( unsigned char ) );
+	if (!img)
+		FatalError( "Unable to allocate memory in ReadBMP()!");
+   
+	ImageDest d = { img, 3*(*width), IMAGE_PIXELS_RGB8, *width, *height, !invertY };
+	ReadBMPPixels( fp, f, topDown, &d );
+
 	/* cleanup */
-    free( tmp );
 	fclose( fp );
  
 	/* return our image */
-	*width = imgWidth;
-	*height = imgHeight;
     return img;
 }
 
@@ -189,14 +246,10 @@ int WriteBMP( char *f, int width, int height, unsigned char *ptr )
 
 
 
-/* Reads an unsigned short from a file in little endian format */
-static unsigned short int ReadUnsignedShort(FILE *fp)
+/* Gets an unsigned short, stored in little endian format, from a buffer */
+static unsigned short int GetUnsignedShort(const unsigned char *p)
 {
-    unsigned short int lsb, msb;
-
-    lsb = getc(fp);
-    msb = getc(fp);
-    return (msb << 8) | lsb;
+    return (unsigned short int)((p[1] << 8) | p[0]);
 }
 
 
@@ -212,16 +265,10 @@ static void WriteUnsignedShort(unsigned short int x, FILE *fp)
     putc(msb, fp);
 }
 
-/* Reads as unsigned int word from a file in little endian format */
-static unsigned int ReadUnsignedInt(FILE *fp)
+/* Gets an unsigned int, stored in little endian format, from a buffer */
+static unsigned int GetUnsignedInt(const unsigned char *p)
 {
-    unsigned int b1, b2, b3, b4;
-
-    b1 = getc(fp);
-    b2 = getc(fp);
-    b3 = getc(fp);
-    b4 = getc(fp);
-    return (b4 << 24) | (b3 << 16) | (b2 << 8) | b1;
+    return ((unsigned int)p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
 }
 
 
@@ -242,16 +289,10 @@ static void WriteUnsignedInt(unsigned int x, FILE *fp)
 }
 
 
-/* Reads an int word from a file in little endian format */
-static int ReadInt(FILE *fp)
+/* Gets an int, stored in little endian format, from a buffer */
+static int GetInt(const unsigned char *p)
 {
-    int b1, b2, b3, b4;
-
-    b1 = getc(fp);
-    b2 = getc(fp);
-    b3 = getc(fp);
-    b4 = getc(fp);
-    return (b4 << 24) | (b3 << 16) | (b2 << 8) | b1;
+    return (int)GetUnsignedInt(p);
 }
 
 
@@ -44,7 +44,8 @@
 /*              right, and pixels are stored in scan-line order.            */
 /*              NOTE: Not the layout from the file (where its BGR not RGB)  */
 /*    The values stored in *w and *h are the image width & height           */
-unsigned char *ReadBMP( char *f, int *width, int *height, bool invertY=false );
+/*    (invertY defaults to false in imageIO.h, which most code includes)    */
+unsigned char *ReadBMP( char *f, int *width, int *height, bool invertY );
 
 
 /* Writes an uncompressed 24-bit BMP to the file 'f'                        */
@@ -0,0 +1,145 @@
+/******************************************************************/
+/* imageDecode.cpp                                                */
+/* -----------------------                                        */
+/*                                                                */
+/* Implements ReadImageInfo() and DecodeImage() (see imageIO.h):  */
+/*     identifying files by their first bytes, and converting     */
+/*     rows of pixels into the caller's layout.  The formats      */
+/*     themselves are decoded in their own files.                 */
+/******************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "imageDecode.h"
+
+#pragma warning( disable: 4996 )
+
+static const unsigned char ktxMagic[12] =
+	{ 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+int ImagePixelBytes( int layout )
+{
+	switch( layout )
+	{
+	case IMAGE_PIXELS_L8:      return 1;
+	case IMAGE_PIXELS_LA8:     return 2;
+	case IMAGE_PIXELS_RGB8:
+	case IMAGE_PIXELS_BGR8:    return 3;
+	case IMAGE_PIXELS_RGBA8:
+	case IMAGE_PIXELS_BGRA8:
+	case IMAGE_PIXELS_RGB9E5:  return 4;
+	case IMAGE_PIXELS_RGB16F:  return 6;
+	case IMAGE_PIXELS_RGB32F:  return 12;
+	}
+	return 0;
+}
+
+static bool IsHDRLayout( int layout )
+{
+	return layout == IMAGE_PIXELS_RGB32F || layout == IMAGE_PIXELS_RGB16F ||
+		   layout == IMAGE_PIXELS_RGB9E5;
+}
+
+// Which format has these first bytes?
+static int SniffFormat( const unsigned char *magic, int numBytes )
+{
+	if (numBytes >= 64 && !memcmp( magic, ktxMagic, 12 ))          return IMAGE_FORMAT_KTX;
+	if (numBytes < 2)                                               return IMAGE_FORMAT_UNKNOWN;
+	if (magic[0] == '#' && magic[1] == '?')                         return IMAGE_FORMAT_HDR;
+	if (magic[0] == 'B' && magic[1] == 'M')                         return IMAGE_FORMAT_BMP;
+	if (magic[0] == 0x01 && magic[1] == 0xDA)                       return IMAGE_FORMAT_SGI;
+	if ((magic[0] == 'P' || magic[0] == 'p') && magic[1] >= '1' && magic[1] <= '6')
+		return IMAGE_FORMAT_PPM;
+	return IMAGE_FORMAT_UNKNOWN;
+}
+
+bool ReadImageInfo( const char *filename, ImageInfo *info )
+{
+	memset( info, 0, sizeof(ImageInfo) );
+	FILE *f = fopen( filename, "rb" );
+	if (!f) return false;
+
+	unsigned char magic[64];
+	int numBytes = (int)fread( magic, 1, 64, f );
+	fseek( f, 0, SEEK_SET );
+
+	bool ok = false;
+	info->format = SniffFormat( magic, numBytes );
+	switch( info->format )
+	{
+	case IMAGE_FORMAT_PPM:   ok = ReadPPMInfo( f, info );    break;
+	case IMAGE_FORMAT_BMP:   ok = ReadBMPInfo( f, info );    break;
+	case IMAGE_FORMAT_SGI:   ok = ReadSGIInfo( f, info );    break;
+	case IMAGE_FORMAT_HDR:   ok = ReadHDRInfo( f, info );    break;
+	case IMAGE_FORMAT_KTX:
+		// Just the size.  The rest of the header describes GL formats.
+		info->width  = magic[36] | (magic[37] << 8) | (magic[38] << 16) | (magic[39] << 24);
+		info->height = magic[40] | (magic[41] << 8) | (magic[42] << 16) | (magic[43] << 24);
+		ok = true;
+		break;
+	}
+	fclose( f );
+
+	if (!ok) info->format = IMAGE_FORMAT_UNKNOWN;
+	return ok;
+}
+
+bool DecodeImage( const char *filename, void *dst, int rowPitch, int layout, bool invertY )
+{
+	ImageInfo info;
+	if (!ReadImageInfo( filename, &info ) || info.format == IMAGE_FORMAT_KTX) return false;
+	if (!dst || !ImagePixelBytes( layout ) || layout >= IMAGE_PIXELS_L8 ||
+		rowPitch < info.width * ImagePixelBytes( layout ))
+		return false;
+	if (info.isHDR != IsHDRLayout( layout ))
+	{
+		Error( "DecodeImage() can't convert '%s' to the requested pixel layout!", (char *)filename );
+		return false;
+	}
+
+	ImageDest d = { (unsigned char *)dst, rowPitch, layout, info.width, info.height, invertY };
+	switch( info.format )
+	{
+	case IMAGE_FORMAT_PPM:   DecodePPM( filename, &d );    break;
+	case IMAGE_FORMAT_BMP:   DecodeBMP( filename, &d );    break;
+	case IMAGE_FORMAT_SGI:   DecodeSGI( filename, &d );    break;
+	case IMAGE_FORMAT_HDR:   DecodeHDR( filename, &d );    break;
+	}
+	return true;
+}
+
+void WritePixelRow( const ImageDest *d, int y, const unsigned char *src, int srcLayout )
+{
+	unsigned char *dst = ImageDestRow( d, y );
+	if (srcLayout == d->layout)
+	{
+		if (dst != src) memcpy( dst, src, d->width * ImagePixelBytes( srcLayout ) );
+		return;
+	}
+
+	int srcBytes = ImagePixelBytes( srcLayout ), dstBytes = ImagePixelBytes( d->layout );
+	int srcR = (srcLayout == IMAGE_PIXELS_BGR8 || srcLayout == IMAGE_PIXELS_BGRA8) ? 2 : 0;
+	int dstR = (d->layout == IMAGE_PIXELS_BGR8 || d->layout == IMAGE_PIXELS_BGRA8) ? 2 : 0;
+	for (int x=0; x < d->width; x++, src += srcBytes, dst += dstBytes)
+	{
+		unsigned char r, g, b, a = 255;
+		if (srcBytes <= 2)
+		{
+			r = g = b = src[0];
+			if (srcBytes == 2) a = src[1];
+		}
+		else
+		{
+			r = src[srcR];
+			g = src[1];
+			b = src[2-srcR];
+			if (srcBytes == 4) a = src[3];
+		}
+		dst[dstR]   = r;
+		dst[1]      = g;
+		dst[2-dstR] = b;
+		if (dstBytes == 4) dst[3] = a;
+	}
+}
+
@@ -0,0 +1,51 @@
+/******************************************************************/
+/* imageDecode.h                                                  */
+/* -----------------------                                        */
+/*                                                                */
+/* What the image readers share to implement DecodeImage() (see  */
+/*     imageIO.h).  Each reader produces rows of pixels in the    */
+/*     file's own layout, top row first, and hands them to        */
+/*     WritePixelRow(), which converts them into the caller's     */
+/*     buffer.  Rows already in the caller's layout are decoded   */
+/*     in place, using ImageDestRow().                            */
+/******************************************************************/
+
+#ifndef __IMAGE_DECODE_H__
+#define __IMAGE_DECODE_H__
+
+#include <stdio.h>
+#include "imageIO.h"
+
+// Extra layouts for rows handed to WritePixelRow()
+#define IMAGE_PIXELS_L8        100   // Gray
+#define IMAGE_PIXELS_LA8       101   // Gray and alpha
+
+// Where (and how) to decode an image
+typedef struct {
+	unsigned char *dst;
+	long rowPitch;
+	int layout, width, height;
+	bool invertY;
+} ImageDest;
+
+// Where row y (counting from the top of the image) goes
+inline unsigned char *ImageDestRow( const ImageDest *d, int y )
+{
+	return d->dst + (d->invertY ? d->height-1-y : y) * d->rowPitch;
+}
+
+// Convert a row of 8-bit pixels in 'srcLayout' into row y of the image
+void WritePixelRow( const ImageDest *d, int y, const unsigned char *src, int srcLayout );
+
+// Per format:  read the header of an open file, and decode a whole file
+bool ReadPPMInfo( FILE *f, ImageInfo *info );
+bool ReadBMPInfo( FILE *f, ImageInfo *info );
+bool ReadSGIInfo( FILE *f, ImageInfo *info );
+bool ReadHDRInfo( FILE *f, ImageInfo *info );
+void DecodePPM( const char *filename, const ImageDest *d );
+void DecodeBMP( const char *filename, const ImageDest *d );
+void DecodeSGI( const char *filename, const ImageDest *d );
+void DecodeHDR( const char *filename, const ImageDest *d );
+
+#endif
+
@@ -20,7 +20,12 @@ unsigned char *ReadRGB( const char *name, int *width, int *height, int *componen
 
 // Reads '.hdr' and '.rgbe' files  (Greg Ward's format).
 //   -> Note the header parser is a bit fragile...
-float *ReadHDR( char *filename, int *width, int *height );
+//   -> Returns 3 floats per pixel.  The other versions return 3 half
+//      floats (for GL_RGB16F) or one packed GL_RGB9_E5 value per pixel,
+//      using a half or a quarter of the memory.
+float *ReadHDR( char *filename, int *width, int *height, bool invertY=false );
+unsigned short *ReadHDRHalf( char *filename, int *width, int *height, bool invertY=false );
+unsigned int *ReadHDRRGB9E5( char *filename, int *width, int *height, bool invertY=false );
 
 // Reads '.bmp' files (Windows bitmaps)
 unsigned char *ReadBMP( char *f, int *width, int *height, bool invertY=false );
@@ -30,6 +35,42 @@ unsigned char *ReadBMP( char *f, int *width, int *height, bool invertY=false );
 unsigned char *ReadPPM( char *f, int *mode, int *width, int *height, bool invertY=false );
 
 
+// Decoding into your own memory.  ReadImageInfo() finds a file's format
+//   from its first bytes (not its extension) and reads its size, without
+//   decoding anything.  DecodeImage() then writes the pixels straight into
+//   'dst' (which can be a mapped pixel buffer), starting a new row every
+//   'rowPitch' bytes, in the given IMAGE_PIXELS_* layout.  8-bit images
+//   decode to the 8-bit layouts and HDR images to the float ones.
+//   -> Rows go top to bottom, or bottom to top (OpenGL's order) with invertY.
+//   -> Both return false if the file isn't a format they know.  Damaged
+//      files are fatal errors, as with the Read*() functions.
+#define IMAGE_FORMAT_UNKNOWN   0
+#define IMAGE_FORMAT_PPM       1   // Also PGM and PBM
+#define IMAGE_FORMAT_BMP       2
+#define IMAGE_FORMAT_SGI       3   // '.rgb' and '.rgba'
+#define IMAGE_FORMAT_HDR       4
+#define IMAGE_FORMAT_KTX       5   // Only recognized.  See Utils/textureContainer.h
+
+#define IMAGE_PIXELS_RGB8      1
+#define IMAGE_PIXELS_RGBA8     2
+#define IMAGE_PIXELS_BGR8      3
+#define IMAGE_PIXELS_BGRA8     4
+#define IMAGE_PIXELS_RGB32F    5   // For GL_FLOAT
+#define IMAGE_PIXELS_RGB16F    6   // For GL_HALF_FLOAT_ARB
+#define IMAGE_PIXELS_RGB9E5    7   // For GL_UNSIGNED_INT_5_9_9_9_REV_EXT
+
+typedef struct {
+	int format;                    // IMAGE_FORMAT_*
+	int width, height;
+	int components;                // Channels stored in the file
+	bool hasAlpha, isHDR;
+} ImageInfo;
+
+bool ReadImageInfo( const char *filename, ImageInfo *info );
+bool DecodeImage( const char *filename, void *dst, int rowPitch, int layout, bool invertY=false );
+int ImagePixelBytes( int layout );
+
+
 // Error code used by image I/O routines.  Can be useful elsewhere too!
 void FatalError( char *msg );    // a fatal, terminating error 
 void Error( char *msg );         // a non-fatal, non-terminating error 
@@ -10,7 +10,12 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include "rgbe.h"
+#include "imageDecode.h"
+#include "Utils/parallelFor.h"
+#include "Utils/halfFloat.h"
 
 void FatalHDRError( char *str, char *fname )
 {
@@ -18,32 +23,297 @@ void FatalHDRError( char *str, char *fname )
   exit(-1);
 }
 
-float *ReadHDR(char *filename, int *w, int *h )
+/*
+** The pixel data is read with one fread(), then a quick pass finds
+**    where each run-length encoded scanline starts, so the scanlines
+**    can be decoded (and converted) on several threads at once.  Each
+**    scanline is decoded to raw 4-byte RGBE pixels in a small buffer,
+**    then converted to floats, half floats, or RGB9E5 straight into
+**    the destination, so there's never a whole image of RGBE pixels.
+*/
+
+/* largest image we'll allocate memory for */
+#define HDR_MAX_PIXELS  (1<<28)
+
+/* 2^(e-136) for each RGBE exponent, with 0 for e=0 (see rgbe2float) */
+static float rgbeScale[256];
+
+static void BuildScaleTable( void )
+{
+  static int built = 0;
+  if (built) return;
+  rgbeScale[0] = 0;
+  for (int e=1; e < 256; e++)
+    rgbeScale[e] = (float) ldexp( 1.0, e-(int)(128+8) );
+  built = 1;
+}
+
+/* converts a row of RGBE pixels */
+typedef void (*RGBERowFunc)( const unsigned char *src, unsigned char *dst, int width );
+
+typedef struct {
+  unsigned char *payload;         /* file data after the header          */
+  long *lineStart;                /* offset of each scanline in payload, */
+                                  /*    or NULL if it isn't RLE encoded  */
+  int width, height;
+} RGBEFile;
+
+typedef struct {
+  const RGBEFile *file;
+  const ImageDest *dest;
+  RGBERowFunc convert;
+} HDRDecodeJob;
+
+/*
+** Walk one RLE scanline starting at 'pos' without decoding it.  Returns
+**    the offset just past the scanline, or -1 if it's bad or truncated.
+*/
+static long SkipScanline( const unsigned char *data, long pos, long size, int width )
+{
+  if (pos+4 > size) return -1;
+  if (data[pos] != 2 || data[pos+1] != 2 || (data[pos+2] & 0x80) ||
+      (((int)data[pos+2])<<8 | data[pos+3]) != width)
+    return -1;
+  pos += 4;
+  for (int c=0; c < 4; c++)
+  {
+    int x = 0;
+    while (x < width)
+    {
+      if (pos+2 > size) return -1;
+      int count = data[pos];
+      if (count > 128) { count -= 128; pos += 2; }
+      else             { pos += 1+count; }
+      if (count == 0 || count > width - x) return -1;
+      x += count;
+    }
+  }
+  return (pos > size) ? -1 : pos;
+}
+
+/* Decode an RLE scanline (already checked by SkipScanline) to RGBE pixels */
+static void DecodeScanline( const unsigned char *src, unsigned char *dst, int width )
+{
+  src += 4;
+  for (int c=0; c < 4; c++)
+  {
+    unsigned char *ptr = dst + c, *end = dst + 4*width;
+    while (ptr < end)
+    {
+      int count = *src++;
+      if (count > 128)
+      {
+        unsigned char val = *src++;
+        for (count -= 128; count > 0; count--, ptr += 4) *ptr = val;
+      }
+      else
+        for (; count > 0; count--, ptr += 4) *ptr = *src++;
+    }
+  }
+}
+
+/*
+** Read the header and pixel data of an image, and find its scanlines.
+**    Handles flat and new-style RLE files, like the routines in rgbe.cpp.
+*/
+static void ReadRGBEFile( const char *filename, RGBEFile *file )
 {
   FILE *f;
-  float *tmpbuf;
   int width, height;
+  char *fname = (char *)filename;
 
   /* open the file */
   f = fopen( filename, "rb" );
-  if (!f) FatalHDRError( "Unable to load image file \"%s\" in loadHDR()!\n", filename ); 
+  if (!f) FatalHDRError( "Unable to load image file \"%s\" in loadHDR()!\n", fname );
 
   /* read in header information */
   if (RGBE_ReadHeader( f, &width, &height, NULL ) != RGBE_RETURN_SUCCESS)
-    FatalHDRError( "Unable to read HDR header in image \"%s\"!\n", filename );
-
-  /* allocate memory, both temporary & final */
-  tmpbuf = (float *)malloc( 3 * width * height * sizeof(float) );
-  if (!tmpbuf ) FatalHDRError( "Unable to allocate memory for image \"%s\"!\n", filename );
+    FatalHDRError( "Unable to read HDR header in image \"%s\"!\n", fname );
+  if (width <= 0 || height <= 0 || (long long)width*height > HDR_MAX_PIXELS)
+    FatalHDRError( "Bad image size in HDR image \"%s\"!\n", fname );
 
-  /* read in the image data */
-  if (RGBE_ReadPixels_RLE(f, tmpbuf, width, height) != RGBE_RETURN_SUCCESS)
-    FatalHDRError( "Unable to read HDR data in image \"%s\"!\n", filename );
-  
-  /* clse the file */
+  /* read everything after the header at once */
+  long start = ftell( f );
+  fseek( f, 0, SEEK_END );
+  long size = ftell( f ) - start;
+  fseek( f, start, SEEK_SET );
+  unsigned char *payload = (unsigned char *)malloc( size > 0 ? size : 1 );
+  if (!payload) FatalHDRError( "Unable to allocate memory for image \"%s\"!\n", fname );
+  if (size <= 0 || (long)fread( payload, 1, size, f ) != size)
+    FatalHDRError( "Unable to read HDR data in image \"%s\"!\n", fname );
   fclose(f);
- 
-  *w = width;
-  *h = height;
-  return tmpbuf;
+
+  file->payload = payload;
+  file->lineStart = NULL;
+  file->width = width;
+  file->height = height;
+
+  /* a file that isn't run length encoded is just the pixels */
+  if (width < 8 || width > 0x7fff || payload[0] != 2 || payload[1] != 2 || (payload[2] & 0x80))
+  {
+    if (size < 4 * (long)width * height)
+      FatalHDRError( "Unable to read HDR data in image \"%s\"!\n", fname );
+    return;
+  }
+
+  /* find where each scanline starts, checking them as we go */
+  file->lineStart = (long *)malloc( height * sizeof(long) );
+  if (!file->lineStart) FatalHDRError( "Unable to allocate memory for image \"%s\"!\n", fname );
+  long pos = 0;
+  for (int y=0; y < height; y++)
+  {
+    file->lineStart[y] = pos;
+    pos = SkipScanline( payload, pos, size, width );
+    if (pos < 0) FatalHDRError( "Unable to read HDR data in image \"%s\"!\n", fname );
+  }
+}
+
+/*
+** Conversions from RGBE.  These are simple loops over a row with no
+**    branches in the common case, so the compiler can vectorize them.
+*/
+static void RowToFloat( const unsigned char *src, unsigned char *out, int width )
+{
+  float *dst = (float *)out;
+  for (int x=0; x < width; x++, src += 4, dst += 3)
+  {
+    float f = rgbeScale[src[3]];
+    dst[0] = src[0] * f;
+    dst[1] = src[1] * f;
+    dst[2] = src[2] * f;
+  }
+}
+
+static void RowToHalf( const unsigned char *src, unsigned char *out, int width )
+{
+  unsigned short *dst = (unsigned short *)out;
+  for (int x=0; x < width; x++, src += 4, dst += 3)
+  {
+    float f = rgbeScale[src[3]];
+    dst[0] = FloatToHalf( src[0] * f );
+    dst[1] = FloatToHalf( src[1] * f );
+    dst[2] = FloatToHalf( src[2] * f );
+  }
+}
+
+/*
+** RGB9E5 is also a shared exponent format:  value = m * 2^(e-24) with
+**    9-bit mantissas and a 5-bit exponent.  RGBE is m * 2^(e-136) with
+**    8-bit mantissas, so we just double the mantissas and rebias the
+**    exponent, which is exact unless it is outside RGB9E5's range.
+*/
+static void RowToRGB9E5( const unsigned char *src, unsigned char *out, int width )
+{
+  unsigned int *dst = (unsigned int *)out;
+  for (int x=0; x < width; x++, src += 4)
+  {
+    int e = src[3] - 113;
+    unsigned int r = src[0] << 1, g = src[1] << 1, b = src[2] << 1;
+    if (src[3] == 0)
+      r = g = b = e = 0;
+    else if (e > 31)               /* too bright:  clamp to the max */
+    {
+      int shift = (e-31 > 9) ? 9 : e-31;
+      r <<= shift; g <<= shift; b <<= shift;
+      if (r > 511) r = 511;
+      if (g > 511) g = 511;
+      if (b > 511) b = 511;
+      e = 31;
+    }
+    else if (e < 0)                /* too dim:  denormalize */
+    {
+      int shift = (-e > 31) ? 31 : -e;
+      r >>= shift; g >>= shift; b >>= shift;
+      e = 0;
+    }
+    dst[x] = r | (g << 9) | (b << 18) | ((unsigned int)e << 27);
+  }
+}
+
+/* ParallelFor() callback:  decode and convert scanlines [first,last) */
+static void DecodeAndConvertRange( int first, int last, void *data )
+{
+  HDRDecodeJob *job = (HDRDecodeJob *)data;
+  const RGBEFile *file = job->file;
+  unsigned char *rgbe = file->lineStart ? (unsigned char *)malloc( 4*file->width ) : NULL;
+  for (int y=first; y < last; y++)
+  {
+    const unsigned char *src = file->payload + 4*(long)file->width*y;
+    if (rgbe)
+    {
+      DecodeScanline( file->payload + file->lineStart[y], rgbe, file->width );
+      src = rgbe;
+    }
+    job->convert( src, ImageDestRow( job->dest, y ), file->width );
+  }
+  if (rgbe) free( rgbe );
+}
+
+/* Decode and convert a file read by ReadRGBEFile(), then free its data */
+static void ConvertRGBEFile( RGBEFile *file, const ImageDest *d )
+{
+  HDRDecodeJob job;
+  BuildScaleTable();
+  job.file = file;
+  job.dest = d;
+  job.convert = RowToFloat;
+  if (d->layout == IMAGE_PIXELS_RGB16F)     job.convert = RowToHalf;
+  else if (d->layout == IMAGE_PIXELS_RGB9E5) job.convert = RowToRGB9E5;
+
+  ParallelFor( file->height, DecodeAndConvertRange, &job, 16 );
+
+  if (file->lineStart) free( file->lineStart );
+  free( file->payload );
+}
+
+/* The size of an HDR image (for ReadImageInfo()) */
+bool ReadHDRInfo( FILE *f, ImageInfo *info )
+{
+  if (RGBE_ReadHeader( f, &info->width, &info->height, NULL ) != RGBE_RETURN_SUCCESS)
+    return false;
+  info->components = 3;
+  info->isHDR = true;
+  return info->width > 0 && info->height > 0;
+}
+
+/* Decode an HDR image into the destination (for DecodeImage()) */
+void DecodeHDR( const char *filename, const ImageDest *d )
+{
+  RGBEFile file;
+  ReadRGBEFile( filename, &file );
+  if (file.width != d->width || file.height != d->height)
+    FatalHDRError( "The size of HDR image \"%s\" changed while reading it!\n", (char *)filename );
+  ConvertRGBEFile( &file, d );
+}
+
+/* Read an image into newly allocated memory, in the given layout */
+static void *ReadAndConvertHDR( char *filename, int *w, int *h, bool invertY, int layout )
+{
+  RGBEFile file;
+  ReadRGBEFile( filename, &file );
+  long rowPitch = ImagePixelBytes( layout ) * (long)file.width;
+  unsigned char *out = (unsigned char *)malloc( rowPitch * file.height );
+  if (!out) FatalHDRError( "Unable to allocate memory for image \"%s\"!\n", filename );
+
+  ImageDest d = { out, rowPitch, layout, file.width, file.height, invertY };
+  ConvertRGBEFile( &file, &d );
+
+  *w = file.width;
+  *h = file.height;
+  return out;
+}
+
+float *ReadHDR(char *filename, int *w, int *h, bool invertY )
+{
+  return (float *)ReadAndConvertHDR( filename, w, h, invertY, IMAGE_PIXELS_RGB32F );
+}
+
+unsigned short *ReadHDRHalf(char *filename, int *w, int *h, bool invertY )
+{
+  return (unsigned short *)ReadAndConvertHDR( filename, w, h, invertY, IMAGE_PIXELS_RGB16F );
+}
+
+unsigned int *ReadHDRRGB9E5(char *filename, int *w, int *h, bool invertY )
+{
+  return (unsigned int *)ReadAndConvertHDR( filename, w, h, invertY, IMAGE_PIXELS_RGB9E5 );
 }
@@ -1,7 +1,9 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include "ppm.h"
+#include "imageDecode.h"
 
 /* 
 ** check if integer specified is a valid 
@@ -85,109 +87,259 @@ void Warning( char *formatStr, char *insertThisStr )
 
 
 
-/* read a texture from a file */
-unsigned char *ReadPPM( char *f, int *mode, int *width, int *height, bool invertY )
+/* Largest image we'll try to allocate (keeps 3*w*h from overflowing) */
+#define PPM_MAX_PIXELS   (0x7FFFFFFF / 6)
+
+/*
+** read the next number in a PPM header (or ASCII pixels).  comments 
+** (starting with '#') may appear anywhere, not just after the first line.  
+** the single whitespace character ending the number is consumed, so 
+** after the last header field the file is positioned at the pixels.
+** returns -1 if there is no number.
+*/
+static int ReadHeaderInt( FILE *infile )
+{
+  int c = getc(infile), value = 0, digits = 0;
+
+  while (c != EOF)
+    {
+      if (c == '#')
+        while (c != EOF && c != '\n' && c != '\r') c = getc(infile);
+      else if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f')
+        c = getc(infile);
+      else
+        break;
+    }
+
+  while (c >= '0' && c <= '9' && digits < 9)
+    {
+      value = 10*value + (c - '0');
+      digits++;
+      c = getc(infile);
+    }
+  if (c != EOF && c != ' ' && c != '\t' && c != '\n' && c != '\r')
+    ungetc(c, infile);
+  return digits ? value : -1;
+}
+
+/*
+** read the magic number, size, and maximum value.  returns NULL if they
+** look OK, or else an error message (with a %s for the file name).
+*/
+static const char *ReadPPMHeader( FILE *infile, int *mode, int *width, int *height, int *img_max )
+{
+  int c0 = getc(infile), c1 = getc(infile);
+  *mode = c1-'0';
+  if ((!IsValidMode(*mode)) || (c0 != 'P' && c0 != 'p'))
+    return "LIBGFX: Invalid PPM format specification in '%s'!";
+
+  /* image size and max component value (comments may be anywhere) */
+  *width = ReadHeaderInt( infile );
+  *height = ReadHeaderInt( infile );
+  if (*width <= 0 || *height <= 0 || (long long)(*width) * (*height) > PPM_MAX_PIXELS)
+    return "LIBGFX: Invalid or unsupported image size in '%s'!";
+
+  /* PBMs are just 1's and 0's, so there's no max_component */
+  *img_max = 1;
+  if (*mode != PBM_RAW && *mode != PBM_ASCII)
+    {
+      *img_max = ReadHeaderInt( infile );
+      if (*img_max > 65535 || *img_max <= 0)
+        return "LIBGFX: Invalid value for maximum image color in '%s'!";
+    }
+  return NULL;
+}
+
+/* open a PPM and read its header.  bad files are fatal errors. */
+static FILE *OpenPPM( const char *f, int *mode, int *width, int *height, int *img_max )
 {
   FILE *infile;
-  char string[256], buf[80];
-  unsigned char *texImage;
-  int i, j, count=0, img_max;
-  long img_size;
-  int r, g, b, bw, c=0, raw=0, ascii=0;
-    
-  /* open file containing texture */
+  char buf[512];
+  const char *err;
+
   if ((infile = fopen(f, "rb")) == NULL) {
     sprintf(buf, "LIBGFX: Can't open file '%s'!", f);
     FatalError( buf );
   }
-  
-  /* read and discard first line (the P3 or P6, etc...) */
-  fgets(string, 256, infile);
-  *mode = string[1]-'0';
-  if ((!IsValidMode(*mode)) || (string[0] != 'P' && string[0] != 'p'))
+  if ((err = ReadPPMHeader( infile, mode, width, height, img_max )) != NULL)
     {
-      sprintf(buf, "LIBGFX: Invalid PPM format specification in '%s'!", f);
-      FatalError(buf);
+      sprintf(buf, err, f);
+      FatalError( buf );
     }
-  raw = RawMode( *mode );
-  ascii = ASCIIMode( *mode );
+  return infile;
+}
 
-  /* discard all the comments at the top of the file               */
-  /* if there are comments elsewhere, this code doesn't handle it! */
-  fgets(string, 256, infile);
-  while (string[0] == '#')
-     fgets(string, 256, infile);
+/* the size and channels of a PPM (for ReadImageInfo()) */
+bool ReadPPMInfo( FILE *infile, ImageInfo *info )
+{
+  int mode, img_max;
+  if (ReadPPMHeader( infile, &mode, &info->width, &info->height, &img_max ))
+    return false;
+  info->components = (mode == PPM_RAW || mode == PPM_ASCII) ? 3 : 1;
+  return true;
+}
 
-  /* read image size and max component value */
-  sscanf(string, "%d %d", width, height);
-  
-  /* PBMs are just 1's and 0's, so there's no max_component */
-  if (*mode != PBM_RAW && *mode != PBM_ASCII)
+/*
+** a table rescaling samples 0..img_max to 0..255, or NULL if they already
+** are.  callers clamp samples to img_max before looking them up.
+*/
+static unsigned char *BuildSampleLUT( int img_max )
+{
+  if (img_max == 255) return NULL;
+  unsigned char *lut = (unsigned char *)malloc( img_max+1 );
+  if (!lut) FatalError("LIBGFX: Cannot allocate memory for image!");
+  for (int v=0; v <= img_max; v++)
+    lut[v] = (unsigned char)( (v*255L + img_max/2) / img_max );
+  return lut;
+}
+
+/*
+** read the pixels of a raw (binary) PPM/PGM/PBM a row at a time, and 
+** convert them into the destination.  8-bit color rows are read straight
+** into the destination when it wants RGB.  16-bit samples (maximum
+** values over 255) are big endian.
+*/
+static void ReadRawPixels( FILE *infile, const char *f, int mode, int img_max, const ImageDest *d )
+{
+  int width = d->width, height = d->height;
+  int sampleBytes = (img_max > 255) ? 2 : 1;
+  int channels = (mode == PPM_RAW) ? 3 : 1;
+  long rowBytes = (mode == PBM_RAW) ? (width+7)/8 : width * channels * sampleBytes;
+  bool rgbRows = (mode == PPM_RAW && sampleBytes == 1 && img_max == 255);
+  bool truncated = false;
+  char buf[512];
+
+  unsigned char *row = (unsigned char *)malloc( rowBytes );
+  unsigned char *out = (unsigned char *)malloc( 3*width );
+  if (!row || !out) FatalError("LIBGFX: Cannot allocate memory for image!");
+
+  /* rescale to 0..255 through a table, unless the file already is */
+  unsigned char *lut = (mode != PBM_RAW) ? BuildSampleLUT( img_max ) : NULL;
+
+  for (int y=0; y < height; y++)
+    {
+      unsigned char *data = (rgbRows && d->layout == IMAGE_PIXELS_RGB8) ? ImageDestRow( d, y ) : row;
+      long got = truncated ? 0 : (long)fread( data, 1, rowBytes, infile );
+      if (got < rowBytes)
+        {
+          if (!truncated)
+            {
+              sprintf(buf, "LIBGFX: '%s' is shorter than its header says!  Missing pixels are black.", f);
+              Warning( buf );
+            }
+          truncated = true;
+          memset( data+got, 0, rowBytes-got );
+        }
+
+      if (rgbRows)
+        WritePixelRow( d, y, data, IMAGE_PIXELS_RGB8 );
+      else if (mode == PBM_RAW)   /* 1 bits are black, rows padded to a whole byte */
+        {
+          for (int x=0; x < width; x++)
+            out[x] = (data[x/8] & (0x80 >> (x%8))) ? 0 : 255;
+          WritePixelRow( d, y, out, IMAGE_PIXELS_L8 );
+        }
+      else
+        {
+          for (long i=0; i < width*channels; i++)
+            {
+              int v = (sampleBytes == 2) ? ((data[2*i] << 8) | data[2*i+1]) : data[i];
+              out[i] = lut ? lut[ v > img_max ? img_max : v ] : (unsigned char)v;
+            }
+          WritePixelRow( d, y, out, channels == 3 ? IMAGE_PIXELS_RGB8 : IMAGE_PIXELS_L8 );
+        }
+    }
+
+  if (lut) free( lut );
+  free( out );
+  free( row );
+}
+
+/* read the pixels following the header into the destination */
+static void ReadPPMPixels( FILE *infile, const char *f, int mode, int img_max, const ImageDest *d )
+{
+  int r, g, b;
+  bool truncated = false;
+  char buf[512];
+
+  if (RawMode( mode ))
     {
-      fscanf(infile, "%d ", &img_max);
-      if ((raw && img_max > 255) || (img_max <= 0))
-	  FatalError( "LIBGFX: Invalid value for maximum image color!" );
+      ReadRawPixels( infile, f, mode, img_max, d );
+      return;
     }
 
+  /* ASCII modes.  samples are read like header fields, so comments may 
+  ** appear between them.  once a sample is missing (or isn't a number), 
+  ** the rest of the image is black, as with a short raw file.  samples are
+  ** clamped and rescaled just like raw ones. */
+  unsigned char *lut = (mode != PBM_ASCII) ? BuildSampleLUT( img_max ) : NULL;
+  unsigned char *row = (unsigned char *)malloc( 3*d->width );
+  if (!row) FatalError("LIBGFX: Cannot allocate memory for image!");
+  for (int i=0; i < d->height; i++) {
+    for (int j=0; j < d->width; j++) {
+      r = g = b = 0;
+      if (!truncated)
+        {
+          r = ReadHeaderInt( infile );
+          if (mode==PPM_ASCII && r >= 0) g = ReadHeaderInt( infile );
+          if (mode==PPM_ASCII && g >= 0) b = ReadHeaderInt( infile );
+        }
+      if (!truncated && (r < 0 || g < 0 || b < 0))
+        {
+          sprintf(buf, "LIBGFX: '%s' is shorter than its header says!  Missing pixels are black.", f);
+          Warning( buf );
+          truncated = true;
+          r = g = b = 0;
+        }
+      if (mode==PBM_ASCII)
+        {
+          if (r!=1 && r!=0) r=0;
+          r=g=b=r*255;
+        }
+      else
+        {
+          if (mode==PGM_ASCII) g=b=r;
+          r = (r > img_max) ? img_max : r;
+          g = (g > img_max) ? img_max : g;
+          b = (b > img_max) ? img_max : b;
+          if (lut) { r = lut[r];  g = lut[g];  b = lut[b]; }
+        }
+      row[3*j+0] = r;
+      row[3*j+1] = g;
+      row[3*j+2] = b;
+    }
+    WritePixelRow( d, i, row, IMAGE_PIXELS_RGB8 );
+  }
+  if (lut) free( lut );
+  free( row );
+}
+
+/* decode a PPM into the destination (for DecodeImage()) */
+void DecodePPM( const char *f, const ImageDest *d )
+{
+  int mode, width, height, img_max;
+  FILE *infile = OpenPPM( f, &mode, &width, &height, &img_max );
+  if (width != d->width || height != d->height)
+    FatalError( "LIBGFX: The size of '%s' changed while reading it!", (char *)f );
+  ReadPPMPixels( infile, f, mode, img_max, d );
+  fclose( infile );
+}
+
+/* read a texture from a file */
+unsigned char *ReadPPM( char *f, int *mode, int *width, int *height, bool invertY )
+{
+  int img_max;
+  unsigned char *texImage;
+
+  FILE *infile = OpenPPM( f, mode, width, height, &img_max );
+
   /* allocate texture array */
-  img_size = 3*(*height)*(*width);
-  if ((texImage = (unsigned char *)calloc(img_size, sizeof(char))) == NULL)
+  if ((texImage = (unsigned char *)calloc( 3*(long)(*height)*(*width), sizeof(char) )) == NULL)
     FatalError("LIBGFX: Cannot allocate memory for image!");
-  
+
   /* read image data */
-  for (i=0; i < *height; i++) {
-    for (j=0; j < *width; j++) {
-	  int loc = invertY ? 3*((*width)*(*height-1-i) + j) : 3*((*width)*i + j);
-      if (raw)
-	    {
-		  if (*mode==PBM_RAW)
-	      {
-	        int bit_pos;
-	        if ((count%8)==0) bw=fgetc(infile);
-	        bit_pos = 7-(count%8);
-	        r=g=b=((bw & (1 << bit_pos))?0:255);
-	        count++;
-	        if ((j+1)==*width) count=0;
-	      }
-	    else if (*mode==PGM_RAW)
-	      r=g=b=fgetc(infile);
-	    else if (*mode==PPM_RAW)
-	      {
-	        r = fgetc(infile);
-	        g = fgetc(infile);
-	        b = fgetc(infile);
-	      }
-	  //texImage[c++] = r;
-	  //texImage[c++] = g;
-	  //texImage[c++] = b;
-	  texImage[loc+0] = r;
-	  texImage[loc+1] = g;
-	  texImage[loc+2] = b;
-	  }
-      else /* then ASCII mode */
-	  {
-	    if (*mode==PBM_ASCII)
-	      {
-	        fscanf(infile, "%d", &r);
-	        if (r!=1 && r!=0) r=0;
-	        r=g=b=r*255;
-	      }
-	    else if (*mode==PGM_ASCII)
-	      {
-	        fscanf(infile, "%d", &r);
-	        r=g=b=r;
-	      }
-	    else if (*mode==PPM_ASCII)
-	    fscanf(infile, "%d %d %d", &r, &g, &b);
-	    //texImage[c++] = r;
-	    //texImage[c++] = g;
-	    //texImage[c++] = b;
-		texImage[loc+0] = r;
-		texImage[loc+1] = g;
-		texImage[loc+2] = b;
-	  }
-    }
-  }
+  ImageDest d = { texImage, 3*(*width), IMAGE_PIXELS_RGB8, *width, *height, invertY };
+  ReadPPMPixels( infile, f, *mode, img_max, &d );
  
   fclose( infile );
   
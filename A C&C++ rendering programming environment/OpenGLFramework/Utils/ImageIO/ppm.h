@@ -46,7 +46,9 @@
 /*              right, and pixels are stored in scan-line order.            */
 /*    The value stored in *mode is one of the modes above (e.g., PPM_ASCII) */
 /*    The values stored in *w and *h are the image width & height           */             
-unsigned char *ReadPPM( char *f, int *mode, int *width, int *height, bool invertY=false );
+/*    Samples are scaled to 0..255 (so 16-bit files are reduced to 8 bits). */
+/*    (invertY defaults to false in imageIO.h, which most code includes)    */
+unsigned char *ReadPPM( char *f, int *mode, int *width, int *height, bool invertY );
 
 /* Writes a PPM/PGM/PBM to the file 'f'                                     */
 /*    Returns:  One of the error codes from above or GFXIO_OK               */
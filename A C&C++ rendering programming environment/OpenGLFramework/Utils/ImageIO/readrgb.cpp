@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include <stdlib.h> 
 #include <string.h>
+#include "imageDecode.h"
 
 void
 bwtorgba(unsigned char *b,unsigned char *l,int n) {
@@ -209,60 +210,103 @@ ImageGetRow(ImageRec *image, unsigned char *buf, int y, int z) {
     }
 }
 
-unsigned char *
-ReadRGB(const char *name, int *width, int *height, int *components, bool invertY=false ) {
-    unsigned *base, *lptr;
-    unsigned char *rbuf, *gbuf, *bbuf, *abuf;
-    ImageRec *image;
+/* Size and channels of an SGI image (for ReadImageInfo()).  Only 8-bit
+** images are supported. */
+bool ReadSGIInfo(FILE *f, ImageInfo *info) {
+    unsigned char hdr[12];
+
+    if (fread(hdr, 1, 12, f) != 12 || hdr[0] != 0x01 || hdr[1] != 0xDA || hdr[3] != 1)
+	return false;
+    info->width = (hdr[6] << 8) | hdr[7];
+    info->height = (hdr[8] << 8) | hdr[9];
+    info->components = (hdr[10] << 8) | hdr[11];
+    if (info->width <= 0 || info->height <= 0)
+	return false;
+    if (info->components < 1)
+	info->components = 1;
+    info->hasAlpha = (info->components == 2 || info->components >= 4);
+    return true;
+}
+
+/* Expand each row to RGBA (straight into the destination, if it wants
+** RGBA) and convert it into the destination.  Rows are stored bottom up. */
+static void
+ReadSGIPixels(ImageRec *image, const ImageDest *d) {
+    unsigned char *rbuf, *gbuf, *bbuf, *abuf, *rgba;
     int y;
 
-    image = ImageOpen(name);
-    
-    if(!image)
-	return NULL;
-    (*width)=image->xsize;
-    (*height)=image->ysize;
-    (*components)=image->zsize;
-    base = (unsigned *)malloc(image->xsize*image->ysize*sizeof(unsigned));
     rbuf = (unsigned char *)malloc(image->xsize*sizeof(unsigned char));
     gbuf = (unsigned char *)malloc(image->xsize*sizeof(unsigned char));
     bbuf = (unsigned char *)malloc(image->xsize*sizeof(unsigned char));
     abuf = (unsigned char *)malloc(image->xsize*sizeof(unsigned char));
-    if(!base || !rbuf || !gbuf || !bbuf)
-      return NULL;
-    lptr = base;
+    rgba = (unsigned char *)malloc(image->xsize*4*sizeof(unsigned char));
+    if(!rbuf || !gbuf || !bbuf || !abuf || !rgba) {
+	fprintf(stderr, "Out of memory!\n");
+	exit(1);
+    }
     for(y=0; y<image->ysize; y++) {
-	int yy = invertY ? (image->ysize-1-y) : y;
+	int row = image->ysize-1-y;
+	unsigned char *out = (d->layout == IMAGE_PIXELS_RGBA8) ? ImageDestRow(d, row) : rgba;
 	if(image->zsize>=4) {
-	    ImageGetRow(image,rbuf,yy,0);
-	    ImageGetRow(image,gbuf,yy,1);
-	    ImageGetRow(image,bbuf,yy,2);
-	    ImageGetRow(image,abuf,yy,3);
-	    rgbatorgba(rbuf,gbuf,bbuf,abuf,(unsigned char *)lptr,image->xsize);
-	    lptr += image->xsize;
+	    ImageGetRow(image,rbuf,y,0);
+	    ImageGetRow(image,gbuf,y,1);
+	    ImageGetRow(image,bbuf,y,2);
+	    ImageGetRow(image,abuf,y,3);
+	    rgbatorgba(rbuf,gbuf,bbuf,abuf,out,image->xsize);
 	} else if(image->zsize==3) {
-	    ImageGetRow(image,rbuf,yy,0);
-	    ImageGetRow(image,gbuf,yy,1);
-	    ImageGetRow(image,bbuf,yy,2);
-	    rgbtorgba(rbuf,gbuf,bbuf,(unsigned char *)lptr,image->xsize);
-	    lptr += image->xsize;
+	    ImageGetRow(image,rbuf,y,0);
+	    ImageGetRow(image,gbuf,y,1);
+	    ImageGetRow(image,bbuf,y,2);
+	    rgbtorgba(rbuf,gbuf,bbuf,out,image->xsize);
 	} else if(image->zsize==2) {
-	    ImageGetRow(image,rbuf,yy,0);
-	    ImageGetRow(image,abuf,yy,1);
-	    latorgba(rbuf,abuf,(unsigned char *)lptr,image->xsize);
-	    lptr += image->xsize;
+	    ImageGetRow(image,rbuf,y,0);
+	    ImageGetRow(image,abuf,y,1);
+	    latorgba(rbuf,abuf,out,image->xsize);
 	} else {
-	    ImageGetRow(image,rbuf,yy,0);
-	    bwtorgba(rbuf,(unsigned char *)lptr,image->xsize);
-	    lptr += image->xsize;
+	    ImageGetRow(image,rbuf,y,0);
+	    bwtorgba(rbuf,out,image->xsize);
 	}
+	WritePixelRow(d, row, out, IMAGE_PIXELS_RGBA8);
     }
-    ImageClose(image);
     free(rbuf);
     free(gbuf);
     free(bbuf);
     free(abuf);
+    free(rgba);
+}
 
-    return (unsigned char*) base;
+/* Decode an SGI image into the destination (for DecodeImage()) */
+void
+DecodeSGI(const char *name, const ImageDest *d) {
+    ImageRec *image = ImageOpen(name);
+    if (image->xsize != d->width || image->ysize != d->height) {
+	fprintf(stderr, "The size of '%s' changed while reading it!\n", name);
+	exit(1);
+    }
+    ReadSGIPixels(image, d);
+    ImageClose(image);
 }
 
+/* Rows come back in file order (bottom up) unless invertY is given */
+unsigned char *
+ReadRGB(const char *name, int *width, int *height, int *components, bool invertY ) {
+    unsigned char *base;
+    ImageRec *image;
+
+    image = ImageOpen(name);
+    
+    if(!image)
+	return NULL;
+    (*width)=image->xsize;
+    (*height)=image->ysize;
+    (*components)=image->zsize;
+    base = (unsigned char *)malloc(image->xsize*image->ysize*4);
+    if(!base)
+      return NULL;
+
+    ImageDest d = { base, 4*image->xsize, IMAGE_PIXELS_RGBA8, image->xsize, image->ysize, !invertY };
+    ReadSGIPixels(image, &d);
+    ImageClose(image);
+
+    return base;
+}
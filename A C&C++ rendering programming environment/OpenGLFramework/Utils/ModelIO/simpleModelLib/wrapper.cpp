@@ -132,12 +132,12 @@ GLuint HalfEdgeModel::CreateOpenGLVBO( unsigned int flags )
 	// Check to see if the user wants lines, triangles, or (as yet unsupported) triangle adjacency
 	if ( flags & USE_LINES )
 	{
-		if ( edgeVBO > 0 ) { glDeleteBuffers( 1, &edgeVBO ); edgeVBO = 0; }
+		if ( edgeVBO > 0 ) { glState.DeleteBuffers( 1, &edgeVBO ); edgeVBO = 0; }
 		return CreateEdgeVBO( flags );
 	}
 	else
 	{
-		if ( triVBO > 0 ) { glDeleteBuffers( 1, &triVBO ); triVBO = 0; }
+		if ( triVBO > 0 ) { glState.DeleteBuffers( 1, &triVBO ); triVBO = 0; }
 		return CreateTriangleVBO( flags );
 	}
 }
@@ -256,7 +256,7 @@ GLuint HalfEdgeModel::CreateEdgeVBO( unsigned int flags )
 	vboEdgeCount = currentEdge;
 	vboEdgeComponents = numComponents;
 
-	if (edgeVBO > 0) glDeleteBuffers( 1, &edgeVBO );
+	if (edgeVBO > 0) glState.DeleteBuffers( 1, &edgeVBO );
 	glGenBuffers( 1, &edgeVBO );
 	glBindBuffer( GL_ARRAY_BUFFER, edgeVBO );
 	glBufferData( GL_ARRAY_BUFFER, dataSize, floatData, GL_STATIC_DRAW );
@@ -3,7 +3,7 @@
 /* ------------                                                            */
 /*                                                                         */
 /* This is a simple class for grabbing frames from the OpenGL framebuffer. */
-/*                                                                         */  
+/*                                                                         */
 /* (See the header for more useful usage information.)                     */
 /*                                                                         */
 /* Chris Wyman (12/4/2007)                                                 */
@@ -19,31 +19,60 @@
 
 
 
-FrameGrab::FrameGrab( char *baseFileName ): nextFrameNum(0)
+FrameGrab::FrameGrab( char *baseFileName ): nextFrameNum(0),
+	nextPBO(0), frame(0), usePBOs(false), dropWhenBehind(false), nextOrder(0),
+	movie(0), movieFile(0), movieFPS(FRAMEGRAB_MOVIE_FPS), nextMovieNum(0), movieFrames(0),
+	framesCaptured(0), framesWritten(0), framesDropped(0), writeFailures(0), writerWaits(0),
+	writer(0)
 {
+	writer = new ParallelWorker( WriterStep, this );
 	captureBuffer = GL_BACK;
 	baseName = strdup( baseFileName );
+
+	for (int i=0; i < FRAMEGRAB_PBO_RING; i++)
+	{
+		pbo[i] = 0;
+		pboBytes[i] = 0;
+		pboPending[i] = false;
+	}
+	for (int i=0; i < FRAMEGRAB_MAX_QUEUED; i++)
+	{
+		queueState[i] = QUEUE_FREE;
+		queueData[i] = 0;
+		queueDataBytes[i] = 0;
+	}
+
+	// Without pixel buffer objects, frames are read immediately (but still
+	//    written by the writer thread)
+	if (GLEW_ARB_pixel_buffer_object)
+	{
+		glGenBuffers( FRAMEGRAB_PBO_RING, pbo );
+		usePBOs = true;
+	}
 }
 
 FrameGrab::~FrameGrab()
 {
+	StopMovie();
+	Flush();
+	delete writer;
+	for (int i=0; i < FRAMEGRAB_MAX_QUEUED; i++)
+		if (queueData[i]) free( queueData[i] );
+	if (usePBOs) glState.DeleteBuffers( FRAMEGRAB_PBO_RING, pbo );
+	if (movieFile) free( movieFile );
 	free( baseName );
 }
 
 void FrameGrab::CaptureFrame( void )
 {
 	char outputFile[512];
-	int width, height;
-	unsigned char *frameData = GrabWholeFrame( &width, &height );
 	sprintf( outputFile, "%s%d.ppm", baseName, nextFrameNum++ );
-	FrameToPPM( outputFile, frameData, width, height );
+	StartCapture( 0, 0, glutGet( GLUT_WINDOW_WIDTH ), glutGet( GLUT_WINDOW_HEIGHT ), outputFile );
 }
 
-void FrameGrab::CaptureFrame( char *outputFilename ) 
-{ 
-	int width, height;
-	unsigned char *frameData = GrabWholeFrame( &width, &height );
-	FrameToPPM( outputFilename, frameData, width, height ); 
+void FrameGrab::CaptureFrame( char *outputFilename )
+{
+	StartCapture( 0, 0, glutGet( GLUT_WINDOW_WIDTH ), glutGet( GLUT_WINDOW_HEIGHT ), outputFilename );
 }
 
 void FrameGrab::CaptureFrameAsFloat( char *outputFilename )
@@ -51,7 +80,7 @@ void FrameGrab::CaptureFrameAsFloat( char *outputFilename )
 	int capturedWidth = glutGet( GLUT_WINDOW_WIDTH );
 	int capturedHeight = glutGet( GLUT_WINDOW_HEIGHT );
 	float *frameData = (float *)malloc( capturedWidth * capturedHeight * 4 * sizeof( float ) );
-	if (!frameData) 
+	if (!frameData)
 		FatalError("Unable to allocate temporary memory during frame capture!");
 	glPushAttrib( GL_PIXEL_MODE_BIT );
 	glReadBuffer( captureBuffer );
@@ -59,7 +88,7 @@ void FrameGrab::CaptureFrameAsFloat( char *outputFilename )
 	glPopAttrib();
 
 	FILE *out = fopen( outputFilename, "wb");
-	if (!out) 
+	if (!out)
 		FatalError("Unable to capture frame.  fopen() failed!!");
 
 	int count=0;
@@ -67,56 +96,227 @@ void FrameGrab::CaptureFrameAsFloat( char *outputFilename )
 	for (int j=0; j<capturedHeight; j++)
 		for (int i=0; i<capturedWidth; i++)
 		{
-			fprintf( out, "%.8f, %.8f, %.8f, %.8f\n", 
+			fprintf( out, "%.8f, %.8f, %.8f, %.8f\n",
 				frameData[count], frameData[count+1], frameData[count+2], frameData[count+3] );
 			count+= 4;
 		}
 	fclose( out );
+	free( frameData );
 }
 
 void FrameGrab::CaptureFrameRegion( int left, int bottom, int right, int top )
 {
 	char outputFile[512];
-	unsigned char *frameData = GrabFrameRegion( left, bottom, right, top );
 	sprintf( outputFile, "%s%d.ppm", baseName, nextFrameNum++ );
-	FrameToPPM( outputFile, frameData, abs(right-left), abs(top-bottom) );
+	StartCapture( left < right ? left : right, bottom < top ? bottom : top,
+		          abs(right-left), abs(top-bottom), outputFile );
 }
 
-unsigned char *FrameGrab::GrabFrameRegion( int left, int bottom, int right, int top )
+// Colors are read as RGBA, which drivers can copy without converting, and
+//    have their alpha dropped by the writer thread
+void FrameGrab::StartCapture( int left, int bottom, int width, int height, char *f, MovieWriter *m )
 {
-	unsigned char *frameData = (unsigned char *)malloc( abs(right-left) * abs(top-bottom) * 3 * sizeof( unsigned char ) );
-	if (!frameData)
-		FatalError("Unable to allocate temporary memory during frame capture!");
+	if (width <= 0 || height <= 0) return;
+	framesCaptured++;
+
+	if (!usePBOs)
+	{
+		int i = GetQueueEntry( 4*width*height, !m );
+		if (i < 0) return;
+		glPushAttrib( GL_PIXEL_MODE_BIT );
+		glReadBuffer( captureBuffer );
+		glReadPixels( left, bottom, width, height, GL_RGBA, GL_UNSIGNED_BYTE, queueData[i] );
+		glPopAttrib();
+		queueWidth[i] = width;
+		queueHeight[i] = height;
+		strncpy( queueFile[i], f, 511 );
+		queueFile[i][511] = 0;
+		queueMovie[i] = m;
+		QueueEntry( i );
+		return;
+	}
+
+	// Only capturing more than once a frame finds the next readback still
+	//    pending (and has to wait for it)
+	int ring = nextPBO;
+	nextPBO = (nextPBO + 1) % FRAMEGRAB_PBO_RING;
+	if (pboPending[ring]) FinishCapture( ring );
 
 	// Select the correct buffer to read from, then read from it.
 	//    Note this read happens *without* permanently changing the state of the read buffer!
+	glState.BindBuffer( GL_PIXEL_PACK_BUFFER_ARB, pbo[ring] );
+	if (pboBytes[ring] < 4*width*height)
+	{
+		glBufferData( GL_PIXEL_PACK_BUFFER_ARB, 4*width*height, 0, GL_STREAM_READ );
+		pboBytes[ring] = 4*width*height;
+	}
 	glPushAttrib( GL_PIXEL_MODE_BIT );
 	glReadBuffer( captureBuffer );
-	glReadPixels( left, bottom, right-left, top-bottom, GL_RGB, GL_UNSIGNED_BYTE, frameData );
+	glReadPixels( left, bottom, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0 );
 	glPopAttrib();
+	glState.BindBuffer( GL_PIXEL_PACK_BUFFER_ARB, 0 );
+
+	pboWidth[ring] = width;
+	pboHeight[ring] = height;
+	pboFrame[ring] = frame;
+	strncpy( pboFile[ring], f, 511 );
+	pboFile[ring][511] = 0;
+	pboMovie[ring] = m;
+	pboPending[ring] = true;
+}
 
-	return frameData;
+// Copy a readback out of its pixel buffer object, into the queue
+void FrameGrab::FinishCapture( int ring )
+{
+	pboPending[ring] = false;
+	int i = GetQueueEntry( 4*pboWidth[ring]*pboHeight[ring], !pboMovie[ring] );
+	if (i < 0) return;
+
+	glState.BindBuffer( GL_PIXEL_PACK_BUFFER_ARB, pbo[ring] );
+	unsigned char *pixels = (unsigned char *)glMapBuffer( GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY );
+	if (pixels)
+	{
+		memcpy( queueData[i], pixels, 4*pboWidth[ring]*pboHeight[ring] );
+		glUnmapBuffer( GL_PIXEL_PACK_BUFFER_ARB );
+	}
+	glState.BindBuffer( GL_PIXEL_PACK_BUFFER_ARB, 0 );
+
+	if (!pixels)
+	{
+		printf("Error: Unable to map a frame capture's pixel buffer!\n");
+		lock.Lock();
+		writeFailures++;
+		queueState[i] = QUEUE_FREE;
+		lock.Unlock();
+		return;
+	}
+	queueWidth[i] = pboWidth[ring];
+	queueHeight[i] = pboHeight[ring];
+	strcpy( queueFile[i], pboFile[ring] );
+	queueMovie[i] = pboMovie[ring];
+	QueueEntry( i );
 }
 
+// Oldest readbacks first, so the writer gets frames in order
+void FrameGrab::Update( void )
+{
+	for (int k=0; k < FRAMEGRAB_PBO_RING; k++)
+	{
+		int ring = (nextPBO + k) % FRAMEGRAB_PBO_RING;
+		if (pboPending[ring] && frame - pboFrame[ring] >= FRAMEGRAB_PBO_RING-1)
+			FinishCapture( ring );
+	}
+	frame++;
+}
 
-unsigned char *FrameGrab::GrabWholeFrame( int *capturedWidth, int *capturedHeight )
+void FrameGrab::Flush( void )
 {
-	*capturedWidth = glutGet( GLUT_WINDOW_WIDTH );
-	*capturedHeight = glutGet( GLUT_WINDOW_HEIGHT );
+	for (int k=0; k < FRAMEGRAB_PBO_RING; k++)
+	{
+		int ring = (nextPBO + k) % FRAMEGRAB_PBO_RING;
+		if (pboPending[ring]) FinishCapture( ring );
+	}
+
+	while (1)
+	{
+		bool busy = false;
+		lock.Lock();
+		for (int i=0; i < FRAMEGRAB_MAX_QUEUED; i++)
+			if (queueState[i] != QUEUE_FREE) busy = true;
+		lock.Unlock();
+		if (!busy) break;
+		writer->Wake();
+		ParallelSleep( 1 );
+	}
+}
 
-	// Note we will capture RGB (not RGBA) seeing as PPMs only support 3 channels per pixel.
-	unsigned char *frameData = (unsigned char *)malloc( (*capturedWidth) * (*capturedHeight) * 3 * sizeof( unsigned char ) );
-	if (!frameData)
-		FatalError("Unable to allocate temporary memory during frame capture!");
+int FrameGrab::GetQueueEntry( size_t bytes, bool mayDrop )
+{
+	bool waited = false;
+	while (1)
+	{
+		int i = -1;
+		lock.Lock();
+		for (int j=0; j < FRAMEGRAB_MAX_QUEUED && i < 0; j++)
+			if (queueState[j] == QUEUE_FREE) i = j;
+		if (i >= 0) queueState[i] = QUEUE_FILLING;
+		lock.Unlock();
+
+		if (i >= 0)
+		{
+			// Keep this entry's buffer for the next capture that uses it
+			if (queueDataBytes[i] < bytes)
+			{
+				if (queueData[i]) free( queueData[i] );
+				queueData[i] = (unsigned char *)malloc( bytes );
+				queueDataBytes[i] = queueData[i] ? bytes : 0;
+			}
+			if (queueData[i]) return i;
+
+			printf("Error: Unable to allocate memory for a frame capture!\n");
+			lock.Lock();
+			writeFailures++;
+			queueState[i] = QUEUE_FREE;
+			lock.Unlock();
+			return -1;
+		}
 
-	// Select the correct buffer to read from, then read from it.
-	//    Note this read happens *without* permanently changing the state of the read buffer!
-	glPushAttrib( GL_PIXEL_MODE_BIT );
-	glReadBuffer( captureBuffer );
-	glReadPixels( 0, 0, *capturedWidth, *capturedHeight, GL_RGB, GL_UNSIGNED_BYTE, frameData );
-	glPopAttrib();
+		if (dropWhenBehind && mayDrop)
+		{
+			framesDropped++;
+			return -1;
+		}
+		if (!waited) writerWaits++;
+		waited = true;
+		writer->Wake();
+		ParallelSleep( 1 );
+	}
+}
+
+void FrameGrab::QueueEntry( int i )
+{
+	lock.Lock();
+	queueOrder[i] = nextOrder++;
+	queueState[i] = QUEUE_WAITING;
+	lock.Unlock();
+
+	// (Re)start the writer.  If it can't be, everything waiting is
+	//    written right here.
+	writer->Wake();
+}
+
+bool FrameGrab::WriterStep( void *data )
+{
+	return ((FrameGrab *)data)->WriteNext();
+}
 
-	return frameData;
+// Write the frame queued first.  Returns false if none are waiting.
+bool FrameGrab::WriteNext( void )
+{
+	lock.Lock();
+	int best = -1;
+	for (int i=0; i < FRAMEGRAB_MAX_QUEUED; i++)
+		if (queueState[i] == QUEUE_WAITING && (best < 0 || queueOrder[i] < queueOrder[best]))
+			best = i;
+	if (best >= 0) queueState[best] = QUEUE_WRITING;
+	lock.Unlock();
+	if (best < 0) return false;
+
+	bool ok = WriteQueued( best );
+
+	lock.Lock();
+	if (ok) framesWritten++;
+	else    writeFailures++;
+	queueState[best] = QUEUE_FREE;
+	lock.Unlock();
+	return true;
+}
+
+bool FrameGrab::WriteQueued( int i )
+{
+	if (queueMovie[i])
+		return queueMovie[i]->WriteFrame( queueData[i] );
+	return FrameToPPM( queueFile[i], queueData[i], queueWidth[i], queueHeight[i] );
 }
 
 void FrameGrab::CaptureStencil( char *outputFilename )
@@ -128,8 +328,12 @@ void FrameGrab::CaptureStencil( char *outputFilename )
 	if (!frameData)
 		FatalError("Unable to allocate temporary memory during frame capture!");
 
+	// Rows are packed tightly (not padded to 4 bytes)
+	glPixelStorei( GL_PACK_ALIGNMENT, 1 );
 	glReadPixels( 0, 0, width, height, GL_STENCIL_INDEX, GL_UNSIGNED_BYTE, frameData );
-	FrameToPGM( outputFilename, frameData, width, height ); 
+	glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+	FrameToPGM( outputFilename, frameData, width, height );
+	free( frameData );
 }
 
 void FrameGrab::CaptureDepth( char *outputFilename )
@@ -141,8 +345,70 @@ void FrameGrab::CaptureDepth( char *outputFilename )
 	if (!frameData)
 		FatalError("Unable to allocate temporary memory during frame capture!");
 
+	glPixelStorei( GL_PACK_ALIGNMENT, 1 );
 	glReadPixels( 0, 0, width, height, GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, frameData );
-	FrameToPGM( outputFilename, frameData, width, height ); 
+	glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+	FrameToPGM( outputFilename, frameData, width, height );
+	free( frameData );
+}
+
+void FrameGrab::SetMovieFile( char *movieFilename, int fps )
+{
+	if (movieFile) free( movieFile );
+	movieFile = movieFilename ? strdup( movieFilename ) : 0;
+	movieFPS = fps > 0 ? fps : FRAMEGRAB_MOVIE_FPS;
+}
+
+bool FrameGrab::StartMovie( char *movieFilename )
+{
+	char outputFile[512];
+	StopMovie();
+	if (movieFilename)  strncpy( outputFile, movieFilename, 511 );
+	else if (movieFile) strncpy( outputFile, movieFile, 511 );
+	else                sprintf( outputFile, "%sMovie%d.y4m", baseName, nextMovieNum++ );
+	outputFile[511] = 0;
+
+	// Every frame of a movie is the same size
+	int width = glutGet( GLUT_WINDOW_WIDTH ) & ~1, height = glutGet( GLUT_WINDOW_HEIGHT ) & ~1;
+	movie = new MovieWriter( outputFile, width, height, movieFPS );
+	if (!movie->IsValid())
+	{
+		delete movie;
+		movie = 0;
+		return false;
+	}
+	movieFrames = 0;
+	printf("(+) Recording movie '%s' (%d x %d, %d fps)...\n", outputFile, width, height, movieFPS );
+	return true;
+}
+
+void FrameGrab::CaptureMovieFrame( void )
+{
+	if (!movie) return;
+	StartCapture( 0, 0, movie->GetWidth(), movie->GetHeight(), movie->GetFilename(), movie );
+	movieFrames++;
+}
+
+// Every frame has to be written before the movie can be closed
+void FrameGrab::StopMovie( void )
+{
+	if (!movie) return;
+	Flush();
+	printf("(+) Finished movie '%s' (%u frames, %.2f seconds)\n",
+		   movie->GetFilename(), movie->GetNumFrames(), movie->GetNumFrames() / (double)movieFPS );
+	delete movie;
+	movie = 0;
+	movieFrames = 0;
+}
+
+void FrameGrab::PrintStats( FILE *f )
+{
+	lock.Lock();
+	fprintf( f, "Frame grabs: %u captured, %u written, %u dropped, %u waits for the writer",
+		     framesCaptured, framesWritten, framesDropped, writerWaits );
+	if (writeFailures) fprintf( f, ", %u FAILED\n", writeFailures );
+	else               fprintf( f, "\n" );
+	lock.Unlock();
 }
 
 
@@ -151,11 +417,11 @@ void FrameGrab::FrameToPGM( char *f, unsigned char *data, int width, int height
   FILE *out = fopen(f, "wb");
   if (!out)
 	  FatalError("Unable to capture frame.  fopen() failed!!");
-  
-  fprintf(out, "P5\n# File captured by Chris Wyman's OpenGL framegrabber\n");  
+
+  fprintf(out, "P5\n# File captured by Chris Wyman's OpenGL framegrabber\n");
   fprintf(out, "%d %d\n", width, height);
-  fprintf(out, "%d\n", 255); 
-  
+  fprintf(out, "%d\n", 255);
+
   for ( int y = height-1; y >= 0; y-- )
 	  fwrite( data+(y*width), 1, width, out );
 
@@ -163,20 +429,39 @@ void FrameGrab::FrameToPGM( char *f, unsigned char *data, int width, int height
   fclose(out);
 }
 
-void FrameGrab::FrameToPPM( char *f, unsigned char *data, int width, int height )
+// Called on the writer thread, so errors are reported, not fatal
+bool FrameGrab::FrameToPPM( char *f, unsigned char *data, int width, int height )
 {
   FILE *out = fopen(f, "wb");
-  if (!out)
-		FatalError("Unable to capture frame.  fopen() failed!!");
-  
-  fprintf(out, "P6\n# File captured by Chris Wyman's OpenGL framegrabber\n");  
+  unsigned char *row = (unsigned char *)malloc( 3*width );
+  if (!out || !row)
+  {
+	  printf("Error: Unable to write frame capture '%s'!\n", f );
+	  if (out) fclose( out );
+	  if (row) free( row );
+	  return false;
+  }
+
+  fprintf(out, "P6\n# File captured by Chris Wyman's OpenGL framegrabber\n");
   fprintf(out, "%d %d\n", width, height);
-  fprintf(out, "%d\n", 255); 
-  
+  fprintf(out, "%d\n", 255);
+
   for ( int y = height-1; y >= 0; y-- )
-	  fwrite( data+(3*y*width), 1, 3*width, out );
+  {
+	  unsigned char *src = data + 4*y*width;
+	  for ( int x = 0; x < width; x++, src += 4 )
+	  {
+		  row[3*x+0] = src[0];
+		  row[3*x+1] = src[1];
+		  row[3*x+2] = src[2];
+	  }
+	  fwrite( row, 1, 3*width, out );
+  }
 
   fprintf(out, "\n");
+  bool ok = !ferror( out );
   fclose(out);
+  free( row );
+  if (!ok) printf("Error: Unable to write frame capture '%s'!\n", f );
+  return ok;
 }
-
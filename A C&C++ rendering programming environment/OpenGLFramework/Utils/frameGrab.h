@@ -11,6 +11,9 @@
 /*     In display() routine right before glutSwapBuffers():                */
 /*          grab->CaptureFrame();                                          */
 /*                                                                         */
+/*     And every frame (whether or not anything was captured):             */
+/*          grab->Update();                                                */
+/*                                                                         */
 /* This outputs an image "screenCaptureXXX.ppm", where the first capture   */
 /*     has a name screenCapture0.ppm, and it is incremented for every      */
 /*     additional capture during the program's execution.                  */
@@ -20,7 +23,27 @@
 /*     overrides this behavior and outputs a one-time (i.e., no number)    */
 /*     PPM file with the name specified.                                   */
 /*                                                                         */
+/* Captures don't stall the render thread.  CaptureFrame() only starts     */
+/*     reading the frame into one of a ring of pixel buffer objects, and   */
+/*     Update() picks it up FRAMEGRAB_PBO_RING-1 frames later, when it has */
+/*     long since arrived.  The pixels then wait in a short queue for a    */
+/*     writer thread to save them, in buffers reused from one capture to   */
+/*     the next.  If the writer falls behind (e.g., capturing every frame  */
+/*     to a slow disk), the render thread waits for it, or, after          */
+/*     SetDropWhenBehind( true ), skips the capture (see PrintStats()).    */
+/*     Call Flush() to wait until everything captured has been written.    */
+/*                                                                         */
+/* Movies:  after StartMovie(), call CaptureMovieFrame() every frame (in   */
+/*     place of CaptureFrame()) until StopMovie().  Frames stream into a   */
+/*     Y4M or raw RGB file, or a named pipe an encoder reads (see          */
+/*     movieWriter.h), converted on the writer thread.  Movie frames are   */
+/*     never dropped.  GetMovieTime() is the movie's time so far, a fixed  */
+/*     1/fps per frame, so animating with it makes the movie play at the   */
+/*     right speed however slowly (or quickly) frames were drawn.          */
+/*                                                                         */
 /* Some of these assumptions can be changed by varying CaptureFrame calls. */
+/*     The stencil, depth, and floating point captures are rare, and are   */
+/*     still read and written immediately.                                 */
 /*                                                                         */
 /* Chris Wyman (12/4/2007)                                                 */
 /***************************************************************************/
@@ -28,6 +51,18 @@
 #ifndef __FRAMEGRAB_H
 #define __FRAMEGRAB_H
 
+#include "parallelFor.h"
+#include "movieWriter.h"
+
+// Readbacks in flight.  Frame N's capture is picked up at frame N+2.
+#define FRAMEGRAB_PBO_RING         3
+
+// Most captured frames waiting for the writer thread
+#define FRAMEGRAB_MAX_QUEUED       8
+
+// Frame rate of movies, unless told otherwise
+#define FRAMEGRAB_MOVIE_FPS        30
+
 class FrameGrab
 {
 private:
@@ -35,15 +70,65 @@ private:
 	int nextFrameNum;
 	char *baseName;
 
-	// Actually grabs the data from the scene.  These function encapsulates
-	//    _all_ the OpenGL code.  
-	unsigned char *GrabWholeFrame( int *capturedWidth, int *capturedHeight );
-	unsigned char *GrabFrameRegion( int left, int bottom, int right, int top );
+	// Start reading a region of the frame, to be saved to file 'f' (or added
+	//    to a movie).  This function encapsulates all the OpenGL code for
+	//    color captures.
+	void StartCapture( int left, int bottom, int width, int height, char *f, MovieWriter *m=0 );
+
+	// Readbacks in flight (in pixel buffer objects, where supported)
+	GLuint pbo[FRAMEGRAB_PBO_RING];
+	int pboBytes[FRAMEGRAB_PBO_RING], pboWidth[FRAMEGRAB_PBO_RING], pboHeight[FRAMEGRAB_PBO_RING];
+	unsigned int pboFrame[FRAMEGRAB_PBO_RING];
+	bool pboPending[FRAMEGRAB_PBO_RING];
+	char pboFile[FRAMEGRAB_PBO_RING][512];
+	MovieWriter *pboMovie[FRAMEGRAB_PBO_RING];
+	int nextPBO;
+	unsigned int frame;
+	bool usePBOs, dropWhenBehind;
+
+	// Pass a finished readback on to the writer
+	void FinishCapture( int ring );
+
+	// Captured frames (RGBA, bottom row first) waiting to be written.  The
+	//    writer thread only looks at the queue while holding the lock, and
+	//    writes the waiting frame with the lowest order.
+	enum { QUEUE_FREE, QUEUE_FILLING, QUEUE_WAITING, QUEUE_WRITING };
+	int queueState[FRAMEGRAB_MAX_QUEUED];
+	unsigned char *queueData[FRAMEGRAB_MAX_QUEUED];
+	size_t queueDataBytes[FRAMEGRAB_MAX_QUEUED];
+	int queueWidth[FRAMEGRAB_MAX_QUEUED], queueHeight[FRAMEGRAB_MAX_QUEUED];
+	char queueFile[FRAMEGRAB_MAX_QUEUED][512];
+	MovieWriter *queueMovie[FRAMEGRAB_MAX_QUEUED];
+	unsigned int queueOrder[FRAMEGRAB_MAX_QUEUED];
+	unsigned int nextOrder;
+
+	// The movie being recorded, if any
+	MovieWriter *movie;
+	char *movieFile;
+	int movieFPS, nextMovieNum;
+	unsigned int movieFrames;
 
-	// Saves data with a certain width and height to the specified file.  
-	//    This is the function containing all the explicit I/O code.  If you 
-	//    want to output a different file type, this is the function to update.
-	void FrameToPPM( char *f, unsigned char *data, int width, int height );
+	// Statistics
+	unsigned int framesCaptured, framesWritten, framesDropped, writeFailures, writerWaits;
+
+	ParallelWorker *writer;
+	ParallelMutex lock;
+
+	static bool WriterStep( void *data );
+	bool WriteNext( void );
+	bool WriteQueued( int i );
+
+	// A free queue entry (with room for 'bytes'), waiting for the writer if
+	//    needed.  Returns -1 if the capture should be dropped instead (never
+	//    for movie frames).
+	int GetQueueEntry( size_t bytes, bool mayDrop );
+	void QueueEntry( int i );
+
+	// Saves RGBA data (bottom row first) with a certain width and height to
+	//    the specified file.  This is the function containing all the
+	//    explicit I/O code.  If you want to output a different file type,
+	//    this is the function to update.
+	bool FrameToPPM( char *f, unsigned char *data, int width, int height );
 
 	// Some formats (depth & stencil) only need a grayscale image.  This func is used.
 	void FrameToPGM( char *f, unsigned char *data, int width, int height );
@@ -68,7 +153,32 @@ public:
 
 	// Capture the depth buffer of the current frame
 	void CaptureDepth( char *outputFilename );
+
+	// Once per frame, after any captures:  hands readbacks that have arrived
+	//    to the writer thread
+	void Update( void );
+
+	// Wait until every capture so far has been written
+	void Flush( void );
+
+	// When the writer falls behind, skip captures (true) rather than wait
+	//    for it (false, the default)
+	inline void SetDropWhenBehind( bool drop ) { dropWhenBehind=drop; }
+
+	// Record a movie to 'movieFilename' (if NULL, to the file given to
+	//    SetMovieFile(), else "<baseFileName>Movie<movieNumber>.y4m"), at
+	//    the window's size (rounded down to even)
+	bool StartMovie( char *movieFilename=0 );
+	void CaptureMovieFrame( void );
+	void StopMovie( void );
+	inline bool IsCapturingMovie( void ) const { return movie != 0; }
+	inline double GetMovieTime( void ) const   { return movieFrames / (double)movieFPS; }
+
+	// Where (and how fast) StartMovie() records by default
+	void SetMovieFile( char *movieFilename, int fps=FRAMEGRAB_MOVIE_FPS );
+
+	void PrintStats( FILE *f );
 };
 
 
-#endif
\ No newline at end of file
+#endif
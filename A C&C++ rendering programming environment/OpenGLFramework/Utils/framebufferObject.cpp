@@ -20,10 +20,35 @@
 #include <string.h>
 #include <assert.h>
 #include "framebufferObject.h"
+#include "glStateCache.h"
 
 #pragma warning( disable: 4996 )
 
-FrameBuffer::FrameBuffer( char *name ) : depth(-1), automaticMipmapsEnabled(0)
+size_t FrameBuffer::totalGPUBytes = 0;
+
+// Rough bytes per texel of the formats used for FBO textures
+static int FormatBytes( GLenum format )
+{
+	switch (format)
+	{
+	case GL_LUMINANCE: case GL_ALPHA: case GL_INTENSITY: 
+		return 1;
+	case GL_RGBA16F_ARB: case GL_RGB16F_ARB: 
+		return 8;
+	case GL_RGBA32F_ARB: case GL_RGB32F_ARB: 
+		return 16;
+	default:
+		return 4;
+	}
+}
+
+void FrameBuffer::SetGPUBytes( size_t bytes )
+{
+	totalGPUBytes += bytes - gpuBytes;
+	gpuBytes = bytes;
+}
+
+FrameBuffer::FrameBuffer( char *name ) : depth(-1), automaticMipmapsEnabled(0), gpuBytes(0)
 {
 	glGetIntegerv( GL_MAX_COLOR_ATTACHMENTS_EXT, &maxColorBuffers );
 	colorIDs = new GLuint[maxColorBuffers];
@@ -49,7 +74,7 @@ FrameBuffer::FrameBuffer( char *name ) : depth(-1), automaticMipmapsEnabled(0)
 }
 
 FrameBuffer::FrameBuffer( int width, int height, char *name ) 
-: width( width ), height( height ), depth(-1), automaticMipmapsEnabled(0)
+: width( width ), height( height ), depth(-1), automaticMipmapsEnabled(0), gpuBytes(0)
 {
 	glGetIntegerv( GL_MAX_COLOR_ATTACHMENTS_EXT, &maxColorBuffers );
 	colorIDs = new GLuint[maxColorBuffers];
@@ -76,7 +101,7 @@ FrameBuffer::FrameBuffer( GLenum type, int width, int height, int depth,
 				 GLuint colorBufType, int numColorBufs, int hasZbuf, 
 				 bool enableAutomaticMipmaps, char *name ) :
 width( width ), height( height ), depth( depth ), 
-automaticMipmapsEnabled(enableAutomaticMipmaps?1:0)
+automaticMipmapsEnabled(enableAutomaticMipmaps?1:0), gpuBytes(0)
 {
 	if ( type == GL_TEXTURE_1D || type == GL_TEXTURE_3D )
 		printf("Warning!  FrameBuffer constructor called with untested texture type!\n");
@@ -161,12 +186,20 @@ automaticMipmapsEnabled(enableAutomaticMipmaps?1:0)
 		UnbindBuffer();
 	}
 
+	// Note how much memory all that took
+	size_t texels = (size_t)width * (type == GL_TEXTURE_1D ? 1 : height) * 
+		            (type == GL_TEXTURE_CUBE_MAP ? 6 : 1) * 
+					(type == GL_TEXTURE_2D_ARRAY_EXT || type == GL_TEXTURE_3D ? depth : 1);
+	size_t colorBytes = texels * FormatBytes( colorBufType ) * (numColorBufs > 0 ? numColorBufs : 0);
+	if (enableAutomaticMipmaps) colorBytes += colorBytes / 3;
+	SetGPUBytes( colorBytes + (hasZbuf > 0 ? texels * 4 : 0) );
+
 	glBindTexture( type, 0 );
 }
 
 
 FrameBuffer::FrameBuffer( int test ) :
-	width( 512 ), height( 512 ), depth( -1 ), automaticMipmapsEnabled( 0 )
+	width( 512 ), height( 512 ), depth( -1 ), automaticMipmapsEnabled( 0 ), gpuBytes( 0 )
 {
 	glGetIntegerv( GL_MAX_COLOR_ATTACHMENTS_EXT, &maxColorBuffers );
 	colorIDs = new GLuint[maxColorBuffers]; colorType = new GLenum[maxColorBuffers];
@@ -240,17 +273,18 @@ FrameBuffer::~FrameBuffer( )
 	
 	for (int i=0; i < maxColorBuffers; i++)
 		if (colorIDs[i])
-			glDeleteTextures( 1, &colorIDs[i] );
+			glState.DeleteTextures( 1, &colorIDs[i] );
 
 	// delete the stencil & depth renderbuffers
 	if (depthID)
-		glDeleteTextures( 1, &depthID );
+		glState.DeleteTextures( 1, &depthID );
 		//glDeleteRenderbuffersEXT(1, &depthID);
 	if (stencilID)
 		glDeleteRenderbuffersEXT(1, &stencilID);
 
 	// delete the framebuffer
 	glDeleteFramebuffersEXT( 1, &ID );
+	SetGPUBytes( 0 );
 	delete [] colorIDs;
 	delete [] colorType; 
 }
@@ -595,6 +629,8 @@ void FrameBuffer::ResizeExistingFBO( int newWidth, int newHeight )
 	}
 
 	glBindTexture( GL_TEXTURE_2D, 0 );
+	if (width > 0 && height > 0)
+		SetGPUBytes( (size_t)((double)gpuBytes * newWidth * newHeight / ((double)width * height)) );
 	width = newWidth; 
 	height = newHeight;
 
@@ -51,6 +51,11 @@ private:
 
 	// Test values for use with texture array FBOs.  These may be broken, and should not be exposed!
 	int depth;
+
+	// (Estimated) GPU memory for the buffers this FBO created, and for all FBOs
+	size_t gpuBytes;
+	static size_t totalGPUBytes;
+	void SetGPUBytes( size_t bytes );
 public:
 	FrameBuffer( char *name=0 );                           // avoid the use of this constructor whenever possible
 	FrameBuffer( int width, int height, char *name=0 );    // use this constructor if you want to setup the textures yourself
@@ -126,6 +131,11 @@ public:
 	inline GLuint GetBufferID( void ) const	       { return ID; }
 	inline char *GetName( void )				   { return fbName; }
 
+	// GPU memory used by the textures created by the constructor (attached
+	//      textures and renderbuffers aren't counted), here and in all FBOs.
+	inline size_t GetGPUBytes( void ) const        { return gpuBytes; }
+	static inline size_t GetTotalGPUBytes( void )  { return totalGPUBytes; }
+
 	// Allows you to set the size, particularly useful if you use the default constructor, 
 	//      and want to set it up correctly afterwards!
 	inline void SetSize( int newWidth, int newHeight ) { width = newWidth; height = newHeight; }
@@ -0,0 +1,317 @@
+/***************************************************************************/
+/* glStateCache.cpp                                                        */
+/* ------------                                                            */
+/*                                                                         */
+/* Implements a shadow of commonly changed OpenGL state that drops         */
+/*     redundant state changes.  See the header for usage notes.           */
+/***************************************************************************/
+
+#include <string.h>
+#include "glStateCache.h"
+
+#pragma warning( disable: 4996 )
+
+// The one and only cache.  It touches no OpenGL state until first used, so
+//    it is safe to construct before the GL context exists.
+GLStateCache glState;
+
+
+GLStateCache::GLStateCache() : issuedCalls(0), filteredCalls(0)
+{
+	Invalidate( GLSTATE_ALL );
+}
+
+void GLStateCache::Invalidate( unsigned int which )
+{
+	if (which & GLSTATE_PROGRAM)
+		currentProgram = GLSTATE_UNKNOWN;
+	if (which & GLSTATE_TEXTURES)
+	{
+		activeUnit = GLSTATE_UNKNOWN;
+		memset( texBinding, 0xFF, sizeof( texBinding ) );
+		memset( texGenMode, 0xFF, sizeof( texGenMode ) );
+	}
+	if (which & GLSTATE_BUFFERS)
+		memset( bufBinding, 0xFF, sizeof( bufBinding ) );
+	if (which & GLSTATE_ENABLES)
+	{
+		memset( globalEnables, -1, sizeof( globalEnables ) );
+		memset( unitEnables, -1, sizeof( unitEnables ) );
+	}
+	if (which & GLSTATE_CLIENT_ARRAYS)
+		memset( clientArrays, -1, sizeof( clientArrays ) );
+	if (which & GLSTATE_BLEND_DEPTH)
+	{
+		blendSrc = blendDst = depthFunc = GLSTATE_UNKNOWN;
+		depthMask = -1;
+	}
+}
+
+
+int GLStateCache::TextureTargetIndex( GLenum target )
+{
+	switch( target )
+	{
+	case GL_TEXTURE_1D:            return 0;
+	case GL_TEXTURE_2D:            return 1;
+	case GL_TEXTURE_3D:            return 2;
+	case GL_TEXTURE_CUBE_MAP:      return 3;
+	case GL_TEXTURE_2D_ARRAY_EXT:  return 4;
+	}
+	return -1;
+}
+
+int GLStateCache::GlobalCapIndex( GLenum cap )
+{
+	switch( cap )
+	{
+	case GL_BLEND:                 return 0;
+	case GL_DEPTH_TEST:            return 1;
+	case GL_STENCIL_TEST:          return 2;
+	case GL_ALPHA_TEST:            return 3;
+	case GL_CULL_FACE:             return 4;
+	case GL_LIGHTING:              return 5;
+	case GL_NORMALIZE:             return 6;
+	case GL_POLYGON_OFFSET_FILL:   return 7;
+	}
+	return -1;
+}
+
+int GLStateCache::UnitCapIndex( GLenum cap )
+{
+	switch( cap )
+	{
+	case GL_TEXTURE_1D:            return 0;
+	case GL_TEXTURE_2D:            return 1;
+	case GL_TEXTURE_3D:            return 2;
+	case GL_TEXTURE_CUBE_MAP:      return 3;
+	case GL_TEXTURE_GEN_S:         return 4;
+	case GL_TEXTURE_GEN_T:         return 5;
+	case GL_TEXTURE_GEN_R:         return 6;
+	case GL_TEXTURE_GEN_Q:         return 7;
+	}
+	return -1;
+}
+
+int GLStateCache::BufferTargetIndex( GLenum target )
+{
+	switch( target )
+	{
+	case GL_ARRAY_BUFFER:          return 0;
+	case GL_ELEMENT_ARRAY_BUFFER:  return 1;
+	case GL_PIXEL_PACK_BUFFER:     return 2;
+	case GL_PIXEL_UNPACK_BUFFER:   return 3;
+	case GL_UNIFORM_BUFFER:        return 4;
+	}
+	return -1;
+}
+
+int GLStateCache::ClientArrayIndex( GLenum array )
+{
+	switch( array )
+	{
+	case GL_VERTEX_ARRAY:          return 0;
+	case GL_NORMAL_ARRAY:          return 1;
+	case GL_COLOR_ARRAY:           return 2;
+	case GL_TEXTURE_COORD_ARRAY:   return 3;
+	}
+	return -1;
+}
+
+// Returns the index of the active texture unit, or -1 if it is unknown or
+//    beyond the units we shadow.
+int GLStateCache::CurrentUnitIndex( void )
+{
+	if (activeUnit == GLSTATE_UNKNOWN) return -1;
+	int idx = activeUnit - GL_TEXTURE0;
+	return (idx >= 0 && idx < GLSTATE_MAX_TEXTURE_UNITS) ? idx : -1;
+}
+
+
+void GLStateCache::UseProgram( GLuint programID )
+{
+	if (currentProgram == programID && Filtered()) return;
+	Issued();
+	glUseProgram( programID );
+	currentProgram = programID;
+}
+
+void GLStateCache::ActiveTexture( GLenum unit )
+{
+	if (activeUnit == unit && Filtered()) return;
+	Issued();
+	glActiveTexture( unit );
+	activeUnit = unit;
+}
+
+void GLStateCache::BindTexture( GLenum target, GLuint textureID )
+{
+	int unit = CurrentUnitIndex();
+	int tgt  = TextureTargetIndex( target );
+	if (unit >= 0 && tgt >= 0 && texBinding[unit][tgt] == textureID && Filtered()) return;
+	Issued();
+	glBindTexture( target, textureID );
+	if (unit >= 0 && tgt >= 0) texBinding[unit][tgt] = textureID;
+}
+
+void GLStateCache::BindTextureToUnit( GLenum unit, GLenum target, GLuint textureID )
+{
+	// Avoid even switching units if the binding is already correct.
+	int idx = unit - GL_TEXTURE0;
+	int tgt = TextureTargetIndex( target );
+	if (idx >= 0 && idx < GLSTATE_MAX_TEXTURE_UNITS && tgt >= 0 &&
+		texBinding[idx][tgt] == textureID && Filtered()) return;
+	ActiveTexture( unit );
+	BindTexture( target, textureID );
+}
+
+void GLStateCache::TexGenMode( GLenum coord, GLint mode )
+{
+	int unit = CurrentUnitIndex();
+	int c    = coord - GL_S;
+	bool tracked = (unit >= 0 && c >= 0 && c < 4);
+	if (tracked && texGenMode[unit][c] == mode && Filtered()) return;
+	Issued();
+	glTexGeni( coord, GL_TEXTURE_GEN_MODE, mode );
+	if (tracked) texGenMode[unit][c] = mode;
+}
+
+void GLStateCache::BindBuffer( GLenum target, GLuint bufferID )
+{
+	int idx = BufferTargetIndex( target );
+	if (idx >= 0 && bufBinding[idx] == bufferID && Filtered()) return;
+	Issued();
+	glBindBuffer( target, bufferID );
+	if (idx >= 0) bufBinding[idx] = bufferID;
+}
+
+void GLStateCache::DeleteTextures( GLsizei n, const GLuint *textureIDs )
+{
+	for (int i=0; i < n; i++)
+	{
+		if (!textureIDs[i]) continue;
+		for (int unit=0; unit < GLSTATE_MAX_TEXTURE_UNITS; unit++)
+			for (int tgt=0; tgt < GLSTATE_NUM_TEXTURE_TARGETS; tgt++)
+				if (texBinding[unit][tgt] == textureIDs[i])
+					texBinding[unit][tgt] = 0;
+	}
+	glDeleteTextures( n, textureIDs );
+}
+
+void GLStateCache::DeleteBuffers( GLsizei n, const GLuint *bufferIDs )
+{
+	for (int i=0; i < n; i++)
+	{
+		if (!bufferIDs[i]) continue;
+		for (int idx=0; idx < GLSTATE_NUM_BUFFER_TARGETS; idx++)
+			if (bufBinding[idx] == bufferIDs[i])
+				bufBinding[idx] = 0;
+	}
+	glDeleteBuffers( n, bufferIDs );
+}
+
+
+void GLStateCache::SetEnabled( GLenum cap, bool enable )
+{
+	signed char want = enable ? 1 : 0;
+	signed char *shadow = 0;
+
+	// Find where this cap is shadowed (if anywhere)
+	int idx = GlobalCapIndex( cap );
+	if (idx >= 0)
+		shadow = &globalEnables[idx];
+	else if ((idx = UnitCapIndex( cap )) >= 0)
+	{
+		int unit = CurrentUnitIndex();
+		if (unit >= 0) shadow = &unitEnables[unit][idx];
+	}
+
+	if (shadow && *shadow == want && Filtered()) return;
+	Issued();
+	if (enable) glEnable( cap );
+	else glDisable( cap );
+	if (shadow) *shadow = want;
+}
+
+void GLStateCache::Enable( GLenum cap )
+{
+	SetEnabled( cap, true );
+}
+
+void GLStateCache::Disable( GLenum cap )
+{
+	SetEnabled( cap, false );
+}
+
+bool GLStateCache::IsEnabled( GLenum cap )
+{
+	signed char *shadow = 0;
+	int idx = GlobalCapIndex( cap );
+	if (idx >= 0)
+		shadow = &globalEnables[idx];
+	else if ((idx = UnitCapIndex( cap )) >= 0)
+	{
+		int unit = CurrentUnitIndex();
+		if (unit >= 0) shadow = &unitEnables[unit][idx];
+	}
+
+	if (shadow && *shadow >= 0) return (*shadow == 1);
+	bool enabled = (glIsEnabled( cap ) == GL_TRUE);
+	if (shadow) *shadow = enabled ? 1 : 0;
+	return enabled;
+}
+
+
+void GLStateCache::EnableClientState( GLenum array )
+{
+	int idx = ClientArrayIndex( array );
+	if (idx >= 0 && clientArrays[idx] == 1 && Filtered()) return;
+	Issued();
+	glEnableClientState( array );
+	if (idx >= 0) clientArrays[idx] = 1;
+}
+
+void GLStateCache::DisableClientState( GLenum array )
+{
+	int idx = ClientArrayIndex( array );
+	if (idx >= 0 && clientArrays[idx] == 0 && Filtered()) return;
+	Issued();
+	glDisableClientState( array );
+	if (idx >= 0) clientArrays[idx] = 0;
+}
+
+
+void GLStateCache::BlendFunc( GLenum srcFactor, GLenum dstFactor )
+{
+	if (blendSrc == srcFactor && blendDst == dstFactor && Filtered()) return;
+	Issued();
+	glBlendFunc( srcFactor, dstFactor );
+	blendSrc = srcFactor;
+	blendDst = dstFactor;
+}
+
+void GLStateCache::DepthFunc( GLenum func )
+{
+	if (depthFunc == func && Filtered()) return;
+	Issued();
+	glDepthFunc( func );
+	depthFunc = func;
+}
+
+void GLStateCache::DepthMask( GLboolean flag )
+{
+	if (depthMask == (GLint)flag && Filtered()) return;
+	Issued();
+	glDepthMask( flag );
+	depthMask = flag;
+}
+
+
+void GLStateCache::PrintCounters( FILE *f )
+{
+	unsigned int total = issuedCalls + filteredCalls;
+	fprintf( f, "GL state changes: %u requested, %u issued, %u filtered (%.1f%%)\n",
+		     total, issuedCalls, filteredCalls,
+			 total > 0 ? 100.0f * filteredCalls / total : 0.0f );
+}
+
@@ -0,0 +1,143 @@
+/***************************************************************************/
+/* glStateCache.h                                                          */
+/* ------------                                                            */
+/*                                                                         */
+/* A thin shadow of the OpenGL state most frequently touched while drawing */
+/*     a scene:  the bound GLSL program, the active texture unit, per-unit */
+/*     texture bindings and enables, the array/element buffer bindings,    */
+/*     the common glEnable() caps, and blend/depth functions.              */
+/*                                                                         */
+/* Code that routes state changes through this class (rather than calling  */
+/*     OpenGL directly) gets redundant calls dropped for free.  This       */
+/*     matters because materials and meshes re-specify identical state    */
+/*     for every object they draw.                                         */
+/*                                                                         */
+/* Any state the cache has not seen set (e.g., after Invalidate(), or      */
+/*     state changed by code that talks to OpenGL directly) is "unknown"   */
+/*     and the next change is always passed through.  If you change        */
+/*     tracked state behind the cache's back, call Invalidate() with the   */
+/*     appropriate GLSTATE_* bits afterwards.                              */
+/*                                                                         */
+/* All of the OpenGL calls live in the .cpp file, so the counters (issued  */
+/*     vs. filtered calls) can be checked by linking against a mock GL     */
+/*     (see Tests/testGLStateCache.cpp).                                   */
+/***************************************************************************/
+
+#ifndef __GLSTATECACHE_H
+#define __GLSTATECACHE_H
+
+#include <stdio.h>
+#include <GL/glew.h>
+#include <GL/glut.h>
+
+// How many texture units and binding targets per unit are shadowed.  State
+//    for units or targets outside these is passed straight to OpenGL.
+#define GLSTATE_MAX_TEXTURE_UNITS    16
+#define GLSTATE_NUM_TEXTURE_TARGETS  5
+#define GLSTATE_NUM_GLOBAL_CAPS      8
+#define GLSTATE_NUM_UNIT_CAPS        8
+#define GLSTATE_NUM_BUFFER_TARGETS   5
+#define GLSTATE_NUM_CLIENT_ARRAYS    4
+
+// Bits passed to GLStateCache::Invalidate().  These can be OR'd together.
+#define GLSTATE_PROGRAM          0x00000001
+#define GLSTATE_TEXTURES         0x00000002
+#define GLSTATE_BUFFERS          0x00000004
+#define GLSTATE_ENABLES          0x00000008
+#define GLSTATE_CLIENT_ARRAYS    0x00000010
+#define GLSTATE_BLEND_DEPTH      0x00000020
+#define GLSTATE_ALL              0xFFFFFFFF
+
+// Value stored in the shadow for an unknown binding or enum
+#define GLSTATE_UNKNOWN          0xFFFFFFFF
+
+class GLStateCache
+{
+public:
+	GLStateCache();
+	~GLStateCache() {}
+
+	// Forget some (or all) of the shadowed state, so the next change of that
+	//    state is always issued.  Pass an OR of the GLSTATE_* bits above.
+	void Invalidate( unsigned int which = GLSTATE_ALL );
+
+	// Programs
+	void UseProgram( GLuint programID );
+	inline GLuint GetProgram( void ) const { return currentProgram; }
+
+	// Texture units.  BindTexture() and the per-unit enables below apply to
+	//    the unit selected by the most recent ActiveTexture().  Note that
+	//    BindTextureToUnit() does not change units if the binding is already
+	//    correct, so do not rely on it to select the active unit.
+	void ActiveTexture( GLenum unit );
+	void BindTexture( GLenum target, GLuint textureID );
+	void BindTextureToUnit( GLenum unit, GLenum target, GLuint textureID );
+	void TexGenMode( GLenum coord, GLint mode );
+
+	// Buffers (GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_PIXEL_*_BUFFER,
+	//    GL_UNIFORM_BUFFER)
+	void BindBuffer( GLenum target, GLuint bufferID );
+
+	// glDeleteTextures()/glDeleteBuffers().  Deleting a bound object binds 0
+	//    in its place, and OpenGL may hand the name out again, so always
+	//    delete through these so the shadowed bindings follow along.
+	void DeleteTextures( GLsizei n, const GLuint *textureIDs );
+	void DeleteBuffers( GLsizei n, const GLuint *bufferIDs );
+
+	// glEnable()/glDisable().  Texture enables and texgen enables are per-unit
+	//    state, and are tracked against the currently active unit.
+	void Enable( GLenum cap );
+	void Disable( GLenum cap );
+	void SetEnabled( GLenum cap, bool enable );
+	bool IsEnabled( GLenum cap );   // Queries OpenGL if the state is unknown
+
+	// Client-side vertex arrays
+	void EnableClientState( GLenum array );
+	void DisableClientState( GLenum array );
+
+	// Blending and depth functions
+	void BlendFunc( GLenum srcFactor, GLenum dstFactor );
+	void DepthFunc( GLenum func );
+	void DepthMask( GLboolean flag );
+
+	// Statistics.  "Issued" calls actually went to OpenGL, "filtered" calls
+	//    were dropped because the state already matched.
+	inline unsigned int GetIssuedCount( void ) const   { return issuedCalls; }
+	inline unsigned int GetFilteredCount( void ) const { return filteredCalls; }
+	inline void ResetCounters( void )                  { issuedCalls = filteredCalls = 0; }
+	void PrintCounters( FILE *f );
+
+private:
+	unsigned int issuedCalls, filteredCalls;
+
+	// Shadowed state.  GLSTATE_UNKNOWN (or -1 for the enables) means the
+	//    cache does not know what OpenGL currently has.
+	GLuint currentProgram;
+	GLenum activeUnit;
+	GLuint texBinding[GLSTATE_MAX_TEXTURE_UNITS][GLSTATE_NUM_TEXTURE_TARGETS];
+	GLint  texGenMode[GLSTATE_MAX_TEXTURE_UNITS][4];
+	signed char unitEnables[GLSTATE_MAX_TEXTURE_UNITS][GLSTATE_NUM_UNIT_CAPS];
+	signed char globalEnables[GLSTATE_NUM_GLOBAL_CAPS];
+	signed char clientArrays[GLSTATE_NUM_CLIENT_ARRAYS];
+	GLuint bufBinding[GLSTATE_NUM_BUFFER_TARGETS];
+	GLenum blendSrc, blendDst, depthFunc;
+	GLint  depthMask;
+
+	// Map OpenGL enums to slots in the arrays above (-1 if not tracked)
+	int TextureTargetIndex( GLenum target );
+	int GlobalCapIndex( GLenum cap );
+	int UnitCapIndex( GLenum cap );
+	int BufferTargetIndex( GLenum target );
+	int ClientArrayIndex( GLenum array );
+	int CurrentUnitIndex( void );
+
+	// Helpers for bookkeeping the counters
+	inline bool Filtered( void ) { filteredCalls++; return true; }
+	inline void Issued( void )   { issuedCalls++; }
+};
+
+// The single cache shared by all code using the current OpenGL context
+extern GLStateCache glState;
+
+#endif
+
@@ -12,6 +12,9 @@
 **************************************************************************/
 
 #include "glslProgram.h"
+#include "glStateCache.h"
+#include "programBinaryCache.h"
+#include "shaderSourceCache.h"
 #include "sceneLoader.h"
 
 #pragma warning( disable: 4996 )
@@ -27,10 +30,16 @@
 #define BIND_TEX2D_PTR    8
 #define BIND_MAX          8
 
+// Bits in GLSLProgram::dirtyShaders, marking sources not yet compiled.
+//    (Bit 'i' is for shader stage 'i', GLSL_STAGE_*, so keep this order.)
+#define DIRTY_VERTEX      0x1
+#define DIRTY_GEOMETRY    0x2
+#define DIRTY_FRAGMENT    0x4
+
 class GLSLBindings
 {
 public:
-	GLint uniformLocation;
+	int uniformHandle;
 	GLuint bindingType; 
 	float *boundC_variable;
 	GLuint textureID;
@@ -38,18 +47,64 @@ public:
 	char *shaderVarName;
 };
 
+// An entry in the uniform table.  Besides the location and type from the
+//    linked program, this keeps a copy of the last value sent to OpenGL so 
+//    that re-sending the same value can be skipped.
+class GLSLUniform
+{
+public:
+	char *name;
+	GLint location;          // -1 if not in the current program
+	GLenum type;             // 0 if not known to be an active uniform
+	bool isInteger;          // Needs glUniform*i() (ints, bools, samplers)
+	int nextInBucket;        // Next uniform in this hash bucket (or -1)
+	bool shadowValid;        // Is value[] really what OpenGL has?
+	int numValues;           // Number of floats in value[] (-1 => an int)
+	float value[16];
+};
+
+// A simple string hash for the uniform table
+static unsigned int HashUniformName( char *name )
+{
+	unsigned int hash = 5381;
+	while (*name) hash = ((hash << 5) + hash) + (unsigned char)(*name++);
+	return hash % GLSL_UNIFORM_HASH_SIZE;
+}
+
+// Uniforms of these types must be set with glUniform*i()
+static bool IsIntegerUniformType( GLenum type )
+{
+	switch( type )
+	{
+	case GL_INT:  case GL_INT_VEC2:  case GL_INT_VEC3:  case GL_INT_VEC4:
+	case GL_BOOL: case GL_BOOL_VEC2: case GL_BOOL_VEC3: case GL_BOOL_VEC4:
+	case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+	case GL_SAMPLER_1D_SHADOW: case GL_SAMPLER_2D_SHADOW:
+	case GL_SAMPLER_2D_ARRAY_EXT: case GL_SAMPLER_2D_ARRAY_SHADOW_EXT:
+		return true;
+	}
+	return false;
+}
+
 
 GLSLProgram::GLSLProgram( bool verboseError, PathList *path ) :
 	verbose(verboseError), vertShaderID(0), geomShaderID(0), fragShaderID(0),
-	isLinked(false), enabled(false), shaderEnableFlags(0), shaderDisableFlags(0)
+	isLinked(false), enabled(false), shaderEnableFlags(0), shaderDisableFlags(0),
+	shaderRestoreFlags(0)
 {
 	shaderSearchPath = path;
 	vertShaderFile = NULL;
 	geomShaderFile = NULL;
 	fragShaderFile = NULL;
+	vertSource = geomSource = fragSource = NULL;
+	preamble = NULL;
+	dirtyShaders = compilingShaders = 0;
+	linkPending = false;
+	pendingCacheKey = 0;
 	geomVerticesOut = 0; // OpenGL default... Silly, because it gives a linker error at 0!
 	geomInputType = GL_TRIANGLES;
 	geomOutputType = GL_TRIANGLE_STRIP;
+	for (int i=0; i < GLSL_UNIFORM_HASH_SIZE; i++) uniformHash[i] = -1;
 	programID = glCreateProgram();
 	if (programID == 0)
 	{
@@ -60,13 +115,19 @@ GLSLProgram::GLSLProgram( bool verboseError, PathList *path ) :
 
 GLSLProgram::GLSLProgram( char *vShader, char *gShader, char *fShader, bool verboseErrors, PathList *path ) :
 	verbose(verboseErrors), vertShaderID(0), geomShaderID(0), fragShaderID(0), isLinked(false), enabled(false),
-	shaderEnableFlags(0), shaderDisableFlags(0)
+	shaderEnableFlags(0), shaderDisableFlags(0), shaderRestoreFlags(0)
 {
 	geomVerticesOut = 0; // OpenGL default... Silly, because it gives a linker error at 0!
 	shaderSearchPath = path;
 	vertShaderFile = geomShaderFile = fragShaderFile = NULL;
+	vertSource = geomSource = fragSource = NULL;
+	preamble = NULL;
+	dirtyShaders = compilingShaders = 0;
+	linkPending = false;
+	pendingCacheKey = 0;
 	geomInputType = GL_TRIANGLES;
 	geomOutputType = GL_TRIANGLE_STRIP;
+	for (int i=0; i < GLSL_UNIFORM_HASH_SIZE; i++) uniformHash[i] = -1;
 	programID = glCreateProgram();
 	if (programID == 0)
 	{
@@ -86,21 +147,27 @@ GLSLProgram::~GLSLProgram()
 	//    the shader from file) then we are responsible for cleaning up,
 	//    which means (a) free the OpenGL shader, (b) free the duplicated
 	//    storage for the filename.
+	//    (Shaders are only created once compiled, which never happens if the
+	//    program came from the binary cache, so also check the IDs.)
 	if (vertShaderFile) 
 	{ 
 		free(vertShaderFile); 
-		glDeleteShader( vertShaderID ); 
+		if (vertShaderID) glDeleteShader( vertShaderID ); 
 	}
 	if (geomShaderFile) 
 	{
 		free(geomShaderFile);
-		glDeleteShader( geomShaderID );
+		if (geomShaderID) glDeleteShader( geomShaderID );
 	}
 	if (fragShaderFile) 
 	{
 		free(fragShaderFile);
-		glDeleteShader( fragShaderID );
+		if (fragShaderID) glDeleteShader( fragShaderID );
 	}
+	if (vertSource) free( vertSource );
+	if (geomSource) free( geomSource );
+	if (fragSource) free( fragSource );
+	if (preamble) free( preamble );
 
 	for (unsigned int i=0; i < autoBindUniforms.Size(); i++)
 	{
@@ -108,38 +175,44 @@ GLSLProgram::~GLSLProgram()
 			free (autoBindUniforms[i]->shaderVarName);
 		delete autoBindUniforms[i];
 	}
+
+	for (unsigned int i=0; i < uniforms.Size(); i++)
+	{
+		free( uniforms[i]->name );
+		delete uniforms[i];
+	}
+
+	for (unsigned int i=0; i < uniformBlockNames.Size(); i++)
+		free( uniformBlockNames[i] );
+
+	for (int stage=0; stage < 3; stage++)
+		for (unsigned int i=0; i < sourceFiles[stage].Size(); i++)
+			free( sourceFiles[stage][i] );
+
+	glDeleteProgram( programID );
 }
 
 
+// The Set*Shader() methods only load the source.  Compiling waits until
+//    LinkProgram(), which may not need to compile at all if the linked
+//    program is in the binary cache.
 bool GLSLProgram::SetVertexShader  ( char *shaderFilename )
 {
 	// Load the shader code
-	char *tmpString = ReturnFileAsString( shaderFilename );
+	char *tmpString = ReturnFileAsString( shaderFilename, GLSL_STAGE_VERTEX );
 	if (!tmpString && verbose) 
 		fprintf(stderr, "***Error: Unable to load vertex shader '%s'!\n", shaderFilename );
 	if (!tmpString) return false;
 
 	// Copy the filename (now that we know it is valid) in case we need to reload.
+	if (vertShaderFile) free( vertShaderFile );
 	vertShaderFile = strdup( shaderFilename );
 
-	// Create an OpenGL shader object, give OpenGL the source, and free the temp memory
-	vertShaderID = glCreateShader( GL_VERTEX_SHADER );
-	glShaderSource( vertShaderID, 1, (const char **)&tmpString, 0 );
-	free( tmpString );
-
-	// Copile the shader, and check if there were compilation errors
-	GLint compiled = 0;
-	glCompileShader( vertShaderID );
-	glGetShaderiv( vertShaderID, GL_COMPILE_STATUS, &compiled);
-
-	// If there were compile errors, we might want to print them out.
-	if (!compiled)
-	{
-		PrintCompilerError( vertShaderID, vertShaderFile );
-		return false;
-	}
-
-	glAttachShader( programID, vertShaderID );
+	// Keep the source until the next link
+	if (vertSource) free( vertSource );
+	vertSource = tmpString;
+	dirtyShaders |= DIRTY_VERTEX;
+	isLinked = false;
 	return true;
 }
 
@@ -148,33 +221,20 @@ bool GLSLProgram::SetGeometryShader( char *shaderFilename )
 
 #ifdef HAVE_SHADER_MODEL_4
 	// Load the shader code
-	char *tmpString = ReturnFileAsString( shaderFilename );
+	char *tmpString = ReturnFileAsString( shaderFilename, GLSL_STAGE_GEOMETRY );
 	if (!tmpString && verbose) 
 		fprintf(stderr, "***Error: Unable to load geometry shader '%s'!\n", shaderFilename );
 	if (!tmpString) return false;
 
 	// Copy the filename (now that we know it is valid) in case we need to reload.
+	if (geomShaderFile) free( geomShaderFile );
 	geomShaderFile = strdup( shaderFilename );
 
-	// Create an OpenGL shader object, give OpenGL the source, and free the temp memory
-	geomShaderID = glCreateShader( GL_GEOMETRY_SHADER_EXT );
-	glShaderSource( geomShaderID, 1, (const char **)&tmpString, 0 );
-	free( tmpString );
-
-	// Copile the shader, and check if there were compilation errors
-	GLint compiled = 0;
-	glCompileShader( geomShaderID );
-	glGetShaderiv( geomShaderID, GL_COMPILE_STATUS, &compiled);
-
-	// Print out compiler errors.
-	if (!compiled)
-	{
-		PrintCompilerError( geomShaderID, geomShaderFile );
-		return false;
-	}
-
-	glAttachShader( programID, geomShaderID );
-
+	// Keep the source until the next link
+	if (geomSource) free( geomSource );
+	geomSource = tmpString;
+	dirtyShaders |= DIRTY_GEOMETRY;
+	isLinked = false;
 #endif
 
 	return true;
@@ -183,115 +243,310 @@ bool GLSLProgram::SetGeometryShader( char *shaderFilename )
 bool GLSLProgram::SetFragmentShader( char *shaderFilename )
 {
 	// Load the shader code
-	char *tmpString = ReturnFileAsString( shaderFilename );
+	char *tmpString = ReturnFileAsString( shaderFilename, GLSL_STAGE_FRAGMENT );
 	if (!tmpString && verbose) 
 		fprintf(stderr, "***Error: Unable to load fragment shader '%s'!\n", shaderFilename );
 	if (!tmpString) return false;
 
 	// Copy the filename (now that we know it is valid) in case we need to reload.
+	if (fragShaderFile) free( fragShaderFile );
 	fragShaderFile = strdup( shaderFilename );
 
-	// Create an OpenGL shader object, give OpenGL the source, and free the temp memory
-	fragShaderID = glCreateShader( GL_FRAGMENT_SHADER );
-	glShaderSource( fragShaderID, 1, (const char **)&tmpString, 0 );
-	free( tmpString );
-
-	// Copile the shader, and check if there were compilation errors
-	GLint compiled = 0;
-	glCompileShader( fragShaderID );
-	glGetShaderiv( fragShaderID, GL_COMPILE_STATUS, &compiled);
-
-	// If there were compile errors, we might want to print them out.
-	if (!compiled)
-	{
-		PrintCompilerError( fragShaderID, fragShaderFile );
-		return false;
-	}
-
-	glAttachShader( programID, fragShaderID );
+	// Keep the source until the next link
+	if (fragSource) free( fragSource );
+	fragSource = tmpString;
+	dirtyShaders |= DIRTY_FRAGMENT;
+	isLinked = false;
 	return true;
 }
 
 // Reloads shaders from files, compiles them all, and links the result
 bool GLSLProgram::ReloadShaders( void )
 {
-	GLint compiled=0, linked=0;
-
 	// Make sure this isn't currently bound!
 	if (enabled) DisableShader();
 
-	// Reload all shaders (that have non-zero shaders attached and we are responsible for (non-zero filename))
+	// Reload all shaders we are responsible for (non-zero filename)
 	char *tmpString;
-	if (vertShaderID > 0 && vertShaderFile)
+	if (vertShaderFile)
 	{
-		tmpString = ReturnFileAsString( vertShaderFile );
+		tmpString = ReturnFileAsString( vertShaderFile, GLSL_STAGE_VERTEX );
 		if (!tmpString && verbose) fprintf(stderr, "***Error: Unable to load vertex shader '%s'!\n", vertShaderFile );
 		if (!tmpString) return false;
-		glShaderSource( vertShaderID, 1, (const char **)&tmpString, 0 );
-		free( tmpString );
-		glCompileShader( vertShaderID );
-		glGetShaderiv( vertShaderID, GL_COMPILE_STATUS, &compiled);
-		if (!compiled)
-		{
-			PrintCompilerError( vertShaderID, vertShaderFile );
-			return false;
-		}
+		if (vertSource) free( vertSource );
+		vertSource = tmpString;
+		dirtyShaders |= DIRTY_VERTEX;
 	}
-	if (geomShaderID > 0 && geomShaderFile)
+	if (geomShaderFile)
 	{
-		tmpString = ReturnFileAsString( geomShaderFile );
+		tmpString = ReturnFileAsString( geomShaderFile, GLSL_STAGE_GEOMETRY );
 		if (!tmpString && verbose) fprintf(stderr, "***Error: Unable to load geometry shader '%s'!\n", geomShaderFile );
 		if (!tmpString) return false;
-		glShaderSource( geomShaderID, 1, (const char **)&tmpString, 0 );
-		free( tmpString );
-		glCompileShader( geomShaderID );
-		glGetShaderiv( geomShaderID, GL_COMPILE_STATUS, &compiled);
-		if (!compiled)
-		{
-			PrintCompilerError( geomShaderID, geomShaderFile );
-			return false;
-		}
+		if (geomSource) free( geomSource );
+		geomSource = tmpString;
+		dirtyShaders |= DIRTY_GEOMETRY;
 	}
-	if (fragShaderID > 0 && fragShaderFile)
+	if (fragShaderFile)
 	{
-		tmpString = ReturnFileAsString( fragShaderFile );
+		tmpString = ReturnFileAsString( fragShaderFile, GLSL_STAGE_FRAGMENT );
 		if (!tmpString && verbose) fprintf(stderr, "***Error: Unable to load fragment shader '%s'!\n", fragShaderFile );
 		if (!tmpString) return false;
-		glShaderSource( fragShaderID, 1, (const char **)&tmpString, 0 );
-		free( tmpString );
-		glCompileShader( fragShaderID );
-		glGetShaderiv( fragShaderID, GL_COMPILE_STATUS, &compiled);
+		if (fragSource) free( fragSource );
+		fragSource = tmpString;
+		dirtyShaders |= DIRTY_FRAGMENT;
+	}
+
+	// Unchanged files give the same cache key, so this is cheap for them
+	return LinkProgram();
+}
+
+// Hand one shader's source to the compiler, creating and attaching the 
+//    OpenGL shader object the first time through.  This does not wait for
+//    the result (see CheckShaderCompiles()).
+void GLSLProgram::SubmitShader( GLuint &shaderID, GLenum type, char *source )
+{
+	if (!shaderID)
+	{
+		shaderID = glCreateShader( type );
+		glAttachShader( programID, shaderID );
+	}
+	glShaderSource( shaderID, 1, (const char **)&source, 0 );
+	glCompileShader( shaderID );
+}
+
+// Start compiling all shaders whose source changed since they were last 
+//    compiled.  The ones started are remembered in compilingShaders.
+void GLSLProgram::SubmitDirtyShaders( void )
+{
+	if ((dirtyShaders & DIRTY_VERTEX) && vertSource)
+	{
+		SubmitShader( vertShaderID, GL_VERTEX_SHADER, vertSource );
+		compilingShaders |= DIRTY_VERTEX;
+	}
+#ifdef HAVE_SHADER_MODEL_4
+	if ((dirtyShaders & DIRTY_GEOMETRY) && geomSource)
+	{
+		SubmitShader( geomShaderID, GL_GEOMETRY_SHADER_EXT, geomSource );
+		compilingShaders |= DIRTY_GEOMETRY;
+	}
+#endif
+	if ((dirtyShaders & DIRTY_FRAGMENT) && fragSource)
+	{
+		SubmitShader( fragShaderID, GL_FRAGMENT_SHADER, fragSource );
+		compilingShaders |= DIRTY_FRAGMENT;
+	}
+	dirtyShaders &= ~compilingShaders;
+}
+
+// Check the results of the compiles started by SubmitDirtyShaders().  This
+//    waits for the compiler.  Shaders that failed stay dirty.
+bool GLSLProgram::CheckShaderCompiles( void )
+{
+	GLuint ids[3]   = { vertShaderID, geomShaderID, fragShaderID };
+	char  *files[3] = { vertShaderFile, geomShaderFile, fragShaderFile };
+	bool ok = true;
+	for (int i=0; i < 3; i++)
+	{
+		if (!(compilingShaders & (1u << i))) continue;
+		GLint compiled = 0;
+		glGetShaderiv( ids[i], GL_COMPILE_STATUS, &compiled );
 		if (!compiled)
 		{
-			PrintCompilerError( fragShaderID, fragShaderFile );
-			return false;
+			PrintCompilerError( ids[i], files[i], i );
+			dirtyShaders |= (1u << i);
+			ok = false;
 		}
 	}
+	compilingShaders = 0;
+	return ok;
+}
 
-	glLinkProgram( programID );
-	glGetProgramiv( programID, GL_LINK_STATUS, &linked);
-	if (!linked)
+// The key for the binary cache.  Anything that changes the linked program
+//    must be hashed here.  (The cache itself adds the driver strings.)
+unsigned long long GLSLProgram::ProgramCacheKey( void )
+{
+	unsigned long long key = PROGRAM_CACHE_HASH_INIT;
+	key = ProgramBinaryCache::HashString( key, vertSource );
+	key = ProgramBinaryCache::HashString( key, geomSource );
+	key = ProgramBinaryCache::HashString( key, fragSource );
+	if (geomSource)
 	{
-		PrintLinkerError();
-		return ( isLinked = false );
+		int geomSettings[3] = { geomInputType, geomOutputType, geomVerticesOut };
+		key = ProgramBinaryCache::Hash( key, geomSettings, sizeof( geomSettings ) );
+	}
+	return key;
+}
+
+// Get a link going:  either load the program from the binary cache (and be
+//    done), or submit the changed shaders and the link to the driver.  If 
+//    'checkCompiles' is set, compile errors are caught before linking, so a
+//    broken edit leaves the previously linked program intact.
+bool GLSLProgram::BeginLink( bool checkCompiles )
+{
+	GLint linked=0;
+
+	// See if a binary of this exact program was saved on an earlier run
+	pendingCacheKey = 0;
+	if (programCache.IsEnabled())
+	{
+		pendingCacheKey = ProgramCacheKey();
+		if (programCache.Load( programID, pendingCacheKey ))
+		{
+			linkPending = false;
+			isLinked = true;
+			ResolveUniforms();
+			return true;
+		}
 	}
 
-	ResetAutomaticBindings();
-	return ( isLinked = true );
+	// No luck.  Compile from source.  If this fails, whatever the program
+	//    held before (if anything) is still usable, unless the cache lookup
+	//    above clobbered it with a rejected binary.
+	SubmitDirtyShaders();
+	if (checkCompiles && !CheckShaderCompiles())
+	{
+		glGetProgramiv( programID, GL_LINK_STATUS, &linked );
+		isLinked = (linked != 0);
+		return false;
+	}
+
+#ifdef HAVE_SHADER_MODEL_4
+	if (geomShaderID)
+	{
+		glProgramParameteriEXT( programID, GL_GEOMETRY_INPUT_TYPE_EXT, geomInputType );
+		glProgramParameteriEXT( programID, GL_GEOMETRY_OUTPUT_TYPE_EXT, geomOutputType );
+		glProgramParameteriEXT( programID, GL_GEOMETRY_VERTICES_OUT_EXT, geomVerticesOut );
+	}
+#endif
+
+	programCache.PrepareForLink( programID );
+	glLinkProgram( programID );
+	isLinked = false;
+	linkPending = true;
+	return true;
 }
 
-// Relinks the program and checks for any errors.
+// Relinks the program and checks for any errors.  Uses the program binary
+//    cache if possible, and compiles any changed shaders otherwise.
 bool GLSLProgram::LinkProgram( void )
 {
+	if (!BeginLink( true )) return false;
+	return FinishLink();
+}
+
+// Like LinkProgram(), but does not wait for the driver.  Check back with
+//    PollLink() or FinishLink().
+bool GLSLProgram::StartLink( void )
+{
+	return BeginLink( false );
+}
+
+// Without KHR_parallel_shader_compile there's no way to ask without 
+//    waiting, so just say we're done (FinishLink() may then block).
+bool GLSLProgram::IsLinkDone( void )
+{
+	if (!linkPending || !GLEW_KHR_parallel_shader_compile) return true;
+	GLint done = 0;
+	glGetProgramiv( programID, GL_COMPLETION_STATUS_KHR, &done );
+	return done != 0;
+}
+
+bool GLSLProgram::PollLink( void )
+{
+	if (!linkPending) return true;
+	if (!IsLinkDone()) return false;
+	FinishLink();
+	return true;
+}
+
+// Wait for a link started by BeginLink() and check the results.
+bool GLSLProgram::FinishLink( void )
+{
+	if (!linkPending) return isLinked;
+	linkPending = false;
+
+	// A compile error explains the (certain) link failure, so just print that
+	if (!CheckShaderCompiles()) 
+		return ( isLinked = false );
+
 	GLint linked=0;
-	glLinkProgram( programID );
 	glGetProgramiv( programID, GL_LINK_STATUS, &linked);
 	if (!linked)
 	{
 		PrintLinkerError();
 		return ( isLinked = false );
 	}
-	return ( isLinked = true );
+	isLinked = true;
+	if (programCache.IsEnabled())
+		programCache.Store( programID, pendingCacheKey );
+	ResolveUniforms();
+	return true;
+}
+
+
+// Build a new program from the same files and settings (re-reading the
+//    files), and start it linking.  Returns NULL if a file can't be loaded.
+GLSLProgram *GLSLProgram::CreateReplacement( void )
+{
+	GLSLProgram *repl = new GLSLProgram( verbose, shaderSearchPath );
+	repl->SetPreamble( preamble );
+	bool ok = true;
+	if (vertShaderFile) ok = ok && repl->SetVertexShader( vertShaderFile );
+	if (geomShaderFile) ok = ok && repl->SetGeometryShader( geomShaderFile );
+	if (fragShaderFile) ok = ok && repl->SetFragmentShader( fragShaderFile );
+	if (!ok)
+	{
+		delete repl;
+		return 0;
+	}
+	repl->geomInputType   = geomInputType;
+	repl->geomOutputType  = geomOutputType;
+	repl->geomVerticesOut = geomVerticesOut;
+	repl->StartLink();
+	return repl;
+}
+
+static void SwapFileLists( Array1D< char * > &a, Array1D< char * > &b )
+{
+	Array1D< char * > tmp;
+	for (unsigned int i=0; i < a.Size(); i++) tmp.Add( a[i] );
+	a.Clear();
+	for (unsigned int i=0; i < b.Size(); i++) a.Add( b[i] );
+	b.Clear();
+	for (unsigned int i=0; i < tmp.Size(); i++) b.Add( tmp[i] );
+}
+
+// Swap the OpenGL program (and the sources it was built from) with one
+//    built by CreateReplacement().  Our uniform handles, automatic bindings,
+//    and state flags are kept.  'other' ends up with our old program, which
+//    is freed when it is deleted.
+void GLSLProgram::TakeProgramFrom( GLSLProgram *other )
+{
+	if (enabled) DisableShader();
+
+	GLuint tmpID;
+	tmpID = programID;    programID    = other->programID;    other->programID    = tmpID;
+	tmpID = vertShaderID; vertShaderID = other->vertShaderID; other->vertShaderID = tmpID;
+	tmpID = geomShaderID; geomShaderID = other->geomShaderID; other->geomShaderID = tmpID;
+	tmpID = fragShaderID; fragShaderID = other->fragShaderID; other->fragShaderID = tmpID;
+
+	char *tmpSrc;
+	tmpSrc = vertSource; vertSource = other->vertSource; other->vertSource = tmpSrc;
+	tmpSrc = geomSource; geomSource = other->geomSource; other->geomSource = tmpSrc;
+	tmpSrc = fragSource; fragSource = other->fragSource; other->fragSource = tmpSrc;
+
+	unsigned int tmpDirty = dirtyShaders;
+	dirtyShaders = other->dirtyShaders;
+	other->dirtyShaders = tmpDirty;
+	for (int stage=0; stage < 3; stage++)
+		SwapFileLists( sourceFiles[stage], other->sourceFiles[stage] );
+
+	isLinked = other->isLinked;
+	other->isLinked = false;
+
+	// The cache may know our old ID as bound, and OpenGL may reuse that ID
+	glState.Invalidate( GLSTATE_PROGRAM );
+	ResolveUniforms();
 }
 
 
@@ -316,48 +571,82 @@ GLuint GLSLProgram::GetShaderID( GLenum type )
 }
 
 
-// Open a shader, read its contents into a string in memory.
-char *GLSLProgram::ReturnFileAsString( char *filename )
+// Open a shader, read its contents (with #includes expanded) into a string
+//    in memory.  The files it used are remembered in sourceFiles[stage], for
+//    compiler error messages.  See shaderSourceCache.h.
+char *GLSLProgram::ReturnFileAsString( char *filename, int stage )
 {
-	/* open the file */
-	FILE *file;
-	
-	if (shaderSearchPath)
-		file = shaderSearchPath->OpenFileInPath( filename, "r" );
-	else
-		file = fopen( filename, "r" );
-
-	if (!file) return 0;	
+	Array1D< char * > files;
+	char *shaderMemory = shaderSources.LoadShader( filename, shaderSearchPath, &files );
+	if (!shaderMemory) return 0;
+	if (preamble) shaderMemory = InsertPreamble( shaderMemory );
 
-	/* get the length of the file */
-	fseek( file, 0, SEEK_END );
-	long size = ftell( file );
-	rewind( file );
+	for (unsigned int i=0; i < sourceFiles[stage].Size(); i++)
+		free( sourceFiles[stage][i] );
+	sourceFiles[stage].Clear();
+	for (unsigned int i=0; i < files.Size(); i++)
+		sourceFiles[stage].Add( files[i] );
 
-	/* allocate memory for the shader string */
-	char *shaderMemory = (char *)calloc( (size+1), sizeof(char) );
-	if (!shaderMemory) { fclose(file); return 0; }
-	memset( shaderMemory, 0, (size+1) );
+	return shaderMemory;
+}
 
-	/* read shader data from the file */
-	fread (shaderMemory,1,size,file);
-	shaderMemory[size] = 0;
 
-	/* clean up and return the data */
-	fclose(file);
+void GLSLProgram::SetPreamble( char *text )
+{
+	if (preamble) free( preamble );
+	preamble = (text && text[0]) ? strdup( text ) : NULL;
+}
 
-	return shaderMemory;
+// Put the preamble after the #version line (which must come first), or at 
+//    the very start if there is none, then reset the line numbering.  
+//    Frees 'source' and returns a new string.
+char *GLSLProgram::InsertPreamble( char *source )
+{
+	char *insertAt = source;
+	int nextLine = 1;
+	for (char *line = source; line && *line; nextLine++)
+	{
+		char *ptr = line;
+		while (*ptr == ' ' || *ptr == '\t') ptr++;
+		char *end = strchr( line, '\n' );
+		if (!strncmp( ptr, "#version", 8 ))
+		{
+			insertAt = end ? end+1 : line + strlen( line );
+			nextLine++;
+			break;
+		}
+		line = end ? end+1 : 0;
+	}
+	if (insertAt == source) nextLine = 1;
+
+	char lineBuf[64];
+	sprintf( lineBuf, "#line %d 0\n", nextLine );
+	size_t before = insertAt - source;
+	char *result = (char *)malloc( strlen( source ) + strlen( preamble ) + strlen( lineBuf ) + 3 );
+	memcpy( result, source, before );
+	result[before] = 0;
+	if (before > 0 && source[before-1] != '\n') strcat( result, "\n" );
+	strcat( result, preamble );
+	if (preamble[strlen(preamble)-1] != '\n') strcat( result, "\n" );
+	strcat( result, lineBuf );
+	strcat( result, insertAt );
+	free( source );
+	return result;
 }
 
 
 // Grabs the shader log (e.g., compiler errors) for a specified shader. 
-//     (The filename is just there to be pretty)
-void GLSLProgram::PrintCompilerError( GLuint shaderID, char *filename )
+//     (The filename is just there to be pretty.)  If the shader includes
+//     other files, the log refers to them by number, so print a legend.
+void GLSLProgram::PrintCompilerError( GLuint shaderID, char *filename, int stage )
 {
 	if (!verbose) return;
 	char buf[4096];
 	GLsizei theLen;
 	fprintf(stderr, "(((GLSL Compile Error!)))....When compiling '%s'....\n", filename );
+	if (sourceFiles[stage].Size() > 1)
+		for (unsigned int i=0; i < sourceFiles[stage].Size(); i++)
+			fprintf(stderr, "          Source string %d: '%s'\n", i, sourceFiles[stage][i] );
 	fprintf(stderr, "-----------------------------------------------------------------\n");
 	glGetShaderInfoLog( shaderID, 4095, &theLen, buf );
 	fprintf(stderr, "%s\n", buf);
@@ -375,11 +664,11 @@ void GLSLProgram::PrintLinkerError( void )
 	fprintf(stderr, "(((GLSL Link Error!)))....When linking....\n" );
 	sprintf( shaderNum, "<Shader ID #%d>", vertShaderID );
 	fprintf(stderr, "                  Vertex: '%s',\n", 
-		vertShaderID == 0 ? "<FIXED-FUNCTION>" : ( vertShaderFile ? vertShaderFile : shaderNum ) );
+		!vertShaderFile && vertShaderID == 0 ? "<FIXED-FUNCTION>" : ( vertShaderFile ? vertShaderFile : shaderNum ) );
 	fprintf(stderr, "                Geometry: '%s',\n", 
-		geomShaderID == 0 ? "<FIXED-FUNCTION>" : ( geomShaderFile ? geomShaderFile : shaderNum ) );
+		!geomShaderFile && geomShaderID == 0 ? "<FIXED-FUNCTION>" : ( geomShaderFile ? geomShaderFile : shaderNum ) );
 	fprintf(stderr, "            and Fragment: '%s'\n", 
-		fragShaderID == 0 ? "<FIXED-FUNCTION>" : ( fragShaderFile ? fragShaderFile : shaderNum ) );
+		!fragShaderFile && fragShaderID == 0 ? "<FIXED-FUNCTION>" : ( fragShaderFile ? fragShaderFile : shaderNum ) );
 	fprintf(stderr, "-----------------------------------------------------------------\n");
 	glGetProgramInfoLog( programID, 4095, &theLen, buf );
 	fprintf(stderr, "%s\n", buf);
@@ -388,13 +677,15 @@ void GLSLProgram::PrintLinkerError( void )
 
 void GLSLProgram::GeometryShaderSettings( GLenum inputType, int maxEmittedVerts, GLenum outputType )
 {
-	if (!geomShaderID) return;
+	if (!geomSource) return;
 
 #ifdef HAVE_SHADER_MODEL_4
 
-	glProgramParameteriEXT( programID, GL_GEOMETRY_INPUT_TYPE_EXT, inputType );
-	glProgramParameteriEXT( programID, GL_GEOMETRY_OUTPUT_TYPE_EXT, outputType );
-	glProgramParameteriEXT( programID, GL_GEOMETRY_VERTICES_OUT_EXT, maxEmittedVerts );
+	// These are passed to OpenGL in LinkProgram() (and are part of the
+	//    binary cache key, since they change the linked program).
+	geomInputType   = inputType;
+	geomOutputType  = outputType;
+	geomVerticesOut = maxEmittedVerts;
 
 	isLinked = false;
 
@@ -415,54 +706,67 @@ void GLSLProgram::GeometryShaderSettings( GLenum inputType, int maxEmittedVerts,
 
 void GLSLProgram::BindAndEnableTexture( char *shaderTextureName, GLint textureID, GLenum location, GLenum type )
 {
-	GLint loc = glGetUniformLocation( programID, shaderTextureName );
-	if (loc != -1) glUniform1i( loc, location-GL_TEXTURE0 );
-	glActiveTexture( location );
-	glBindTexture( type, textureID );
-	glEnable( type );
+	UploadUniformi( FindUniform( shaderTextureName, true ), location-GL_TEXTURE0 );
+	glState.ActiveTexture( location );
+	glState.BindTexture( type, textureID );
+	glState.Enable( type );
+}
+
+
+void GLSLProgram::BindAndEnableTextureByHandle( int handle, GLint textureID, GLenum location, GLenum type )
+{
+	UploadUniformi( handle, location-GL_TEXTURE0 );
+	glState.ActiveTexture( location );
+	glState.BindTexture( type, textureID );
+	glState.Enable( type );
 }
 
 
 void GLSLProgram::DisableTexture( GLenum location, GLenum type )
 {
-	glActiveTexture( location );
-	glDisable( type );
-	glBindTexture( type, 0 );
+	glState.ActiveTexture( location );
+	glState.Disable( type );
+	glState.BindTexture( type, 0 );
 }
 
 
 bool GLSLProgram::EnableShader( void )
 {
+	// Someone is using us before the link was checked.  Wait for it.
+	if (linkPending) FinishLink();
+
 	// Enable the relevant program.
-	glUseProgram( programID );
+	glState.UseProgram( programID );
 
 	// If there's uniforms we want to bind when we enable the program, loop thru them.
 	for (unsigned int i=0; i < autoBindUniforms.Size(); i++)
 	{
 		// Check that this uniform corresponds to a variable...
-		if ( (autoBindUniforms[i]->uniformLocation < 0) ) continue;
+		GLSLBindings *bind = autoBindUniforms[i];
+		if ( GetParameterLocation( bind->uniformHandle ) < 0 ) continue;
 
 		// It does.  Check what type
-		if ( (autoBindUniforms[i]->bindingType >= BIND_FLOAT) &&  // It's 1, 2, 3, or 4 vector to pass,
-			 (autoBindUniforms[i]->bindingType <= BIND_MAT4) )    // or it's a matrix type.
-			SetUniform( autoBindUniforms[i]->uniformLocation, 
-						autoBindUniforms[i]->bindingType, 
-						autoBindUniforms[i]->boundC_variable );
-		else if (autoBindUniforms[i]->bindingType == BIND_TEX2D_PTR) //It's a 2D texture, but we have a pointer
-		{                                                            //   to the texID, not the texID itself
-			glUniform1i( autoBindUniforms[i]->uniformLocation, autoBindUniforms[i]->textureUnit-GL_TEXTURE0 );
-			glActiveTexture( autoBindUniforms[i]->textureUnit );
+		if ( (bind->bindingType >= BIND_FLOAT) && (bind->bindingType <= BIND_VEC4) ) // It's 1, 2, 3, or 4 vector to pass
+			UploadUniform( bind->uniformHandle, bind->bindingType, bind->boundC_variable );
+		else if ( bind->bindingType == BIND_MAT4 )                                   // or it's a matrix type.
+			UploadUniform( bind->uniformHandle, 16, bind->boundC_variable );
+		else if ( (bind->bindingType == BIND_MAT2) || (bind->bindingType == BIND_MAT3) )
+			continue;                                                                // (Not supported)
+		else if (bind->bindingType == BIND_TEX2D_PTR) //It's a 2D texture, but we have a pointer
+		{                                             //   to the texID, not the texID itself
+			UploadUniformi( bind->uniformHandle, bind->textureUnit-GL_TEXTURE0 );
+			glState.ActiveTexture( bind->textureUnit );
 			// The following line is a sneaky cast.  Your compiler may complain, but it should be OK unless
 			//    you compile this on a machine where:  sizeof(GLuint) != sizeof(GLuint *)
-			glBindTexture( GL_TEXTURE_2D, *((GLuint *)autoBindUniforms[i]->textureID) );
-			glEnable( GL_TEXTURE_2D );
+			glState.BindTexture( GL_TEXTURE_2D, *((GLuint *)bind->textureID) );
+			glState.Enable( GL_TEXTURE_2D );
 		}
 		else // It's a texture of some sort to bind, and we have the constant GL texture identifier already
 		{
-			glUniform1i( autoBindUniforms[i]->uniformLocation, autoBindUniforms[i]->textureUnit-GL_TEXTURE0 );
-			glActiveTexture( autoBindUniforms[i]->textureUnit );
-			glBindTexture( autoBindUniforms[i]->bindingType, autoBindUniforms[i]->textureID );
-			glEnable( autoBindUniforms[i]->bindingType );
+			UploadUniformi( bind->uniformHandle, bind->textureUnit-GL_TEXTURE0 );
+			glState.ActiveTexture( bind->textureUnit );
+			glState.BindTexture( bind->bindingType, bind->textureID );
+			glState.Enable( bind->bindingType );
 		}
 
 	}
@@ -477,18 +781,18 @@ bool GLSLProgram::EnableShader( void )
 bool GLSLProgram::DisableShader( void )
 {
 	// Disable the program
-	glUseProgram( 0 );
+	glState.UseProgram( 0 );
 
-	// If we changed the state with EnableShader(), pop the state off.
-	if (shaderEnableFlags || shaderDisableFlags) glPopAttrib();
+	// If we changed the state with EnableShader(), put it back the way it was.
+	if (shaderEnableFlags || shaderDisableFlags) RestoreProgramSpecificEnablesAndDisables();
 
 	// If we enabled any textures in EnableShader(), disable them.
 	for (unsigned int i=0; i < autoBindUniforms.Size(); i++)
 		if ( (autoBindUniforms[i]->bindingType > BIND_MAX) )  // Then we need to disable a texture
 		{
-			glActiveTexture( autoBindUniforms[i]->textureUnit );
-			glBindTexture( autoBindUniforms[i]->bindingType, 0 );
-			glDisable( autoBindUniforms[i]->bindingType );
+			glState.ActiveTexture( autoBindUniforms[i]->textureUnit );
+			glState.BindTexture( autoBindUniforms[i]->bindingType, 0 );
+			glState.Disable( autoBindUniforms[i]->bindingType );
 		}
 
 	// OK, we're done.
@@ -499,98 +803,246 @@ bool GLSLProgram::DisableShader( void )
 
 int GLSLProgram::SetParameter( char *paramName, float x )
 {
-	GLint location = glGetUniformLocation( programID, paramName );
-	if (location != -1) glUniform1f( location, x );
-	return location;
+	int handle = FindUniform( paramName, true );
+	SetParameterByHandle( handle, x );
+	return GetParameterLocation( handle );
 }
 
 int GLSLProgram::SetParameter( char *paramName, float x, float y )
 {
-	GLint location = glGetUniformLocation( programID, paramName );
-	if (location != -1) glUniform2f( location, x, y );
-	return location;
+	int handle = FindUniform( paramName, true );
+	SetParameterByHandle( handle, x, y );
+	return GetParameterLocation( handle );
 }
 
 int GLSLProgram::SetParameter( char *paramName, float x, float y, float z )
 {
-	GLint location = glGetUniformLocation( programID, paramName );
-	if (location != -1) glUniform3f( location, x, y, z );
-	return location;
+	int handle = FindUniform( paramName, true );
+	SetParameterByHandle( handle, x, y, z );
+	return GetParameterLocation( handle );
 }
 
 int GLSLProgram::SetParameter( char *paramName, float x, float y, float z, float w )
 {
-	GLint location = glGetUniformLocation( programID, paramName );
-	if (location != -1) glUniform4f( location, x, y, z, w );
-	return location;
-}
-
-void GLSLProgram::SetUniform( GLint location, int arraySize, float *array )
-{
-	switch( arraySize )
-	{
-	case 4:
-		glUniform4fv( location, 1, array );
-		break;
-	case 3:
-		glUniform3fv( location, 1, array );
-		break;
-	case 2:
-		glUniform2fv( location, 1, array );
-		break;
-	case 1:
-		glUniform1fv( location, 1, array );
-		break;
-	case BIND_MAT4:
-		glUniformMatrix4fv( location, 1, false, array );
-		break;
-	}
+	int handle = FindUniform( paramName, true );
+	SetParameterByHandle( handle, x, y, z, w );
+	return GetParameterLocation( handle );
 }
 
 int GLSLProgram::SetParameterv( char *paramName, int arraySize, float *array )
 {
-	GLint location = glGetUniformLocation( programID, paramName );
-	if (location == -1) return -1;
-	if (arraySize == 1)
-		glUniform1fv( location, 1, array );
-	else if (arraySize == 2)
-		glUniform2fv( location, 1, array );
-	else if (arraySize == 3)
-		glUniform3fv( location, 1, array );
-	else glUniform4fv( location, 1, array );
-	return location;
+	int handle = FindUniform( paramName, true );
+	SetParameterByHandlev( handle, arraySize, array );
+	return GetParameterLocation( handle );
 }
 
 int GLSLProgram::Set4x4MatrixParameterv( char *paramName, float *array )
 {
-	GLint location = glGetUniformLocation( programID, paramName );
-	if (location == -1) return -1;
-	glUniformMatrix4fv( location, 1, false, array );
-	return location;
+	int handle = FindUniform( paramName, true );
+	Set4x4MatrixParameterByHandlev( handle, array );
+	return GetParameterLocation( handle );
 }
 
 void GLSLProgram::SetTextureBinding( char *shaderTextureName, GLenum location )
 {
-	GLint loc = glGetUniformLocation( programID, shaderTextureName );
-	if (loc != -1) glUniform1i( loc, location-GL_TEXTURE0 );
+	UploadUniformi( FindUniform( shaderTextureName, true ), location-GL_TEXTURE0 );
 }
 
 
-void GLSLProgram::ResetAutomaticBindings( void )
+int GLSLProgram::GetParameterHandle( char *paramName )
 {
-	for (unsigned int i=0; i < autoBindUniforms.Size(); i++)
+	return FindUniform( paramName, true );
+}
+
+GLint GLSLProgram::GetParameterLocation( int handle )
+{
+	if (handle < 0 || handle >= (int)uniforms.Size()) return -1;
+	return uniforms[handle]->location;
+}
+
+void GLSLProgram::SetParameterByHandle( int handle, float x )
+{
+	float vals[1] = { x };
+	UploadUniform( handle, 1, vals );
+}
+
+void GLSLProgram::SetParameterByHandle( int handle, float x, float y )
+{
+	float vals[2] = { x, y };
+	UploadUniform( handle, 2, vals );
+}
+
+void GLSLProgram::SetParameterByHandle( int handle, float x, float y, float z )
+{
+	float vals[3] = { x, y, z };
+	UploadUniform( handle, 3, vals );
+}
+
+void GLSLProgram::SetParameterByHandle( int handle, float x, float y, float z, float w )
+{
+	float vals[4] = { x, y, z, w };
+	UploadUniform( handle, 4, vals );
+}
+
+void GLSLProgram::SetParameterByHandlev( int handle, int arraySize, float *array )
+{
+	UploadUniform( handle, (arraySize >= 1 && arraySize <= 3) ? arraySize : 4, array );
+}
+
+void GLSLProgram::Set4x4MatrixParameterByHandlev( int handle, float *array )
+{
+	UploadUniform( handle, 16, array );
+}
+
+
+// Find the uniform table entry for a named variable.  If it's not there, and 
+//    addIfMissing is set, add it (asking OpenGL where it is if we're linked).
+int GLSLProgram::FindUniform( char *name, bool addIfMissing )
+{
+	if (!name) return -1;
+	unsigned int bucket = HashUniformName( name );
+	for (int idx = uniformHash[bucket]; idx >= 0; idx = uniforms[idx]->nextInBucket)
+		if (!strcmp( uniforms[idx]->name, name )) return idx;
+	if (!addIfMissing) return -1;
+
+	GLSLUniform *u = new GLSLUniform();
+	u->name         = strdup( name );
+	u->location     = isLinked ? glGetUniformLocation( programID, name ) : -1;
+	u->type         = 0;
+	u->isInteger    = false;
+	u->shadowValid  = false;
+	u->numValues    = 0;
+	u->nextInBucket = uniformHash[bucket];
+	return ( uniformHash[bucket] = uniforms.Add( u ) );
+}
+
+// After linking, locations (and possibly types) of all the uniforms may have
+//    changed, and OpenGL has reset all their values.  Rebuild the table.
+void GLSLProgram::ResolveUniforms( void )
+{
+	// Forget everything we knew about the old program.
+	for (unsigned int i=0; i < uniforms.Size(); i++)
 	{
-		if (!autoBindUniforms[i]->shaderVarName) continue;
-		autoBindUniforms[i]->uniformLocation = glGetUniformLocation( programID, 
-													autoBindUniforms[i]->shaderVarName );
+		uniforms[i]->type = 0;
+		uniforms[i]->isInteger = false;
+		uniforms[i]->shadowValid = false;
 	}
+
+	// Make sure all the program's active uniforms are in the table with their types
+	GLint numActive = 0, maxLength = 0;
+	glGetProgramiv( programID, GL_ACTIVE_UNIFORMS, &numActive );
+	glGetProgramiv( programID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength );
+	char *nameBuf = (char *)malloc( maxLength+1 );
+	for (int i=0; nameBuf && i < numActive; i++)
+	{
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform( programID, i, maxLength+1, &length, &size, &type, nameBuf );
+		if (!strncmp( nameBuf, "gl_", 3 )) continue;   // Built-in state, not settable
+		char *bracket = strstr( nameBuf, "[0]" );      // Arrays are reported as "name[0]"
+		if (bracket) *bracket = 0;
+		int idx = FindUniform( nameBuf, true );
+		uniforms[idx]->type = type;
+		uniforms[idx]->isInteger = IsIntegerUniformType( type );
+	}
+	if (nameBuf) free( nameBuf );
+
+	// Find the new locations.  This includes any names someone asked for that
+	//    are not (or are no longer) in the program, which get -1.
+	for (unsigned int i=0; i < uniforms.Size(); i++)
+		uniforms[i]->location = glGetUniformLocation( programID, uniforms[i]->name );
+
+	// Linking also forgets which buffers the uniform blocks read from.
+	for (unsigned int i=0; i < uniformBlockNames.Size(); i++)
+		ApplyUniformBlockBinding( i );
+}
+
+void GLSLProgram::BindUniformBlock( char *blockName, GLuint bindingPoint )
+{
+	unsigned int idx;
+	for (idx=0; idx < uniformBlockNames.Size(); idx++)
+		if (!strcmp( uniformBlockNames[idx], blockName )) break;
+	if (idx < uniformBlockNames.Size())
+		uniformBlockBindings[idx] = bindingPoint;
+	else
+	{
+		uniformBlockNames.Add( strdup( blockName ) );
+		uniformBlockBindings.Add( bindingPoint );
+	}
+	if (isLinked) ApplyUniformBlockBinding( idx );
+}
+
+void GLSLProgram::ApplyUniformBlockBinding( unsigned int idx )
+{
+	if (!GLEW_ARB_uniform_buffer_object) return;
+	GLuint blockIdx = glGetUniformBlockIndex( programID, uniformBlockNames[idx] );
+	if (blockIdx != GL_INVALID_INDEX)
+		glUniformBlockBinding( programID, blockIdx, uniformBlockBindings[idx] );
+}
+
+// Send a value to OpenGL, unless it's the same as the last one sent.  Values
+//    can only be set for the currently bound program, so we only trust our
+//    copy of the value if this program was bound when it was set.
+void GLSLProgram::UploadUniform( int handle, int numFloats, float *values )
+{
+	if (handle < 0 || handle >= (int)uniforms.Size()) return;
+	GLSLUniform *u = uniforms[handle];
+	if (u->location < 0) return;
+
+	bool isBound = ( glState.GetProgram() == programID );
+	if ( isBound && u->shadowValid && u->numValues == numFloats &&
+		 !memcmp( u->value, values, numFloats*sizeof(float) ) ) 
+		return;
+
+	if (u->isInteger && numFloats == 1)
+		glUniform1i( u->location, (GLint)values[0] );
+	else switch( numFloats )
+	{
+	case 1:
+		glUniform1fv( u->location, 1, values );
+		break;
+	case 2:
+		glUniform2fv( u->location, 1, values );
+		break;
+	case 3:
+		glUniform3fv( u->location, 1, values );
+		break;
+	case 4:
+		glUniform4fv( u->location, 1, values );
+		break;
+	case 16:
+		glUniformMatrix4fv( u->location, 1, false, values );
+		break;
+	}
+
+	u->shadowValid = isBound;
+	u->numValues = numFloats;
+	memcpy( u->value, values, numFloats*sizeof(float) );
+}
+
+// Same as UploadUniform(), but for integer values (e.g., sampler texture units)
+void GLSLProgram::UploadUniformi( int handle, GLint value )
+{
+	if (handle < 0 || handle >= (int)uniforms.Size()) return;
+	GLSLUniform *u = uniforms[handle];
+	if (u->location < 0) return;
+
+	bool isBound = ( glState.GetProgram() == programID );
+	if ( isBound && u->shadowValid && u->numValues == -1 && u->value[0] == (float)value )
+		return;
+
+	glUniform1i( u->location, value );
+	u->shadowValid = isBound;
+	u->numValues = -1;
+	u->value[0] = (float)value;
 }
 
 
 void GLSLProgram::SetupAutomaticBinding( char *paramName, int arraySize, float *array )
 {
 	unsigned int idx = autoBindUniforms.Add( new GLSLBindings() );
-	autoBindUniforms[idx]->uniformLocation = glGetUniformLocation( programID, paramName );
+	autoBindUniforms[idx]->uniformHandle = FindUniform( paramName, true );
 	autoBindUniforms[idx]->bindingType = arraySize;
 	autoBindUniforms[idx]->boundC_variable = array;
 	autoBindUniforms[idx]->shaderVarName = strdup( paramName );
@@ -599,7 +1051,7 @@ void GLSLProgram::SetupAutomaticBinding( char *paramName, int arraySize, float *
 void GLSLProgram::SetupAutomatic4x4MatrixBinding( char *paramName, float *array )
 {
 	unsigned int idx = autoBindUniforms.Add( new GLSLBindings() );
-	autoBindUniforms[idx]->uniformLocation = glGetUniformLocation( programID, paramName );
+	autoBindUniforms[idx]->uniformHandle = FindUniform( paramName, true );
 	autoBindUniforms[idx]->bindingType = BIND_MAT4;
 	autoBindUniforms[idx]->boundC_variable = array;
 	autoBindUniforms[idx]->shaderVarName = strdup( paramName );
@@ -608,41 +1060,55 @@ void GLSLProgram::SetupAutomatic4x4MatrixBinding( char *paramName, float *array
 void GLSLProgram::SetupAutomaticTextureBinding( char *shaderTextureName, GLuint textureID, GLenum location, GLenum type )
 {
 	unsigned int idx = autoBindUniforms.Add( new GLSLBindings() );
-	autoBindUniforms[idx]->uniformLocation = glGetUniformLocation( programID, shaderTextureName );
+	autoBindUniforms[idx]->uniformHandle = FindUniform( shaderTextureName, true );
 	autoBindUniforms[idx]->textureUnit = location;
 	autoBindUniforms[idx]->bindingType = type;
 	autoBindUniforms[idx]->textureID   = textureID;
 	autoBindUniforms[idx]->shaderVarName = strdup( shaderTextureName );
-	glUniform1i( autoBindUniforms[idx]->uniformLocation, autoBindUniforms[idx]->textureUnit-GL_TEXTURE0 );
+	UploadUniformi( autoBindUniforms[idx]->uniformHandle, autoBindUniforms[idx]->textureUnit-GL_TEXTURE0 );
 }
 
 void GLSLProgram::SetupAutomaticTexture_Experimental( char *shaderTextureName, GLuint *textureID, GLenum location )
 {
 	unsigned int idx = autoBindUniforms.Add( new GLSLBindings() );
-	autoBindUniforms[idx]->uniformLocation = glGetUniformLocation( programID, shaderTextureName );
+	autoBindUniforms[idx]->uniformHandle = FindUniform( shaderTextureName, true );
 	autoBindUniforms[idx]->textureUnit = location;
 	autoBindUniforms[idx]->bindingType = BIND_TEX2D_PTR;
 	// The following line is a sneaky cast.  Your compiler may complain, but it should be OK unless
 	//    you compile this on a machine where:  sizeof(GLuint) != sizeof(GLuint *)
 	autoBindUniforms[idx]->textureID   = (GLuint)textureID;
 	autoBindUniforms[idx]->shaderVarName = strdup( shaderTextureName );
-	glUniform1i( autoBindUniforms[idx]->uniformLocation, autoBindUniforms[idx]->textureUnit-GL_TEXTURE0 );
+	UploadUniformi( autoBindUniforms[idx]->uniformHandle, autoBindUniforms[idx]->textureUnit-GL_TEXTURE0 );
 }
 
+// The GLSL_* flags and the OpenGL state each one corresponds to
+static const unsigned int programStateFlags[] = { GLSL_BLEND, GLSL_DEPTH_TEST, GLSL_STENCIL_TEST,
+                                                  GLSL_ALPHA_TEST, GLSL_CULL_FACE, GLSL_LIGHTING };
+static const GLenum programStateCaps[] = { GL_BLEND, GL_DEPTH_TEST, GL_STENCIL_TEST,
+                                           GL_ALPHA_TEST, GL_CULL_FACE, GL_LIGHTING };
+#define NUM_PROGRAM_STATE_FLAGS   6
+
+// Rather than glPushAttrib( GL_ENABLE_BIT ), which saves (and later restores) 
+//    every enable in OpenGL, remember just the ones we touch.  The state cache 
+//    usually already knows these, so this rarely requires querying OpenGL.
 void GLSLProgram::SetProgramSpecificEnablesAndDisables( void )
 {
-	glPushAttrib( GL_ENABLE_BIT );
-	if ( shaderEnableFlags & GLSL_BLEND )			glEnable( GL_BLEND );
-	if ( shaderEnableFlags & GLSL_DEPTH_TEST )		glEnable( GL_DEPTH_TEST );
-	if ( shaderEnableFlags & GLSL_STENCIL_TEST )	glEnable( GL_STENCIL_TEST );
-	if ( shaderEnableFlags & GLSL_ALPHA_TEST )		glEnable( GL_ALPHA_TEST );
-	if ( shaderEnableFlags & GLSL_CULL_FACE )		glEnable( GL_CULL_FACE );
-	if ( shaderEnableFlags & GLSL_LIGHTING )		glEnable( GL_LIGHTING );
-	if ( shaderDisableFlags & GLSL_BLEND )			glDisable( GL_BLEND );
-	if ( shaderDisableFlags & GLSL_DEPTH_TEST )		glDisable( GL_DEPTH_TEST );
-	if ( shaderDisableFlags & GLSL_STENCIL_TEST )	glDisable( GL_STENCIL_TEST );
-	if ( shaderDisableFlags & GLSL_ALPHA_TEST )		glDisable( GL_ALPHA_TEST );
-	if ( shaderDisableFlags & GLSL_CULL_FACE )		glDisable( GL_CULL_FACE );
-	if ( shaderDisableFlags & GLSL_LIGHTING )		glDisable( GL_LIGHTING );
+	shaderRestoreFlags = 0;
+	for (int i=0; i < NUM_PROGRAM_STATE_FLAGS; i++)
+	{
+		if ( !((shaderEnableFlags | shaderDisableFlags) & programStateFlags[i]) ) continue;
+		if ( glState.IsEnabled( programStateCaps[i] ) ) shaderRestoreFlags |= programStateFlags[i];
+		if ( shaderEnableFlags & programStateFlags[i] ) glState.Enable( programStateCaps[i] );
+		if ( shaderDisableFlags & programStateFlags[i] ) glState.Disable( programStateCaps[i] );
+	}
+}
+
+void GLSLProgram::RestoreProgramSpecificEnablesAndDisables( void )
+{
+	for (int i=0; i < NUM_PROGRAM_STATE_FLAGS; i++)
+	{
+		if ( !((shaderEnableFlags | shaderDisableFlags) & programStateFlags[i]) ) continue;
+		glState.SetEnabled( programStateCaps[i], (shaderRestoreFlags & programStateFlags[i]) != 0 );
+	}
 }
 
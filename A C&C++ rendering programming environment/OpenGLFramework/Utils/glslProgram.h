@@ -45,6 +45,15 @@
 //    references to both from the class and .cpp file
 #include "DataTypes/Array1D.h"
 class GLSLBindings;
+class GLSLUniform;
+
+// Indices for per-shader-stage data
+#define GLSL_STAGE_VERTEX        0
+#define GLSL_STAGE_GEOMETRY      1
+#define GLSL_STAGE_FRAGMENT      2
+
+// Number of buckets in each program's uniform name -> location hash table
+#define GLSL_UNIFORM_HASH_SIZE   64
 
 // Begin the definition of the GLSLProgram class
 class GLSLProgram
@@ -59,7 +68,10 @@ public:
 		         bool verboseErrors=false, PathList *path = 0 );
 	~GLSLProgram();
 
-	// Assocate a shader from a particuar file (Error => returns 'false')
+	// Assocate a shader from a particuar file (Error => returns 'false').
+	//    Only a missing file is an error here.  The source is compiled by 
+	//    the next LinkProgram(), which reports any compile errors (and skips
+	//    compiling entirely if the program is in the binary cache).
 	bool SetVertexShader  ( char *shaderFilename );
 	bool SetGeometryShader( char *shaderFilename );
 	bool SetFragmentShader( char *shaderFilename );
@@ -76,13 +88,27 @@ public:
 	bool LinkProgram( void );
 	inline bool IsLinked( void ) { return isLinked; } 
 
+	// Non-blocking linking, so many programs can compile in parallel (with
+	//    KHR_parallel_shader_compile) or while the CPU does other work.
+	//    StartLink() submits the compiles and link and returns immediately.
+	//    PollLink() returns true once the link is finished (checking for 
+	//    errors then), and never waits if the driver can report progress.
+	//    FinishLink() waits, and returns the same value as LinkProgram().
+	//    EnableShader() calls FinishLink() if a link is still pending.
+	bool StartLink( void );
+	bool PollLink( void );
+	bool FinishLink( void );
+	inline bool IsLinkPending( void ) const { return linkPending; }
+
 	// Set geometry shader params.  Requires relinking (call LinkProgram())
 	void GeometryShaderSettings( GLenum inputType, 
 		                         int maxEmittedVerts, 
 								 GLenum outputType );
 
 	// Set uniform shader parameters.  The number of parameters (or array size)
-	//    should match the size of the variable in the GLSL shader.
+	//    should match the size of the variable in the GLSL shader.  Uniform
+	//    locations are looked up once per link (not per call), and a copy of
+	//    each uniform's value is kept so unchanged values are not re-sent.
 	int SetParameter( char *paramName, float x );
 	int SetParameter( char *paramName, float x, float y );
 	int SetParameter( char *paramName, float x, float y, float z );
@@ -95,6 +121,25 @@ public:
 	//    that's the only one implemented.  Array should be in OpenGL order.
 	int Set4x4MatrixParameterv( char *paramName, float *array );
 
+	// Faster versions of the above, which skip even the hash table lookup.
+	//    Get a handle once (e.g., in a Preprocess() method) and reuse it.  
+	//    Handles remain valid after ReloadShaders(), even if the variable 
+	//    disappears from (or reappears in) the shader.  Setting a handle of
+	//    -1, or a handle whose variable is not in the shader, does nothing.
+	int  GetParameterHandle( char *paramName );
+	void SetParameterByHandle( int handle, float x );
+	void SetParameterByHandle( int handle, float x, float y );
+	void SetParameterByHandle( int handle, float x, float y, float z );
+	void SetParameterByHandle( int handle, float x, float y, float z, float w );
+	void SetParameterByHandlev( int handle, int arraySize, float *array );
+	void Set4x4MatrixParameterByHandlev( int handle, float *array );
+	GLint GetParameterLocation( int handle );
+
+	// Associate a uniform block (if the shader declares one with this name)
+	//    with a uniform buffer binding point.  This is remembered, and redone
+	//    whenever the program is relinked.  Requires ARB_uniform_buffer_object.
+	void BindUniformBlock( char *blockName, GLuint bindingPoint );
+
 	// These are shortcuts for utilizing textures with this shader.  To use a
 	//     texture in GLSL, you need four steps:  1) Bind name to a texture 
 	//     unit, 2) glActiveTexture(texUnit), 3) glBindTexture(texType,texID),
@@ -110,6 +155,13 @@ public:
 		                 GLenum type = GL_TEXTURE_2D );
 	void SetTextureBinding( char *shaderTextureName, 
 		                    GLenum location = GL_TEXTURE0 );
+	void BindAndEnableTextureByHandle( int handle, GLint textureID, 
+		                               GLenum location = GL_TEXTURE0, 
+							           GLenum type = GL_TEXTURE_2D );
+
+	// Text (e.g., "#define USE_TEXTURE 1\n") inserted into every shader after
+	//    its #version line.  This must be set before the Set*Shader() calls.
+	void SetPreamble( char *text );
 
 	/***********************************************************************/
 	/*                           ADVANCED STUFF                            */
@@ -133,8 +185,9 @@ public:
 
 	// Sometimes it's easier to tell the shader what state it needs... and 
 	//    let EnableShader() and DisableShader() handle the enabling.  Before
-	//    changing state PushAttrib() is used, and PopAttrib() is called in 
-	//    DisableShader().  Thus these are non-destructive to current state.
+	//    changing state, the prior value of each affected enable is recorded,
+	//    and DisableShader() restores it.  Thus these are non-destructive to 
+	//    current state.
 	inline void SetProgramEnables( unsigned int progEnableFlags = 0 )  
 	            { shaderEnableFlags = progEnableFlags; }
 	inline void SetProgramDisables( unsigned int progDisableFlags = 0 )  
@@ -142,10 +195,25 @@ public:
 
 	// Read out OpenGL program ID (i.e., from glCreateProgram() or 
 	//    glCreateShader()).  For the shader IDs, pass in: GL_VERTEX_SHADER,
-	//    GL_GEOMETRY_SHADER_EXT, or GL_FRAGMENT_SHADER
+	//    GL_GEOMETRY_SHADER_EXT, or GL_FRAGMENT_SHADER.  Shader IDs are 0
+	//    until the shader is compiled (never, if loaded from the cache).
 	inline GLuint GetProgramID( void ) { return programID; } 
 	GLuint GetShaderID( GLenum type );  
 
+	// The files each shader stage (GLSL_STAGE_*) was built from:  the main 
+	//    file, followed by any files it #included.
+	inline unsigned int GetNumSourceFiles( int stage ) const { return sourceFiles[stage].Size(); }
+	inline char *GetSourceFile( int stage, unsigned int i )  { return sourceFiles[stage][i]; }
+
+	// Rebuilding a program without disturbing the one in use (e.g., when its
+	//    files change).  CreateReplacement() makes a new program from the 
+	//    same files and starts linking it (NULL if a file can't be read).
+	//    Once its link is done and succeeded, TakeProgramFrom() moves its 
+	//    OpenGL program into this one, so all users of this GLSLProgram see
+	//    the new program, and handles stay valid.  Then delete the other.
+	GLSLProgram *CreateReplacement( void );
+	void TakeProgramFrom( GLSLProgram *other );
+
 	// Changes if verbose error messages are on/off  
 	inline void VerboseOff() { verbose = false; }
 	inline void VerboseOn()  { verbose = true; }
@@ -176,25 +244,65 @@ private:
 	//    reload these files in ReloadShaders().
 	char *vertShaderFile, *geomShaderFile, *fragShaderFile;  
 
+	// The shader source text, kept so LinkProgram() can compile on a binary
+	//    cache miss.  dirtyShaders says which have not been compiled yet.
+	char *vertSource, *geomSource, *fragSource;
+	unsigned int dirtyShaders;
+	char *preamble;               // See SetPreamble()
+
+	// Every file each shader's source came from (the main file, then its
+	//    #includes), indexed by GLSL_STAGE_*.  Entry 'i' is what the GLSL
+	//    compiler calls source string 'i' in its error messages.
+	Array1D< char * > sourceFiles[3];
+
+	// State of a link begun by StartLink() that has not been checked yet.
+	//    compilingShaders says which shaders were submitted with it.
+	bool linkPending;
+	unsigned int compilingShaders;
+	unsigned long long pendingCacheKey;
+
 	// Parameters for geometry shader input and output.  
 	int geomVerticesOut, geomInputType, geomOutputType;
 
 	// Variables automatically bound upon calling EnableShader()
 	Array1D< GLSLBindings * > autoBindUniforms;
 
+	// All the uniforms we know about (either active in the linked program or
+	//    asked for by name), hashed by name.  Entries are never removed, so
+	//    indices into this array are used as handles.
+	Array1D< GLSLUniform * > uniforms;
+	int uniformHash[GLSL_UNIFORM_HASH_SIZE];
+
+	// Uniform blocks associated with buffer binding points (BindUniformBlock())
+	Array1D< char * > uniformBlockNames;
+	Array1D< GLuint > uniformBlockBindings;
+
 	// Special functionality that absolutely must be enabled or disabled?
-	unsigned int shaderEnableFlags, shaderDisableFlags;
+	//    (And which of those were enabled before EnableShader() changed them)
+	unsigned int shaderEnableFlags, shaderDisableFlags, shaderRestoreFlags;
 
 	// Private utility functions
-	char *ReturnFileAsString( char *filename );     // Searches the path
-	void PrintCompilerError( GLuint shaderID, char *filename );
+	char *ReturnFileAsString( char *filename, int stage );  // Searches the path
+	char *InsertPreamble( char *source );
+	void PrintCompilerError( GLuint shaderID, char *filename, int stage );
 	void PrintLinkerError( void );
-	void SetUniform( GLint location, int arraySize, float *array );
+	void SubmitShader( GLuint &shaderID, GLenum type, char *source );
+	void SubmitDirtyShaders( void );
+	bool CheckShaderCompiles( void );
+	unsigned long long ProgramCacheKey( void );
+	bool BeginLink( bool checkCompiles );
+	bool IsLinkDone( void );
 	void SetProgramSpecificEnablesAndDisables( void );
-
-	// This needs to be called in ReloadShaders() to make sure the bindings
-	//    are set to the appropriate shader variables.
-	void ResetAutomaticBindings( void );
+	void RestoreProgramSpecificEnablesAndDisables( void );
+
+	// Uniform table maintenance.  ResolveUniforms() needs to be called after 
+	//    every successful link, to query the new locations and types (and to 
+	//    forget the shadowed values, as linking resets them).
+	int  FindUniform( char *name, bool addIfMissing );
+	void ResolveUniforms( void );
+	void UploadUniform( int handle, int numFloats, float *values );
+	void UploadUniformi( int handle, GLint value );
+	void ApplyUniformBlockBinding( unsigned int idx );
 };
 
 
@@ -204,7 +312,7 @@ private:
 //    This is state that is modified when EnableShader() is called. 
 // NOTE:  These can be OR'd together, so if you add more, make sure to
 //    maintain this ability!  If you add more, you need to change the code
-//    in SetProgramSpecificEnablesAndDisables().
+//    tables used by SetProgramSpecificEnablesAndDisables().
 #define GLSL_NO_SPECIAL_STATE	0x00000000
 #define GLSL_BLEND				0x00000001
 #define GLSL_DEPTH_TEST			0x00000002
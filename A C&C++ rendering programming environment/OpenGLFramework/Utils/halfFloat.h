@@ -0,0 +1,50 @@
+/***************************************************************************/
+/* halfFloat.h                                                             */
+/* ------------                                                            */
+/*                                                                         */
+/* Conversions between floats and IEEE 754 half floats (as stored in       */
+/*     GL_HALF_FLOAT textures), without any lookup tables.                 */
+/*                                                                         */
+/* FloatToHalf() rounds to nearest.  Values too big for a half are clamped */
+/*     to +/-65504 rather than becoming infinite, since image data that    */
+/*     overflows is better off saturated.  NaNs stay NaNs.                 */
+/***************************************************************************/
+
+#ifndef __HALFFLOAT_H
+#define __HALFFLOAT_H
+
+inline unsigned short FloatToHalf( float f )
+{
+	union { float f; unsigned int u; } bits;
+	bits.f = f;
+	unsigned short sign = (unsigned short)( (bits.u >> 16) & 0x8000 );
+	unsigned int mag = bits.u & 0x7FFFFFFF;
+	bits.u = mag;
+
+	if (mag > 0x7F800000) return sign | 0x7E00;                  // NaN
+	if (mag >= 0x477FF000) return sign | 0x7BFF;                 // >= 65520, clamp
+	if (mag < 0x38800000)                                        // < 2^-14, denormal
+		return sign | (unsigned short)( bits.f * 16777216.0f + 0.5f );
+	return sign | (unsigned short)( ((mag + 0x00001000) >> 13) - (112 << 10) );
+}
+
+inline float HalfToFloat( unsigned short h )
+{
+	union { float f; unsigned int u; } bits;
+	unsigned int sign = ((unsigned int)h & 0x8000) << 16;
+	unsigned int exp  = (h >> 10) & 0x1F;
+	unsigned int mant = h & 0x3FF;
+
+	if (exp == 0)                                                // zero or denormal
+	{
+		bits.f = mant * (1.0f / 16777216.0f);
+		bits.u |= sign;
+	}
+	else if (exp == 31)                                          // infinity or NaN
+		bits.u = sign | 0x7F800000 | (mant << 13);
+	else
+		bits.u = sign | ((exp + 112) << 23) | (mant << 13);
+	return bits.f;
+}
+
+#endif
@@ -0,0 +1,389 @@
+/***************************************************************************/
+/* mipmapGenerator.cpp                                                     */
+/* ------------                                                            */
+/*                                                                         */
+/* Implements the CPU mipmap generator.  See the header for usage notes.   */
+/***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "mipmapGenerator.h"
+#include "parallelFor.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#include <xmmintrin.h>
+#define MIPMAP_USE_SSE
+#endif
+
+// Half-width of the Kaiser filter, in destination pixels, and its shape
+#define KAISER_RADIUS   2.0f
+#define KAISER_ALPHA    4.0f
+
+// Iterations of the search for each level's alpha scale
+#define COVERAGE_SEARCH_STEPS  16
+
+
+/***************************************************************************/
+/*                        sRGB <-> linear tables                           */
+/***************************************************************************/
+
+// srgbToLinear[b] is byte b decoded.  srgbThreshold[b] is the linear value
+//    halfway (in sRGB) between bytes b and b+1, so encoding is a search.
+static float srgbToLinear[256];
+static float srgbThreshold[255];
+
+static double SRGBDecode( double c )
+{
+	return (c <= 0.04045) ? c / 12.92 : pow( (c + 0.055) / 1.055, 2.4 );
+}
+
+// Built before main() runs, so threads never race to build them
+class SRGBTables
+{
+public:
+	SRGBTables()
+	{
+		for (int i=0; i < 256; i++)
+			srgbToLinear[i] = (float)SRGBDecode( i / 255.0 );
+		for (int i=0; i < 255; i++)
+			srgbThreshold[i] = (float)SRGBDecode( (i + 0.5) / 255.0 );
+	}
+};
+static SRGBTables buildSRGBTables;
+
+static inline unsigned char LinearToSRGBByte( float v )
+{
+	int lo = 0, hi = 255;          // Answer is the number of thresholds below v
+	while (lo < hi)
+	{
+		int mid = (lo + hi) >> 1;
+		if (srgbThreshold[mid] < v) lo = mid+1;
+		else hi = mid;
+	}
+	return (unsigned char)lo;
+}
+
+static inline unsigned char LinearToByte( float v )
+{
+	if (v <= 0.0f) return 0;
+	if (v >= 1.0f) return 255;
+	return (unsigned char)( v * 255.0f + 0.5f );
+}
+
+
+/***************************************************************************/
+/*                         Resampling filters                              */
+/***************************************************************************/
+
+// The taps for resampling along one axis.  Destination pixel i sums
+//    count[i] source pixels, listed at index/weight[ offset[i] ... ].
+typedef struct
+{
+	int *offset, *count, *index;
+	float *weight;
+} AxisFilter;
+
+static double BesselI0( double x )
+{
+	double sum = 1.0, term = 1.0;
+	for (int k=1; k < 32; k++)
+	{
+		term *= (x / (2.0*k)) * (x / (2.0*k));
+		sum += term;
+		if (term < 1e-12 * sum) break;
+	}
+	return sum;
+}
+
+// The Kaiser-windowed sinc, at a distance of d destination pixels
+static double KaiserWeight( double d )
+{
+	double t = d / KAISER_RADIUS;
+	if (t <= -1.0 || t >= 1.0) return 0.0;
+	double sinc = (fabs(d) < 1e-8) ? 1.0 : sin( 3.14159265358979 * d ) / (3.14159265358979 * d);
+	return sinc * BesselI0( KAISER_ALPHA * sqrt( 1.0 - t*t ) ) / BesselI0( KAISER_ALPHA );
+}
+
+static void BuildAxisFilter( int srcSize, int dstSize, unsigned int flags, AxisFilter *f )
+{
+	double scale = srcSize / (double)dstSize;
+	double radius = (flags & MIPMAP_KAISER) ? KAISER_RADIUS * scale : 0.5 * scale;
+	int maxTaps = (int)ceil( 2.0 * radius ) + 2;
+
+	f->offset = (int *)malloc( dstSize * sizeof(int) );
+	f->count  = (int *)malloc( dstSize * sizeof(int) );
+	f->index  = (int *)malloc( dstSize * maxTaps * sizeof(int) );
+	f->weight = (float *)malloc( dstSize * maxTaps * sizeof(float) );
+
+	for (int i=0; i < dstSize; i++)
+	{
+		double center = (i + 0.5) * scale;
+		int first = (int)floor( center - radius ), last = (int)ceil( center + radius );
+		int n = 0, *idx = f->index + i*maxTaps;
+		double w[256], total = 0.0;
+		for (int j=first; j < last && n < maxTaps && n < 256; j++)
+		{
+			double wt;
+			if (flags & MIPMAP_KAISER)
+				wt = KaiserWeight( (j + 0.5 - center) / scale );
+			else   // Box:  how much of the destination pixel does source pixel j cover?
+			{
+				double lo = j > center - radius ? j : center - radius;
+				double hi = j+1 < center + radius ? j+1 : center + radius;
+				wt = hi > lo ? hi - lo : 0.0;
+			}
+			if (wt == 0.0) continue;
+
+			// Past the edges, repeat the edge pixel (and merge its taps)
+			int src = j < 0 ? 0 : (j >= srcSize ? srcSize-1 : j);
+			if (n > 0 && idx[n-1] == src) w[n-1] += wt;
+			else { idx[n] = src; w[n++] = wt; }
+			total += wt;
+		}
+
+		f->offset[i] = i*maxTaps;
+		f->count[i]  = n;
+		for (int k=0; k < n; k++)
+			f->weight[i*maxTaps + k] = (float)( w[k] / total );
+	}
+}
+
+static void FreeAxisFilter( AxisFilter *f )
+{
+	free( f->offset );
+	free( f->count );
+	free( f->index );
+	free( f->weight );
+}
+
+// Everything the resampling threads need
+typedef struct
+{
+	const float *src;
+	float *tmp, *dst;
+	int srcW, srcH, dstW, dstH, comps;
+	bool simd;
+	AxisFilter horiz, vert;
+} ResampleJob;
+
+// Horizontal pass:  source rows -> tmp rows (dstW wide)
+static void ResampleRows( int first, int last, void *data )
+{
+	ResampleJob *job = (ResampleJob *)data;
+	int comps = job->comps;
+	for (int y=first; y < last; y++)
+	{
+		const float *srcRow = job->src + y * job->srcW * comps;
+		float *tmpRow = job->tmp + y * job->dstW * comps;
+		int x = 0;
+
+#ifdef MIPMAP_USE_SSE
+		// An RGBA pixel is one SSE register.  The sums are done in the same
+		//    order as below, so give the same results.
+		if (job->simd && comps == 4)
+			for (; x < job->dstW; x++)
+			{
+				__m128 sum = _mm_setzero_ps();
+				int off = job->horiz.offset[x];
+				for (int k=0; k < job->horiz.count[x]; k++)
+				{
+					__m128 p = _mm_loadu_ps( srcRow + job->horiz.index[off+k] * 4 );
+					sum = _mm_add_ps( sum, _mm_mul_ps( _mm_set1_ps( job->horiz.weight[off+k] ), p ) );
+				}
+				_mm_storeu_ps( tmpRow + x*4, sum );
+			}
+#endif
+
+		for (; x < job->dstW; x++)
+		{
+			float sum[4] = { 0, 0, 0, 0 };
+			int off = job->horiz.offset[x];
+			for (int k=0; k < job->horiz.count[x]; k++)
+			{
+				const float *p = srcRow + job->horiz.index[off+k] * comps;
+				float w = job->horiz.weight[off+k];
+				for (int c=0; c < comps; c++)
+					sum[c] += w * p[c];
+			}
+			for (int c=0; c < comps; c++)
+				tmpRow[x*comps+c] = sum[c];
+		}
+	}
+}
+
+// Vertical pass:  tmp rows -> destination rows.  The inner loop runs
+//    along whole rows, 4 floats at a time with SSE.
+static void ResampleColumns( int first, int last, void *data )
+{
+	ResampleJob *job = (ResampleJob *)data;
+	int rowLen = job->dstW * job->comps;
+	for (int y=first; y < last; y++)
+	{
+		float *dstRow = job->dst + y * rowLen;
+		memset( dstRow, 0, rowLen * sizeof(float) );
+		int off = job->vert.offset[y];
+		for (int k=0; k < job->vert.count[y]; k++)
+		{
+			const float *tmpRow = job->tmp + job->vert.index[off+k] * rowLen;
+			float w = job->vert.weight[off+k];
+			int i = 0;
+#ifdef MIPMAP_USE_SSE
+			if (job->simd)
+			{
+				__m128 w4 = _mm_set1_ps( w );
+				for (; i+4 <= rowLen; i += 4)
+					_mm_storeu_ps( dstRow+i, _mm_add_ps( _mm_loadu_ps( dstRow+i ),
+						                                 _mm_mul_ps( w4, _mm_loadu_ps( tmpRow+i ) ) ) );
+			}
+#endif
+			for (; i < rowLen; i++)
+				dstRow[i] += w * tmpRow[i];
+		}
+	}
+}
+
+static float *Resample( const float *src, int srcW, int srcH, int dstW, int dstH, int comps, unsigned int flags )
+{
+	ResampleJob job;
+	job.src = src;
+	job.srcW = srcW;  job.srcH = srcH;
+	job.dstW = dstW;  job.dstH = dstH;
+	job.comps = comps;
+	job.simd = !(flags & MIPMAP_NO_SIMD);
+	job.tmp = (float *)malloc( dstW * srcH * comps * sizeof(float) );
+	job.dst = (float *)malloc( dstW * dstH * comps * sizeof(float) );
+	BuildAxisFilter( srcW, dstW, flags, &job.horiz );
+	BuildAxisFilter( srcH, dstH, flags, &job.vert );
+
+	ParallelFor( srcH, ResampleRows, &job, 32 );
+	ParallelFor( dstH, ResampleColumns, &job, 32 );
+
+	FreeAxisFilter( &job.horiz );
+	FreeAxisFilter( &job.vert );
+	free( job.tmp );
+	return job.dst;
+}
+
+
+/***************************************************************************/
+/*                    Conversions and alpha coverage                       */
+/***************************************************************************/
+
+// Which channels are sRGB color, and which (if any) is alpha?
+static inline int NumColorChannels( int comps, unsigned int flags )
+{
+	if (flags & MIPMAP_LINEAR_DATA) return 0;
+	return comps >= 3 ? 3 : 1;
+}
+
+static inline int AlphaChannel( int comps )
+{
+	return (comps == 2 || comps == 4) ? comps-1 : -1;
+}
+
+static float *BytesToFloat( const unsigned char *pixels, int numPixels, int comps, unsigned int flags )
+{
+	int numColor = NumColorChannels( comps, flags );
+	float *out = (float *)malloc( numPixels * comps * sizeof(float) );
+	for (int i=0; i < numPixels; i++)
+		for (int c=0; c < comps; c++)
+		{
+			unsigned char b = pixels[i*comps+c];
+			out[i*comps+c] = (c < numColor && c != AlphaChannel( comps )) ? srgbToLinear[b] : b * (1.0f/255.0f);
+		}
+	return out;
+}
+
+static unsigned char *FloatToBytes( const float *pixels, int numPixels, int comps, unsigned int flags, float alphaScale )
+{
+	int numColor = NumColorChannels( comps, flags ), alpha = AlphaChannel( comps );
+	unsigned char *out = (unsigned char *)malloc( numPixels * comps );
+	for (int i=0; i < numPixels; i++)
+		for (int c=0; c < comps; c++)
+		{
+			float v = pixels[i*comps+c];
+			if (c == alpha)          out[i*comps+c] = LinearToByte( v * alphaScale );
+			else if (c < numColor)   out[i*comps+c] = LinearToSRGBByte( v );
+			else                     out[i*comps+c] = LinearToByte( v );
+		}
+	return out;
+}
+
+// Fraction of pixels whose (scaled, 8-bit) alpha passes the alpha test
+static float AlphaCoverage( const float *pixels, int numPixels, int comps, float cutoff, float scale )
+{
+	int alpha = AlphaChannel( comps ), passed = 0;
+	unsigned char threshold = LinearToByte( cutoff );
+	for (int i=0; i < numPixels; i++)
+		if (LinearToByte( pixels[i*comps+alpha] * scale ) >= threshold) passed++;
+	return passed / (float)numPixels;
+}
+
+// Find the alpha scale giving this level the same coverage as level 0
+static float FindAlphaScale( const float *pixels, int numPixels, int comps, float cutoff, float target )
+{
+	float lo = 0.0f, hi = 4.0f;
+	for (int i=0; i < COVERAGE_SEARCH_STEPS; i++)
+	{
+		float mid = 0.5f * (lo + hi);
+		if (AlphaCoverage( pixels, numPixels, comps, cutoff, mid ) < target) lo = mid;
+		else hi = mid;
+	}
+	return hi;
+}
+
+
+/***************************************************************************/
+/*                             The chain                                   */
+/***************************************************************************/
+
+MipmapChain::MipmapChain( const unsigned char *level0, int width, int height, int components ) :
+	components(components)
+{
+	levelWidth.Add( width );
+	levelHeight.Add( height );
+	levelData.Add( level0 );
+}
+
+MipmapChain::~MipmapChain()
+{
+	for (unsigned int i=1; i < levelData.Size(); i++)
+		free( (void *)levelData[i] );
+}
+
+void MipmapChain::AddLevel( int width, int height, unsigned char *data )
+{
+	levelWidth.Add( width );
+	levelHeight.Add( height );
+	levelData.Add( data );
+}
+
+MipmapChain *GenerateMipmaps( const unsigned char *pixels, int width, int height, int components,
+							  unsigned int flags, float alphaCutoff )
+{
+	MipmapChain *chain = new MipmapChain( pixels, width, height, components );
+	if (width < 1 || height < 1 || components < 1 || components > 4) return chain;
+
+	bool keepCoverage = (flags & MIPMAP_PRESERVE_COVERAGE) && AlphaChannel( components ) >= 0;
+	float *level = BytesToFloat( pixels, width*height, components, flags );
+	float coverage = keepCoverage ? AlphaCoverage( level, width*height, components, alphaCutoff, 1.0f ) : 0;
+
+	int w = width, h = height;
+	while (w > 1 || h > 1)
+	{
+		int nw = w > 1 ? w/2 : 1, nh = h > 1 ? h/2 : 1;
+		float *next = Resample( level, w, h, nw, nh, components, flags );
+		free( level );
+		level = next;
+		w = nw;
+		h = nh;
+
+		// Only the stored bytes get the coverage fix-up, not the next level's input
+		float alphaScale = keepCoverage ? FindAlphaScale( level, w*h, components, alphaCutoff, coverage ) : 1.0f;
+		chain->AddLevel( w, h, FloatToBytes( level, w*h, components, flags, alphaScale ) );
+	}
+	free( level );
+	return chain;
+}
+
@@ -0,0 +1,76 @@
+/***************************************************************************/
+/* mipmapGenerator.h                                                       */
+/* ------------                                                            */
+/*                                                                         */
+/* Builds mipmap chains on the CPU, replacing gluBuild2DMipmaps() (which   */
+/*     is single threaded, rescales non-power-of-two images to powers of   */
+/*     two, and averages gamma-encoded bytes).                             */
+/*                                                                         */
+/* Each level is filtered from the one above it, in floating point:        */
+/*     - Color channels are treated as sRGB, and averaged in linear space  */
+/*       (unless MIPMAP_LINEAR_DATA is given, e.g., for normal maps).      */
+/*     - Odd and non-power-of-two sizes are handled by weighting source    */
+/*       pixels by how much of each destination pixel they cover.          */
+/*     - MIPMAP_KAISER uses a Kaiser-windowed sinc, which keeps distant    */
+/*       levels sharper than a box filter.                                 */
+/*     - MIPMAP_PRESERVE_COVERAGE scales each level's alpha so the same    */
+/*       fraction of texels pass the alpha test as in level 0.  Without    */
+/*       this, alpha-tested foliage thins out and vanishes with distance.  */
+/*                                                                         */
+/* Rows of each level are split across threads (see parallelFor.h), and   */
+/*     filtered 4 floats at a time with SSE where available.  The output   */
+/*     depends on neither the number of threads nor SSE (MIPMAP_NO_SIMD    */
+/*     forces the plain loops).  Tests/testMipmapGenerator.cpp checks      */
+/*     both paths against stored golden levels.                            */
+/***************************************************************************/
+
+#ifndef __MIPMAPGENERATOR_H
+#define __MIPMAPGENERATOR_H
+
+#include "DataTypes/Array1D.h"
+
+// Flags for GenerateMipmaps()
+#define MIPMAP_DEFAULT               0x00000000   // Box filter, sRGB color
+#define MIPMAP_KAISER                0x00000001   // Kaiser-windowed sinc filter
+#define MIPMAP_LINEAR_DATA           0x00000002   // Not sRGB color; filter values as-is
+#define MIPMAP_PRESERVE_COVERAGE     0x00000004   // Keep alpha test coverage constant
+#define MIPMAP_NO_SIMD               0x00000008   // Don't use SSE (same output, for testing)
+
+// Alpha test threshold used by MIPMAP_PRESERVE_COVERAGE, unless told otherwise
+#define MIPMAP_DEFAULT_ALPHA_CUTOFF  0.5f
+
+// Bump this when the generator's output changes (it's part of cache keys)
+#define MIPMAP_GENERATOR_VERSION     1
+
+// A full chain of mipmaps, down to 1x1.  Level 0 is the original image,
+//    which is not copied (so it must outlive the chain).
+class MipmapChain
+{
+public:
+	MipmapChain( const unsigned char *level0, int width, int height, int components );
+	~MipmapChain();
+
+	inline int GetComponents( void ) const                       { return components; }
+	inline unsigned int GetNumLevels( void ) const               { return levelData.Size(); }
+	inline int GetLevelWidth( unsigned int lvl )                 { return levelWidth[lvl]; }
+	inline int GetLevelHeight( unsigned int lvl )                { return levelHeight[lvl]; }
+	inline const unsigned char *GetLevelData( unsigned int lvl ) { return levelData[lvl]; }
+
+	// Add the next level (we take ownership of the malloc()'d data)
+	void AddLevel( int width, int height, unsigned char *data );
+
+private:
+	int components;
+	Array1D< int > levelWidth, levelHeight;
+	Array1D< const unsigned char * > levelData;
+};
+
+// Build the mipmaps for an image with 'components' (1-4) bytes per pixel.
+//    With 2 or 4 components, the last one is alpha.  The caller deletes
+//    the result.
+MipmapChain *GenerateMipmaps( const unsigned char *pixels, int width, int height, int components,
+							  unsigned int flags=MIPMAP_DEFAULT,
+							  float alphaCutoff=MIPMAP_DEFAULT_ALPHA_CUTOFF );
+
+#endif
+
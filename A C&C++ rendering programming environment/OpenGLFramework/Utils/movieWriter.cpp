@@ -0,0 +1,197 @@
+/***************************************************************************/
+/* movieWriter.cpp                                                         */
+/* ------------                                                            */
+/*                                                                         */
+/* Implements streaming Y4M and raw RGB movies.  See the header for usage  */
+/*     notes.                                                              */
+/***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "movieWriter.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MOVIE_USE_SSE2
+#endif
+
+// Visual Studio 2005 arbitrarily decided all sorts of standard library calls
+//    are obsolete, making this essential to avoid pages and pages of useless
+//    warnings.
+#pragma warning( disable: 4996 )
+
+
+// BT.601 video range, in 8.8 fixed point.  Chroma is computed from the sum
+//    of two (vertically averaged) pixels, so is shifted one bit further.
+#define Y_FROM_RGB( r, g, b )   ((( 66*(r) + 129*(g) +  25*(b) + 128) >> 8) + 16)
+#define U_FROM_SUM( r, g, b )   (((-38*(r) -  74*(g) + 112*(b) + 256) >> 9) + 128)
+#define V_FROM_SUM( r, g, b )   (((112*(r) -  94*(g) -  18*(b) + 256) >> 9) + 128)
+
+#ifdef MOVIE_USE_SSE2
+// Four 32-bit sums from madd results [p0 rg, p0 b, p1 rg, p1 b] and the same
+//    for p2 and p3
+static inline __m128i AddPairs( __m128i a, __m128i b )
+{
+	__m128 fa = _mm_castsi128_ps( a ), fb = _mm_castsi128_ps( b );
+	return _mm_add_epi32( _mm_castps_si128( _mm_shuffle_ps( fa, fb, _MM_SHUFFLE(2,0,2,0) ) ),
+		                  _mm_castps_si128( _mm_shuffle_ps( fa, fb, _MM_SHUFFLE(3,1,3,1) ) ) );
+}
+
+// Luma of 4 RGBA pixels, as 32-bit values
+static inline __m128i Luma4( const unsigned char *src )
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i coef = _mm_setr_epi16( 66, 129, 25, 0, 66, 129, 25, 0 );
+	__m128i px = _mm_loadu_si128( (const __m128i *)src );
+	__m128i sum = AddPairs( _mm_madd_epi16( _mm_unpacklo_epi8( px, zero ), coef ),
+		                    _mm_madd_epi16( _mm_unpackhi_epi8( px, zero ), coef ) );
+	return _mm_add_epi32( _mm_srai_epi32( _mm_add_epi32( sum, _mm_set1_epi32( 128 ) ), 8 ),
+		                  _mm_set1_epi32( 16 ) );
+}
+
+// Sums of horizontally adjacent pixels:  [p0+p1, p2+p3] as 16-bit RGBA
+static inline __m128i PairSums( __m128i px )
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i lo = _mm_unpacklo_epi8( px, zero ), hi = _mm_unpackhi_epi8( px, zero );
+	return _mm_unpacklo_epi64( _mm_add_epi16( lo, _mm_srli_si128( lo, 8 ) ),
+		                       _mm_add_epi16( hi, _mm_srli_si128( hi, 8 ) ) );
+}
+
+static inline __m128i Chroma4( __m128i sums0, __m128i sums1, __m128i coef )
+{
+	__m128i sum = AddPairs( _mm_madd_epi16( sums0, coef ), _mm_madd_epi16( sums1, coef ) );
+	return _mm_add_epi32( _mm_srai_epi32( _mm_add_epi32( sum, _mm_set1_epi32( 256 ) ), 9 ),
+		                  _mm_set1_epi32( 128 ) );
+}
+#endif
+
+void RGBAToYUV420( const unsigned char *rgba, int width, int height,
+				   unsigned char *yPlane, unsigned char *uPlane, unsigned char *vPlane )
+{
+	for (int row=0; row < height; row += 2)
+	{
+		// The output's top rows are the input's last
+		const unsigned char *srcA = rgba + 4*width*(height-1-row);
+		const unsigned char *srcB = srcA - 4*width;
+		unsigned char *yA = yPlane + width*row, *yB = yA + width;
+		unsigned char *u = uPlane + (width/2)*(row/2), *v = vPlane + (width/2)*(row/2);
+		int x = 0;
+
+#ifdef MOVIE_USE_SSE2
+		const __m128i coefU = _mm_setr_epi16( -38, -74, 112, 0, -38, -74, 112, 0 );
+		const __m128i coefV = _mm_setr_epi16( 112, -94, -18, 0, 112, -94, -18, 0 );
+		for (; x+8 <= width; x += 8)
+		{
+			const unsigned char *a = srcA + 4*x, *b = srcB + 4*x;
+			__m128i lumaA = _mm_packs_epi32( Luma4( a ), Luma4( a+16 ) );
+			__m128i lumaB = _mm_packs_epi32( Luma4( b ), Luma4( b+16 ) );
+			_mm_storel_epi64( (__m128i *)(yA + x), _mm_packus_epi16( lumaA, lumaA ) );
+			_mm_storel_epi64( (__m128i *)(yB + x), _mm_packus_epi16( lumaB, lumaB ) );
+
+			__m128i sums0 = PairSums( _mm_avg_epu8( _mm_loadu_si128( (const __m128i *)a ),
+				                                    _mm_loadu_si128( (const __m128i *)b ) ) );
+			__m128i sums1 = PairSums( _mm_avg_epu8( _mm_loadu_si128( (const __m128i *)(a+16) ),
+				                                    _mm_loadu_si128( (const __m128i *)(b+16) ) ) );
+			__m128i uv = _mm_packs_epi32( Chroma4( sums0, sums1, coefU ), Chroma4( sums0, sums1, coefV ) );
+			uv = _mm_packus_epi16( uv, uv );
+			int uBytes = _mm_cvtsi128_si32( uv ), vBytes = _mm_cvtsi128_si32( _mm_srli_si128( uv, 4 ) );
+			memcpy( u + x/2, &uBytes, 4 );
+			memcpy( v + x/2, &vBytes, 4 );
+		}
+#endif
+
+		// Whatever's left (or everything, without SSE2).  Vertical averages
+		//    round up, as _mm_avg_epu8() does.
+		for (; x < width; x += 2)
+		{
+			const unsigned char *a = srcA + 4*x, *b = srcB + 4*x;
+			yA[x]   = (unsigned char)Y_FROM_RGB( a[0], a[1], a[2] );
+			yA[x+1] = (unsigned char)Y_FROM_RGB( a[4], a[5], a[6] );
+			yB[x]   = (unsigned char)Y_FROM_RGB( b[0], b[1], b[2] );
+			yB[x+1] = (unsigned char)Y_FROM_RGB( b[4], b[5], b[6] );
+
+			int sum[3];
+			for (int c=0; c < 3; c++)
+				sum[c] = ((a[c] + b[c] + 1) >> 1) + ((a[c+4] + b[c+4] + 1) >> 1);
+			u[x/2] = (unsigned char)U_FROM_SUM( sum[0], sum[1], sum[2] );
+			v[x/2] = (unsigned char)V_FROM_SUM( sum[0], sum[1], sum[2] );
+		}
+	}
+}
+
+
+MovieWriter::MovieWriter( char *movieFile, int width, int height, int fps ) :
+	file(0), format(MOVIE_FORMAT_Y4M), width(width), height(height), numFrames(0)
+{
+	filename = strdup( movieFile );
+	if (width <= 0 || height <= 0 || (width & 1) || (height & 1))
+	{
+		printf("Error: Movie '%s' can't be %d x %d (sizes must be even)!\n", movieFile, width, height );
+		return;
+	}
+
+	char *ptr = strrchr( movieFile, '.' );
+	char buf[16];
+	strncpy( buf, ptr ? ptr : "", 15 );
+	buf[15] = 0;
+	for (int i=0; buf[i]; i++)
+		buf[i] = tolower( buf[i] );
+	if (!strcmp(buf, ".rgb") || !strcmp(buf, ".raw"))  format = MOVIE_FORMAT_RGB;
+
+	file = fopen( movieFile, "wb" );
+	if (!file)
+	{
+		printf("Error: Unable to open movie '%s'!\n", movieFile );
+		return;
+	}
+
+	if (format == MOVIE_FORMAT_Y4M)
+	{
+		fprintf( file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps );
+		frame.SetSize( width*height + 2*(width/2)*(height/2) );
+	}
+	else
+		frame.SetSize( 3*width*height );
+}
+
+MovieWriter::~MovieWriter()
+{
+	if (file) fclose( file );
+	free( filename );
+}
+
+bool MovieWriter::WriteFrame( const unsigned char *rgba )
+{
+	if (!file) return false;
+
+	unsigned char *out = frame.GetData();
+	if (format == MOVIE_FORMAT_Y4M)
+	{
+		unsigned char *u = out + width*height, *v = u + (width/2)*(height/2);
+		RGBAToYUV420( rgba, width, height, out, u, v );
+		fprintf( file, "FRAME\n" );
+	}
+	else
+	{
+		for (int y=0; y < height; y++)
+		{
+			const unsigned char *src = rgba + 4*width*(height-1-y);
+			for (int x=0; x < width; x++, src += 4, out += 3)
+			{
+				out[0] = src[0];
+				out[1] = src[1];
+				out[2] = src[2];
+			}
+		}
+	}
+
+	if (fwrite( frame.GetData(), 1, frame.Size(), file ) != frame.Size())
+	{
+		printf("Error: Unable to write to movie '%s'!\n", filename );
+		return false;
+	}
+	numFrames++;
+	return true;
+}
@@ -0,0 +1,66 @@
+/***************************************************************************/
+/* movieWriter.h                                                           */
+/* ------------                                                            */
+/*                                                                         */
+/* Streams frames into an uncompressed movie, for an external encoder to   */
+/*     turn into something smaller.  Two formats are written:              */
+/*        Y4M ("YUV4MPEG2"):  planar YUV 4:2:0, with a header giving the   */
+/*            size and frame rate, so e.g. "ffmpeg -i movie.y4m out.mp4"   */
+/*            needs no other options.  Used for '.y4m' files, and any      */
+/*            file without a known extension (e.g., a named pipe).         */
+/*        Raw RGB:  just 24-bit RGB pixels, top row first.  Used for       */
+/*            '.rgb' and '.raw' files (the encoder must be told the size,  */
+/*            e.g. "-f rawvideo -pix_fmt rgb24 -s 1024x768 -r 30").        */
+/*                                                                         */
+/* The file can be a named pipe (a FIFO on Unix, "\\.\pipe\name" on        */
+/*     Windows) that an encoder is reading, so frames never touch the      */
+/*     disk.  (On Unix, opening a FIFO waits for the reader to start.)     */
+/*                                                                         */
+/* Frames are RGBA, bottom row first, as glReadPixels() gives them.  The   */
+/*     conversion to YUV (BT.601, video range, each chroma sample from a   */
+/*     2x2 block) uses SSE2 where available.  FrameGrab (frameGrab.h) does */
+/*     the writing on its writer thread.                                   */
+/***************************************************************************/
+
+#ifndef __MOVIEWRITER_H
+#define __MOVIEWRITER_H
+
+#include <stdio.h>
+#include "DataTypes/Array1D.h"
+
+#define MOVIE_FORMAT_Y4M           0
+#define MOVIE_FORMAT_RGB           1
+
+// Convert 'width' x 'height' RGBA pixels (bottom row first) into planar
+//    YUV 4:2:0 (top row first).  Width and height must be even.  The U and
+//    V planes are (width/2) x (height/2).
+void RGBAToYUV420( const unsigned char *rgba, int width, int height,
+				   unsigned char *yPlane, unsigned char *uPlane, unsigned char *vPlane );
+
+class MovieWriter
+{
+public:
+	// Opens the file and writes its header.  Width and height must be even.
+	//    Check IsValid() after.
+	MovieWriter( char *movieFile, int width, int height, int fps );
+	~MovieWriter();
+
+	inline bool IsValid( void ) const                { return file != 0; }
+	inline char *GetFilename( void )                 { return filename; }
+	inline int GetFormat( void ) const               { return format; }
+	inline int GetWidth( void ) const                { return width; }
+	inline int GetHeight( void ) const               { return height; }
+	inline unsigned int GetNumFrames( void ) const   { return numFrames; }
+
+	// Add a GetWidth() x GetHeight() RGBA frame (bottom row first)
+	bool WriteFrame( const unsigned char *rgba );
+
+private:
+	char *filename;
+	FILE *file;
+	int format, width, height;
+	unsigned int numFrames;
+	Array1D< unsigned char > frame;   // The converted frame
+};
+
+#endif
@@ -0,0 +1,273 @@
+/***************************************************************************/
+/* parallelFor.cpp                                                         */
+/* ------------                                                            */
+/*                                                                         */
+/* Implements ParallelFor(), background threads, ParallelMutex, and        */
+/*     ParallelWorker with Win32 threads or pthreads.  See the header for  */
+/*     usage notes.                                                        */
+/***************************************************************************/
+
+#include <stdlib.h>
+#include "parallelFor.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+// How many ParallelFor() ranges this thread is inside, so nested loops run
+//    serially.  It's per thread, since separate threads (e.g., the main
+//    thread and a TextureStreamer) may each run their own loops at once.
+#ifdef _WIN32
+static __declspec(thread) int parallelLoopDepth = 0;
+#else
+static __thread int parallelLoopDepth = 0;
+#endif
+
+// One thread's share of the loop
+typedef struct
+{
+	ParallelRangeFunc func;
+	void *data;
+	int first, last;
+} ParallelRange;
+
+#ifdef _WIN32
+static unsigned __stdcall ParallelThreadMain( void *arg )
+#else
+static void *ParallelThreadMain( void *arg )
+#endif
+{
+	ParallelRange *range = (ParallelRange *)arg;
+	parallelLoopDepth++;
+	range->func( range->first, range->last, range->data );
+	parallelLoopDepth--;
+	return 0;
+}
+
+
+// (Asked every time, rather than cached in a static that threads starting
+//    their first loops at once would race on.  It's cheap.)
+int GetNumberOfCores( void )
+{
+	int numCores;
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo( &info );
+	numCores = (int)info.dwNumberOfProcessors;
+#else
+	numCores = (int)sysconf( _SC_NPROCESSORS_ONLN );
+#endif
+	if (numCores < 1) numCores = 1;
+	if (numCores > PARALLEL_MAX_THREADS) numCores = PARALLEL_MAX_THREADS;
+	return numCores;
+}
+
+void ParallelFor( int count, ParallelRangeFunc func, void *data, int minPerThread )
+{
+	if (count <= 0) return;
+	if (minPerThread < 1) minPerThread = 1;
+
+	int numThreads = parallelLoopDepth > 0 ? 1 : GetNumberOfCores();
+	if (numThreads > count / minPerThread) numThreads = count / minPerThread;
+	if (numThreads <= 1)
+	{
+		func( 0, count, data );
+		return;
+	}
+
+	ParallelRange ranges[PARALLEL_MAX_THREADS];
+	for (int i=0; i < numThreads; i++)
+	{
+		ranges[i].func  = func;
+		ranges[i].data  = data;
+		ranges[i].first = (int)( ((long long)count * i) / numThreads );
+		ranges[i].last  = (int)( ((long long)count * (i+1)) / numThreads );
+	}
+
+	// Start threads for all but the first range, which we do ourselves.  If
+	//    a thread can't be started, its range is done here instead.
+#ifdef _WIN32
+	HANDLE threads[PARALLEL_MAX_THREADS];
+	int started = 0;
+	for (int i=1; i < numThreads; i++)
+	{
+		HANDLE h = (HANDLE)_beginthreadex( 0, 0, ParallelThreadMain, &ranges[i], 0, 0 );
+		if (h) threads[started++] = h;
+		else ParallelThreadMain( &ranges[i] );
+	}
+	ParallelThreadMain( &ranges[0] );
+	if (started > 0)
+		WaitForMultipleObjects( started, threads, TRUE, INFINITE );
+	for (int i=0; i < started; i++)
+		CloseHandle( threads[i] );
+#else
+	pthread_t threads[PARALLEL_MAX_THREADS];
+	int started = 0;
+	for (int i=1; i < numThreads; i++)
+	{
+		if (!pthread_create( &threads[started], 0, ParallelThreadMain, &ranges[i] )) started++;
+		else ParallelThreadMain( &ranges[i] );
+	}
+	ParallelThreadMain( &ranges[0] );
+	for (int i=0; i < started; i++)
+		pthread_join( threads[i], 0 );
+#endif
+}
+
+
+// A thread started by ParallelStartThread()
+typedef struct
+{
+	ParallelThreadFunc func;
+	void *data;
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	pthread_t handle;
+#endif
+} ParallelThread;
+
+#ifdef _WIN32
+static unsigned __stdcall ParallelBackgroundMain( void *arg )
+#else
+static void *ParallelBackgroundMain( void *arg )
+#endif
+{
+	ParallelThread *thread = (ParallelThread *)arg;
+	thread->func( thread->data );
+	return 0;
+}
+
+void *ParallelStartThread( ParallelThreadFunc func, void *data )
+{
+	ParallelThread *thread = new ParallelThread;
+	thread->func = func;
+	thread->data = data;
+#ifdef _WIN32
+	thread->handle = (HANDLE)_beginthreadex( 0, 0, ParallelBackgroundMain, thread, 0, 0 );
+	if (thread->handle) return thread;
+#else
+	if (!pthread_create( &thread->handle, 0, ParallelBackgroundMain, thread )) return thread;
+#endif
+	delete thread;
+	return 0;
+}
+
+void ParallelJoinThread( void *thread )
+{
+	if (!thread) return;
+	ParallelThread *t = (ParallelThread *)thread;
+#ifdef _WIN32
+	WaitForSingleObject( t->handle, INFINITE );
+	CloseHandle( t->handle );
+#else
+	pthread_join( t->handle, 0 );
+#endif
+	delete t;
+}
+
+void ParallelSleep( int milliseconds )
+{
+#ifdef _WIN32
+	Sleep( milliseconds );
+#else
+	usleep( 1000 * milliseconds );
+#endif
+}
+
+
+ParallelMutex::ParallelMutex()
+{
+#ifdef _WIN32
+	CRITICAL_SECTION *cs = new CRITICAL_SECTION;
+	InitializeCriticalSection( cs );
+	handle = cs;
+#else
+	pthread_mutex_t *mutex = new pthread_mutex_t;
+	pthread_mutex_init( mutex, 0 );
+	handle = mutex;
+#endif
+}
+
+ParallelMutex::~ParallelMutex()
+{
+#ifdef _WIN32
+	DeleteCriticalSection( (CRITICAL_SECTION *)handle );
+	delete (CRITICAL_SECTION *)handle;
+#else
+	pthread_mutex_destroy( (pthread_mutex_t *)handle );
+	delete (pthread_mutex_t *)handle;
+#endif
+}
+
+void ParallelMutex::Lock( void )
+{
+#ifdef _WIN32
+	EnterCriticalSection( (CRITICAL_SECTION *)handle );
+#else
+	pthread_mutex_lock( (pthread_mutex_t *)handle );
+#endif
+}
+
+void ParallelMutex::Unlock( void )
+{
+#ifdef _WIN32
+	LeaveCriticalSection( (CRITICAL_SECTION *)handle );
+#else
+	pthread_mutex_unlock( (pthread_mutex_t *)handle );
+#endif
+}
+
+
+ParallelWorker::ParallelWorker( ParallelStepFunc step, void *data ) :
+	step(step), data(data), thread(0), quit(false), finished(false), woken(false)
+{
+}
+
+ParallelWorker::~ParallelWorker()
+{
+	quit = true;
+	ParallelJoinThread( thread );
+}
+
+// Before exiting, check with Wake() (under the lock), so an item queued
+//    just after the last step either gets a restarted thread or this one
+void ParallelWorker::ThreadMain( void *arg )
+{
+	ParallelWorker *w = (ParallelWorker *)arg;
+	while (!w->quit)
+	{
+		if (w->step( w->data )) continue;
+
+		w->lock.Lock();
+		bool again = w->woken;
+		w->woken = false;
+		if (!again) w->finished = true;
+		w->lock.Unlock();
+		if (!again) return;
+	}
+}
+
+void ParallelWorker::Wake( void )
+{
+	lock.Lock();
+	bool restart = finished;
+	woken = !finished;
+	lock.Unlock();
+
+	if (restart)
+	{
+		ParallelJoinThread( thread );
+		thread = 0;
+		finished = false;
+	}
+	if (thread) return;
+
+	thread = ParallelStartThread( ThreadMain, this );
+	if (!thread)
+		while (!quit && step( data )) ;
+}
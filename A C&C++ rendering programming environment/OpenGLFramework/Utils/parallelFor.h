@@ -0,0 +1,82 @@
+/***************************************************************************/
+/* parallelFor.h                                                           */
+/* ------------                                                            */
+/*                                                                         */
+/* A very small helper for splitting a loop across the CPU's cores, for    */
+/*     the (non-OpenGL!) number crunching done while loading scenes.       */
+/*                                                                         */
+/* ParallelFor( count, func, data ) splits [0, count) into one contiguous  */
+/*     range per thread and calls func( first, last, data ) on each range  */
+/*     (with 'last' one past the end), returning once all are done.  The   */
+/*     calling thread does one of the ranges itself.  Threads are created  */
+/*     per call, so only use this for work taking milliseconds or more.    */
+/*                                                                         */
+/* Callbacks run concurrently, so they must only write to their own range  */
+/*     of the output (or use a ParallelMutex), and must never make OpenGL  */
+/*     calls.  A ParallelFor() started from inside a callback simply runs  */
+/*     on the calling thread, so nested loops don't multiply the threads.  */
+/***************************************************************************/
+
+#ifndef __PARALLELFOR_H
+#define __PARALLELFOR_H
+
+// Never split work across more than this many threads
+#define PARALLEL_MAX_THREADS   32
+
+typedef void (*ParallelRangeFunc)( int first, int last, void *data );
+
+// Run func over [0,count), giving each thread at least minPerThread items
+void ParallelFor( int count, ParallelRangeFunc func, void *data, int minPerThread=1 );
+
+// The number of threads ParallelFor() will use (at most)
+int GetNumberOfCores( void );
+
+// A single background thread, for long running work (e.g., streaming data
+//    in while frames are drawn) that the caller can't wait for.  The same
+//    rules as ParallelFor() callbacks apply.  ParallelStartThread() 
+//    returns 0 if the thread couldn't be started.
+typedef void (*ParallelThreadFunc)( void *data );
+void *ParallelStartThread( ParallelThreadFunc func, void *data );
+void ParallelJoinThread( void *thread );
+void ParallelSleep( int milliseconds );
+
+// A lock, for the rare bits of shared state (e.g., statistics) touched
+//    from inside ParallelFor() callbacks
+class ParallelMutex
+{
+public:
+	ParallelMutex();
+	~ParallelMutex();
+	void Lock( void );
+	void Unlock( void );
+private:
+	void *handle;
+};
+
+// A background thread working through a queue the owner fills a bit at a
+//    time (e.g., tiles to read, or frames to write).  'step' handles one
+//    waiting item (finding it under the owner's own lock), returning false
+//    once none are left, and the thread exits when that happens.  Call
+//    Wake() after queueing items to (re)start it.  If a thread can't be
+//    started, Wake() runs the steps itself until nothing is waiting.
+//    Deleting the worker stops it after the current item.
+typedef bool (*ParallelStepFunc)( void *data );
+class ParallelWorker
+{
+public:
+	ParallelWorker( ParallelStepFunc step, void *data );
+	~ParallelWorker();
+	void Wake( void );
+private:
+	ParallelStepFunc step;
+	void *data;
+	void *thread;
+	volatile bool quit;
+	bool finished, woken;
+	ParallelMutex lock;
+
+	static void ThreadMain( void *worker );
+};
+
+#endif
+
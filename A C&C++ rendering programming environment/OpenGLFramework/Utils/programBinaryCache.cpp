@@ -0,0 +1,206 @@
+/***************************************************************************/
+/* programBinaryCache.cpp                                                  */
+/* ------------                                                            */
+/*                                                                         */
+/* Implements the on-disk GLSL program binary cache.  See the header for   */
+/*     usage notes.                                                        */
+/***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "programBinaryCache.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#define MakeCacheDirectory(d)  _mkdir(d)
+#else
+#include <sys/stat.h>
+#define MakeCacheDirectory(d)  mkdir(d, 0755)
+#endif
+
+#pragma warning( disable: 4996 )
+
+// Bump this if the file layout changes, so old files are ignored
+#define PROGRAM_CACHE_FILE_VERSION  1
+
+// The header at the start of each cache file
+typedef struct
+{
+	char magic[4];             // "GLPB"
+	unsigned int version;      // PROGRAM_CACHE_FILE_VERSION
+	unsigned long long key;    // Full key (sources + driver), to catch stray files
+	GLenum binaryFormat;       // From glGetProgramBinary()
+	GLint  binaryLength;       // Bytes of binary data following the header
+} ProgramCacheHeader;
+
+// The one and only cache.
+ProgramBinaryCache programCache;
+
+
+ProgramBinaryCache::ProgramBinaryCache() :
+	enabled(true), createdDirectory(false), hits(0), misses(0), rejected(0), stored(0),
+	haveDriverKey(false), driverKey(0)
+{
+	directory = strdup( "shaderCache/" );
+}
+
+ProgramBinaryCache::~ProgramBinaryCache()
+{
+	free( directory );
+}
+
+void ProgramBinaryCache::SetDirectory( char *dir )
+{
+	free( directory );
+	directory = strdup( dir );
+	createdDirectory = false;
+}
+
+unsigned long long ProgramBinaryCache::Hash( unsigned long long hash, const void *data, unsigned int numBytes )
+{
+	const unsigned char *ptr = (const unsigned char *)data;
+	for (unsigned int i=0; i < numBytes; i++)
+	{
+		hash ^= ptr[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+unsigned long long ProgramBinaryCache::HashString( unsigned long long hash, const char *str )
+{
+	// Include the terminator, so "ab"+"c" and "a"+"bc" differ.  NULL strings
+	//    (e.g., no geometry shader) hash differently than empty ones.
+	if (!str) return Hash( hash, "\xff", 1 );
+	return Hash( hash, str, (unsigned int)strlen( str )+1 );
+}
+
+unsigned long long ProgramBinaryCache::FullKey( unsigned long long sourceKey )
+{
+	if (!haveDriverKey)
+	{
+		driverKey = PROGRAM_CACHE_HASH_INIT;
+		driverKey = HashString( driverKey, (const char *)glGetString( GL_VENDOR ) );
+		driverKey = HashString( driverKey, (const char *)glGetString( GL_RENDERER ) );
+		driverKey = HashString( driverKey, (const char *)glGetString( GL_VERSION ) );
+		haveDriverKey = true;
+	}
+	return Hash( driverKey, &sourceKey, sizeof( sourceKey ) );
+}
+
+void ProgramBinaryCache::CacheFilename( char *buf, unsigned long long key )
+{
+	sprintf( buf, "%s%08x%08x.glbin", directory,
+		     (unsigned int)(key >> 32), (unsigned int)(key & 0xFFFFFFFF) );
+}
+
+void ProgramBinaryCache::PrepareForLink( GLuint programID )
+{
+	if (!IsEnabled()) return;
+	glProgramParameteri( programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
+}
+
+bool ProgramBinaryCache::Load( GLuint programID, unsigned long long sourceKey )
+{
+	if (!IsEnabled()) return false;
+
+	unsigned long long key = FullKey( sourceKey );
+	char filename[1024];
+	CacheFilename( filename, key );
+
+	FILE *f = fopen( filename, "rb" );
+	if (!f) { misses++; return false; }
+
+	// The file holds the header and then exactly binaryLength bytes, so a
+	//    corrupt or truncated length can't make us allocate more than that
+	fseek( f, 0, SEEK_END );
+	long fileBytes = ftell( f );
+	fseek( f, 0, SEEK_SET );
+
+	ProgramCacheHeader hdr;
+	if ( fread( &hdr, sizeof( hdr ), 1, f ) != 1 || strncmp( hdr.magic, "GLPB", 4 ) ||
+		 hdr.version != PROGRAM_CACHE_FILE_VERSION || hdr.key != key || hdr.binaryLength <= 0 ||
+		 fileBytes < 0 || (long long)hdr.binaryLength != (long long)fileBytes - (long long)sizeof( hdr ) )
+	{
+		fclose( f );
+		misses++;
+		return false;
+	}
+
+	void *binary = malloc( hdr.binaryLength );
+	bool readOK = binary && fread( binary, 1, hdr.binaryLength, f ) == (size_t)hdr.binaryLength;
+	fclose( f );
+	if (!readOK)
+	{
+		free( binary );
+		misses++;
+		return false;
+	}
+
+	// The driver may refuse binaries it produced earlier (e.g., after a
+	//    driver update that kept the same version string).  That's a miss.
+	GLint linked = 0;
+	glProgramBinary( programID, hdr.binaryFormat, binary, hdr.binaryLength );
+	glGetProgramiv( programID, GL_LINK_STATUS, &linked );
+	free( binary );
+	if (!linked)
+	{
+		remove( filename );
+		rejected++;
+		misses++;
+		return false;
+	}
+
+	hits++;
+	return true;
+}
+
+void ProgramBinaryCache::Store( GLuint programID, unsigned long long sourceKey )
+{
+	if (!IsEnabled()) return;
+
+	GLint length = 0;
+	glGetProgramiv( programID, GL_PROGRAM_BINARY_LENGTH, &length );
+	if (length <= 0) return;
+
+	ProgramCacheHeader hdr;
+	memcpy( hdr.magic, "GLPB", 4 );
+	hdr.version = PROGRAM_CACHE_FILE_VERSION;
+	hdr.key = FullKey( sourceKey );
+	void *binary = malloc( length );
+	if (!binary) return;
+	glGetProgramBinary( programID, length, &hdr.binaryLength, &hdr.binaryFormat, binary );
+
+	if (!createdDirectory)
+	{
+		MakeCacheDirectory( directory );  // Fails harmlessly if it already exists
+		createdDirectory = true;
+	}
+
+	// Failing to write the cache is not worth complaining about; we'll
+	//    just compile this program again next time.
+	char filename[1024];
+	CacheFilename( filename, hdr.key );
+	FILE *f = fopen( filename, "wb" );
+	if (f)
+	{
+		bool ok = fwrite( &hdr, sizeof( hdr ), 1, f ) == 1 &&
+			      fwrite( binary, 1, hdr.binaryLength, f ) == (size_t)hdr.binaryLength;
+		fclose( f );
+		if (ok) stored++;
+		else remove( filename );
+	}
+	free( binary );
+}
+
+void ProgramBinaryCache::PrintStats( FILE *f )
+{
+	if (!IsEnabled())
+	{
+		fprintf( f, "Program binary cache: disabled or unsupported\n" );
+		return;
+	}
+	fprintf( f, "Program binary cache: %u hits, %u misses (%u rejected by driver), %u stored\n",
+		     hits, misses, rejected, stored );
+}
+
@@ -0,0 +1,85 @@
+/***************************************************************************/
+/* programBinaryCache.h                                                    */
+/* ------------                                                            */
+/*                                                                         */
+/* An on-disk cache of linked GLSL program binaries (ARB_get_program_      */
+/*     binary), so that warm runs skip compiling and linking shaders.      */
+/*                                                                         */
+/* GLSLProgram::LinkProgram() hashes its shader sources and geometry       */
+/*     shader settings, and asks the cache for a binary with that key.     */
+/*     The cache mixes in the GL vendor, renderer, and version strings, so */
+/*     a driver update (or a different GPU) simply misses and recompiles.  */
+/*     Drivers are allowed to reject binaries they once produced, so a     */
+/*     failed Load() is never an error -- the caller compiles from source  */
+/*     and Store()s the new binary, replacing the stale one.               */
+/*                                                                         */
+/* Binaries are stored in one file per program, named by key, in a cache   */
+/*     directory ("shaderCache/" by default).  Deleting the directory is   */
+/*     always safe.                                                        */
+/***************************************************************************/
+
+#ifndef __PROGRAMBINARYCACHE_H
+#define __PROGRAMBINARYCACHE_H
+
+#include <stdio.h>
+#include <GL/glew.h>
+#include <GL/glut.h>
+
+// Starting value for the (64-bit FNV-1a) hashes below
+#define PROGRAM_CACHE_HASH_INIT   14695981039346656037ULL
+
+class ProgramBinaryCache
+{
+public:
+	ProgramBinaryCache();
+	~ProgramBinaryCache();
+
+	// Where cache files live.  The directory is created when first needed.
+	void SetDirectory( char *dir );
+	inline char *GetDirectory( void )           { return directory; }
+
+	// The cache is on by default, but only used if the driver supports it.
+	inline void Enable( void )                  { enabled = true; }
+	inline void Disable( void )                 { enabled = false; }
+	inline bool IsEnabled( void ) const         { return enabled && GLEW_ARB_get_program_binary; }
+
+	// Call before glLinkProgram() so the driver keeps a retrievable binary.
+	void PrepareForLink( GLuint programID );
+
+	// Try to load the binary with this key into programID.  Returns true
+	//    only if it was found and the driver accepted it (i.e., the program
+	//    is now linked).  NOTE:  If the driver rejects the binary, the old
+	//    contents of programID are gone, too.
+	bool Load( GLuint programID, unsigned long long sourceKey );
+
+	// Save the binary for the (successfully linked) programID under this key.
+	void Store( GLuint programID, unsigned long long sourceKey );
+
+	// Hash helpers for building source keys.  Start at PROGRAM_CACHE_HASH_INIT.
+	static unsigned long long Hash( unsigned long long hash, const void *data, unsigned int numBytes );
+	static unsigned long long HashString( unsigned long long hash, const char *str );
+
+	// Statistics
+	inline unsigned int GetHitCount( void ) const   { return hits; }
+	inline unsigned int GetMissCount( void ) const  { return misses; }
+	void PrintStats( FILE *f );
+
+private:
+	char *directory;
+	bool enabled, createdDirectory;
+	unsigned int hits, misses, rejected, stored;
+
+	// Hash of the driver identification strings (computed on first use,
+	//    since there is no GL context when the cache is constructed)
+	bool haveDriverKey;
+	unsigned long long driverKey;
+
+	unsigned long long FullKey( unsigned long long sourceKey );
+	void CacheFilename( char *buf, unsigned long long key );
+};
+
+// The single cache used by all GLSLPrograms
+extern ProgramBinaryCache programCache;
+
+#endif
+
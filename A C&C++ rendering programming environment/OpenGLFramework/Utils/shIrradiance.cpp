@@ -0,0 +1,314 @@
+/***************************************************************************/
+/* shIrradiance.cpp                                                        */
+/* ------------                                                            */
+/*                                                                         */
+/* Implements the spherical harmonic projection of environment maps and   */
+/*     the cache of its results.  See the header for usage notes.          */
+/***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "shIrradiance.h"
+#include "textureCompressor.h"
+#include "programBinaryCache.h"
+#include "HighResolutionTimer.h"
+#include "ImageIO/imageIO.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#include <xmmintrin.h>
+#define SH_USE_SSE
+#endif
+
+#ifdef _WIN32
+#include <direct.h>
+#define MakeCacheDirectory(d)  _mkdir(d)
+#else
+#include <sys/stat.h>
+#define MakeCacheDirectory(d)  mkdir(d, 0755)
+#endif
+
+#pragma warning( disable: 4996 )
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Bump this if the file layout changes, so old files are ignored
+#define SH_CACHE_FILE_VERSION  1
+
+// The header at the start of each cache file, followed by the 27 floats
+typedef struct
+{
+	char magic[4];             // "SHIR"
+	unsigned int version;      // SH_CACHE_FILE_VERSION
+	unsigned long long key;    // Full key, to catch stray files
+} SHCacheHeader;
+
+// The one and only cache.
+SHIrradianceCache shIrradiance;
+
+
+// Each row of the map is reduced to 5 sums per channel:  the texels times
+//    1, cos(phi), sin(phi), cos(2 phi), and sin(2 phi).  Every basis
+//    function is one of these times something depending only on theta.
+#define SH_ROW_SUMS  5
+
+typedef struct
+{
+	const float *rgb;
+	int width, height;
+	float *trig;               // cos(phi), sin(phi), cos(2 phi), sin(2 phi) per column
+	double *rowSums;           // 3*SH_ROW_SUMS per row
+} SHProjectJob;
+
+static void SumRow( const float *rgb, int width, const float *trig, double *sums )
+{
+	const float *cos1 = trig, *sin1 = trig + width, *cos2 = trig + 2*width, *sin2 = trig + 3*width;
+	for (int i=0; i < 3*SH_ROW_SUMS; i++)
+		sums[i] = 0;
+
+	int x = 0;
+#ifdef SH_USE_SSE
+	__m128 acc[3*SH_ROW_SUMS];
+	for (int i=0; i < 3*SH_ROW_SUMS; i++)
+		acc[i] = _mm_setzero_ps();
+	for (; x+4 <= width; x += 4)
+	{
+		const float *p = rgb + 3*x;
+		__m128 c1 = _mm_loadu_ps( cos1+x ), s1 = _mm_loadu_ps( sin1+x );
+		__m128 c2 = _mm_loadu_ps( cos2+x ), s2 = _mm_loadu_ps( sin2+x );
+		for (int ch=0; ch < 3; ch++)
+		{
+			__m128 v = _mm_set_ps( p[9+ch], p[6+ch], p[3+ch], p[ch] );
+			__m128 *a = acc + SH_ROW_SUMS*ch;
+			a[0] = _mm_add_ps( a[0], v );
+			a[1] = _mm_add_ps( a[1], _mm_mul_ps( v, c1 ) );
+			a[2] = _mm_add_ps( a[2], _mm_mul_ps( v, s1 ) );
+			a[3] = _mm_add_ps( a[3], _mm_mul_ps( v, c2 ) );
+			a[4] = _mm_add_ps( a[4], _mm_mul_ps( v, s2 ) );
+		}
+	}
+	for (int i=0; i < 3*SH_ROW_SUMS; i++)
+	{
+		float lanes[4];
+		_mm_storeu_ps( lanes, acc[i] );
+		sums[i] = (double)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+#endif
+
+	// Whatever's left (or everything, without SSE)
+	for (; x < width; x++)
+		for (int ch=0; ch < 3; ch++)
+		{
+			double v = rgb[3*x+ch], *s = sums + SH_ROW_SUMS*ch;
+			s[0] += v;
+			s[1] += v*cos1[x];
+			s[2] += v*sin1[x];
+			s[3] += v*cos2[x];
+			s[4] += v*sin2[x];
+		}
+}
+
+static void SumRows( int first, int last, void *data )
+{
+	SHProjectJob *job = (SHProjectJob *)data;
+	for (int y=first; y < last; y++)
+		SumRow( job->rgb + 3*(size_t)y*job->width, job->width, job->trig,
+		        job->rowSums + 3*SH_ROW_SUMS*y );
+}
+
+void ProjectSHIrradiance( const float *rgb, int width, int height, float coeffs[SH_NUM_COEFFS][3] )
+{
+	SHProjectJob job;
+	job.rgb = rgb;
+	job.width = width;
+	job.height = height;
+	job.trig = (float *)malloc( 4*width*sizeof(float) );
+	job.rowSums = (double *)malloc( 3*SH_ROW_SUMS*height*sizeof(double) );
+	for (int x=0; x < width; x++)
+	{
+		double phi = 2*M_PI*(x+0.5)/width;
+		job.trig[x]         = (float)cos( phi );
+		job.trig[x+width]   = (float)sin( phi );
+		job.trig[x+2*width] = (float)cos( 2*phi );
+		job.trig[x+3*width] = (float)sin( 2*phi );
+	}
+	ParallelFor( height, SumRows, &job, 16 );
+
+	// Apply the parts of the basis depending on theta, and the solid angle
+	//    of the row's texels, adding rows in order so results don't depend
+	//    on the number of threads.
+	double sh[SH_NUM_COEFFS][3];
+	memset( sh, 0, sizeof( sh ) );
+	double dPhiTheta = (2*M_PI/width) * (M_PI/height);
+	for (int y=0; y < height; y++)
+	{
+		double theta = M_PI*(y+0.5)/height;
+		double s = sin( theta ), c = cos( theta ), dOmega = s * dPhiTheta;
+		for (int ch=0; ch < 3; ch++)
+		{
+			const double *S = job.rowSums + 3*SH_ROW_SUMS*y + SH_ROW_SUMS*ch;
+			sh[0][ch] += dOmega * 0.282095 * S[0];
+			sh[1][ch] += dOmega * 0.488603 * c * S[0];
+			sh[2][ch] += dOmega * 0.488603 * s * S[2];
+			sh[3][ch] += dOmega * 0.488603 * s * S[1];
+			sh[4][ch] += dOmega * 1.092548 * s * c * S[1];
+			sh[5][ch] += dOmega * 1.092548 * s * c * S[2];
+			sh[6][ch] += dOmega * 0.315392 * ( (1.5*s*s - 1) * S[0] - 1.5*s*s * S[3] );
+			sh[7][ch] += dOmega * 0.546274 * s * s * S[4];
+			sh[8][ch] += dOmega * 0.546274 * ( (0.5*s*s - c*c) * S[0] + 0.5*s*s * S[3] );
+		}
+	}
+	free( job.trig );
+	free( job.rowSums );
+
+	// Convolve with the clamped cosine, to turn radiance into irradiance
+	static const double band[SH_NUM_COEFFS] = { M_PI, 2*M_PI/3, 2*M_PI/3, 2*M_PI/3,
+		                                        M_PI/4, M_PI/4, M_PI/4, M_PI/4, M_PI/4 };
+	for (int i=0; i < SH_NUM_COEFFS; i++)
+		for (int ch=0; ch < 3; ch++)
+			coeffs[i][ch] = (float)(band[i] * sh[i][ch]);
+}
+
+
+SHIrradianceCache::SHIrradianceCache() : directory(0), enabled(true), createdDirectory(false),
+	projected(0), loaded(0), stored(0), projectSeconds(0)
+{
+}
+
+SHIrradianceCache::~SHIrradianceCache()
+{
+	free( directory );
+	for (unsigned int i=0; i < fileNames.Size(); i++)
+	{
+		free( fileNames[i] );
+		free( fileCoeffs[i] );
+	}
+}
+
+void SHIrradianceCache::SetDirectory( char *dir )
+{
+	free( directory );
+	directory = strdup( dir );
+	createdDirectory = false;
+}
+
+void SHIrradianceCache::CacheFilename( char *buf, unsigned long long key )
+{
+	sprintf( buf, "%s%08x%08x.sh", directory ? directory : compressedTextures.GetDirectory(),
+		     (unsigned int)(key >> 32), (unsigned int)(key & 0xFFFFFFFF) );
+}
+
+// Hashing the file is far cheaper than decoding and projecting it
+unsigned long long SHIrradianceCache::HashFile( char *hdrFile, bool *ok )
+{
+	int params[2] = { SH_PROJECTION_VERSION, SH_NUM_COEFFS };
+	unsigned long long key = ProgramBinaryCache::Hash( PROGRAM_CACHE_HASH_INIT, params, sizeof( params ) );
+
+	*ok = false;
+	FILE *f = fopen( hdrFile, "rb" );
+	if (!f) return key;
+	unsigned char *buf = (unsigned char *)malloc( 1 << 20 );
+	size_t numBytes;
+	while ((numBytes = fread( buf, 1, 1 << 20, f )) > 0)
+		key = ProgramBinaryCache::Hash( key, buf, (unsigned int)numBytes );
+	*ok = !ferror( f );
+	free( buf );
+	fclose( f );
+	return key;
+}
+
+bool SHIrradianceCache::Load( unsigned long long key, float *coeffs )
+{
+	char filename[1024];
+	CacheFilename( filename, key );
+	FILE *f = fopen( filename, "rb" );
+	if (!f) return false;
+
+	SHCacheHeader hdr;
+	bool ok = fread( &hdr, sizeof( hdr ), 1, f ) == 1 && !strncmp( hdr.magic, "SHIR", 4 ) &&
+		      hdr.version == SH_CACHE_FILE_VERSION && hdr.key == key &&
+			  fread( coeffs, sizeof(float), 3*SH_NUM_COEFFS, f ) == 3*SH_NUM_COEFFS;
+	fclose( f );
+	if (ok) loaded++;
+	return ok;
+}
+
+void SHIrradianceCache::Store( unsigned long long key, const float *coeffs )
+{
+	if (!createdDirectory)
+	{
+		MakeCacheDirectory( directory ? directory : compressedTextures.GetDirectory() );  // Fails harmlessly if it already exists
+		createdDirectory = true;
+	}
+
+	SHCacheHeader hdr;
+	memcpy( hdr.magic, "SHIR", 4 );
+	hdr.version = SH_CACHE_FILE_VERSION;
+	hdr.key = key;
+
+	// Failing to write the cache is not worth complaining about
+	char filename[1024];
+	CacheFilename( filename, key );
+	FILE *f = fopen( filename, "wb" );
+	if (!f) return;
+	bool ok = fwrite( &hdr, sizeof( hdr ), 1, f ) == 1 &&
+		      fwrite( coeffs, sizeof(float), 3*SH_NUM_COEFFS, f ) == 3*SH_NUM_COEFFS;
+	fclose( f );
+	if (!ok) remove( filename );
+	else stored++;
+}
+
+const float *SHIrradianceCache::Get( char *hdrFile )
+{
+	if (!hdrFile) return 0;
+
+	lock.Lock();
+	for (unsigned int i=0; i < fileNames.Size(); i++)
+		if (!strcmp( fileNames[i], hdrFile ))
+		{
+			lock.Unlock();
+			return fileCoeffs[i];
+		}
+
+	float *coeffs = (float *)malloc( 3*SH_NUM_COEFFS*sizeof(float) );
+	bool hashed = false;
+	unsigned long long key = enabled ? HashFile( hdrFile, &hashed ) : 0;
+	if (!hashed || !Load( key, coeffs ))
+	{
+		ImageInfo info;
+		float *rgb = 0;
+		if (ReadImageInfo( hdrFile, &info ) && info.isHDR)
+			rgb = (float *)malloc( 3*sizeof(float)*(size_t)info.width*info.height );
+		if (!rgb)
+		{
+			printf("Error in SHIrradianceCache::Get(): Unable to read HDR image '%s'!\n", hdrFile );
+			free( coeffs );
+			lock.Unlock();
+			return 0;
+		}
+		DecodeImage( hdrFile, rgb, 3*sizeof(float)*info.width, IMAGE_PIXELS_RGB32F );
+
+		TimerStruct start, end;
+		GetHighResolutionTime( &start );
+		ProjectSHIrradiance( rgb, info.width, info.height, (float (*)[3])coeffs );
+		GetHighResolutionTime( &end );
+		projectSeconds += ConvertTimeDifferenceToSec( &end, &start );
+		projected++;
+		free( rgb );
+
+		if (hashed) Store( key, coeffs );
+	}
+
+	fileNames.Add( strdup( hdrFile ) );
+	fileCoeffs.Add( coeffs );
+	lock.Unlock();
+	return coeffs;
+}
+
+void SHIrradianceCache::PrintStats( FILE *f )
+{
+	fprintf( f, "SH irradiance: %u maps projected (%.2f ms), %u loaded from disk, %u stored\n",
+		     projected, 1000.0*projectSeconds, loaded, stored );
+}
@@ -0,0 +1,105 @@
+/***************************************************************************/
+/* shIrradiance.h                                                          */
+/* ------------                                                            */
+/*                                                                         */
+/* Diffuse lighting from an HDR environment map, as 9 spherical harmonic   */
+/*     coefficients (3rd order, i.e., bands 0-2) per color channel.        */
+/*     Irradiance is smooth enough that these 27 numbers reproduce it to   */
+/*     within a few percent, so a shader can light with the whole map      */
+/*     without sampling it (Ramamoorthi and Hanrahan, SIGGRAPH 2001).      */
+/*                                                                         */
+/* Maps are equirectangular ("lat-long") '.hdr' files.  The top row looks  */
+/*     straight up (+Y), and the direction for texel (x,y) of a w x h map  */
+/*     is, with theta = PI*(y+0.5)/h and phi = 2*PI*(x+0.5)/w:             */
+/*                                                                         */
+/*        ( sin(theta)*cos(phi), cos(theta), sin(theta)*sin(phi) )         */
+/*                                                                         */
+/* The coefficients are already convolved with the cosine lobe, so the     */
+/*     irradiance for a (world-space, unit) normal n is just the sum of    */
+/*     coefficient i times basis function i.  In GLSL:                     */
+/*                                                                         */
+/*    uniform vec3 shIrradiance[9];                                        */
+/*    vec3 Irradiance( vec3 n ) {                                          */
+/*        return shIrradiance[0] * 0.282095                                */
+/*             + shIrradiance[1] * 0.488603 * n.y                          */
+/*             + shIrradiance[2] * 0.488603 * n.z                          */
+/*             + shIrradiance[3] * 0.488603 * n.x                          */
+/*             + shIrradiance[4] * 1.092548 * n.x * n.y                    */
+/*             + shIrradiance[5] * 1.092548 * n.y * n.z                    */
+/*             + shIrradiance[6] * 0.315392 * (3.0 * n.z * n.z - 1.0)      */
+/*             + shIrradiance[7] * 1.092548 * n.x * n.z                    */
+/*             + shIrradiance[8] * 0.546274 * (n.x * n.x - n.y * n.y);     */
+/*    }                                                                    */
+/*                                                                         */
+/*     (A diffuse surface then reflects albedo * Irradiance( n ) / PI.)    */
+/*     GLSLShaderMaterials fill in such an array with the scene file line  */
+/*     "bind shIrradiance shirradiance <file.hdr>".                        */
+/*                                                                         */
+/* The projection handles 4 texels at a time with SSE (where available),   */
+/*     splits rows across threads (see parallelFor.h), and only does the   */
+/*     per-texel work that depends on the column:  everything depending    */
+/*     on the row is applied to each row's sums.  Results are cached in    */
+/*     memory by file name, and on disk by a hash of the file's contents,  */
+/*     in the same directory as compressed textures (textureCompressor.h). */
+/***************************************************************************/
+
+#ifndef __SHIRRADIANCE_H
+#define __SHIRRADIANCE_H
+
+#include <stdio.h>
+#include "DataTypes/Array1D.h"
+#include "parallelFor.h"
+
+#define SH_NUM_COEFFS       9
+
+// Bump this when the projection's output changes, so cached results are redone
+#define SH_PROJECTION_VERSION  1
+
+// Project an equirectangular map (3 floats per texel, top row first) into
+//    irradiance coefficients:  coeffs[i][channel], as in the GLSL above.
+void ProjectSHIrradiance( const float *rgb, int width, int height, float coeffs[SH_NUM_COEFFS][3] );
+
+
+class SHIrradianceCache
+{
+public:
+	SHIrradianceCache();
+	~SHIrradianceCache();
+
+	// Where cache files live.  Defaults to the compressed texture cache's.
+	void SetDirectory( char *dir );
+
+	// Reading and writing the disk cache is on by default
+	inline void Enable( void )                  { enabled = true; }
+	inline void Disable( void )                 { enabled = false; }
+	inline bool IsEnabled( void ) const         { return enabled; }
+
+	// The 9 RGB coefficients (27 floats) for an '.hdr' file, which stay
+	//    valid for the life of the cache.  Returns NULL (after printing an
+	//    error) if the file can't be read.
+	const float *Get( char *hdrFile );
+
+	// Statistics
+	inline unsigned int GetNumMaps( void ) const   { return fileNames.Size(); }
+	void PrintStats( FILE *f );
+
+private:
+	char *directory;
+	bool enabled, createdDirectory;
+	unsigned int projected, loaded, stored;
+	double projectSeconds;
+	ParallelMutex lock;
+
+	Array1D< char * > fileNames;
+	Array1D< float * > fileCoeffs;
+
+	unsigned long long HashFile( char *hdrFile, bool *ok );
+	bool Load( unsigned long long key, float *coeffs );
+	void Store( unsigned long long key, const float *coeffs );
+	void CacheFilename( char *buf, unsigned long long key );
+};
+
+// The single cache used by all materials
+extern SHIrradianceCache shIrradiance;
+
+#endif
@@ -0,0 +1,166 @@
+/***************************************************************************/
+/* shaderHotReload.cpp                                                     */
+/* ------------                                                            */
+/*                                                                         */
+/* Implements background rebuilding of GLSL programs whose files changed.  */
+/*     See the header for usage notes.                                     */
+/***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "shaderHotReload.h"
+#include "glslProgram.h"
+
+#pragma warning( disable: 4996 )
+
+// A name to print for a program (its fragment shader, or else vertex shader)
+static char *ProgramDisplayName( GLSLProgram *prog )
+{
+	if (prog->GetNumSourceFiles( GLSL_STAGE_FRAGMENT ) > 0)
+		return prog->GetSourceFile( GLSL_STAGE_FRAGMENT, 0 );
+	if (prog->GetNumSourceFiles( GLSL_STAGE_VERTEX ) > 0)
+		return prog->GetSourceFile( GLSL_STAGE_VERTEX, 0 );
+	return "<unnamed program>";
+}
+
+
+ShaderHotReloader::ShaderHotReloader() : enabled(true), haveCheckTime(false)
+{
+}
+
+ShaderHotReloader::~ShaderHotReloader()
+{
+	for (unsigned int i=0; i < watchedFiles.Size(); i++)
+		free( watchedFiles[i] );
+	for (unsigned int i=0; i < pendingReplacement.Size(); i++)
+		delete pendingReplacement[i];
+}
+
+int ShaderHotReloader::WatchFile( char *path )
+{
+	for (unsigned int i=0; i < watchedFiles.Size(); i++)
+		if (!strcmp( watchedFiles[i], path )) return i;
+
+	struct stat info;
+	watchedTimes.Add( stat( path, &info ) ? 0 : info.st_mtime );
+	return watchedFiles.Add( strdup( path ) );
+}
+
+bool ShaderHotReloader::FileChanged( int idx )
+{
+	// A file that can't be stat()'d is probably being saved right now.  Wait.
+	struct stat info;
+	if (stat( watchedFiles[idx], &info )) return false;
+	if (info.st_mtime == watchedTimes[idx]) return false;
+	watchedTimes[idx] = info.st_mtime;
+	return true;
+}
+
+bool ShaderHotReloader::IsPending( GLSLProgram *prog )
+{
+	for (unsigned int i=0; i < pendingOriginal.Size(); i++)
+		if (pendingOriginal[i] == prog) return true;
+	return false;
+}
+
+void ShaderHotReloader::CheckForChanges( Array1D< GLSLProgram * > &programs )
+{
+	// Check each file once, even if many programs include it
+	Array1D< bool > changed;
+	for (unsigned int i=0; i < watchedFiles.Size(); i++)
+		changed.Add( FileChanged( i ) );
+
+	Array1D< GLSLProgram * > stillChanged;
+	for (unsigned int p=0; p < programs.Size(); p++)
+	{
+		GLSLProgram *prog = programs[p];
+		bool needsRebuild = false;
+		for (int stage=0; stage < 3; stage++)
+			for (unsigned int i=0; i < prog->GetNumSourceFiles( stage ); i++)
+			{
+				// Files first seen now (e.g., a newly added #include) are not "changed"
+				unsigned int idx = WatchFile( prog->GetSourceFile( stage, i ) );
+				if (idx < changed.Size() && changed[idx]) needsRebuild = true;
+			}
+
+		// A change seen while an earlier rebuild is still compiling isn't in
+		//    that rebuild, so remember it until the program is free again
+		for (unsigned int i=0; i < changedWhilePending.Size(); i++)
+			if (changedWhilePending[i] == prog) needsRebuild = true;
+		if (!needsRebuild) continue;
+		if (IsPending( prog ))
+		{
+			stillChanged.Add( prog );
+			continue;
+		}
+
+		GLSLProgram *replacement = prog->CreateReplacement();
+		if (!replacement)
+		{
+			printf("(!) Shader '%s' changed, but could not be reloaded.  Keeping the old one.\n",
+				   ProgramDisplayName( prog ) );
+			continue;
+		}
+		pendingOriginal.Add( prog );
+		pendingReplacement.Add( replacement );
+	}
+
+	changedWhilePending.Clear();
+	for (unsigned int i=0; i < stillChanged.Size(); i++)
+		changedWhilePending.Add( stillChanged[i] );
+}
+
+void ShaderHotReloader::FinishReplacements( void )
+{
+	Array1D< GLSLProgram * > stillOriginal, stillReplacement;
+	for (unsigned int i=0; i < pendingOriginal.Size(); i++)
+	{
+		GLSLProgram *orig = pendingOriginal[i], *repl = pendingReplacement[i];
+		if (!repl->PollLink())
+		{
+			stillOriginal.Add( orig );
+			stillReplacement.Add( repl );
+			continue;
+		}
+
+		if (repl->IsLinked())
+		{
+			orig->TakeProgramFrom( repl );
+			printf("(+) Reloaded shader '%s'\n", ProgramDisplayName( orig ) );
+		}
+		else
+			printf("(!) Shader '%s' has errors.  Keeping the old one.\n", ProgramDisplayName( orig ) );
+		delete repl;
+	}
+
+	pendingOriginal.Clear();
+	pendingReplacement.Clear();
+	for (unsigned int i=0; i < stillOriginal.Size(); i++)
+	{
+		pendingOriginal.Add( stillOriginal[i] );
+		pendingReplacement.Add( stillReplacement[i] );
+	}
+}
+
+void ShaderHotReloader::Update( Array1D< GLSLProgram * > &programs )
+{
+	if (!enabled) return;
+
+	// Swap in anything that finished since last frame
+	if (pendingOriginal.Size() > 0)
+		FinishReplacements();
+
+	// Don't hit the file system every frame
+	TimerStruct now;
+	GetHighResolutionTime( &now );
+	if (haveCheckTime && ConvertTimeDifferenceToSec( &now, &lastCheck ) < SHADER_HOT_RELOAD_INTERVAL)
+		return;
+	lastCheck = now;
+
+	// The first time through just records the files' dates
+	haveCheckTime = true;
+	CheckForChanges( programs );
+}
+
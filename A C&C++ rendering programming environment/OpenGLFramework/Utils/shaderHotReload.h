@@ -0,0 +1,83 @@
+/***************************************************************************/
+/* shaderHotReload.h                                                       */
+/* ------------                                                            */
+/*                                                                         */
+/* Watches the files every GLSLProgram was built from (including files     */
+/*     pulled in with #include) and rebuilds just the programs affected    */
+/*     when one changes on disk, without stalling the frame.               */
+/*                                                                         */
+/* Call Update() once per frame, at the start of the frame, with the list  */
+/*     of programs to watch.  It:                                          */
+/*       1) Every SHADER_HOT_RELOAD_INTERVAL seconds, checks the watched   */
+/*          files' modification times.  For each program using a changed  */
+/*          file, a replacement program is built and its link started     */
+/*          (see GLSLProgram::StartLink()), so it compiles in parallel.    */
+/*       2) Polls the replacements.  When one finishes linking, its GL     */
+/*          program is swapped into the original GLSLProgram, so every     */
+/*          material using it picks up the change at once (and uniform    */
+/*          handles stay valid).  If it failed to compile or link, the     */
+/*          errors are printed and the original program is kept.           */
+/*                                                                         */
+/* The file checks are a handful of stat() calls, done on the main thread. */
+/*     (Change notification APIs differ per OS, and OpenGL work must stay  */
+/*     on the thread owning the context anyway.)                           */
+/***************************************************************************/
+
+#ifndef __SHADERHOTRELOAD_H
+#define __SHADERHOTRELOAD_H
+
+#include <stdio.h>
+#include <time.h>
+#include "DataTypes/Array1D.h"
+#include "HighResolutionTimer.h"
+
+class GLSLProgram;
+
+// Seconds between checks of the watched files
+#define SHADER_HOT_RELOAD_INTERVAL   0.5f
+
+class ShaderHotReloader
+{
+public:
+	ShaderHotReloader();
+	~ShaderHotReloader();
+
+	// Check for changes and swap in finished programs (see above)
+	void Update( Array1D< GLSLProgram * > &programs );
+
+	inline void Enable( void )                { enabled = true; }
+	inline void Disable( void )               { enabled = false; }
+	inline bool IsEnabled( void ) const       { return enabled; }
+
+	// How many programs are being rebuilt right now?
+	inline unsigned int NumPending( void ) const { return pendingOriginal.Size(); }
+
+private:
+	bool enabled, haveCheckTime;
+	TimerStruct lastCheck;
+
+	// Watched files and the modification time last seen for each
+	Array1D< char * > watchedFiles;
+	Array1D< time_t > watchedTimes;
+
+	// Rebuilds in progress:  pendingReplacement[i] will replace pendingOriginal[i]
+	Array1D< GLSLProgram * > pendingOriginal;
+	Array1D< GLSLProgram * > pendingReplacement;
+
+	// Programs whose files changed again while they were being rebuilt.
+	//    They are rebuilt once the current rebuild finishes.
+	Array1D< GLSLProgram * > changedWhilePending;
+
+	// Find a file in watchedFiles (adding it if needed).  Returns its index.
+	int WatchFile( char *path );
+
+	// Check the file's date.  Returns true if it changed since last time.
+	bool FileChanged( int idx );
+
+	bool IsPending( GLSLProgram *prog );
+	void CheckForChanges( Array1D< GLSLProgram * > &programs );
+	void FinishReplacements( void );
+};
+
+#endif
+
@@ -0,0 +1,89 @@
+/***************************************************************************/
+/* shaderPermutationCache.cpp                                              */
+/* ------------                                                            */
+/*                                                                         */
+/* Implements the table of shared shader permutations.  See the header for */
+/*     usage notes.                                                        */
+/***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "shaderPermutationCache.h"
+
+#pragma warning( disable: 4996 )
+
+class ShaderPermutation
+{
+public:
+	char *baseKey;
+	unsigned int features;
+	GLSLProgram *program;
+	int nextInBucket;
+};
+
+// The one and only cache.
+ShaderPermutationCache shaderPermutations;
+
+
+static unsigned int HashPermutation( const char *baseKey, unsigned int features )
+{
+	unsigned int hash = 5381;
+	while (*baseKey) hash = ((hash << 5) + hash) + (unsigned char)(*baseKey++);
+	hash = ((hash << 5) + hash) + features;
+	return hash % SHADER_PERMUTATION_HASH_SIZE;
+}
+
+
+ShaderPermutationCache::ShaderPermutationCache() : requested(0), compiled(0)
+{
+	for (int i=0; i < SHADER_PERMUTATION_HASH_SIZE; i++)
+		hash[i] = -1;
+}
+
+ShaderPermutationCache::~ShaderPermutationCache()
+{
+	for (unsigned int i=0; i < perms.Size(); i++)
+	{
+		free( perms[i]->baseKey );
+		delete perms[i];
+	}
+}
+
+GLSLProgram *ShaderPermutationCache::Find( char *baseKey, unsigned int features )
+{
+	requested++;
+	unsigned int bucket = HashPermutation( baseKey, features );
+	for (int i = hash[bucket]; i >= 0; i = perms[i]->nextInBucket)
+		if (perms[i]->features == features && !strcmp( perms[i]->baseKey, baseKey ))
+			return perms[i]->program;
+	return 0;
+}
+
+void ShaderPermutationCache::Add( char *baseKey, unsigned int features, GLSLProgram *program )
+{
+	unsigned int bucket = HashPermutation( baseKey, features );
+	ShaderPermutation *perm = new ShaderPermutation();
+	perm->baseKey  = strdup( baseKey );
+	perm->features = features;
+	perm->program  = program;
+	perm->nextInBucket = hash[bucket];
+	hash[bucket] = perms.Add( perm );
+	compiled++;
+}
+
+void ShaderPermutationCache::BuildDefines( unsigned int features, char *buf )
+{
+	buf[0] = 0;
+	if (features & SHADER_FEATURE_SHADOWED)    strcat( buf, "#define USE_SHADOW_MAP 1\n" );
+	if (features & SHADER_FEATURE_TEXTURED)    strcat( buf, "#define USE_TEXTURE 1\n" );
+	if (features & SHADER_FEATURE_ALPHA_TEST)  strcat( buf, "#define USE_ALPHA_TEST 1\n" );
+	if (features & SHADER_FEATURE_VT_FEEDBACK) strcat( buf, "#define VT_FEEDBACK 1\n" );
+	if (features & SHADER_FEATURE_FRAME_CONSTANTS) strcat( buf, "#define USE_FRAME_CONSTANTS 1\n" );
+	sprintf( buf + strlen( buf ), "#define NUM_LIGHTS %u\n", SHADER_FEATURE_NUM_LIGHTS( features ) );
+}
+
+void ShaderPermutationCache::PrintStats( FILE *f )
+{
+	fprintf( f, "Shader permutations: %u requested, %u compiled\n", requested, compiled );
+}
+
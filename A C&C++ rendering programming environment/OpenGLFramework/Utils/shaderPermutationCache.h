@@ -0,0 +1,84 @@
+/***************************************************************************/
+/* shaderPermutationCache.h                                                */
+/* ------------                                                            */
+/*                                                                         */
+/* Shares compiled GLSL programs between materials, with one program per   */
+/*     combination of shader files, state, and "feature bits".             */
+/*                                                                         */
+/* Instead of branching at runtime on uniforms (e.g., useShadowMap), a     */
+/*     shader can test preprocessor symbols, which GLSLProgram inserts     */
+/*     right after the #version line (see GLSLProgram::SetPreamble()):     */
+/*                                                                         */
+/*        USE_SHADOW_MAP       if SHADER_FEATURE_SHADOWED is set           */
+/*        USE_TEXTURE          if SHADER_FEATURE_TEXTURED is set           */
+/*        USE_ALPHA_TEST       if SHADER_FEATURE_ALPHA_TEST is set         */
+/*        VT_FEEDBACK          if SHADER_FEATURE_VT_FEEDBACK is set        */
+/*        USE_FRAME_CONSTANTS  if SHADER_FEATURE_FRAME_CONSTANTS is set,    */
+/*                             i.e., the scene has its per-frame uniform   */
+/*                             buffer (see Scene/frameConstants.h)         */
+/*        NUM_LIGHTS           always, the number of scene lights          */
+/*                                                                         */
+/* Each set of bits is compiled once (a "permutation"), and every material */
+/*     asking for the same files, state, and bits gets the same program.   */
+/*     Materials look up their permutations once, when preprocessed, so    */
+/*     picking one while drawing is just an array index.                   */
+/*                                                                         */
+/* The cache does not own the programs (they belong to the scene's shader  */
+/*     list, so they can be reloaded), it only finds them.                 */
+/***************************************************************************/
+
+#ifndef __SHADERPERMUTATIONCACHE_H
+#define __SHADERPERMUTATIONCACHE_H
+
+#include <stdio.h>
+#include "DataTypes/Array1D.h"
+
+class GLSLProgram;
+class ShaderPermutation;
+
+// Feature bits.  The number of lights lives in the upper bits.
+#define SHADER_FEATURE_NONE          0x00000000
+#define SHADER_FEATURE_SHADOWED      0x00000001
+#define SHADER_FEATURE_TEXTURED      0x00000002
+#define SHADER_FEATURE_ALPHA_TEST    0x00000004
+#define SHADER_FEATURE_VT_FEEDBACK   0x00000008
+#define SHADER_FEATURE_FRAME_CONSTANTS 0x00000010
+#define SHADER_FEATURE_LIGHTS(n)     ( ((unsigned int)(n) & 0xFF) << 8 )
+#define SHADER_FEATURE_NUM_LIGHTS(f) ( ((f) >> 8) & 0xFF )
+
+// Number of buckets in the permutation hash table
+#define SHADER_PERMUTATION_HASH_SIZE 128
+
+class ShaderPermutationCache
+{
+public:
+	ShaderPermutationCache();
+	~ShaderPermutationCache();
+
+	// Find the program for this base key (a string naming the files and any
+	//    state baked into the program) and set of feature bits, or NULL.
+	GLSLProgram *Find( char *baseKey, unsigned int features );
+
+	// Remember a newly built program for this key and set of bits
+	void Add( char *baseKey, unsigned int features, GLSLProgram *program );
+
+	// Write the #defines for a set of feature bits into 'buf' (which should
+	//    hold at least 256 characters).  Pass to GLSLProgram::SetPreamble().
+	static void BuildDefines( unsigned int features, char *buf );
+
+	// Statistics:  how many programs were asked for vs. actually compiled
+	inline unsigned int GetRequestCount( void ) const  { return requested; }
+	inline unsigned int GetCompileCount( void ) const  { return compiled; }
+	void PrintStats( FILE *f );
+
+private:
+	Array1D< ShaderPermutation * > perms;
+	int hash[SHADER_PERMUTATION_HASH_SIZE];
+	unsigned int requested, compiled;
+};
+
+// The single cache shared by all materials
+extern ShaderPermutationCache shaderPermutations;
+
+#endif
+
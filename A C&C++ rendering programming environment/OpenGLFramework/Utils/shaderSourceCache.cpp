@@ -0,0 +1,331 @@
+/***************************************************************************/
+/* shaderSourceCache.cpp                                                   */
+/* ------------                                                            */
+/*                                                                         */
+/* Implements the GLSL #include expander and its in-memory file cache.     */
+/*     See the header for usage notes.                                     */
+/***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "shaderSourceCache.h"
+#include "searchPathList.h"
+
+#pragma warning( disable: 4996 )
+
+// A file read into memory
+class ShaderSourceFile
+{
+public:
+	char *path;              // Resolved path (the hash key)
+	char *dir;               // Directory part of path, including the trailing '/'
+	time_t modified;         // Modification time when text was read
+	char *text;
+	bool pragmaOnce;         // Contains "#pragma once"?
+	int nextInBucket;
+};
+
+// A cached include lookup.  'resolved' is NULL if nothing was found.
+class ShaderIncludePath
+{
+public:
+	char *key;
+	char *resolved;
+	int nextInBucket;
+};
+
+// The one and only cache.
+ShaderSourceCache shaderSources;
+
+
+static unsigned int HashSourceName( const char *name )
+{
+	unsigned int hash = 5381;
+	while (*name) hash = ((hash << 5) + hash) + (unsigned char)(*name++);
+	return hash % SHADERSOURCE_HASH_SIZE;
+}
+
+// Append text to a growing, malloc()'d buffer
+static void AppendText( char **buf, unsigned int *bufLen, unsigned int *bufAlloc, const char *text, unsigned int len )
+{
+	if (*bufLen + len + 1 > *bufAlloc)
+	{
+		unsigned int newAlloc = *bufAlloc ? *bufAlloc : 4096;
+		while (*bufLen + len + 1 > newAlloc) newAlloc *= 2;
+		*buf = (char *)realloc( *buf, newAlloc );
+		*bufAlloc = newAlloc;
+	}
+	memcpy( *buf + *bufLen, text, len );
+	*bufLen += len;
+	(*buf)[*bufLen] = 0;
+}
+
+// Does this line (starting at 'line', pointing just past the '#') hold the
+//    given directive?  If so, returns a pointer just past the directive name.
+static char *MatchDirective( char *line, const char *directive )
+{
+	while (*line == ' ' || *line == '\t') line++;
+	unsigned int len = (unsigned int)strlen( directive );
+	if (strncmp( line, directive, len )) return 0;
+	if (line[len] != ' ' && line[len] != '\t' && line[len] != '"' && line[len] != '<' &&
+		line[len] != '\r' && line[len] != '\n' && line[len] != 0) return 0;
+	return line + len;
+}
+
+
+ShaderSourceCache::ShaderSourceCache() : fileReads(0), cacheHits(0)
+{
+	for (int i=0; i < SHADERSOURCE_HASH_SIZE; i++)
+		fileHash[i] = pathHash[i] = -1;
+}
+
+ShaderSourceCache::~ShaderSourceCache()
+{
+	Clear();
+}
+
+void ShaderSourceCache::ForgetResolvedPaths( void )
+{
+	for (unsigned int i=0; i < pathTable.Size(); i++)
+	{
+		free( pathTable[i]->key );
+		if (pathTable[i]->resolved) free( pathTable[i]->resolved );
+		delete pathTable[i];
+	}
+	pathTable.Clear();
+	for (int i=0; i < SHADERSOURCE_HASH_SIZE; i++)
+		pathHash[i] = -1;
+}
+
+void ShaderSourceCache::Clear( void )
+{
+	ForgetResolvedPaths();
+	for (unsigned int i=0; i < fileTable.Size(); i++)
+	{
+		free( fileTable[i]->path );
+		free( fileTable[i]->dir );
+		free( fileTable[i]->text );
+		delete fileTable[i];
+	}
+	fileTable.Clear();
+	for (int i=0; i < SHADERSOURCE_HASH_SIZE; i++)
+		fileHash[i] = -1;
+}
+
+char *ShaderSourceCache::ResolvePath( char *name, char *includerDir, PathList *path )
+{
+	char key[1024];
+	sprintf( key, "%p|%s|%s", (void *)path, includerDir, name );
+
+	unsigned int bucket = HashSourceName( key );
+	for (int i = pathHash[bucket]; i >= 0; i = pathTable[i]->nextInBucket)
+		if (!strcmp( pathTable[i]->key, key ))
+			return pathTable[i]->resolved;
+
+	// Not looked up before.  Check next to the includer, then the current
+	//    directory, then the search path (like PathList::OpenFileInPath()).
+	char buf[1024];
+	struct stat info;
+	char *found = 0;
+	if (includerDir[0])
+	{
+		sprintf( buf, "%s%s", includerDir, name );
+		if (!stat( buf, &info )) found = buf;
+	}
+	if (!found && !stat( name, &info ))
+		found = name;
+	for (int i=0; !found && path && i < path->GetNumPaths(); i++)
+	{
+		sprintf( buf, "%s%s", path->GetPath(i), name );
+		if (!stat( buf, &info )) found = buf;
+	}
+
+	ShaderIncludePath *entry = new ShaderIncludePath();
+	entry->key = strdup( key );
+	entry->resolved = found ? strdup( found ) : 0;
+	entry->nextInBucket = pathHash[bucket];
+	pathHash[bucket] = pathTable.Add( entry );
+	return entry->resolved;
+}
+
+ShaderSourceFile *ShaderSourceCache::GetFile( char *resolvedPath )
+{
+	struct stat info;
+	if (stat( resolvedPath, &info )) return 0;
+
+	unsigned int bucket = HashSourceName( resolvedPath );
+	ShaderSourceFile *entry = 0;
+	for (int i = fileHash[bucket]; i >= 0; i = fileTable[i]->nextInBucket)
+		if (!strcmp( fileTable[i]->path, resolvedPath ))
+		{
+			entry = fileTable[i];
+			break;
+		}
+
+	// Already have an up-to-date copy?
+	if (entry && entry->modified == info.st_mtime)
+	{
+		cacheHits++;
+		return entry;
+	}
+
+	// Read the file
+	FILE *f = fopen( resolvedPath, "rb" );
+	if (!f) return 0;
+	fseek( f, 0, SEEK_END );
+	long size = ftell( f );
+	rewind( f );
+	char *text = (char *)malloc( size+1 );
+	if (!text) { fclose( f ); return 0; }
+	size = (long)fread( text, 1, size, f );
+	text[size] = 0;
+	fclose( f );
+	fileReads++;
+
+	if (!entry)
+	{
+		entry = new ShaderSourceFile();
+		entry->path = strdup( resolvedPath );
+		entry->dir  = strdup( resolvedPath );
+		char *slash = entry->dir, *ptr;
+		for (ptr = entry->dir; *ptr; ptr++)
+			if (*ptr == '/' || *ptr == '\\') slash = ptr+1;
+		*slash = 0;
+		entry->text = 0;
+		entry->nextInBucket = fileHash[bucket];
+		fileHash[bucket] = fileTable.Add( entry );
+	}
+	if (entry->text) free( entry->text );
+	entry->text = text;
+	entry->modified = info.st_mtime;
+
+	// Look for a "#pragma once" line
+	entry->pragmaOnce = false;
+	for (char *line = text; line && *line; )
+	{
+		while (*line == ' ' || *line == '\t') line++;
+		char *rest;
+		if (*line == '#' && (rest = MatchDirective( line+1, "pragma" )) && MatchDirective( rest, "once" ))
+			entry->pragmaOnce = true;
+		line = strchr( line, '\n' );
+		if (line) line++;
+	}
+	return entry;
+}
+
+bool ShaderSourceCache::Expand( ShaderSourceFile *file, PathList *path, int depth,
+		                        Array1D<char *> &fileList, Array1D<int> &onceFiles,
+				                char **buf, unsigned int *bufLen, unsigned int *bufAlloc )
+{
+	if (depth > SHADERSOURCE_MAX_DEPTH)
+	{
+		fprintf( stderr, "***Error: Shader includes nested too deeply (recursive?) in '%s'!\n", file->path );
+		return false;
+	}
+
+	// Find this file's source string number
+	int fileIdx = -1;
+	for (unsigned int i=0; i < fileList.Size(); i++)
+		if (!strcmp( fileList[i], file->path )) fileIdx = i;
+	if (fileIdx < 0)
+		fileIdx = fileList.Add( strdup( file->path ) );
+
+	if (file->pragmaOnce)
+	{
+		for (unsigned int i=0; i < onceFiles.Size(); i++)
+			if (onceFiles[i] == fileIdx) return true;
+		onceFiles.Add( fileIdx );
+	}
+
+	char lineBuf[64];
+	if (depth > 0)
+	{
+		sprintf( lineBuf, "#line 1 %d\n", fileIdx );
+		AppendText( buf, bufLen, bufAlloc, lineBuf, (unsigned int)strlen( lineBuf ) );
+	}
+
+	int lineNum = 1;
+	for (char *line = file->text; *line; lineNum++)
+	{
+		char *end = strchr( line, '\n' );
+		unsigned int len = end ? (unsigned int)(end - line + 1) : (unsigned int)strlen( line );
+
+		char *ptr = line, *rest;
+		while (*ptr == ' ' || *ptr == '\t') ptr++;
+		if (*ptr == '#' && (rest = MatchDirective( ptr+1, "include" )))
+		{
+			// Pull out the name between "" or <>
+			char name[512];
+			while (*rest == ' ' || *rest == '\t') rest++;
+			char close = (*rest == '<') ? '>' : '"';
+			unsigned int n = 0;
+			if (*rest == '"' || *rest == '<')
+				for (rest++; *rest && *rest != close && *rest != '\n' && n < sizeof(name)-1; rest++)
+					name[n++] = *rest;
+			name[n] = 0;
+			if (!n || *rest != close)
+			{
+				fprintf( stderr, "***Error: Malformed #include in '%s' (line %d)!\n", file->path, lineNum );
+				return false;
+			}
+
+			char *resolved = ResolvePath( name, file->dir, path );
+			ShaderSourceFile *inc = resolved ? GetFile( resolved ) : 0;
+			if (!inc)
+			{
+				fprintf( stderr, "***Error: Unable to find '%s' included from '%s' (line %d)!\n",
+					     name, file->path, lineNum );
+				return false;
+			}
+			if (!Expand( inc, path, depth+1, fileList, onceFiles, buf, bufLen, bufAlloc ))
+				return false;
+
+			// Make sure the include ended its last line, and get back to our numbering
+			if (*bufLen > 0 && (*buf)[*bufLen-1] != '\n')
+				AppendText( buf, bufLen, bufAlloc, "\n", 1 );
+			sprintf( lineBuf, "#line %d %d\n", lineNum+1, fileIdx );
+			AppendText( buf, bufLen, bufAlloc, lineBuf, (unsigned int)strlen( lineBuf ) );
+		}
+		else if (*ptr == '#' && (rest = MatchDirective( ptr+1, "pragma" )) && MatchDirective( rest, "once" ))
+			AppendText( buf, bufLen, bufAlloc, "\n", 1 );  // Ours, not the compiler's.  Keep the line count.
+		else
+			AppendText( buf, bufLen, bufAlloc, line, len );
+
+		line += len;
+	}
+	return true;
+}
+
+char *ShaderSourceCache::LoadShader( char *filename, PathList *path, Array1D<char *> *files )
+{
+	char *resolved = ResolvePath( filename, "", path );
+	ShaderSourceFile *file = resolved ? GetFile( resolved ) : 0;
+	if (!file) return 0;
+
+	Array1D<char *> fileList;
+	Array1D<int> onceFiles;
+	char *buf = 0;
+	unsigned int bufLen = 0, bufAlloc = 0;
+	bool ok = Expand( file, path, 0, fileList, onceFiles, &buf, &bufLen, &bufAlloc );
+	if (ok && !buf) AppendText( &buf, &bufLen, &bufAlloc, "", 0 );  // An empty file
+
+	for (unsigned int i=0; i < fileList.Size(); i++)
+	{
+		if (ok && files) files->Add( fileList[i] );
+		else free( fileList[i] );
+	}
+	if (!ok)
+	{
+		free( buf );
+		return 0;
+	}
+	return buf;
+}
+
+void ShaderSourceCache::PrintStats( FILE *f )
+{
+	fprintf( f, "Shader sources: %u files read, %u reused from memory\n", fileReads, cacheHits );
+}
+
@@ -0,0 +1,95 @@
+/***************************************************************************/
+/* shaderSourceCache.h                                                     */
+/* ------------                                                            */
+/*                                                                         */
+/* Loads GLSL shader source for GLSLProgram, expanding #include directives */
+/*     and keeping every file it reads in memory, so a header shared by    */
+/*     many shaders is found and read from disk only once.                 */
+/*                                                                         */
+/* Includes look like C includes:                                          */
+/*                                                                         */
+/*        #include "lighting.glsl"     (or <lighting.glsl>)               */
+/*                                                                         */
+/*     and are searched for relative to the including file's directory,    */
+/*     then the current directory, then the program's search PathList.     */
+/*     A file containing "#pragma once" is only expanded once per shader.  */
+/*     (Classic #ifndef/#define guards work too, since GLSL understands    */
+/*     them, but the guarded text is still sent to the compiler.)          */
+/*                                                                         */
+/* GLSL's #line directive takes a source string number rather than a file */
+/*     name, so each file in a shader is given a number (0 = the main      */
+/*     file, then in order of first inclusion), #line directives are       */
+/*     emitted around every include, and the list of files is returned so  */
+/*     compile errors can be printed with a number -> file legend.         */
+/*                                                                         */
+/* Cached files are keyed by their resolved path and are re-read only if   */
+/*     their modification time changed.  Resolved include paths are also   */
+/*     cached; call ForgetResolvedPaths() if files may have been added to  */
+/*     (or removed from) the search directories.                           */
+/***************************************************************************/
+
+#ifndef __SHADERSOURCECACHE_H
+#define __SHADERSOURCECACHE_H
+
+#include <stdio.h>
+#include <time.h>
+#include "DataTypes/Array1D.h"
+
+class PathList;
+class ShaderSourceFile;
+class ShaderIncludePath;
+
+// Number of buckets in the file and include path hash tables
+#define SHADERSOURCE_HASH_SIZE     256
+
+// Includes nested deeper than this are assumed to be recursive
+#define SHADERSOURCE_MAX_DEPTH     32
+
+class ShaderSourceCache
+{
+public:
+	ShaderSourceCache();
+	~ShaderSourceCache();
+
+	// Load a shader, with all includes expanded.  Returns a malloc()'d string
+	//    (or NULL if the file, or one of its includes, cannot be found).  If
+	//    'files' is non-NULL, it is filled with strdup()'d resolved paths of
+	//    every file used, where files[i] is GLSL source string number 'i'.
+	char *LoadShader( char *filename, PathList *path, Array1D<char *> *files=0 );
+
+	// Drop cached include path lookups (file contents are checked by date)
+	void ForgetResolvedPaths( void );
+
+	// Free everything
+	void Clear( void );
+
+	// Statistics
+	inline unsigned int GetFileReadCount( void ) const  { return fileReads; }
+	inline unsigned int GetCacheHitCount( void ) const  { return cacheHits; }
+	void PrintStats( FILE *f );
+
+private:
+	Array1D<ShaderSourceFile *> fileTable;
+	Array1D<ShaderIncludePath *> pathTable;
+	int fileHash[SHADERSOURCE_HASH_SIZE];
+	int pathHash[SHADERSOURCE_HASH_SIZE];
+	unsigned int fileReads, cacheHits;
+
+	// Find (and possibly read) the file at this resolved path, or NULL
+	ShaderSourceFile *GetFile( char *resolvedPath );
+
+	// Map an include name to a resolved path, or NULL if nothing is found.
+	//    The result is owned by the cache; do not free() it.
+	char *ResolvePath( char *name, char *includerDir, PathList *path );
+
+	// The guts of LoadShader()
+	bool Expand( ShaderSourceFile *file, PathList *path, int depth,
+		         Array1D<char *> &fileList, Array1D<int> &onceFiles,
+				 char **buf, unsigned int *bufLen, unsigned int *bufAlloc );
+};
+
+// The single cache shared by all GLSLPrograms
+extern ShaderSourceCache shaderSources;
+
+#endif
+
@@ -0,0 +1,222 @@
+/***************************************************************************/
+/* spectralConvert.cpp                                                     */
+/* ------------                                                            */
+/*                                                                         */
+/* Implements batch conversion of spectra to XYZ and RGB.  See the header  */
+/*     for usage notes.                                                    */
+/***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "spectralConvert.h"
+#include "parallelFor.h"
+
+// (Define SPECTRAL_NO_SSE to build with just the plain C++ loops)
+#if (defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)) && !defined(SPECTRAL_NO_SSE)
+#include <xmmintrin.h>
+#define SPECTRAL_USE_SSE
+#endif
+
+// Spectra per block when rearranging SpectralColors
+#define SPECTRAL_BLOCK   256
+
+
+// Each bin's X, Y, and Z matching function values, divided by their sums
+//    over all bins (just as SpectralColor::ToXYZ() does)
+class SpectralBinWeights
+{
+public:
+	float x[SPECTRALCOLORBINS], y[SPECTRALCOLORBINS], z[SPECTRALCOLORBINS];
+
+	SpectralBinWeights()
+	{
+		RGBColor sum = RGBColor::Black();
+		for (int i=0; i < SPECTRALCOLORBINS; i++)
+			sum += XYZSpectrum::GetXYZStimulus( MINWAVELENGTH + i*WAVELENGTH_INCR );
+		for (int i=0; i < SPECTRALCOLORBINS; i++)
+		{
+			RGBColor response = XYZSpectrum::GetXYZStimulus( MINWAVELENGTH + i*WAVELENGTH_INCR );
+			x[i] = response.Red() / sum.Red();
+			y[i] = response.Green() / sum.Green();
+			z[i] = response.Blue() / sum.Blue();
+		}
+	}
+};
+
+static SpectralBinWeights binWeights;
+
+// XYZSpectrum::ConvertXYZToRGB()'s matrix
+static const float xyzToRGB[3][3] = {
+	{  3.240479f, -1.537250f, -0.498535f },
+	{ -0.969256f,  1.875991f,  0.041556f },
+	{  0.055648f, -0.204043f,  1.057311f } };
+
+typedef struct
+{
+	const float *spectra;
+	int stride;
+	float *out[3];
+	bool toRGB;
+} SpectralJob;
+
+// Convert spectra [first, last) of a job
+static void ConvertSpectra( int first, int last, void *data )
+{
+	SpectralJob *job = (SpectralJob *)data;
+	const float *wx = binWeights.x, *wy = binWeights.y, *wz = binWeights.z;
+	const float *s = job->spectra;
+	int stride = job->stride, i = first;
+
+#ifdef SPECTRAL_USE_SSE
+	for (; i+4 <= last; i += 4)
+	{
+		__m128 X = _mm_setzero_ps(), Y = _mm_setzero_ps(), Z = _mm_setzero_ps();
+		for (int b=0; b < SPECTRALCOLORBINS; b++)
+		{
+			__m128 v = _mm_loadu_ps( s + b*stride + i );
+			X = _mm_add_ps( X, _mm_mul_ps( v, _mm_set1_ps( wx[b] ) ) );
+			Y = _mm_add_ps( Y, _mm_mul_ps( v, _mm_set1_ps( wy[b] ) ) );
+			Z = _mm_add_ps( Z, _mm_mul_ps( v, _mm_set1_ps( wz[b] ) ) );
+		}
+		if (job->toRGB)
+		{
+			__m128 c[3];
+			for (int j=0; j < 3; j++)
+				c[j] = _mm_add_ps( _mm_add_ps( _mm_mul_ps( X, _mm_set1_ps( xyzToRGB[j][0] ) ),
+				                               _mm_mul_ps( Y, _mm_set1_ps( xyzToRGB[j][1] ) ) ),
+				                   _mm_mul_ps( Z, _mm_set1_ps( xyzToRGB[j][2] ) ) );
+			X = c[0];  Y = c[1];  Z = c[2];
+		}
+		_mm_storeu_ps( job->out[0] + i, X );
+		_mm_storeu_ps( job->out[1] + i, Y );
+		_mm_storeu_ps( job->out[2] + i, Z );
+	}
+#endif
+
+	// Whatever's left (or everything, without SSE)
+	for (; i < last; i++)
+	{
+		float X = 0, Y = 0, Z = 0;
+		for (int b=0; b < SPECTRALCOLORBINS; b++)
+		{
+			float v = s[b*stride + i];
+			X += v*wx[b];
+			Y += v*wy[b];
+			Z += v*wz[b];
+		}
+		if (job->toRGB)
+		{
+			float R = xyzToRGB[0][0]*X + xyzToRGB[0][1]*Y + xyzToRGB[0][2]*Z;
+			float G = xyzToRGB[1][0]*X + xyzToRGB[1][1]*Y + xyzToRGB[1][2]*Z;
+			float B = xyzToRGB[2][0]*X + xyzToRGB[2][1]*Y + xyzToRGB[2][2]*Z;
+			X = R;  Y = G;  Z = B;
+		}
+		job->out[0][i] = X;
+		job->out[1][i] = Y;
+		job->out[2][i] = Z;
+	}
+}
+
+static void ConvertSpectraJob( const float *spectra, int stride, int count, float *a, float *b, float *c, bool toRGB )
+{
+	SpectralJob job;
+	job.spectra = spectra;
+	job.stride = stride;
+	job.out[0] = a;
+	job.out[1] = b;
+	job.out[2] = c;
+	job.toRGB = toRGB;
+	ParallelFor( count, ConvertSpectra, &job, SPECTRAL_CONVERT_GRAIN );
+}
+
+void SpectraToXYZ( const float *spectra, int stride, int count, float *x, float *y, float *z )
+{
+	ConvertSpectraJob( spectra, stride, count, x, y, z, false );
+}
+
+void SpectraToRGB( const float *spectra, int stride, int count, float *r, float *g, float *b )
+{
+	ConvertSpectraJob( spectra, stride, count, r, g, b, true );
+}
+
+void XYZToRGB( const float *x, const float *y, const float *z, int count, float *r, float *g, float *b )
+{
+	int i = 0;
+#ifdef SPECTRAL_USE_SSE
+	for (; i+4 <= count; i += 4)
+	{
+		__m128 X = _mm_loadu_ps( x+i ), Y = _mm_loadu_ps( y+i ), Z = _mm_loadu_ps( z+i ), c[3];
+		for (int j=0; j < 3; j++)
+			c[j] = _mm_add_ps( _mm_add_ps( _mm_mul_ps( X, _mm_set1_ps( xyzToRGB[j][0] ) ),
+			                               _mm_mul_ps( Y, _mm_set1_ps( xyzToRGB[j][1] ) ) ),
+			                   _mm_mul_ps( Z, _mm_set1_ps( xyzToRGB[j][2] ) ) );
+		_mm_storeu_ps( r+i, c[0] );
+		_mm_storeu_ps( g+i, c[1] );
+		_mm_storeu_ps( b+i, c[2] );
+	}
+#endif
+	for (; i < count; i++)
+	{
+		float X = x[i], Y = y[i], Z = z[i];
+		r[i] = xyzToRGB[0][0]*X + xyzToRGB[0][1]*Y + xyzToRGB[0][2]*Z;
+		g[i] = xyzToRGB[1][0]*X + xyzToRGB[1][1]*Y + xyzToRGB[1][2]*Z;
+		b[i] = xyzToRGB[2][0]*X + xyzToRGB[2][1]*Y + xyzToRGB[2][2]*Z;
+	}
+}
+
+
+typedef struct
+{
+	const SpectralColor *colors;
+	int count;
+	RGBColor *out;
+	bool toRGB;
+} SpectralColorJob;
+
+// Convert blocks [first, last) of SpectralColors, rearranging each first
+static void ConvertColorBlocks( int first, int last, void *data )
+{
+	SpectralColorJob *job = (SpectralColorJob *)data;
+	float bins[SPECTRALCOLORBINS*SPECTRAL_BLOCK], out[3][SPECTRAL_BLOCK];
+	for (int blk=first; blk < last; blk++)
+	{
+		int start = blk*SPECTRAL_BLOCK;
+		int num = job->count - start < SPECTRAL_BLOCK ? job->count - start : SPECTRAL_BLOCK;
+		for (int i=0; i < num; i++)
+			for (int b=0; b < SPECTRALCOLORBINS; b++)
+				bins[b*SPECTRAL_BLOCK + i] = job->colors[start+i].GetBinValue( b );
+
+		SpectralJob block;
+		block.spectra = bins;
+		block.stride = SPECTRAL_BLOCK;
+		block.out[0] = out[0];
+		block.out[1] = out[1];
+		block.out[2] = out[2];
+		block.toRGB = job->toRGB;
+		ConvertSpectra( 0, num, &block );
+
+		for (int i=0; i < num; i++)
+			job->out[start+i] = RGBColor( out[0][i], out[1][i], out[2][i] );
+	}
+}
+
+static void ConvertColorsJob( const SpectralColor *colors, int count, RGBColor *out, bool toRGB )
+{
+	SpectralColorJob job;
+	job.colors = colors;
+	job.count = count;
+	job.out = out;
+	job.toRGB = toRGB;
+	ParallelFor( (count + SPECTRAL_BLOCK-1) / SPECTRAL_BLOCK, ConvertColorBlocks, &job,
+		         SPECTRAL_CONVERT_GRAIN / SPECTRAL_BLOCK );
+}
+
+void SpectralColorsToXYZ( const SpectralColor *colors, int count, RGBColor *xyz )
+{
+	ConvertColorsJob( colors, count, xyz, false );
+}
+
+void SpectralColorsToRGB( const SpectralColor *colors, int count, RGBColor *rgb )
+{
+	ConvertColorsJob( colors, count, rgb, true );
+}
@@ -0,0 +1,43 @@
+/***************************************************************************/
+/* spectralConvert.h                                                       */
+/* ------------                                                            */
+/*                                                                         */
+/* Converts many spectra at once to XYZ, and on to linear RGB.  This gives */
+/*     the same results as SpectralColor::ToXYZ() followed by              */
+/*     XYZSpectrum::ConvertXYZToRGB() (to within float rounding), but for  */
+/*     millions of colors, as when preprocessing spectral textures or      */
+/*     lights.                                                             */
+/*                                                                         */
+/* Spectra are stored "structure of arrays":  the SPECTRALCOLORBINS bins   */
+/*     of spectrum i are at spectra[i], spectra[i + stride], spectra[i +   */
+/*     2*stride], and so on.  Each bin's (already normalized) matching     */
+/*     function weights are computed once, so converting is three dot      */
+/*     products per spectrum, done for 4 spectra at a time with SSE (where */
+/*     available).  Big batches are split across threads (parallelFor.h).  */
+/*                                                                         */
+/* For arrays of SpectralColors, SpectralColorsTo*() rearrange a block at  */
+/*     a time into this layout, and convert that.                          */
+/***************************************************************************/
+
+#ifndef __SPECTRALCONVERT_H
+#define __SPECTRALCONVERT_H
+
+#include "DataTypes/RGBColor.h"
+#include "DataTypes/SpectralColor.h"
+
+// Fewest spectra given to each thread
+#define SPECTRAL_CONVERT_GRAIN      4096
+
+// 'count' spectra (with bins 'stride' floats apart, stride >= count) to
+//    XYZ, or to linear RGB (not clamped).  The outputs are 'count' floats each.
+void SpectraToXYZ( const float *spectra, int stride, int count, float *x, float *y, float *z );
+void SpectraToRGB( const float *spectra, int stride, int count, float *r, float *g, float *b );
+
+// XYZ to linear RGB, for 'count' colors.  The outputs may be the inputs.
+void XYZToRGB( const float *x, const float *y, const float *z, int count, float *r, float *g, float *b );
+
+// The same, from (and to) arrays of colors
+void SpectralColorsToXYZ( const SpectralColor *colors, int count, RGBColor *xyz );
+void SpectralColorsToRGB( const SpectralColor *colors, int count, RGBColor *rgb );
+
+#endif
@@ -0,0 +1,203 @@
+/***************************************************************************/
+/* textureArrayBuilder.cpp                                                 */
+/* ------------                                                            */
+/*                                                                         */
+/* Implements the texture array builder.  See the header for usage notes.  */
+/***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "textureArrayBuilder.h"
+#include "textureCompressor.h"
+#include "mipmapGenerator.h"
+#include "glStateCache.h"
+#include "parallelFor.h"
+#include "ImageIO/imageIO.h"
+#include "DataTypes/glTexture.h"
+
+#pragma warning( disable: 4996 )
+
+size_t TextureArrayBuilder::totalGPUBytes = 0;
+
+
+TextureArrayBuilder::TextureArrayBuilder() : numLayers(0), gpuBytes(0)
+{
+}
+
+TextureArrayBuilder::~TextureArrayBuilder()
+{
+	for (unsigned int i=0; i < arrays.Size(); i++)
+		glState.DeleteTextures( 1, &arrays[i] );
+	totalGPUBytes -= gpuBytes;
+}
+
+void TextureArrayBuilder::Add( GLTexture *tex )
+{
+	for (unsigned int i=0; i < textures.Size(); i++)
+		if (textures[i] == tex) return;
+	textures.Add( tex );
+}
+
+// ParallelFor() callback:  read the images for textures [first,last)
+static void LoadTextureRange( int first, int last, void *data )
+{
+	Array1D< GLTexture * > *textures = (Array1D< GLTexture * > *)data;
+	for (int i=first; i < last; i++)
+		(*textures)[i]->GetImageData();
+}
+
+void TextureArrayBuilder::Build( void )
+{
+	if (textures.Size() == 0) return;
+	if (!GLEW_EXT_texture_array)
+	{
+		Warning( "Texture arrays are unsupported!  Shaders binding a 'texarray' won't work." );
+		return;
+	}
+
+	// We need the images to know their sizes and formats
+	ParallelFor( textures.Size(), LoadTextureRange, &textures );
+
+	GLint maxLayers;
+	glGetIntegerv( GL_MAX_ARRAY_TEXTURE_LAYERS_EXT, &maxLayers );
+
+	// Group the textures, and build an array from each group
+	int *group = (int *)malloc( textures.Size() * sizeof(int) );
+	bool *grouped = (bool *)calloc( textures.Size(), sizeof(bool) );
+	for (unsigned int i=0; i < textures.Size(); i++)
+	{
+		if (grouped[i]) continue;
+		if (!textures[i]->GetImageData() || !textures[i]->CanBeArrayLayer())
+		{
+			Warning( "Texture '%s' can't be put in a texture array!", textures[i]->GetFilename() );
+			continue;
+		}
+
+		int count = 0;
+		for (unsigned int j=i; j < textures.Size() && count < maxLayers; j++)
+			if (!grouped[j] && textures[i]->SameArrayFormat( textures[j] ))
+			{
+				group[count++] = j;
+				grouped[j] = true;
+			}
+		BuildArray( group, count );
+	}
+	free( grouped );
+	free( group );
+	glState.BindTexture( GL_TEXTURE_2D_ARRAY_EXT, 0 );
+}
+
+// The data for each layer of an array, built in parallel
+typedef struct {
+	GLTexture **layers;
+	BCTexture **compressed;
+	MipmapChain **mipmaps;
+	int bcFormat, components;
+} ArrayLayerJob;
+
+static void PrepareLayerRange( int first, int last, void *data )
+{
+	ArrayLayerJob *job = (ArrayLayerJob *)data;
+	for (int i=first; i < last; i++)
+	{
+		GLTexture *tex = job->layers[i];
+		const unsigned char *pixels = (const unsigned char *)tex->GetImageData();
+		if (job->bcFormat)
+			job->compressed[i] = compressedTextures.GetCompressed( job->bcFormat, pixels, tex->GetWidth(), tex->GetHeight(),
+				                                                   job->components, tex->UsesMipmaps(), tex->GetMipFlags() );
+		else
+			job->mipmaps[i] = tex->UsesMipmaps() ?
+				GenerateMipmaps( pixels, tex->GetWidth(), tex->GetHeight(), job->components, tex->GetMipFlags() ) :
+				new MipmapChain( pixels, tex->GetWidth(), tex->GetHeight(), job->components );
+	}
+}
+
+void TextureArrayBuilder::BuildArray( int *group, int count )
+{
+	GLTexture *first = textures[ group[0] ];
+	GLenum target = GL_TEXTURE_2D_ARRAY_EXT;
+
+	// Compress (or mipmap) every layer, like GLTexture::PrepareImage() does
+	ArrayLayerJob job;
+	job.layers = (GLTexture **)malloc( count * sizeof(GLTexture *) );
+	job.compressed = (BCTexture **)calloc( count, sizeof(BCTexture *) );
+	job.mipmaps = (MipmapChain **)calloc( count, sizeof(MipmapChain *) );
+	job.components = (first->GetPixelFormat()==GL_RGB ? 3 : 4);
+	job.bcFormat = 0;
+	if (GLEW_EXT_texture_compression_s3tc)
+		job.bcFormat = (job.components==3 ? BC_FORMAT_BC1 : BC_FORMAT_BC3);
+	for (int i=0; i < count; i++)
+		job.layers[i] = textures[ group[i] ];
+	ParallelFor( count, PrepareLayerRange, &job, 1 );
+
+	GLuint id;
+	glGenTextures( 1, &id );
+	glState.BindTexture( target, id );
+	glTexParameteri( target, GL_TEXTURE_MIN_FILTER, first->GetMinFilter() );
+	glTexParameteri( target, GL_TEXTURE_MAG_FILTER, first->GetMagFilter() );
+	glTexParameteri( target, GL_TEXTURE_WRAP_S, first->GetWrapS() );
+	glTexParameteri( target, GL_TEXTURE_WRAP_T, first->GetWrapT() );
+
+	// Allocate all the levels, then fill in each layer
+	size_t bytes = 0;
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+	if (job.bcFormat)
+	{
+		BCTexture *bc = job.compressed[0];
+		GLenum glFormat = BCGLFormat( job.bcFormat );
+		for (unsigned int lvl=0; lvl < bc->GetNumLevels(); lvl++)
+		{
+			glCompressedTexImage3D( target, lvl, glFormat, bc->GetLevelWidth(lvl), bc->GetLevelHeight(lvl),
+				                    count, 0, bc->GetLevelBytes(lvl)*count, NULL );
+			bytes += (size_t)bc->GetLevelBytes(lvl) * count;
+		}
+		glTexParameteri( target, GL_TEXTURE_MAX_LEVEL, bc->GetNumLevels()-1 );
+		for (int i=0; i < count; i++)
+		{
+			bc = job.compressed[i];
+			for (unsigned int lvl=0; lvl < bc->GetNumLevels(); lvl++)
+				glCompressedTexSubImage3D( target, lvl, 0, 0, i, bc->GetLevelWidth(lvl), bc->GetLevelHeight(lvl), 1,
+					                       glFormat, bc->GetLevelBytes(lvl), bc->GetLevelData(lvl) );
+			delete bc;
+		}
+	}
+	else
+	{
+		MipmapChain *mips = job.mipmaps[0];
+		GLenum format = first->GetPixelFormat();
+		for (unsigned int lvl=0; lvl < mips->GetNumLevels(); lvl++)
+		{
+			glTexImage3D( target, lvl, format, mips->GetLevelWidth(lvl), mips->GetLevelHeight(lvl),
+				          count, 0, format, GL_UNSIGNED_BYTE, NULL );
+			bytes += (size_t)mips->GetLevelWidth(lvl) * mips->GetLevelHeight(lvl) * 4 * count;
+		}
+		glTexParameteri( target, GL_TEXTURE_MAX_LEVEL, mips->GetNumLevels()-1 );
+		for (int i=0; i < count; i++)
+		{
+			mips = job.mipmaps[i];
+			for (unsigned int lvl=0; lvl < mips->GetNumLevels(); lvl++)
+				glTexSubImage3D( target, lvl, 0, 0, i, mips->GetLevelWidth(lvl), mips->GetLevelHeight(lvl), 1,
+					             format, GL_UNSIGNED_BYTE, mips->GetLevelData(lvl) );
+			delete mips;
+		}
+	}
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+
+	for (int i=0; i < count; i++)
+		job.layers[i]->SetArrayLayer( id, i );
+	free( job.layers );
+	free( job.compressed );
+	free( job.mipmaps );
+
+	arrays.Add( id );
+	numLayers += count;
+	gpuBytes += bytes;
+	totalGPUBytes += bytes;
+}
+
+void TextureArrayBuilder::PrintStats( FILE *f )
+{
+	fprintf( f, "Texture arrays: %u textures in %u arrays, %.2f MB\n",
+		     numLayers, arrays.Size(), gpuBytes/1048576.0 );
+}
+
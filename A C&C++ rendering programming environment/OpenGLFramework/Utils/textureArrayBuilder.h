@@ -0,0 +1,69 @@
+/***************************************************************************/
+/* textureArrayBuilder.h                                                   */
+/* ------------                                                            */
+/*                                                                         */
+/* Packs textures of the same size and format into GL_TEXTURE_2D_ARRAY     */
+/*     layers, so materials that differ only in their texture all bind     */
+/*     the same GL texture (and the state cache skips the rebinds), just   */
+/*     changing a layer index between draws.                               */
+/*                                                                         */
+/* Textures are Add()ed if some material asked for them in an array (see  */
+/*     GLTexture::RequestArrayLayer() and the "texarray" binding of        */
+/*     GLSLShaderMaterial).  Build() reads them, groups them by size and   */
+/*     format (GLTexture::SameArrayFormat()), and creates one array per    */
+/*     group, up to the GL's layer limit.  A texture alone in its group    */
+/*     gets a 1 layer array, so shaders expecting an array still work.     */
+/*     Layers are block compressed (or just mipmapped) like GLTexture      */
+/*     does, using the same compressed texture cache.                      */
+/*                                                                         */
+/* Afterwards, GLTexture::GetArrayID() and GetArrayLayer() give the array  */
+/*     and layer holding each texture.  The arrays are extra copies:  the  */
+/*     textures keep their own GL textures for materials that bind them    */
+/*     directly (e.g., the fixed function ones).                           */
+/***************************************************************************/
+
+#ifndef __TEXTUREARRAYBUILDER_H
+#define __TEXTUREARRAYBUILDER_H
+
+#include <stdio.h>
+#include <GL/glew.h>
+#include <GL/glut.h>
+#include "DataTypes/Array1D.h"
+
+class GLTexture;
+
+class TextureArrayBuilder
+{
+public:
+	TextureArrayBuilder();
+	~TextureArrayBuilder();
+
+	// Put a texture in an array when Build() is called
+	void Add( GLTexture *tex );
+
+	// Build the arrays.  Needs an OpenGL context.  Textures that can't go in
+	//    an array (e.g., HDR ones) are left out, with a warning.
+	void Build( void );
+
+	inline unsigned int GetNumArrays( void ) const    { return arrays.Size(); }
+	inline unsigned int GetNumLayers( void ) const    { return numLayers; }
+
+	// GPU memory used by the arrays, here and in all builders
+	inline size_t GetGPUBytes( void ) const           { return gpuBytes; }
+	static inline size_t GetTotalGPUBytes( void )     { return totalGPUBytes; }
+
+	void PrintStats( FILE *f );
+
+private:
+	Array1D< GLTexture * > textures;
+	Array1D< GLuint > arrays;
+	unsigned int numLayers;
+	size_t gpuBytes;
+	static size_t totalGPUBytes;
+
+	// Make an array from textures[group[0..count-1]]
+	void BuildArray( int *group, int count );
+};
+
+#endif
+
@@ -0,0 +1,115 @@
+/***************************************************************************/
+/* textureBudget.cpp                                                       */
+/* ------------                                                            */
+/*                                                                         */
+/* Implements the texture memory budget.  See the header for usage notes.  */
+/***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "textureBudget.h"
+#include "textureStreamer.h"
+#include "framebufferObject.h"
+#include "textureArrayBuilder.h"
+#include "DataTypes/glTexture.h"
+
+
+TextureBudget::TextureBudget( size_t budgetBytes, TextureStreamer *streamer ) :
+	streamer(streamer), budget(budgetBytes), peakBytes(0), bytesFreed(0), frame(1),
+	pressureFrames(0), mipDrops(0), evictions(0), reloads(0)
+{
+	GLTexture::SetCurrentFrame( frame );
+}
+
+void TextureBudget::Add( GLTexture *tex )
+{
+	if (tex) textures.Add( tex );
+}
+
+size_t TextureBudget::GetUsedBytes( void ) const
+{
+	return GLTexture::GetTotalGPUBytes() + FrameBuffer::GetTotalGPUBytes() + 
+		   TextureArrayBuilder::GetTotalGPUBytes();
+}
+
+// Textures drawn last frame can lose mip levels, but aren't evicted.
+//    Without a streamer to reload them, nothing is evicted.  Among equally
+//    old textures, free memory from the biggest first.
+int TextureBudget::LeastRecentlyUsed( void )
+{
+	int best = -1;
+	for (unsigned int i=0; i < textures.Size(); i++)
+	{
+		GLTexture *tex = textures[i];
+		if (!tex->IsResident()) continue;
+		bool usedLastFrame = (tex->GetLastUsedFrame() == frame);
+		if (!tex->CanDropMipLevel() && (usedLastFrame || !streamer)) continue;
+		if (best < 0 || tex->GetLastUsedFrame() < textures[best]->GetLastUsedFrame() ||
+			(tex->GetLastUsedFrame() == textures[best]->GetLastUsedFrame() &&
+			 tex->GetGPUBytes() > textures[best]->GetGPUBytes()))
+			best = i;
+	}
+	return best;
+}
+
+void TextureBudget::Update( void )
+{
+	size_t used = GetUsedBytes();
+	if (used > peakBytes) peakBytes = used;
+	if (budget > 0 && used > budget) pressureFrames++;
+	int changes = 0;
+
+	// Bring back textures drawn last frame (stamped with 'frame') that were
+	//    evicted, or that lost mip levels if they fit again
+	for (unsigned int i=0; streamer && i < textures.Size() && changes < TEXTURE_BUDGET_CHANGES_PER_FRAME; i++)
+	{
+		GLTexture *tex = textures[i];
+		if (tex->GetLastUsedFrame() != frame || !tex->IsStreamingDone()) continue;
+		if (!tex->IsEvicted())
+		{
+			if (!tex->GetDroppedLevels()) continue;
+			size_t fullBytes = tex->GetGPUBytes() << (2*tex->GetDroppedLevels());
+			if (budget > 0 && used - tex->GetGPUBytes() + fullBytes > budget) continue;
+			used += fullBytes - tex->GetGPUBytes();
+		}
+		tex->Reload();
+		streamer->Add( tex );
+		reloads++;
+		changes++;
+	}
+
+	// Free memory until we're under budget
+	while (budget > 0 && used > budget && changes < TEXTURE_BUDGET_CHANGES_PER_FRAME)
+	{
+		int lru = LeastRecentlyUsed();
+		if (lru < 0) break;
+
+		size_t freed;
+		if (textures[lru]->CanDropMipLevel())
+		{
+			freed = textures[lru]->DropTopMipLevel();
+			mipDrops++;
+		}
+		else
+		{
+			freed = textures[lru]->Evict();
+			evictions++;
+		}
+		used = (freed < used ? used - freed : 0);
+		bytesFreed += freed;
+		changes++;
+	}
+
+	GLTexture::SetCurrentFrame( ++frame );
+}
+
+void TextureBudget::PrintStats( FILE *f )
+{
+	fprintf( f, "Texture budget: %.2f MB used (%.2f MB peak) of ",
+		     GetUsedBytes()/1048576.0, peakBytes/1048576.0 );
+	if (budget > 0) fprintf( f, "%.2f MB", budget/1048576.0 );
+	else            fprintf( f, "unlimited" );
+	fprintf( f, ", %u frames over, %u mip levels dropped, %u evicted, %u reloaded\n",
+		     pressureFrames, mipDrops, evictions, reloads );
+}
+
@@ -0,0 +1,78 @@
+/***************************************************************************/
+/* textureBudget.h                                                         */
+/* ------------                                                            */
+/*                                                                         */
+/* Keeps the GPU memory used by textures and framebuffer objects under a   */
+/*     budget, so big scenes degrade (blurrier textures) rather than       */
+/*     running out of video memory.                                        */
+/*                                                                         */
+/* Every GLTexture is stamped with the frame TextureID() was last called   */
+/*     in.  When GLTexture and FrameBuffer memory (see their GetTotal-     */
+/*     GPUBytes()) is over budget, Update() frees memory from the least    */
+/*     recently used textures:  first by dropping their finest mip level   */
+/*     (halving their resolution), and once only one level is left, by    */
+/*     evicting them to a 1x1 placeholder.  Textures used in the last      */
+/*     frame only ever lose mip levels, never get evicted.                 */
+/*                                                                         */
+/* An evicted texture that gets drawn again is reloaded through the        */
+/*     TextureStreamer (Utils/textureStreamer.h).  Textures with dropped   */
+/*     levels get their full resolution back when it fits in the budget.  */
+/*                                                                         */
+/* FBO and texture array memory count towards the budget, but only        */
+/*     textures are ever freed.                                            */
+/***************************************************************************/
+
+#ifndef __TEXTUREBUDGET_H
+#define __TEXTUREBUDGET_H
+
+#include <stdio.h>
+#include "DataTypes/Array1D.h"
+
+class GLTexture;
+class TextureStreamer;
+
+// Most textures dropped, evicted, or reloaded in one frame.  (Dropping a
+//    level reads the texture back from the GPU, so this limits the stall.)
+#define TEXTURE_BUDGET_CHANGES_PER_FRAME   4
+
+class TextureBudget
+{
+public:
+	// A budget of 0 never frees anything, but still keeps the statistics
+	TextureBudget( size_t budgetBytes=0, TextureStreamer *streamer=0 );
+	~TextureBudget() {}
+
+	// Manage a texture (after it has been Preprocess()ed)
+	void Add( GLTexture *tex );
+
+	inline void SetBudget( size_t bytes )           { budget = bytes; }
+	inline size_t GetBudget( void ) const           { return budget; }
+
+	// Call once per frame, on the OpenGL thread, before drawing
+	void Update( void );
+
+	// Memory in use (textures, FBOs, and arrays) and the most ever used
+	size_t GetUsedBytes( void ) const;
+	inline size_t GetPeakBytes( void ) const        { return peakBytes; }
+
+	// Counters:  frames that started over budget, mip levels dropped,
+	//    textures evicted, and textures reloaded (after eviction or drops)
+	inline unsigned int GetPressureFrames( void ) const { return pressureFrames; }
+	inline unsigned int GetMipDrops( void ) const       { return mipDrops; }
+	inline unsigned int GetEvictions( void ) const      { return evictions; }
+	inline unsigned int GetReloads( void ) const        { return reloads; }
+	inline size_t GetBytesFreed( void ) const           { return bytesFreed; }
+	void PrintStats( FILE *f );
+
+private:
+	Array1D< GLTexture * > textures;
+	TextureStreamer *streamer;
+	size_t budget, peakBytes, bytesFreed;
+	unsigned int frame, pressureFrames, mipDrops, evictions, reloads;
+
+	// The least recently used texture we can free memory from, or -1
+	int LeastRecentlyUsed( void );
+};
+
+#endif
+
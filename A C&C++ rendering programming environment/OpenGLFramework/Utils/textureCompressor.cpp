@@ -0,0 +1,478 @@
+/***************************************************************************/
+/* textureCompressor.cpp                                                   */
+/* ------------                                                            */
+/*                                                                         */
+/* Implements the BC1/BC3/BC4/BC5 block encoder and the on-disk cache of   */
+/*     compressed textures.  See the header for usage notes.               */
+/***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "textureCompressor.h"
+#include "programBinaryCache.h"
+#include "parallelFor.h"
+#include "mipmapGenerator.h"
+#include "HighResolutionTimer.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#define MakeCacheDirectory(d)  _mkdir(d)
+#else
+#include <sys/stat.h>
+#define MakeCacheDirectory(d)  mkdir(d, 0755)
+#endif
+
+#pragma warning( disable: 4996 )
+
+// Bump this if the file layout changes, so old files are ignored
+#define BC_CACHE_FILE_VERSION  1
+
+// The header at the start of each cache file.  Each level follows as
+//    width, height, and byte count (3 unsigned ints) and then the data.
+typedef struct
+{
+	char magic[4];             // "BCTX"
+	unsigned int version;      // BC_CACHE_FILE_VERSION
+	unsigned long long key;    // Full key, to catch stray files
+	int format;                // BC_FORMAT_*
+	unsigned int numLevels;
+} BCCacheHeader;
+
+// The one and only cache.
+CompressedTextureCache compressedTextures;
+
+
+/***************************************************************************/
+/*                          Block encoding                                 */
+/***************************************************************************/
+
+unsigned int BCBlockBytes( int format )
+{
+	return (format == BC_FORMAT_BC1 || format == BC_FORMAT_BC4) ? 8 : 16;
+}
+
+unsigned int BCImageBytes( int format, int width, int height )
+{
+	return ((width+3)/4) * ((height+3)/4) * BCBlockBytes( format );
+}
+
+GLenum BCGLFormat( int format )
+{
+	switch( format )
+	{
+	case BC_FORMAT_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case BC_FORMAT_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case BC_FORMAT_BC4: return GL_COMPRESSED_RED_RGTC1;
+	case BC_FORMAT_BC5: return GL_COMPRESSED_RG_RGTC2;
+	}
+	return GL_NONE;
+}
+
+// Copy a 4x4 block to RGBA, repeating the last row/column past the edges
+static void FetchBlock( const unsigned char *pixels, int width, int height, int comps,
+					    int bx, int by, unsigned char *block )
+{
+	for (int y=0; y<4; y++)
+	{
+		int sy = by*4+y < height ? by*4+y : height-1;
+		for (int x=0; x<4; x++)
+		{
+			int sx = bx*4+x < width ? bx*4+x : width-1;
+			const unsigned char *src = pixels + (sy*width + sx)*comps;
+			unsigned char *dst = block + (y*4 + x)*4;
+			dst[0] = src[0];
+			dst[1] = comps > 1 ? src[1] : src[0];
+			dst[2] = comps > 2 ? src[2] : src[0];
+			dst[3] = comps > 3 ? src[3] : 255;
+		}
+	}
+}
+
+static inline int Quantize565( const float *rgb )
+{
+	int r = (int)( rgb[0] * (31.0f/255.0f) + 0.5f );
+	int g = (int)( rgb[1] * (63.0f/255.0f) + 0.5f );
+	int b = (int)( rgb[2] * (31.0f/255.0f) + 0.5f );
+	r = r < 0 ? 0 : (r > 31 ? 31 : r);
+	g = g < 0 ? 0 : (g > 63 ? 63 : g);
+	b = b < 0 ? 0 : (b > 31 ? 31 : b);
+	return (r << 11) | (g << 5) | b;
+}
+
+static inline void Expand565( int c, int *rgb )
+{
+	int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+// BC1 color block:  two 565 endpoints, then a 2-bit index per pixel
+static void EncodeColorBlock( const unsigned char *block, unsigned char *out )
+{
+	// Find the block's principal axis (power iteration on the covariance)
+	float mean[3] = { 0, 0, 0 };
+	for (int i=0; i<16; i++)
+		for (int c=0; c<3; c++)
+			mean[c] += block[4*i+c];
+	for (int c=0; c<3; c++) mean[c] *= 1.0f/16.0f;
+
+	float cov[6] = { 0, 0, 0, 0, 0, 0 };
+	for (int i=0; i<16; i++)
+	{
+		float r = block[4*i]-mean[0], g = block[4*i+1]-mean[1], b = block[4*i+2]-mean[2];
+		cov[0] += r*r; cov[1] += r*g; cov[2] += r*b;
+		cov[3] += g*g; cov[4] += g*b; cov[5] += b*b;
+	}
+
+	float axis[3] = { 1, 1, 1 };
+	for (int iter=0; iter<4; iter++)
+	{
+		float x = cov[0]*axis[0] + cov[1]*axis[1] + cov[2]*axis[2];
+		float y = cov[1]*axis[0] + cov[3]*axis[1] + cov[4]*axis[2];
+		float z = cov[2]*axis[0] + cov[4]*axis[1] + cov[5]*axis[2];
+		float m = fabs(x) > fabs(y) ? fabs(x) : fabs(y);
+		if (fabs(z) > m) m = fabs(z);
+		if (m < 1e-6f) break;          // Flat block.  Any axis will do.
+		axis[0] = x/m; axis[1] = y/m; axis[2] = z/m;
+	}
+
+	// The pixels furthest along the axis in each direction are the endpoints
+	int minIdx = 0, maxIdx = 0;
+	float minT = 1e30f, maxT = -1e30f;
+	for (int i=0; i<16; i++)
+	{
+		float t = block[4*i]*axis[0] + block[4*i+1]*axis[1] + block[4*i+2]*axis[2];
+		if (t < minT) { minT = t; minIdx = i; }
+		if (t > maxT) { maxT = t; maxIdx = i; }
+	}
+
+	// Pull them in a bit, since the extremes are rarely worth representing exactly
+	float hi[3], lo[3];
+	for (int c=0; c<3; c++)
+	{
+		float inset = ( block[4*maxIdx+c] - block[4*minIdx+c] ) / 16.0f;
+		hi[c] = block[4*maxIdx+c] - inset;
+		lo[c] = block[4*minIdx+c] + inset;
+	}
+	int c0 = Quantize565( hi ), c1 = Quantize565( lo );
+
+	// c0 > c1 selects the 4-color (non punch-through) mode
+	if (c0 < c1) { int tmp = c0; c0 = c1; c1 = tmp; }
+	out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+	out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+	unsigned int indices = 0;
+	if (c0 != c1)
+	{
+		int palette[4][3];
+		Expand565( c0, palette[0] );
+		Expand565( c1, palette[1] );
+		for (int c=0; c<3; c++)
+		{
+			palette[2][c] = (2*palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2*palette[1][c]) / 3;
+		}
+		for (int i=0; i<16; i++)
+		{
+			int best = 0, bestDist = 0x7FFFFFFF;
+			for (int p=0; p<4; p++)
+			{
+				int dr = block[4*i]-palette[p][0], dg = block[4*i+1]-palette[p][1], db = block[4*i+2]-palette[p][2];
+				int dist = dr*dr + dg*dg + db*db;
+				if (dist < bestDist) { bestDist = dist; best = p; }
+			}
+			indices |= best << (2*i);
+		}
+	}
+	out[4] = indices & 0xFF;         out[5] = (indices >> 8) & 0xFF;
+	out[6] = (indices >> 16) & 0xFF; out[7] = indices >> 24;
+}
+
+// BC4 single channel block (also the alpha half of BC3):  two 8-bit
+//    endpoints, then a 3-bit index per pixel.  'values' has a stride of 4.
+static void EncodeSingleChannelBlock( const unsigned char *values, unsigned char *out )
+{
+	int hi = 0, lo = 255;
+	for (int i=0; i<16; i++)
+	{
+		if (values[4*i] > hi) hi = values[4*i];
+		if (values[4*i] < lo) lo = values[4*i];
+	}
+
+	// hi > lo selects the 8-value mode:  index 0 is hi, 1 is lo, and 2-7
+	//    step from hi to lo in sevenths.
+	out[0] = hi;
+	out[1] = lo;
+	unsigned long long indices = 0;
+	if (hi > lo)
+	{
+		int range = hi - lo;
+		for (int i=0; i<16; i++)
+		{
+			int t = ( (values[4*i] - lo)*14 + range ) / (2*range);   // Round to 0..7
+			int idx = (t == 7) ? 0 : (t == 0 ? 1 : 8-t);
+			indices |= ((unsigned long long)idx) << (3*i);
+		}
+	}
+	for (int i=0; i<6; i++)
+		out[2+i] = (unsigned char)( (indices >> (8*i)) & 0xFF );
+}
+
+static void EncodeBlock( int format, const unsigned char *block, unsigned char *out )
+{
+	switch( format )
+	{
+	case BC_FORMAT_BC1:
+		EncodeColorBlock( block, out );
+		break;
+	case BC_FORMAT_BC3:
+		EncodeSingleChannelBlock( block+3, out );
+		EncodeColorBlock( block, out+8 );
+		break;
+	case BC_FORMAT_BC4:
+		EncodeSingleChannelBlock( block, out );
+		break;
+	case BC_FORMAT_BC5:
+		EncodeSingleChannelBlock( block, out );
+		EncodeSingleChannelBlock( block+1, out+8 );
+		break;
+	}
+}
+
+// What each thread needs to compress its rows of blocks
+typedef struct
+{
+	int format, width, height, components;
+	const unsigned char *pixels;
+	unsigned char *out;
+} BCCompressJob;
+
+static void CompressBlockRows( int firstRow, int lastRow, void *data )
+{
+	BCCompressJob *job = (BCCompressJob *)data;
+	int blocksWide = (job->width+3)/4;
+	unsigned int blockBytes = BCBlockBytes( job->format );
+	unsigned char block[64];
+	for (int by=firstRow; by < lastRow; by++)
+	{
+		unsigned char *out = job->out + by*blocksWide*blockBytes;
+		for (int bx=0; bx < blocksWide; bx++, out += blockBytes)
+		{
+			FetchBlock( job->pixels, job->width, job->height, job->components, bx, by, block );
+			EncodeBlock( job->format, block, out );
+		}
+	}
+}
+
+void BCCompressImage( int format, const unsigned char *pixels, int width, int height,
+					  int components, unsigned char *out )
+{
+	BCCompressJob job;
+	job.format = format;
+	job.width = width;
+	job.height = height;
+	job.components = components;
+	job.pixels = pixels;
+	job.out = out;
+
+	// Small images aren't worth starting threads for
+	ParallelFor( (height+3)/4, CompressBlockRows, &job, 16 );
+}
+
+/***************************************************************************/
+/*                       Compressed mipmap chains                          */
+/***************************************************************************/
+
+BCTexture::BCTexture( int format ) : format(format)
+{
+}
+
+BCTexture::~BCTexture()
+{
+	for (unsigned int i=0; i < levelData.Size(); i++)
+		free( levelData[i] );
+}
+
+void BCTexture::AddLevel( int width, int height, unsigned int numBytes, unsigned char *data )
+{
+	levelWidth.Add( width );
+	levelHeight.Add( height );
+	levelBytes.Add( numBytes );
+	levelData.Add( data );
+}
+
+void BCTexture::Upload( GLenum target )
+{
+	GLenum glFormat = BCGLFormat( format );
+	for (unsigned int i=0; i < levelData.Size(); i++)
+		glCompressedTexImage2D( target, i, glFormat, levelWidth[i], levelHeight[i], 0,
+								levelBytes[i], levelData[i] );
+	glTexParameteri( target, GL_TEXTURE_MAX_LEVEL, levelData.Size()-1 );
+}
+
+
+/***************************************************************************/
+/*                            The disk cache                               */
+/***************************************************************************/
+
+CompressedTextureCache::CompressedTextureCache() :
+	enabled(true), createdDirectory(false), encoded(0), loaded(0), stored(0), encodeSeconds(0)
+{
+	directory = strdup( "textureCache/" );
+}
+
+CompressedTextureCache::~CompressedTextureCache()
+{
+	free( directory );
+}
+
+void CompressedTextureCache::SetDirectory( char *dir )
+{
+	free( directory );
+	directory = strdup( dir );
+	createdDirectory = false;
+}
+
+void CompressedTextureCache::CacheFilename( char *buf, unsigned long long key )
+{
+	sprintf( buf, "%s%08x%08x.bctex", directory,
+		     (unsigned int)(key >> 32), (unsigned int)(key & 0xFFFFFFFF) );
+}
+
+BCTexture *CompressedTextureCache::Encode( int format, const unsigned char *pixels, int width, int height,
+										   int components, bool mipmaps, unsigned int mipFlags )
+{
+	TimerStruct start, end;
+	GetHighResolutionTime( &start );
+
+	BCTexture *tex = new BCTexture( format );
+	MipmapChain *chain = mipmaps ? GenerateMipmaps( pixels, width, height, components, mipFlags ) :
+		                           new MipmapChain( pixels, width, height, components );
+	for (unsigned int i=0; i < chain->GetNumLevels(); i++)
+	{
+		int w = chain->GetLevelWidth( i ), h = chain->GetLevelHeight( i );
+		unsigned int numBytes = BCImageBytes( format, w, h );
+		unsigned char *data = (unsigned char *)malloc( numBytes );
+		BCCompressImage( format, chain->GetLevelData( i ), w, h, components, data );
+		tex->AddLevel( w, h, numBytes, data );
+	}
+	delete chain;
+
+	GetHighResolutionTime( &end );
+	statsLock.Lock();
+	encodeSeconds += ConvertTimeDifferenceToSec( &end, &start );
+	encoded++;
+	statsLock.Unlock();
+	return tex;
+}
+
+BCTexture *CompressedTextureCache::Load( unsigned long long key, int format )
+{
+	char filename[1024];
+	CacheFilename( filename, key );
+	FILE *f = fopen( filename, "rb" );
+	if (!f) return 0;
+
+	BCCacheHeader hdr;
+	if ( fread( &hdr, sizeof( hdr ), 1, f ) != 1 || strncmp( hdr.magic, "BCTX", 4 ) ||
+		 hdr.version != BC_CACHE_FILE_VERSION || hdr.key != key || hdr.format != format ||
+		 hdr.numLevels == 0 )
+	{
+		fclose( f );
+		return 0;
+	}
+
+	BCTexture *tex = new BCTexture( format );
+	for (unsigned int i=0; i < hdr.numLevels; i++)
+	{
+		unsigned int lvl[3];
+		if (fread( lvl, sizeof( lvl ), 1, f ) != 1 || lvl[2] != BCImageBytes( format, lvl[0], lvl[1] ))
+			break;
+		unsigned char *data = (unsigned char *)malloc( lvl[2] );
+		if (!data || fread( data, 1, lvl[2], f ) != lvl[2])
+		{
+			free( data );
+			break;
+		}
+		tex->AddLevel( lvl[0], lvl[1], lvl[2], data );
+	}
+	fclose( f );
+
+	// A truncated file is just a miss
+	if (tex->GetNumLevels() != hdr.numLevels)
+	{
+		delete tex;
+		return 0;
+	}
+	statsLock.Lock();
+	loaded++;
+	statsLock.Unlock();
+	return tex;
+}
+
+void CompressedTextureCache::Store( unsigned long long key, BCTexture *tex )
+{
+	// Textures are stored from ParallelFor() threads, so only one may make
+	//    the directory (and touch the flag) at once
+	statsLock.Lock();
+	if (!createdDirectory)
+	{
+		MakeCacheDirectory( directory );  // Fails harmlessly if it already exists
+		createdDirectory = true;
+	}
+	statsLock.Unlock();
+
+	BCCacheHeader hdr;
+	memcpy( hdr.magic, "BCTX", 4 );
+	hdr.version = BC_CACHE_FILE_VERSION;
+	hdr.key = key;
+	hdr.format = tex->GetFormat();
+	hdr.numLevels = tex->GetNumLevels();
+
+	// Failing to write the cache is not worth complaining about; we'll
+	//    just compress this texture again next time.
+	char filename[1024];
+	CacheFilename( filename, key );
+	FILE *f = fopen( filename, "wb" );
+	if (!f) return;
+	bool ok = fwrite( &hdr, sizeof( hdr ), 1, f ) == 1;
+	for (unsigned int i=0; ok && i < tex->GetNumLevels(); i++)
+	{
+		unsigned int lvl[3] = { (unsigned int)tex->GetLevelWidth(i), (unsigned int)tex->GetLevelHeight(i),
+			                    tex->GetLevelBytes(i) };
+		ok = fwrite( lvl, sizeof( lvl ), 1, f ) == 1 &&
+			 fwrite( tex->GetLevelData(i), 1, lvl[2], f ) == lvl[2];
+	}
+	fclose( f );
+	if (!ok) remove( filename );
+	statsLock.Lock();
+	if (ok) stored++;
+	statsLock.Unlock();
+}
+
+BCTexture *CompressedTextureCache::GetCompressed( int format, const unsigned char *pixels, int width, int height,
+												  int components, bool mipmaps, unsigned int mipFlags )
+{
+	if (!enabled)
+		return Encode( format, pixels, width, height, components, mipmaps, mipFlags );
+
+	// Hashing the pixels is far cheaper than compressing them
+	int params[8] = { BC_ENCODER_VERSION, format, width, height, components, 
+		              mipmaps ? 1 : 0, (int)mipFlags, MIPMAP_GENERATOR_VERSION };
+	unsigned long long key = ProgramBinaryCache::Hash( PROGRAM_CACHE_HASH_INIT, params, sizeof( params ) );
+	key = ProgramBinaryCache::Hash( key, pixels, width*height*components );
+
+	BCTexture *tex = Load( key, format );
+	if (tex) return tex;
+	tex = Encode( format, pixels, width, height, components, mipmaps, mipFlags );
+	Store( key, tex );
+	return tex;
+}
+
+void CompressedTextureCache::PrintStats( FILE *f )
+{
+	fprintf( f, "Compressed textures: %u encoded (%.2f ms), %u loaded from disk, %u stored\n",
+		     encoded, 1000.0*encodeSeconds, loaded, stored );
+}
+
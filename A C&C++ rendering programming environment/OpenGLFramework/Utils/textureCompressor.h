@@ -0,0 +1,131 @@
+/***************************************************************************/
+/* textureCompressor.h                                                     */
+/* ------------                                                            */
+/*                                                                         */
+/* A CPU encoder for the BC1 (DXT1), BC3 (DXT5), BC4, and BC5 block        */
+/*     compressed texture formats, plus an on-disk cache of its results.   */
+/*                                                                         */
+/* Handing uncompressed data to glTexImage2D() with a compressed internal  */
+/*     format makes the driver compress the image (and every mipmap) on    */
+/*     each load, with vendor-dependent quality.  Instead, GLTexture asks  */
+/*     the cache for a compressed mipmap chain and uploads it directly     */
+/*     with glCompressedTexImage2D().                                      */
+/*                                                                         */
+/* The encoder fits each 4x4 block's endpoints along its principal color   */
+/*     axis.  Block rows are split across threads (see parallelFor.h).     */
+/*     Mipmaps come from mipmapGenerator.h.  The cache may be used from    */
+/*     several threads at once.                                            */
+/*                                                                         */
+/* Compressed chains are stored in one file each, in a cache directory     */
+/*     ("textureCache/" by default), named by a hash of the source pixels, */
+/*     image size, format, and encoder version.  Deleting the directory is */
+/*     always safe.                                                        */
+/***************************************************************************/
+
+#ifndef __TEXTURECOMPRESSOR_H
+#define __TEXTURECOMPRESSOR_H
+
+#include <stdio.h>
+#include <GL/glew.h>
+#include <GL/glut.h>
+#include "DataTypes/Array1D.h"
+#include "parallelFor.h"
+#include "mipmapGenerator.h"
+
+// Block compressed formats the encoder produces
+#define BC_FORMAT_BC1     1   // RGB,  8 bytes per 4x4 block  (DXT1)
+#define BC_FORMAT_BC3     3   // RGBA, 16 bytes per 4x4 block (DXT5)
+#define BC_FORMAT_BC4     4   // R,    8 bytes per 4x4 block  (RGTC1)
+#define BC_FORMAT_BC5     5   // RG,   16 bytes per 4x4 block (RGTC2)
+
+// Bump this when the encoder's output changes, so cached files are redone
+#define BC_ENCODER_VERSION  2
+
+// Bytes in one 4x4 block, and in a whole w x h image, of a given format
+unsigned int BCBlockBytes( int format );
+unsigned int BCImageBytes( int format, int width, int height );
+
+// The GL internal format to upload a given format with
+GLenum BCGLFormat( int format );
+
+// Compress an image with 'components' unsigned chars per pixel (1-4) into
+//    'out', which must hold BCImageBytes() bytes.  Missing channels are
+//    treated as gray (for 1 component) and opaque.
+void BCCompressImage( int format, const unsigned char *pixels, int width, int height,
+					  int components, unsigned char *out );
+
+
+// A chain of compressed mipmap levels, ready to upload
+class BCTexture
+{
+public:
+	BCTexture( int format );
+	~BCTexture();
+
+	inline int GetFormat( void ) const                     { return format; }
+	inline unsigned int GetNumLevels( void ) const         { return levelData.Size(); }
+	inline int GetLevelWidth( unsigned int lvl )           { return levelWidth[lvl]; }
+	inline int GetLevelHeight( unsigned int lvl )          { return levelHeight[lvl]; }
+	inline unsigned int GetLevelBytes( unsigned int lvl )  { return levelBytes[lvl]; }
+	inline unsigned char *GetLevelData( unsigned int lvl ) { return levelData[lvl]; }
+
+	// Add a level (we take ownership of the malloc()'d data)
+	void AddLevel( int width, int height, unsigned int numBytes, unsigned char *data );
+
+	// glCompressedTexImage2D() each level into the currently bound texture
+	void Upload( GLenum target );
+
+private:
+	int format;
+	Array1D< int > levelWidth, levelHeight;
+	Array1D< unsigned int > levelBytes;
+	Array1D< unsigned char * > levelData;
+};
+
+
+class CompressedTextureCache
+{
+public:
+	CompressedTextureCache();
+	~CompressedTextureCache();
+
+	// Where cache files live.  The directory is created when first needed.
+	void SetDirectory( char *dir );
+	inline char *GetDirectory( void )           { return directory; }
+
+	// Reading and writing the disk cache is on by default.  When disabled,
+	//    images are still compressed, just not saved.
+	inline void Enable( void )                  { enabled = true; }
+	inline void Disable( void )                 { enabled = false; }
+	inline bool IsEnabled( void ) const         { return enabled; }
+
+	// Get a compressed version of the image (and all its mipmaps, if
+	//    requested, built with the MIPMAP_* flags), from disk if possible.
+	//    The caller deletes the result.
+	BCTexture *GetCompressed( int format, const unsigned char *pixels, int width, int height,
+							  int components, bool mipmaps, unsigned int mipFlags=MIPMAP_DEFAULT );
+
+	// Statistics
+	inline unsigned int GetEncodeCount( void ) const  { return encoded; }
+	inline unsigned int GetLoadCount( void ) const    { return loaded; }
+	void PrintStats( FILE *f );
+
+private:
+	char *directory;
+	bool enabled, createdDirectory;
+	unsigned int encoded, loaded, stored;
+	double encodeSeconds;
+	ParallelMutex statsLock;        // Guards the statistics and createdDirectory
+
+	BCTexture *Encode( int format, const unsigned char *pixels, int width, int height,
+					   int components, bool mipmaps, unsigned int mipFlags );
+	BCTexture *Load( unsigned long long key, int format );
+	void Store( unsigned long long key, BCTexture *tex );
+	void CacheFilename( char *buf, unsigned long long key );
+};
+
+// The single cache used by all GLTextures
+extern CompressedTextureCache compressedTextures;
+
+#endif
+
@@ -0,0 +1,390 @@
+/***************************************************************************/
+/* textureContainer.cpp                                                    */
+/* ------------                                                            */
+/*                                                                         */
+/* Implements KTX file reading and writing.  See the header for usage.     */
+/*                                                                         */
+/* A KTX 1.1 file is a 64 byte header, key/value data (which we skip, and  */
+/*     never write), then for each mip level a 4 byte size followed by     */
+/*     the level's data, padded to 4 bytes.  Uncompressed rows are also    */
+/*     padded to 4 bytes (OpenGL's default GL_UNPACK_ALIGNMENT).           */
+/***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "textureContainer.h"
+#include "textureCompressor.h"
+#include "mipmapGenerator.h"
+#include "DataTypes/glTexture.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#pragma warning( disable: 4996 )
+
+static const unsigned char ktxIdentifier[12] =
+	{ 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+#define KTX_ENDIANNESS   0x04030201
+
+typedef struct {
+	unsigned char identifier[12];
+	unsigned int endianness;
+	unsigned int glType, glTypeSize, glFormat, glInternalFormat, glBaseInternalFormat;
+	unsigned int pixelWidth, pixelHeight, pixelDepth;
+	unsigned int numberOfArrayElements, numberOfFaces, numberOfMipmapLevels;
+	unsigned int bytesOfKeyValueData;
+} KTXHeader;
+
+// Bytes per pixel of uncompressed data, or 0 if we don't know the format
+static int KTXPixelBytes( GLenum type, GLenum format )
+{
+	int components = 0;
+	if (format == GL_RED || format == GL_ALPHA || format == GL_LUMINANCE) components = 1;
+	else if (format == GL_RG || format == GL_LUMINANCE_ALPHA)             components = 2;
+	else if (format == GL_RGB || format == GL_BGR)                        components = 3;
+	else if (format == GL_RGBA || format == GL_BGRA)                      components = 4;
+	if (type == GL_UNSIGNED_INT_5_9_9_9_REV_EXT) return (components == 3 ? 4 : 0);
+	if (type == GL_UNSIGNED_BYTE)                return components;
+	if (type == GL_HALF_FLOAT_ARB)               return 2*components;
+	if (type == GL_FLOAT)                        return 4*components;
+	return 0;
+}
+
+static inline unsigned int PadTo4( unsigned int bytes )
+{
+	return (bytes + 3) & ~3u;
+}
+
+
+TextureContainer::TextureContainer() : mapping(0), fileBytes(0), fileHandle(0), mapHandle(0),
+	glType(0), glFormat(0), glInternalFormat(0), glBaseInternalFormat(0)
+{
+}
+
+TextureContainer::~TextureContainer()
+{
+	Close();
+}
+
+void TextureContainer::Close( void )
+{
+#ifdef _WIN32
+	if (mapping)    UnmapViewOfFile( (LPCVOID)mapping );
+	if (mapHandle)  CloseHandle( (HANDLE)mapHandle );
+	if (fileHandle) CloseHandle( (HANDLE)fileHandle );
+#else
+	if (mapping)    munmap( (void *)mapping, fileBytes );
+#endif
+	mapping = 0;
+	mapHandle = fileHandle = 0;
+	fileBytes = 0;
+	levelWidth.Clear();
+	levelHeight.Clear();
+	levelBytes.Clear();
+	levelOffset.Clear();
+}
+
+bool TextureContainer::Open( char *filename )
+{
+	Close();
+
+	// Map the whole file, read-only
+#ifdef _WIN32
+	HANDLE file = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+		                       FILE_ATTRIBUTE_NORMAL, 0 );
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		printf("Error in TextureContainer::Open(): Unable to open '%s'!\n", filename );
+		return false;
+	}
+	fileHandle = (void *)file;
+	LARGE_INTEGER size;
+	GetFileSizeEx( file, &size );
+	fileBytes = (size_t)size.QuadPart;
+	if (fileBytes > 0)
+	{
+		mapHandle = (void *)CreateFileMappingA( file, 0, PAGE_READONLY, 0, 0, 0 );
+		if (mapHandle) mapping = (const unsigned char *)MapViewOfFile( (HANDLE)mapHandle, FILE_MAP_READ, 0, 0, 0 );
+	}
+#else
+	int fd = open( filename, O_RDONLY );
+	if (fd < 0)
+	{
+		printf("Error in TextureContainer::Open(): Unable to open '%s'!\n", filename );
+		return false;
+	}
+	struct stat info;
+	fstat( fd, &info );
+	fileBytes = (size_t)info.st_size;
+	if (fileBytes > 0)
+	{
+		void *ptr = mmap( 0, fileBytes, PROT_READ, MAP_PRIVATE, fd, 0 );
+		if (ptr != MAP_FAILED) mapping = (const unsigned char *)ptr;
+	}
+	close( fd );
+#endif
+	if (!mapping)
+	{
+		printf("Error in TextureContainer::Open(): Unable to map '%s'!\n", filename );
+		Close();
+		return false;
+	}
+
+	// Check the header
+	KTXHeader hdr;
+	if (fileBytes < sizeof(KTXHeader))
+	{
+		printf("Error in TextureContainer::Open(): '%s' is too short to be a KTX file!\n", filename );
+		Close();
+		return false;
+	}
+	memcpy( &hdr, mapping, sizeof(KTXHeader) );
+	if (memcmp( hdr.identifier, ktxIdentifier, 12 ))
+	{
+		printf("Error in TextureContainer::Open(): '%s' is not a KTX file!\n", filename );
+		Close();
+		return false;
+	}
+	if (hdr.endianness != KTX_ENDIANNESS)
+	{
+		printf("Error in TextureContainer::Open(): '%s' has the wrong byte order!\n", filename );
+		Close();
+		return false;
+	}
+	if (hdr.pixelWidth < 1 || hdr.pixelHeight < 1 || hdr.pixelDepth > 0 ||
+		hdr.numberOfArrayElements > 0 || hdr.numberOfFaces != 1 || hdr.numberOfMipmapLevels > 32)
+	{
+		printf("Error in TextureContainer::Open(): '%s' is not a 2D texture!\n", filename );
+		Close();
+		return false;
+	}
+	int pixelBytes = hdr.glType ? KTXPixelBytes( hdr.glType, hdr.glFormat ) : 0;
+	if (hdr.glType && !pixelBytes)
+	{
+		printf("Error in TextureContainer::Open(): '%s' has an unsupported format!\n", filename );
+		Close();
+		return false;
+	}
+	glType               = hdr.glType;
+	glFormat             = hdr.glFormat;
+	glInternalFormat     = hdr.glInternalFormat;
+	glBaseInternalFormat = hdr.glBaseInternalFormat;
+
+	// Find the levels.  (0 levels means "generate the mipmaps", we just
+	//    store the one level in that case.)
+	unsigned int numLevels = hdr.numberOfMipmapLevels ? hdr.numberOfMipmapLevels : 1;
+	size_t offset = sizeof(KTXHeader) + hdr.bytesOfKeyValueData;
+	for (unsigned int lvl=0; lvl < numLevels; lvl++)
+	{
+		int w = (hdr.pixelWidth >> lvl) > 0 ? (hdr.pixelWidth >> lvl) : 1;
+		int h = (hdr.pixelHeight >> lvl) > 0 ? (hdr.pixelHeight >> lvl) : 1;
+		unsigned int imageSize = 0;
+		if (offset + 4 <= fileBytes) memcpy( &imageSize, mapping + offset, 4 );
+		offset += 4;
+		if (offset > fileBytes || imageSize > fileBytes - offset ||
+			(pixelBytes && imageSize < PadTo4( w*pixelBytes ) * h))
+		{
+			printf("Error in TextureContainer::Open(): '%s' is truncated or corrupt!\n", filename );
+			Close();
+			return false;
+		}
+		levelWidth.Add( w );
+		levelHeight.Add( h );
+		levelBytes.Add( imageSize );
+		levelOffset.Add( offset );
+		offset += PadTo4( imageSize );
+	}
+	return true;
+}
+
+// Touch one byte per page, so the OS reads the file in now
+void TextureContainer::Touch( void )
+{
+	volatile unsigned char sum = 0;
+	for (size_t i=0; i < fileBytes; i += 4096)
+		sum += mapping[i];
+}
+
+void TextureContainer::Upload( GLenum target )
+{
+	if (!mapping) return;
+	for (unsigned int lvl=0; lvl < GetNumLevels(); lvl++)
+		if (IsCompressed())
+			glCompressedTexImage2D( target, lvl, glInternalFormat, levelWidth[lvl], levelHeight[lvl], 0,
+				                    levelBytes[lvl], GetLevelData( lvl ) );
+		else
+			glTexImage2D( target, lvl, glInternalFormat, levelWidth[lvl], levelHeight[lvl], 0,
+				          glFormat, glType, GetLevelData( lvl ) );
+	glTexParameteri( target, GL_TEXTURE_MAX_LEVEL, GetNumLevels()-1 );
+}
+
+
+// One level to write.  Compressed levels give their size in 'bytes',
+//    uncompressed ones give their (unpadded) row size in 'rowBytes'.
+typedef struct {
+	int width, height;
+	const unsigned char *data;
+	unsigned int bytes, rowBytes;
+} KTXLevel;
+
+static bool WriteKTX( char *filename, GLenum type, unsigned int typeSize, GLenum format,
+					  GLenum internalFormat, GLenum baseFormat, KTXLevel *levels, int numLevels )
+{
+	FILE *f = fopen( filename, "wb" );
+	if (!f)
+	{
+		printf("Error in WriteTextureContainer(): Unable to write '%s'!\n", filename );
+		return false;
+	}
+
+	KTXHeader hdr;
+	memcpy( hdr.identifier, ktxIdentifier, 12 );
+	hdr.endianness            = KTX_ENDIANNESS;
+	hdr.glType                = type;
+	hdr.glTypeSize            = typeSize;
+	hdr.glFormat              = format;
+	hdr.glInternalFormat      = internalFormat;
+	hdr.glBaseInternalFormat  = baseFormat;
+	hdr.pixelWidth            = levels[0].width;
+	hdr.pixelHeight           = levels[0].height;
+	hdr.pixelDepth            = 0;
+	hdr.numberOfArrayElements = 0;
+	hdr.numberOfFaces         = 1;
+	hdr.numberOfMipmapLevels  = numLevels;
+	hdr.bytesOfKeyValueData   = 0;
+	bool ok = fwrite( &hdr, sizeof(KTXHeader), 1, f ) == 1;
+
+	unsigned char zeros[4] = { 0, 0, 0, 0 };
+	for (int lvl=0; ok && lvl < numLevels; lvl++)
+	{
+		KTXLevel *l = &levels[lvl];
+		unsigned int rowPadded = PadTo4( l->rowBytes );
+		unsigned int imageSize = l->rowBytes ? rowPadded * l->height : l->bytes;
+		ok = fwrite( &imageSize, 4, 1, f ) == 1;
+		if (!l->rowBytes)
+			ok = ok && fwrite( l->data, 1, imageSize, f ) == imageSize;
+		else
+			for (int y=0; ok && y < l->height; y++)
+				ok = fwrite( l->data + (size_t)y * l->rowBytes, 1, l->rowBytes, f ) == l->rowBytes &&
+					 fwrite( zeros, 1, rowPadded - l->rowBytes, f ) == rowPadded - l->rowBytes;
+		unsigned int pad = PadTo4( imageSize ) - imageSize;
+		ok = ok && fwrite( zeros, 1, pad, f ) == pad;
+	}
+
+	if (fclose( f ) || !ok)
+	{
+		printf("Error in WriteTextureContainer(): Unable to write '%s'!\n", filename );
+		remove( filename );
+		return false;
+	}
+	return true;
+}
+
+bool WriteTextureContainer( char *filename, BCTexture *tex )
+{
+	KTXLevel *levels = (KTXLevel *)malloc( tex->GetNumLevels() * sizeof(KTXLevel) );
+	for (unsigned int i=0; i < tex->GetNumLevels(); i++)
+	{
+		levels[i].width    = tex->GetLevelWidth(i);
+		levels[i].height   = tex->GetLevelHeight(i);
+		levels[i].data     = tex->GetLevelData(i);
+		levels[i].bytes    = tex->GetLevelBytes(i);
+		levels[i].rowBytes = 0;
+	}
+	GLenum baseFormat = GL_RGBA;
+	if (tex->GetFormat() == BC_FORMAT_BC1)      baseFormat = GL_RGB;
+	else if (tex->GetFormat() == BC_FORMAT_BC4) baseFormat = GL_RED;
+	else if (tex->GetFormat() == BC_FORMAT_BC5) baseFormat = GL_RG;
+	bool ok = WriteKTX( filename, 0, 1, 0, BCGLFormat( tex->GetFormat() ), baseFormat,
+		                levels, tex->GetNumLevels() );
+	free( levels );
+	return ok;
+}
+
+bool WriteTextureContainer( char *filename, MipmapChain *mips, GLenum format )
+{
+	KTXLevel *levels = (KTXLevel *)malloc( mips->GetNumLevels() * sizeof(KTXLevel) );
+	for (unsigned int i=0; i < mips->GetNumLevels(); i++)
+	{
+		levels[i].width    = mips->GetLevelWidth(i);
+		levels[i].height   = mips->GetLevelHeight(i);
+		levels[i].data     = mips->GetLevelData(i);
+		levels[i].bytes    = 0;
+		levels[i].rowBytes = mips->GetLevelWidth(i) * mips->GetComponents();
+	}
+	bool ok = WriteKTX( filename, GL_UNSIGNED_BYTE, 1, format, format, format,
+		                levels, mips->GetNumLevels() );
+	free( levels );
+	return ok;
+}
+
+bool WriteTextureContainer( char *filename, int width, int height, GLenum type, GLenum format,
+						    GLenum internalFormat, const void *data )
+{
+	int pixelBytes = KTXPixelBytes( type, format );
+	if (!pixelBytes)
+	{
+		printf("Error in WriteTextureContainer(): Unsupported format for '%s'!\n", filename );
+		return false;
+	}
+	KTXLevel level;
+	level.width    = width;
+	level.height   = height;
+	level.data     = (const unsigned char *)data;
+	level.bytes    = 0;
+	level.rowBytes = width * pixelBytes;
+	unsigned int typeSize = (type == GL_HALF_FLOAT_ARB ? 2 : (type == GL_UNSIGNED_BYTE ? 1 : 4));
+	return WriteKTX( filename, type, typeSize, format, internalFormat, format, &level, 1 );
+}
+
+
+bool ConvertToTextureContainer( char *imageFile, char *ktxFile, unsigned int flags )
+{
+	// Let GLTexture read the image (but not upload it)
+	GLTexture tex( imageFile, flags | TEXTURE_STREAM, true );
+	const unsigned char *pixels = (const unsigned char *)tex.GetImageData();
+	if (!pixels)
+	{
+		printf("Error in ConvertToTextureContainer(): Unable to read an image from '%s'!\n", imageFile );
+		return false;
+	}
+
+	int width = tex.GetWidth(), height = tex.GetHeight();
+	bool ok;
+	if (tex.GetPixelStorage() != GL_UNSIGNED_BYTE)
+	{
+		// HDR data, already in the format GLTexture would upload
+		ok = WriteTextureContainer( ktxFile, width, height, tex.GetPixelStorage(), tex.GetPixelFormat(),
+			                        tex.GetInternalFormat(), pixels );
+	}
+	else
+	{
+		// (3 or 4 bytes per pixel, as GLTexture decoded it)
+		int components = (tex.GetPixelFormat() == GL_RGBA ? 4 : 3);
+		if (GLEW_EXT_texture_compression_s3tc)
+		{
+			BCTexture *bc = compressedTextures.GetCompressed( (components==3 ? BC_FORMAT_BC1 : BC_FORMAT_BC3),
+				                                              pixels, width, height, components,
+															  tex.UsesMipmaps(), tex.GetMipFlags() );
+			ok = WriteTextureContainer( ktxFile, bc );
+			delete bc;
+		}
+		else
+		{
+			MipmapChain *mips = tex.UsesMipmaps() ?
+				GenerateMipmaps( pixels, width, height, components, tex.GetMipFlags() ) :
+				new MipmapChain( pixels, width, height, components );
+			ok = WriteTextureContainer( ktxFile, mips, (components==3 ? GL_RGB : GL_RGBA) );
+			delete mips;
+		}
+	}
+	return ok;
+}
+
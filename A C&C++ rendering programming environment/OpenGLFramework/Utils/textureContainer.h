@@ -0,0 +1,94 @@
+/***************************************************************************/
+/* textureContainer.h                                                      */
+/* ------------                                                            */
+/*                                                                         */
+/* Reads and writes KTX (version 1.1) files:  textures stored exactly as   */
+/*     they are handed to OpenGL, with all their mipmaps, already block    */
+/*     compressed or converted.  Loading one does no image processing at  */
+/*     all, so it takes as long as reading the file.                       */
+/*                                                                         */
+/* TextureContainer memory maps the file, and uploads each level straight  */
+/*     from the mapping.  GLTexture loads ".ktx" files this way (including */
+/*     when streaming them, see Utils/textureStreamer.h).                  */
+/*                                                                         */
+/* ConvertToTextureContainer() makes a KTX file from any image GLTexture   */
+/*     can read, doing the work GLTexture would do at load time:  8-bit    */
+/*     images are block compressed (if the GL supports it) with all their  */
+/*     mipmaps, HDR images are stored in the GPU format GLTexture picks.   */
+/*     Run the program with "-convert <image> <file.ktx>" to convert.      */
+/*                                                                         */
+/* Only 2D textures (no arrays, cube maps, or 3D textures) are supported,  */
+/*     in the byte order of the machine reading them.                      */
+/***************************************************************************/
+
+#ifndef __TEXTURECONTAINER_H
+#define __TEXTURECONTAINER_H
+
+#include <stdio.h>
+#include <GL/glew.h>
+#include <GL/glut.h>
+#include "DataTypes/Array1D.h"
+
+class BCTexture;
+class MipmapChain;
+
+class TextureContainer
+{
+public:
+	TextureContainer();
+	~TextureContainer();
+
+	// Map a KTX file, and check it.  Prints what's wrong and returns false
+	//    if it can't be used.
+	bool Open( char *filename );
+	void Close( void );
+
+	// Read every page of the file, so uploads don't wait on the disk.
+	//    (Call this on another thread before uploading.)
+	void Touch( void );
+
+	inline int GetWidth( void ) const                       { return levelWidth.Size() ? levelWidth[0] : 0; }
+	inline int GetHeight( void ) const                      { return levelHeight.Size() ? levelHeight[0] : 0; }
+	inline bool IsCompressed( void ) const                  { return glType == 0; }
+	inline GLenum GetGLType( void ) const                   { return glType; }
+	inline GLenum GetGLFormat( void ) const                 { return glFormat; }
+	inline GLenum GetGLInternalFormat( void ) const         { return glInternalFormat; }
+	inline GLenum GetGLBaseInternalFormat( void ) const     { return glBaseInternalFormat; }
+	inline size_t GetFileBytes( void ) const                { return fileBytes; }
+
+	inline unsigned int GetNumLevels( void ) const          { return levelWidth.Size(); }
+	inline int GetLevelWidth( unsigned int lvl ) const      { return levelWidth[lvl]; }
+	inline int GetLevelHeight( unsigned int lvl ) const     { return levelHeight[lvl]; }
+	inline unsigned int GetLevelBytes( unsigned int lvl ) const        { return levelBytes[lvl]; }
+	inline const unsigned char *GetLevelData( unsigned int lvl ) const { return mapping + levelOffset[lvl]; }
+
+	// glTexImage2D() or glCompressedTexImage2D() every level into the
+	//    currently bound texture
+	void Upload( GLenum target );
+
+private:
+	const unsigned char *mapping;
+	size_t fileBytes;
+	void *fileHandle, *mapHandle;
+
+	GLenum glType, glFormat, glInternalFormat, glBaseInternalFormat;
+	Array1D< int > levelWidth, levelHeight;
+	Array1D< unsigned int > levelBytes;
+	Array1D< size_t > levelOffset;
+};
+
+
+// Write KTX files from a compressed mipmap chain, an 8-bit mipmap chain
+//    (with format GL_RGB or GL_RGBA), or a single uncompressed image.
+bool WriteTextureContainer( char *filename, BCTexture *tex );
+bool WriteTextureContainer( char *filename, MipmapChain *mips, GLenum format );
+bool WriteTextureContainer( char *filename, int width, int height, GLenum type, GLenum format,
+						    GLenum internalFormat, const void *data );
+
+// Convert any image GLTexture can read into a KTX file.  'flags' are the
+//    TEXTURE_* flags the texture will be used with (only the mipmap ones
+//    matter).  Needs glewInit() to have been called.
+bool ConvertToTextureContainer( char *imageFile, char *ktxFile, unsigned int flags );
+
+#endif
+
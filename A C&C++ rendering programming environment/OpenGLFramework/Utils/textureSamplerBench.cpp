@@ -0,0 +1,185 @@
+/***************************************************************************/
+/* textureSamplerBench.cpp                                                 */
+/* ------------                                                            */
+/*                                                                         */
+/* Times Texture::SampleBilinear() over the linear and tiled layouts.  See */
+/*     textureSamplerBench.h.                                              */
+/***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "DataTypes/MathDefs.h"
+#include "DataTypes/Texture.h"
+#include "textureSamplerBench.h"
+#include "HighResolutionTimer.h"
+
+// Lookups per SampleBilinear() call.  The results are written over the same
+//    small buffer each time, so only the texture's reads leave the cache.
+#define SAMPLERBENCH_CHUNK           4096
+
+#define SAMPLERBENCH_RANDOM          0
+#define SAMPLERBENCH_COHERENT        1
+#define SAMPLERBENCH_ROTATED         2
+#define SAMPLERBENCH_NUM_PATTERNS    3
+
+static const char *patternNames[SAMPLERBENCH_NUM_PATTERNS] = { "random", "coherent", "rotated" };
+
+// A repeatable random number in [0..1), so every run sees the same lookups
+static float BenchRandom( unsigned int *state )
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return (*state >> 8) * (1.0f / 16777216.0f);
+}
+
+// The (u,v) of each lookup, for one of the access patterns
+static void MakeLookups( int pattern, int width, int height, int count, float *u, float *v )
+{
+	unsigned int state = 2463534242u;
+	float cosA = (float)cos( 75.0 * M_PI / 180.0 ), sinA = (float)sin( 75.0 * M_PI / 180.0 );
+	float cx = 0.5f*width, cy = 0.5f*height;
+	float invW = 1.0f / (width-1), invH = 1.0f / (height-1);
+
+	for (int i=0; i < count; i++)
+	{
+		if (pattern == SAMPLERBENCH_RANDOM)
+		{
+			u[i] = BenchRandom( &state );
+			v[i] = BenchRandom( &state );
+			continue;
+		}
+
+		// Walk the texels row by row (turned around the center, if rotated)
+		float x = (float)(i % width), y = (float)((i / width) % height);
+		if (pattern == SAMPLERBENCH_ROTATED)
+		{
+			float dx = x - cx, dy = y - cy;
+			x = cx + dx*cosA - dy*sinA;
+			y = cy + dx*sinA + dy*cosA;
+		}
+		u[i] = x * invW;
+		v[i] = y * invH;
+	}
+}
+
+// The fastest of SAMPLERBENCH_RUNS runs over all the lookups, in seconds
+static float TimeSampler( const Texture *tex, int count, const float *u, const float *v, RGBAColor *out )
+{
+	float best = 0;
+	for (int run=0; run < SAMPLERBENCH_RUNS; run++)
+	{
+		TimerStruct start, end;
+		GetHighResolutionTime( &start );
+		for (int first=0; first < count; first += SAMPLERBENCH_CHUNK)
+		{
+			int n = (count-first < SAMPLERBENCH_CHUNK ? count-first : SAMPLERBENCH_CHUNK);
+			tex->SampleBilinear( n, u+first, v+first, out );
+		}
+		GetHighResolutionTime( &end );
+		float secs = ConvertTimeDifferenceToSec( &end, &start );
+		if (!run || secs < best) best = secs;
+	}
+	return best;
+}
+
+// Do the two textures give exactly the same results for these lookups?
+static bool SameResults( const Texture *a, const Texture *b, int count, const float *u, const float *v,
+						 RGBAColor *outA, RGBAColor *outB )
+{
+	for (int first=0; first < count; first += SAMPLERBENCH_CHUNK)
+	{
+		int n = (count-first < SAMPLERBENCH_CHUNK ? count-first : SAMPLERBENCH_CHUNK);
+		a->SampleBilinear( n, u+first, v+first, outA );
+		b->SampleBilinear( n, u+first, v+first, outB );
+		for (int i=0; i < n; i++)
+			if (outA[i].Red() != outB[i].Red() || outA[i].Green() != outB[i].Green() ||
+				outA[i].Blue() != outB[i].Blue() || outA[i].Alpha() != outB[i].Alpha())
+				return false;
+	}
+	return true;
+}
+
+bool BenchmarkTextureSampler( char *imageFile )
+{
+	// The texels:  the image, or noise
+	int width = SAMPLERBENCH_TEXTURE_SIZE, height = SAMPLERBENCH_TEXTURE_SIZE;
+	unsigned char *rgba = 0;
+	if (imageFile)
+	{
+		ImageInfo info;
+		if (!ReadImageInfo( imageFile, &info ) || info.width < 2 || info.height < 2)
+		{
+			printf("Error in BenchmarkTextureSampler(): Unable to use '%s' (missing, unreadable, or too small)!\n", imageFile );
+			return false;
+		}
+		width = info.width;
+		height = info.height;
+		rgba = (unsigned char *)malloc( (size_t)width*height*4 );
+		if (!rgba || !DecodeImage( imageFile, rgba, width*4, IMAGE_PIXELS_RGBA8 ))
+		{
+			printf("Error in BenchmarkTextureSampler(): Unable to decode '%s'!\n", imageFile );
+			free( rgba );
+			return false;
+		}
+	}
+
+	// The same texels in both layouts
+	Texture *linear = new Texture( width, height, TEXTURE_STORAGE_RGBA8 );
+	Texture *tiled  = new Texture( width, height, TEXTURE_STORAGE_RGBA8 );
+	unsigned int state = 88172645u;
+	for (int y=0; y < height; y++)
+		for (int x=0; x < width; x++)
+		{
+			RGBAColor c;
+			if (rgba)
+			{
+				unsigned char *t = rgba + 4*((size_t)y*width + x);
+				c = RGBAColor( t[0]/255.0f, t[1]/255.0f, t[2]/255.0f, t[3]/255.0f );
+			}
+			else
+				c = RGBAColor( BenchRandom( &state ), BenchRandom( &state ), BenchRandom( &state ), 1.0f );
+			linear->SetTexel( x, y, c );
+			tiled->SetTexel( x, y, c );
+		}
+	free( rgba );
+
+	tiled->SetLayout( TEXTURE_LAYOUT_TILED );
+	linear->SetWrapS( TEXTURE_REPEAT );  linear->SetWrapT( TEXTURE_REPEAT );
+	tiled->SetWrapS( TEXTURE_REPEAT );   tiled->SetWrapT( TEXTURE_REPEAT );
+
+	int count = SAMPLERBENCH_LOOKUPS;
+	float *u = (float *)malloc( count*sizeof(float) );
+	float *v = (float *)malloc( count*sizeof(float) );
+	RGBAColor *outLinear = new RGBAColor[SAMPLERBENCH_CHUNK];
+	RGBAColor *outTiled  = new RGBAColor[SAMPLERBENCH_CHUNK];
+
+	printf("    (-) Timing SampleBilinear() on a %d x %d texture, %d lookups (best of %d runs)...\n",
+		   width, height, count, SAMPLERBENCH_RUNS );
+	printf("        %-10s %12s %12s %10s\n", "pattern", "linear", "tiled", "speedup" );
+
+	bool ok = true;
+	for (int p=0; p < SAMPLERBENCH_NUM_PATTERNS; p++)
+	{
+		MakeLookups( p, width, height, count, u, v );
+		float linearSecs = TimeSampler( linear, count, u, v, outLinear );
+		float tiledSecs  = TimeSampler( tiled, count, u, v, outTiled );
+		printf("        %-10s %7.1f M/s %7.1f M/s %9.2fx\n", patternNames[p],
+			   count / (1.0e6f * linearSecs), count / (1.0e6f * tiledSecs), linearSecs / tiledSecs );
+
+		if (!SameResults( linear, tiled, count, u, v, outLinear, outTiled ))
+		{
+			printf("Error in BenchmarkTextureSampler(): Linear and tiled layouts differ for %s lookups!\n", patternNames[p] );
+			ok = false;
+		}
+	}
+
+	free( u );
+	free( v );
+	delete [] outLinear;
+	delete [] outTiled;
+	delete linear;
+	delete tiled;
+	return ok;
+}
@@ -0,0 +1,38 @@
+/***************************************************************************/
+/* textureSamplerBench.h                                                   */
+/* ------------                                                            */
+/*                                                                         */
+/* A microbenchmark for the batched CPU texture samplers (Texture.h), run  */
+/*     with "sceneLoader -benchsampler [image]".  It times SampleBilinear() */
+/*     over the same texture stored in the linear and the tiled (Morton)   */
+/*     layouts, for three access patterns:                                 */
+/*        random    lookups scattered over the whole texture               */
+/*        coherent  lookups walking along rows, one texel apart (the best  */
+/*                  case for the linear layout)                            */
+/*        rotated   the same walk, turned 75 degrees, so each step moves   */
+/*                  mostly down a column                                   */
+/*     Each is run a few times and the fastest run reported, in millions   */
+/*     of lookups per second, along with the tiled layout's speedup.  The  */
+/*     two layouts must also give identical results, or this fails.        */
+/*                                                                         */
+/* Without an image, a 2048 x 2048 RGBA8 texture of noise is used, which   */
+/*     is far bigger than the CPU's caches.  Needs no OpenGL context.      */
+/***************************************************************************/
+
+#ifndef __TEXTURESAMPLERBENCH_H
+#define __TEXTURESAMPLERBENCH_H
+
+// Size of the texture used when no image is given
+#define SAMPLERBENCH_TEXTURE_SIZE    2048
+
+// Lookups per run, and runs per pattern and layout (the fastest counts)
+#define SAMPLERBENCH_LOOKUPS         (1 << 22)
+#define SAMPLERBENCH_RUNS            3
+
+// Time the samplers over 'imageFile' (any format DecodeImage() reads), or,
+//    if it's NULL, over a generated texture.  Prints the results, and
+//    returns false if the image couldn't be used or the layouts disagreed.
+bool BenchmarkTextureSampler( char *imageFile=0 );
+
+
+#endif
@@ -0,0 +1,167 @@
+/***************************************************************************/
+/* textureStreamer.cpp                                                     */
+/* ------------                                                            */
+/*                                                                         */
+/* Implements background loading and incremental upload of textures.      */
+/*     See the header for usage notes.                                     */
+/***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "textureStreamer.h"
+#include "glStateCache.h"
+#include "DataTypes/glTexture.h"
+
+#pragma warning( disable: 4996 )
+
+
+TextureStreamer::TextureStreamer( size_t bytesPerFrame ) :
+	numDone(0), reportedDone(false), bytesPerFrame(bytesPerFrame), bytesUploaded(0),
+	pbo(0), seconds(0), decoder(0)
+{
+	decoder = new ParallelWorker( DecodeStep, this );
+	if (GLEW_ARB_pixel_buffer_object)
+		glGenBuffers( 1, &pbo );
+	GetHighResolutionTime( &startTime );
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	delete decoder;
+	if (pbo) glState.DeleteBuffers( 1, &pbo );
+}
+
+void TextureStreamer::Add( GLTexture *tex )
+{
+	if (!tex || !tex->IsStreamed()) return;
+	lock.Lock();
+
+	// A texture we streamed before is being reloaded (see textureBudget.h).
+	//    These don't restart the load timer.
+	for (unsigned int i=0; i < textures.Size(); i++)
+		if (textures[i] == tex)
+		{
+			if (state[i] == STREAM_DONE)
+			{
+				state[i] = STREAM_WAITING;
+				numDone--;
+			}
+			lock.Unlock();
+			return;
+		}
+
+	if (textures.Size() == numDone)
+	{
+		GetHighResolutionTime( &startTime );
+		reportedDone = false;
+	}
+	textures.Add( tex );
+	state.Add( STREAM_WAITING );
+	priority.Add( 0 );
+	lock.Unlock();
+}
+
+bool TextureStreamer::DecodeStep( void *data )
+{
+	return ((TextureStreamer *)data)->DecodeNext();
+}
+
+// Decode the waiting texture with the highest priority.  Returns false if
+//    none are waiting.
+bool TextureStreamer::DecodeNext( void )
+{
+	lock.Lock();
+	int best = -1;
+	for (unsigned int i=0; i < textures.Size(); i++)
+		if (state[i] == STREAM_WAITING && (best < 0 || priority[i] > priority[best]))
+			best = i;
+	GLTexture *tex = (best >= 0 ? textures[best] : 0);
+	if (tex) state[best] = STREAM_DECODING;
+	lock.Unlock();
+	if (!tex) return false;
+
+	tex->StreamDecode();
+
+	lock.Lock();
+	state[best] = STREAM_DECODED;
+	lock.Unlock();
+	return true;
+}
+
+bool TextureStreamer::Update( void )
+{
+	if (textures.Size() == numDone) return false;
+
+	// Update priorities, and (re)start the decoding thread if anything is
+	//    waiting.  If it can't be, the textures are decoded right here.
+	bool waiting = false;
+	lock.Lock();
+	for (unsigned int i=0; i < textures.Size(); i++)
+	{
+		if (state[i] == STREAM_DONE) continue;
+		priority[i] = textures[i]->TakeBindCount();
+		waiting |= (state[i] == STREAM_WAITING);
+	}
+	lock.Unlock();
+	if (waiting) decoder->Wake();
+
+	// See what's ready to upload
+	Array1D< int > ready;
+	lock.Lock();
+	for (unsigned int i=0; i < textures.Size(); i++)
+		if (state[i] == STREAM_DECODED) ready.Add( i );
+	lock.Unlock();
+
+	// Most used textures first (a small insertion sort)
+	for (unsigned int i=1; i < ready.Size(); i++)
+		for (unsigned int j=i; j > 0 && priority[ready[j]] > priority[ready[j-1]]; j--)
+		{
+			int tmp = ready[j];
+			ready[j] = ready[j-1];
+			ready[j-1] = tmp;
+		}
+
+	// Upload a level of each texture per pass, until we run out of budget
+	size_t used = 0;
+	bool progress = true;
+	while (progress && used < bytesPerFrame)
+	{
+		progress = false;
+		for (unsigned int k=0; k < ready.Size(); k++)
+		{
+			GLTexture *tex = textures[ready[k]];
+			if (tex->IsStreamingDone()) continue;
+			size_t next = tex->NextStreamLevelBytes();
+			if (used > 0 && used + next > bytesPerFrame) continue;
+			used += tex->StreamNextLevel( pbo );
+			progress = true;
+			if (tex->IsStreamingDone())
+			{
+				lock.Lock();
+				state[ready[k]] = STREAM_DONE;
+				numDone++;
+				lock.Unlock();
+			}
+		}
+	}
+	bytesUploaded += used;
+
+	if (textures.Size() == numDone && !reportedDone)
+	{
+		TimerStruct now;
+		GetHighResolutionTime( &now );
+		seconds = ConvertTimeDifferenceToSec( &now, &startTime );
+		reportedDone = true;
+		return true;
+	}
+	return false;
+}
+
+void TextureStreamer::PrintStats( FILE *f )
+{
+	fprintf( f, "Texture streaming: %u of %u textures done, %.2f MB uploaded",
+		     numDone, textures.Size(), bytesUploaded/1048576.0 );
+	if (textures.Size() == numDone) fprintf( f, " in %.2f sec\n", seconds );
+	else                            fprintf( f, "\n" );
+}
+
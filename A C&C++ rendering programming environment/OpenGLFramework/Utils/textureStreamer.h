@@ -0,0 +1,90 @@
+/***************************************************************************/
+/* textureStreamer.h                                                       */
+/* ------------                                                            */
+/*                                                                         */
+/* Loads textures in the background while frames are drawn, so scenes with */
+/*     many or large textures start right away instead of sitting on a     */
+/*     black window.                                                       */
+/*                                                                         */
+/* Textures created with TEXTURE_STREAM start out as a 1x1 placeholder     */
+/*     (see GLTexture::Preprocess()).  Once Add()ed here:                  */
+/*       1) A background thread reads, compresses, and builds mipmaps for  */
+/*          each texture in turn (GLTexture::StreamDecode()).              */
+/*       2) Update(), called once per frame on the OpenGL thread, uploads  */
+/*          the decoded textures a mip level at a time, coarsest first, up */
+/*          to a budget of bytes per frame.  The 1x1 level (the image's    */
+/*          average color) goes first, and each level sharpens the image.  */
+/*          Uploads go through a pixel buffer object when available, so    */
+/*          they don't stall the frame.                                    */
+/*                                                                         */
+/* Textures drawn the most in the previous frame are decoded and refined   */
+/*     first.  (Scene objects don't know their screen-space size, so the   */
+/*     number of draws using a texture stands in for it.)  Each pass over  */
+/*     the textures uploads at most one level of each, so every texture    */
+/*     gets its coarse levels before any gets its finest.                  */
+/***************************************************************************/
+
+#ifndef __TEXTURESTREAMER_H
+#define __TEXTURESTREAMER_H
+
+#include <stdio.h>
+#include <GL/glew.h>
+#include <GL/glut.h>
+#include "DataTypes/Array1D.h"
+#include "HighResolutionTimer.h"
+#include "parallelFor.h"
+
+class GLTexture;
+
+// Default number of bytes uploaded per frame.  (At least one mip level is
+//    uploaded each frame, however big.)
+#define TEXTURE_STREAM_BYTES_PER_FRAME   (4*1024*1024)
+
+class TextureStreamer
+{
+public:
+	TextureStreamer( size_t bytesPerFrame=TEXTURE_STREAM_BYTES_PER_FRAME );
+	~TextureStreamer();
+
+	// Stream in a texture.  It must be IsStreamed() and already Preprocess()ed.
+	//    Adding a texture again (after GLTexture::Reload()) streams it again.
+	void Add( GLTexture *tex );
+
+	// Once per frame, on the OpenGL thread.  Returns true on the frame the
+	//    last texture finishes.
+	bool Update( void );
+
+	inline void SetBytesPerFrame( size_t bytes )   { bytesPerFrame = bytes; }
+	inline size_t GetBytesPerFrame( void ) const   { return bytesPerFrame; }
+
+	// How many textures are not fully uploaded yet?
+	inline unsigned int NumPending( void ) const   { return textures.Size() - numDone; }
+
+	void PrintStats( FILE *f );
+
+private:
+	// Per texture states
+	enum { STREAM_WAITING, STREAM_DECODING, STREAM_DECODED, STREAM_DONE };
+
+	Array1D< GLTexture * > textures;
+	Array1D< int > state;
+	Array1D< unsigned int > priority;
+	unsigned int numDone;
+	bool reportedDone;
+
+	size_t bytesPerFrame, bytesUploaded;
+	GLuint pbo;
+	TimerStruct startTime;
+	float seconds;
+
+	// The decoding thread, and the lock for the arrays above (the thread
+	//    only looks at them while holding it)
+	ParallelWorker *decoder;
+	ParallelMutex lock;
+
+	static bool DecodeStep( void *data );
+	bool DecodeNext( void );
+};
+
+#endif
+
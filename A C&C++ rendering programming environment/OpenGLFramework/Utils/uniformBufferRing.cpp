@@ -0,0 +1,57 @@
+/***************************************************************************/
+/* uniformBufferRing.cpp                                                   */
+/* ------------                                                            */
+/*                                                                         */
+/* Implements a ring of uniform buffer objects for per-frame shader data.  */
+/*     See the header for usage notes.                                     */
+/***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "uniformBufferRing.h"
+#include "glStateCache.h"
+
+
+UniformBufferRing::UniformBufferRing( GLuint bindingPoint, unsigned int maxBytes, int ringSize ) :
+	bufferIDs(0), ringSize(ringSize), current(0), bindingPoint(bindingPoint), maxBytes(maxBytes)
+{
+	if (!GLEW_ARB_uniform_buffer_object || ringSize < 1) return;
+
+	bufferIDs = (GLuint *)malloc( ringSize * sizeof( GLuint ) );
+	glGenBuffers( ringSize, bufferIDs );
+	for (int i=0; i < ringSize; i++)
+	{
+		glState.BindBuffer( GL_UNIFORM_BUFFER, bufferIDs[i] );
+		glBufferData( GL_UNIFORM_BUFFER, maxBytes, NULL, GL_STREAM_DRAW );
+	}
+	glState.BindBuffer( GL_UNIFORM_BUFFER, 0 );
+}
+
+UniformBufferRing::~UniformBufferRing()
+{
+	if (!bufferIDs) return;
+	glState.DeleteBuffers( ringSize, bufferIDs );
+	free( bufferIDs );
+}
+
+void UniformBufferRing::Update( void *data, unsigned int numBytes )
+{
+	if (!bufferIDs) return;
+	if (numBytes > maxBytes) numBytes = maxBytes;
+
+	current = (current+1) % ringSize;
+	glState.BindBuffer( GL_UNIFORM_BUFFER, bufferIDs[current] );
+	glBufferSubData( GL_UNIFORM_BUFFER, 0, numBytes, data );
+	Bind();
+}
+
+void UniformBufferRing::Bind( void )
+{
+	if (!bufferIDs) return;
+
+	// glBindBufferBase() also binds the buffer to the generic GL_UNIFORM_BUFFER
+	//    target, so bind that through the state cache first to keep it in sync.
+	glState.BindBuffer( GL_UNIFORM_BUFFER, bufferIDs[current] );
+	glBindBufferBase( GL_UNIFORM_BUFFER, bindingPoint, bufferIDs[current] );
+}
+
@@ -0,0 +1,53 @@
+/***************************************************************************/
+/* uniformBufferRing.h                                                     */
+/* ------------                                                            */
+/*                                                                         */
+/* A small ring of OpenGL uniform buffer objects (UBOs) that hold data     */
+/*     updated once per frame and shared by many shaders (e.g., camera and */
+/*     light parameters).  Every Update() writes into the next buffer in   */
+/*     the ring and binds it to a fixed binding point, so the CPU never    */
+/*     overwrites a buffer the GPU may still be reading from an earlier    */
+/*     frame.                                                              */
+/*                                                                         */
+/* Shaders see the data by declaring a matching uniform block, and the     */
+/*     block must be associated with the same binding point (see           */
+/*     GLSLProgram::BindUniformBlock()).                                   */
+/*                                                                         */
+/* This requires ARB_uniform_buffer_object.  If it is missing, IsValid()   */
+/*     returns false and Update() does nothing.                            */
+/***************************************************************************/
+
+#ifndef __UNIFORMBUFFERRING_H
+#define __UNIFORMBUFFERRING_H
+
+#include <GL/glew.h>
+#include <GL/glut.h>
+
+class UniformBufferRing
+{
+public:
+	// Create 'ringSize' buffers of 'maxBytes' each, to be bound at 'bindingPoint'
+	UniformBufferRing( GLuint bindingPoint, unsigned int maxBytes, int ringSize=3 );
+	~UniformBufferRing();
+
+	// Copy the first 'numBytes' of 'data' into the next buffer in the ring and
+	//    bind it.  Bytes past numBytes are left as they were in that buffer.
+	void Update( void *data, unsigned int numBytes );
+
+	// (Re)bind the current buffer to our binding point, in case someone else
+	//    bound a different buffer there.
+	void Bind( void );
+
+	inline bool IsValid( void ) const               { return bufferIDs != 0; }
+	inline GLuint GetBindingPoint( void ) const     { return bindingPoint; }
+	inline GLuint GetCurrentBufferID( void ) const  { return bufferIDs ? bufferIDs[current] : 0; }
+
+private:
+	GLuint *bufferIDs;
+	int ringSize, current;
+	GLuint bindingPoint;
+	unsigned int maxBytes;
+};
+
+#endif
+
@@ -0,0 +1,552 @@
+/***************************************************************************/
+/* virtualTexture.cpp                                                      */
+/* ------------                                                            */
+/*                                                                         */
+/* Implements '.vt' tile files, the OpenGL side of virtual textures, and   */
+/*     the per-frame feedback, loading, and uploading.  See the header for */
+/*     usage notes.                                                        */
+/***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "virtualTexture.h"
+#include "framebufferObject.h"
+#include "glStateCache.h"
+#include "mipmapGenerator.h"
+#include "ImageIO/imageIO.h"
+#include "Scene/Scene.h"
+#include "Materials/Material.h"
+
+#pragma warning( disable: 4996 )
+
+// A '.vt' file is this magic number and header, then the tiles:  each
+//    (tileSize + 2*border) squared RGBA8 texels, rows bottom to top (as
+//    OpenGL wants them).  Level 0's tiles come first, row by row from the
+//    bottom left, then level 1's, and so on.
+static const char vtMagic[4] = { 'V', 'T', 'E', 'X' };
+enum { VT_HDR_VERSION, VT_HDR_WIDTH, VT_HDR_HEIGHT, VT_HDR_TILESIZE, VT_HDR_BORDER,
+	   VT_HDR_LEVELS, VT_HDR_PAGESX, VT_HDR_PAGESY, VT_HDR_SIZE };
+
+static bool IsPowerOfTwo( int x )
+{
+	return x > 0 && !(x & (x-1));
+}
+
+// Levels go down until a side is one tile
+static int CountLevels( int pagesX, int pagesY )
+{
+	int numLevels = 1;
+	while (numLevels < VT_MAX_LEVELS && (pagesX >> numLevels) > 0 && (pagesY >> numLevels) > 0)
+		numLevels++;
+	return numLevels;
+}
+
+// Is this a header BuildVirtualTexture() could have written?  Anything else
+//    (e.g., more levels than the pages allow) would have us index past the
+//    page table or seek past the tiles.
+static bool IsValidHeader( const unsigned int *header )
+{
+	unsigned int tileSize = header[VT_HDR_TILESIZE];
+	unsigned int pagesX = header[VT_HDR_PAGESX], pagesY = header[VT_HDR_PAGESY];
+	if (header[VT_HDR_VERSION] != VT_FILE_VERSION || header[VT_HDR_BORDER] != VT_BORDER ||
+		tileSize > VT_MAX_TILE_SIZE || !IsPowerOfTwo( (int)tileSize ) ||
+		pagesX > VT_MAX_PAGES || !IsPowerOfTwo( (int)pagesX ) ||
+		pagesY > VT_MAX_PAGES || !IsPowerOfTwo( (int)pagesY ))
+		return false;
+	return header[VT_HDR_LEVELS] == (unsigned int)CountLevels( pagesX, pagesY ) &&
+		   header[VT_HDR_WIDTH] / pagesX == tileSize && header[VT_HDR_WIDTH] % pagesX == 0 &&
+		   header[VT_HDR_HEIGHT] / pagesY == tileSize && header[VT_HDR_HEIGHT] % pagesY == 0;
+}
+
+
+bool BuildVirtualTexture( char *imageFile, char *vtFile, int tileSize )
+{
+	ImageInfo info;
+	if (!ReadImageInfo( imageFile, &info ) || info.format == IMAGE_FORMAT_KTX || info.isHDR)
+	{
+		Error( "BuildVirtualTexture() can't read '%s' (or it is HDR)!", imageFile );
+		return false;
+	}
+	int width = info.width, height = info.height;
+	if (!IsPowerOfTwo( width ) || !IsPowerOfTwo( height ) || !IsPowerOfTwo( tileSize ) ||
+		tileSize > VT_MAX_TILE_SIZE || width < tileSize || height < tileSize ||
+		width / tileSize > VT_MAX_PAGES || height / tileSize > VT_MAX_PAGES)
+	{
+		Error( "BuildVirtualTexture() needs '%s' to be a power of two size, from 1 to 256 tiles across!", imageFile );
+		return false;
+	}
+
+	unsigned char *pixels = (unsigned char *)malloc( 4*width*height );
+	if (!pixels || !DecodeImage( imageFile, pixels, 4*width, IMAGE_PIXELS_RGBA8, true ))
+	{
+		if (pixels) free( pixels );
+		Error( "BuildVirtualTexture() was unable to decode '%s'!", imageFile );
+		return false;
+	}
+	MipmapChain *mips = GenerateMipmaps( pixels, width, height, 4 );
+
+	int pagesX = width / tileSize, pagesY = height / tileSize;
+	int numLevels = CountLevels( pagesX, pagesY );
+
+	FILE *f = fopen( vtFile, "wb" );
+	if (!f)
+	{
+		delete mips;
+		free( pixels );
+		Error( "BuildVirtualTexture() was unable to create '%s'!", vtFile );
+		return false;
+	}
+	unsigned int header[VT_HDR_SIZE];
+	header[VT_HDR_VERSION]  = VT_FILE_VERSION;
+	header[VT_HDR_WIDTH]    = width;
+	header[VT_HDR_HEIGHT]   = height;
+	header[VT_HDR_TILESIZE] = tileSize;
+	header[VT_HDR_BORDER]   = VT_BORDER;
+	header[VT_HDR_LEVELS]   = numLevels;
+	header[VT_HDR_PAGESX]   = pagesX;
+	header[VT_HDR_PAGESY]   = pagesY;
+	fwrite( vtMagic, 1, 4, f );
+	fwrite( header, sizeof( unsigned int ), VT_HDR_SIZE, f );
+
+	// Borders hold the neighboring tiles' texels (clamped at the edges), so
+	//    bilinear filtering at a tile's edge matches the whole image's
+	int padded = tileSize + 2*VT_BORDER;
+	unsigned char *tile = (unsigned char *)malloc( 4*padded*padded );
+	for (int lvl=0; lvl < numLevels; lvl++)
+	{
+		int lw = mips->GetLevelWidth( lvl ), lh = mips->GetLevelHeight( lvl );
+		const unsigned char *level = mips->GetLevelData( lvl );
+		for (int py=0; py < (pagesY >> lvl); py++)
+			for (int px=0; px < (pagesX >> lvl); px++)
+			{
+				unsigned char *dst = tile;
+				for (int ty=0; ty < padded; ty++)
+				{
+					int sy = py*tileSize + ty - VT_BORDER;
+					sy = sy < 0 ? 0 : (sy >= lh ? lh-1 : sy);
+					for (int tx=0; tx < padded; tx++, dst += 4)
+					{
+						int sx = px*tileSize + tx - VT_BORDER;
+						sx = sx < 0 ? 0 : (sx >= lw ? lw-1 : sx);
+						memcpy( dst, level + 4*(sy*lw + sx), 4 );
+					}
+				}
+				fwrite( tile, 1, 4*padded*padded, f );
+			}
+	}
+	bool ok = !ferror( f );
+	fclose( f );
+	free( tile );
+	delete mips;
+	free( pixels );
+	if (!ok) Error( "BuildVirtualTexture() was unable to write '%s'!", vtFile );
+	return ok;
+}
+
+
+VirtualTexture::VirtualTexture( char *vtFile, int feedbackID ) :
+	filename(0), file(0), feedbackID(feedbackID), width(0), height(0), tileSize(0),
+	numLevels(0), pagesX(0), pagesY(0), dataStart(0), pages(0), pageTableID(0), cacheID(0)
+{
+	filename = strdup( vtFile );
+	file = fopen( vtFile, "rb" );
+	if (!file)
+	{
+		Error( "Unable to open virtual texture '%s'!", vtFile );
+		return;
+	}
+
+	char magic[4];
+	unsigned int header[VT_HDR_SIZE];
+	if (fread( magic, 1, 4, file ) != 4 || memcmp( magic, vtMagic, 4 ) ||
+		fread( header, sizeof( unsigned int ), VT_HDR_SIZE, file ) != VT_HDR_SIZE ||
+		!IsValidHeader( header ))
+	{
+		Error( "'%s' is not a virtual texture (or is from another version)!", vtFile );
+		fclose( file );
+		file = 0;
+		return;
+	}
+	width     = header[VT_HDR_WIDTH];
+	height    = header[VT_HDR_HEIGHT];
+	tileSize  = header[VT_HDR_TILESIZE];
+	numLevels = header[VT_HDR_LEVELS];
+	pagesX    = header[VT_HDR_PAGESX];
+	pagesY    = header[VT_HDR_PAGESY];
+	dataStart = 4 + VT_HDR_SIZE * sizeof( unsigned int );
+	pages = new VirtualPageTable( pagesX, pagesY, numLevels, VT_CACHE_SLOTS, VT_CACHE_SLOTS );
+}
+
+VirtualTexture::~VirtualTexture()
+{
+	if (pageTableID) glState.DeleteTextures( 1, &pageTableID );
+	if (cacheID) glState.DeleteTextures( 1, &cacheID );
+	if (pages) delete pages;
+	if (file) fclose( file );
+	free( filename );
+}
+
+void VirtualTexture::Preprocess( void )
+{
+	if (!pages || cacheID) return;
+
+	// The cache starts out undefined.  Nothing reads a slot until its
+	//    page is mapped.
+	int padded = GetPaddedTileSize();
+	glGenTextures( 1, &cacheID );
+	glState.BindTexture( GL_TEXTURE_2D, cacheID );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+	glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, pages->GetSlotsX()*padded, pages->GetSlotsY()*padded,
+		          0, GL_RGBA, GL_UNSIGNED_BYTE, 0 );
+
+	// One texel per page, with a mip level for each of the virtual texture's
+	glGenTextures( 1, &pageTableID );
+	glState.BindTexture( GL_TEXTURE_2D, pageTableID );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, numLevels-1 );
+	for (int lvl=0; lvl < numLevels; lvl++)
+		glTexImage2D( GL_TEXTURE_2D, lvl, GL_RGBA8, pagesX >> lvl, pagesY >> lvl,
+		              0, GL_RGBA, GL_UNSIGNED_BYTE, pages->GetEntries( lvl ) );
+	glState.BindTexture( GL_TEXTURE_2D, 0 );
+}
+
+void VirtualTexture::GetShaderConstants( float info[4], float tile[4], float size[4] )
+{
+	float padded = (float)GetPaddedTileSize();
+	info[0] = (float)pagesX;
+	info[1] = (float)pagesY;
+	info[2] = pages ? (float)pages->GetSlotsX() : 1;
+	info[3] = pages ? (float)pages->GetSlotsY() : 1;
+	tile[0] = (float)( log( (double)tileSize ) / log( 2.0 ) );
+	tile[1] = tileSize / padded;
+	tile[2] = VT_BORDER / padded;
+	tile[3] = (float)feedbackID;
+	size[0] = (float)width;
+	size[1] = (float)height;
+	size[2] = (float)(numLevels-1);
+	size[3] = (float)( 0.5 - log( (double)VT_FEEDBACK_SCALE ) / log( 2.0 ) );
+}
+
+bool VirtualTexture::ReadTile( const VirtualPage &page, unsigned char *dst )
+{
+	if (!file) return false;
+	long index = 0;
+	for (int lvl=0; lvl < page.level; lvl++)
+		index += (pagesX >> lvl)*(pagesY >> lvl);
+	index += page.y*(pagesX >> page.level) + page.x;
+	return !fseek( file, dataStart + index*(long)GetTileBytes(), SEEK_SET ) &&
+		   fread( dst, 1, GetTileBytes(), file ) == GetTileBytes();
+}
+
+void VirtualTexture::UploadTile( int slot, const unsigned char *data )
+{
+	int padded = GetPaddedTileSize();
+	glState.BindTexture( GL_TEXTURE_2D, cacheID );
+	glTexSubImage2D( GL_TEXTURE_2D, 0, (slot % pages->GetSlotsX())*padded, (slot / pages->GetSlotsX())*padded,
+		             padded, padded, GL_RGBA, GL_UNSIGNED_BYTE, data );
+}
+
+void VirtualTexture::UpdatePageTable( void )
+{
+	int changed = pages->UpdateEntries();
+	if (!changed) return;
+	glState.BindTexture( GL_TEXTURE_2D, pageTableID );
+	for (int lvl=0; lvl < changed; lvl++)
+		glTexSubImage2D( GL_TEXTURE_2D, lvl, 0, 0, pagesX >> lvl, pagesY >> lvl,
+		                 GL_RGBA, GL_UNSIGNED_BYTE, pages->GetEntries( lvl ) );
+}
+
+
+
+VirtualTextureManager::VirtualTextureManager() :
+	feedback(0), feedbackWidth(0), feedbackHeight(0), feedbackPBO(0), feedbackPending(false),
+	frame(0), tilesPerFrame(VT_TILES_PER_FRAME), tilesUploaded(0), tilesFailed(0), nextOrder(0),
+	loader(0)
+{
+	loader = new ParallelWorker( LoadStep, this );
+	for (int i=0; i < VT_MAX_QUEUED_LOADS; i++)
+	{
+		loadState[i] = LOAD_FREE;
+		loadData[i] = 0;
+		loadDataBytes[i] = 0;
+	}
+}
+
+VirtualTextureManager::~VirtualTextureManager()
+{
+	delete loader;
+	for (int i=0; i < VT_MAX_QUEUED_LOADS; i++)
+		if (loadData[i]) free( loadData[i] );
+	for (unsigned int i=0; i < textures.Size(); i++)
+		delete textures[i];
+	if (feedbackPBO) glState.DeleteBuffers( 1, &feedbackPBO );
+	if (feedback) delete feedback;
+}
+
+VirtualTexture *VirtualTextureManager::Add( char *vtFile )
+{
+	for (unsigned int i=0; i < textures.Size(); i++)
+		if (!strcmp( textures[i]->GetFilename(), vtFile ))
+			return textures[i];
+	if (textures.Size() >= VT_NO_FEEDBACK)
+	{
+		Error( "Too many virtual textures to add '%s'!", vtFile );
+		return 0;
+	}
+
+	VirtualTexture *tex = new VirtualTexture( vtFile, textures.Size() );
+	if (!tex->IsValid())
+	{
+		delete tex;
+		return 0;
+	}
+	textures.Add( tex );
+	return tex;
+}
+
+void VirtualTextureManager::Preprocess( int screenWidth, int screenHeight )
+{
+	if (feedback || textures.Size() == 0) return;
+	for (unsigned int i=0; i < textures.Size(); i++)
+		textures[i]->Preprocess();
+
+	feedbackWidth  = screenWidth  / VT_FEEDBACK_SCALE > 0 ? screenWidth  / VT_FEEDBACK_SCALE : 1;
+	feedbackHeight = screenHeight / VT_FEEDBACK_SCALE > 0 ? screenHeight / VT_FEEDBACK_SCALE : 1;
+	feedback = new FrameBuffer( GL_TEXTURE_2D, feedbackWidth, feedbackHeight, -1,
+		                        GL_RGBA8, 1, 1, 0, "Virtual Texture Feedback" );
+	feedback->CheckFramebufferStatus( 1 );
+
+	if (GLEW_ARB_pixel_buffer_object)
+	{
+		glGenBuffers( 1, &feedbackPBO );
+		glState.BindBuffer( GL_PIXEL_PACK_BUFFER_ARB, feedbackPBO );
+		glBufferData( GL_PIXEL_PACK_BUFFER_ARB, 4*feedbackWidth*feedbackHeight, 0, GL_STREAM_READ );
+		glState.BindBuffer( GL_PIXEL_PACK_BUFFER_ARB, 0 );
+	}
+	else
+		feedbackPixels.SetSize( 4*feedbackWidth*feedbackHeight );
+}
+
+bool VirtualTextureManager::LoadStep( void *data )
+{
+	return ((VirtualTextureManager *)data)->LoadNext();
+}
+
+// Read the load queued first.  Returns false if none are waiting.
+bool VirtualTextureManager::LoadNext( void )
+{
+	lock.Lock();
+	int best = -1;
+	for (int i=0; i < VT_MAX_QUEUED_LOADS; i++)
+		if (loadState[i] == LOAD_WAITING && (best < 0 || loadOrder[i] < loadOrder[best]))
+			best = i;
+	if (best >= 0) loadState[best] = LOAD_READING;
+	lock.Unlock();
+	if (best < 0) return false;
+
+	bool ok = ReadLoad( best );
+
+	lock.Lock();
+	loadState[best] = ok ? LOAD_READ : LOAD_FAILED;
+	lock.Unlock();
+	return true;
+}
+
+// Read a queued tile (into a buffer kept for the next load in this entry)
+bool VirtualTextureManager::ReadLoad( int i )
+{
+	if (loadDataBytes[i] < loadTex[i]->GetTileBytes())
+	{
+		if (loadData[i]) free( loadData[i] );
+		loadData[i] = (unsigned char *)malloc( loadTex[i]->GetTileBytes() );
+		loadDataBytes[i] = loadData[i] ? loadTex[i]->GetTileBytes() : 0;
+	}
+	if (loadData[i] && loadTex[i]->ReadTile( loadPage[i], loadData[i] ))
+		return true;
+	printf("Error: Unable to read a tile from virtual texture '%s'!\n", loadTex[i]->GetFilename() );
+	return false;
+}
+
+// Last frame's feedback, which has had a frame to arrive
+void VirtualTextureManager::ReadFeedback( void )
+{
+	if (!feedbackPending) return;
+	feedbackPending = false;
+
+	const unsigned char *pixels = feedbackPixels.Size() ? feedbackPixels.GetData() : 0;
+	if (feedbackPBO)
+	{
+		glState.BindBuffer( GL_PIXEL_PACK_BUFFER_ARB, feedbackPBO );
+		pixels = (const unsigned char *)glMapBuffer( GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY );
+	}
+	if (pixels)
+	{
+		frame++;
+		for (unsigned int i=0; i < textures.Size(); i++)
+		{
+			VirtualPageTable *pages = textures[i]->GetPageTable();
+			pages->BeginFrame( frame );
+			pages->AddFeedback( pixels, feedbackWidth*feedbackHeight, textures[i]->GetFeedbackID() );
+		}
+	}
+	if (feedbackPBO)
+	{
+		if (pixels) glUnmapBuffer( GL_PIXEL_PACK_BUFFER_ARB );
+		glState.BindBuffer( GL_PIXEL_PACK_BUFFER_ARB, 0 );
+	}
+}
+
+// Upload the tiles that have been read, oldest first, up to the budget
+void VirtualTextureManager::UploadTiles( void )
+{
+	int ready[VT_MAX_QUEUED_LOADS], numReady = 0;
+	lock.Lock();
+	for (int i=0; i < VT_MAX_QUEUED_LOADS; i++)
+		if (loadState[i] == LOAD_READ) ready[numReady++] = i;
+	lock.Unlock();
+
+	for (int i=1; i < numReady; i++)
+		for (int j=i; j > 0 && loadOrder[ready[j]] < loadOrder[ready[j-1]]; j--)
+		{
+			int tmp = ready[j];
+			ready[j] = ready[j-1];
+			ready[j-1] = tmp;
+		}
+
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+	for (int k=0; k < numReady && k < tilesPerFrame; k++)
+	{
+		int i = ready[k];
+		loadTex[i]->UploadTile( loadSlot[i], loadData[i] );
+		loadTex[i]->GetPageTable()->MapPage( loadPage[i] );
+		tilesUploaded++;
+		lock.Lock();
+		loadState[i] = LOAD_FREE;
+		lock.Unlock();
+	}
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+	glState.BindTexture( GL_TEXTURE_2D, 0 );
+}
+
+// Give the loader the wanted pages that aren't in the cache, coarsest first
+void VirtualTextureManager::QueueMissingPages( void )
+{
+	// Loads that failed give their slot back (and the page will be asked
+	//    for again while it's wanted)
+	int freeLoads[VT_MAX_QUEUED_LOADS], numFree = 0;
+	lock.Lock();
+	for (int i=0; i < VT_MAX_QUEUED_LOADS; i++)
+	{
+		if (loadState[i] == LOAD_FAILED)
+		{
+			loadTex[i]->GetPageTable()->CancelPage( loadPage[i] );
+			loadState[i] = LOAD_FREE;
+			tilesFailed++;
+		}
+		if (loadState[i] == LOAD_FREE) freeLoads[numFree++] = i;
+	}
+	lock.Unlock();
+
+	VirtualPage missing[VT_MAX_QUEUED_LOADS];
+	int used = 0;
+	for (unsigned int t=0; t < textures.Size() && used < numFree; t++)
+	{
+		VirtualPageTable *pages = textures[t]->GetPageTable();
+		int numMissing = pages->GetMissingPages( missing, numFree - used );
+		for (int k=0; k < numMissing; k++)
+		{
+			int slot = pages->AllocateSlot( missing[k] );
+			if (slot < 0) break;
+			int i = freeLoads[used++];
+			loadTex[i]  = textures[t];
+			loadPage[i] = missing[k];
+			loadSlot[i] = slot;
+			loadOrder[i] = nextOrder++;
+			lock.Lock();
+			loadState[i] = LOAD_WAITING;
+			lock.Unlock();
+		}
+	}
+
+	// (Re)start the loader.  If it can't be, the tiles are read right here.
+	if (used > 0)
+		loader->Wake();
+}
+
+// Draw the scene small, with virtual textured materials writing which pages
+//    they want, and start reading it back
+void VirtualTextureManager::DrawFeedback( Scene *s )
+{
+	glPushAttrib( GL_VIEWPORT_BIT | GL_COLOR_BUFFER_BIT );
+	feedback->BindBuffer();
+	glViewport( 0, 0, feedbackWidth, feedbackHeight );
+	glClearColor( 1, 1, 1, 1 );   // VT_NO_FEEDBACK
+	feedback->ClearBuffers();
+
+	// Depth first (cheaply, with the default material), so only the nearest
+	//    surface leaves feedback.  Then only materials that handle
+	//    MATL_FLAGS_VTFEEDBACK turn color writes back on.
+	glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+	glState.Enable( GL_DEPTH_TEST );
+	glState.DepthMask( GL_TRUE );
+	glState.DepthFunc( GL_LESS );
+	s->GetDefaultMaterial()->Enable( s );
+	s->Draw( MATL_FLAGS_NONE, OBJECT_OPTION_NONE, true );
+	s->GetDefaultMaterial()->Disable();
+	glState.DepthMask( GL_FALSE );
+	glState.DepthFunc( GL_LEQUAL );
+	s->Draw( MATL_FLAGS_VTFEEDBACK );
+	glState.DepthMask( GL_TRUE );
+	glState.DepthFunc( GL_LESS );
+	glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
+
+	if (feedbackPBO)
+	{
+		glState.BindBuffer( GL_PIXEL_PACK_BUFFER_ARB, feedbackPBO );
+		glReadPixels( 0, 0, feedbackWidth, feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, 0 );
+		glState.BindBuffer( GL_PIXEL_PACK_BUFFER_ARB, 0 );
+	}
+	else
+		glReadPixels( 0, 0, feedbackWidth, feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, feedbackPixels.GetData() );
+	feedbackPending = true;
+
+	feedback->UnbindBuffer();
+	glPopAttrib();
+}
+
+void VirtualTextureManager::Update( Scene *s )
+{
+	if (!feedback) return;
+	ReadFeedback();
+	UploadTiles();
+	QueueMissingPages();
+	for (unsigned int i=0; i < textures.Size(); i++)
+		textures[i]->UpdatePageTable();
+	glState.BindTexture( GL_TEXTURE_2D, 0 );
+	DrawFeedback( s );
+}
+
+void VirtualTextureManager::PrintStats( FILE *f )
+{
+	unsigned int resident = 0, evicted = 0, slots = 0;
+	size_t cacheBytes = 0;
+	for (unsigned int i=0; i < textures.Size(); i++)
+	{
+		VirtualPageTable *pages = textures[i]->GetPageTable();
+		resident += pages->GetNumResident();
+		evicted  += pages->GetNumEvicted();
+		slots    += pages->GetNumSlots();
+		cacheBytes += pages->GetNumSlots() * textures[i]->GetTileBytes();
+	}
+	fprintf( f, "Virtual textures: %u textures, %u of %u tiles resident (%.2f MB cache), %u loaded, %u evicted",
+		     textures.Size(), resident, slots, cacheBytes/1048576.0, tilesUploaded, evicted );
+	if (tilesFailed) fprintf( f, ", %u FAILED\n", tilesFailed );
+	else             fprintf( f, "\n" );
+}
@@ -0,0 +1,208 @@
+/***************************************************************************/
+/* virtualTexture.h                                                        */
+/* ------------                                                            */
+/*                                                                         */
+/* Sparse virtual texturing:  drawing with textures far too big for video  */
+/*     memory, by keeping only the tiles ("pages") on screen resident.     */
+/*                                                                         */
+/* A virtual texture is a '.vt' file of tiles, made from an image once     */
+/*     with BuildVirtualTexture() (or "sceneLoader -buildvt").  On the GPU */
+/*     it is two textures:  a physical cache, a grid of tile-sized slots   */
+/*     holding whichever tiles are loaded, and a page table, with a texel  */
+/*     per page (of each mip level) saying which slot to read it from.     */
+/*     The bookkeeping is in VirtualPageTable (virtualTexturePages.h).     */
+/*                                                                         */
+/* Each frame, VirtualTextureManager::Update():                            */
+/*       1) Reads back the last frame's feedback (below), to see which     */
+/*          pages were wanted.                                             */
+/*       2) Uploads tiles the loader thread has read, up to a budget per   */
+/*          frame, and updates the page tables.                            */
+/*       3) Queues the missing pages, coarsest first, for the loader.      */
+/*       4) Draws the feedback pass:  the scene again, at 1/8 resolution,  */
+/*          where virtual textured materials write the page they want      */
+/*          (see virtualTexturePages.h for the encoding) instead of color. */
+/*          It is read back through a pixel buffer object, and only        */
+/*          looked at next frame, so the GPU never waits.                  */
+/*                                                                         */
+/* Pages still loading fall back to the nearest coarser page in the cache, */
+/*     so a texture appears blurry at first, and sharpens over a few       */
+/*     frames.                                                             */
+/*                                                                         */
+/* GLSLShaderMaterials use a virtual texture with the scene file line      */
+/*     "bind <name> vtex <unit> <file.vt>", which binds the page table to  */
+/*     the sampler <name>PageTable on texture unit <unit>, the cache to    */
+/*     <name>Cache on <unit>+1, and sets three vec4 uniforms:              */
+/*        <name>Info = ( pagesX, pagesY, slotsX, slotsY )                  */
+/*        <name>Tile = ( log2(tileSize), tileSize / paddedSize,            */
+/*                       border / paddedSize, feedback ID )                */
+/*        <name>Size = ( width, height, numLevels-1, feedback LOD bias )   */
+/*     The material's shader is also compiled with VT_FEEDBACK defined     */
+/*     (see shaderPermutationCache.h), for the feedback pass.  In GLSL:    */
+/*                                                                         */
+/*    uniform sampler2D vtPageTable, vtCache;                              */
+/*    uniform vec4 vtInfo, vtTile, vtSize;                                 */
+/*    vec4 VirtualFeedback( vec2 uv ) {        // For VT_FEEDBACK builds   */
+/*        vec2 dx = dFdx( uv*vtSize.xy ), dy = dFdy( uv*vtSize.xy );       */
+/*        float lod = 0.5*log2( max( dot(dx,dx), dot(dy,dy) ) );           */
+/*        float lvl = clamp( floor( lod + vtSize.w ), 0.0, vtSize.z );     */
+/*        vec2 page = floor( fract( uv ) * vtInfo.xy / exp2( lvl ) );      */
+/*        return vec4( page, lvl, vtTile.w ) / 255.0;                      */
+/*    }                                                                    */
+/*    vec4 VirtualTexture( vec2 uv ) {                                     */
+/*        vec4 e = texture2D( vtPageTable, uv, vtTile.x ) * 255.0;         */
+/*        if (e.a < 1.0) return vec4( 0.5 );       // Nothing loaded yet   */
+/*        e = floor( e + 0.5 );                                            */
+/*        vec2 inPage = fract( uv * vtInfo.xy / exp2( e.z ) );             */
+/*        vec2 st = e.xy + vtTile.z + inPage * vtTile.y;                   */
+/*        return texture2D( vtCache, st / vtInfo.zw );                     */
+/*    }                                                                    */
+/*                                                                         */
+/*     The VT_FEEDBACK build writes VirtualFeedback( uv ) to gl_FragColor. */
+/*     The page table's mipmaps pick the level to draw with, biased by     */
+/*     log2(tileSize) since it has one texel per tile.  The feedback bias  */
+/*     rounds the same way, and makes up for the feedback's lower          */
+/*     resolution.                                                         */
+/*                                                                         */
+/* Limits:  tiles are stored as plain RGBA8 (no compression), filtering is */
+/*     bilinear within the chosen level (tiles have a 1 texel border for   */
+/*     it), and the feedback encoding allows at most VT_MAX_PAGES pages    */
+/*     across and 255 virtual textures.                                    */
+/***************************************************************************/
+
+#ifndef __VIRTUALTEXTURE_H
+#define __VIRTUALTEXTURE_H
+
+#include <stdio.h>
+#include <GL/glew.h>
+#include <GL/glut.h>
+#include "DataTypes/Array1D.h"
+#include "parallelFor.h"
+#include "virtualTexturePages.h"
+
+class Scene;
+class FrameBuffer;
+
+// Tile sizes (in texels, not counting the border) and the border width
+#define VT_DEFAULT_TILE_SIZE       128
+#define VT_MAX_TILE_SIZE           1024
+#define VT_BORDER                  1
+
+// Slots in each virtual texture's physical cache (VT_CACHE_SLOTS squared)
+#define VT_CACHE_SLOTS             16
+
+// The feedback pass is drawn at 1/VT_FEEDBACK_SCALE of the screen size
+#define VT_FEEDBACK_SCALE          8
+
+// Most tiles uploaded per frame, and most tiles queued for the loader
+#define VT_TILES_PER_FRAME         8
+#define VT_MAX_QUEUED_LOADS        64
+
+#define VT_FILE_VERSION            1
+
+// Make a '.vt' file from an image (any format DecodeImage() reads, but not
+//    HDR).  Its width and height must be powers of two, and at least (and
+//    at most VT_MAX_PAGES times) tileSize, itself a power of two up to
+//    VT_MAX_TILE_SIZE.  Needs no OpenGL context.
+bool BuildVirtualTexture( char *imageFile, char *vtFile, int tileSize=VT_DEFAULT_TILE_SIZE );
+
+
+class VirtualTexture
+{
+public:
+	// Opens the file (reading only its header).  Check IsValid() after.
+	VirtualTexture( char *vtFile, int feedbackID );
+	~VirtualTexture();
+
+	inline bool IsValid( void ) const                { return pages != 0; }
+	inline char *GetFilename( void )                 { return filename; }
+	inline int GetFeedbackID( void ) const           { return feedbackID; }
+	inline int GetTileSize( void ) const             { return tileSize; }
+	inline int GetPaddedTileSize( void ) const       { return tileSize + 2*VT_BORDER; }
+	inline size_t GetTileBytes( void ) const         { return 4*GetPaddedTileSize()*GetPaddedTileSize(); }
+	inline VirtualPageTable *GetPageTable( void )    { return pages; }
+
+	// Create the cache and page table textures
+	void Preprocess( void );
+	inline GLuint GetPageTableID( void ) const       { return pageTableID; }
+	inline GLuint GetCacheID( void ) const           { return cacheID; }
+
+	// The <name>Info, <name>Tile, and <name>Size uniforms (see above)
+	void GetShaderConstants( float info[4], float tile[4], float size[4] );
+
+	// Read a tile from the file into 'dst' (GetTileBytes() big).  Only ever
+	//    called by one thread at a time.
+	bool ReadTile( const VirtualPage &page, unsigned char *dst );
+
+	// Put a tile in a slot, and refresh the page table (OpenGL thread only)
+	void UploadTile( int slot, const unsigned char *data );
+	void UpdatePageTable( void );
+
+private:
+	char *filename;
+	FILE *file;
+	int feedbackID;
+	int width, height, tileSize, numLevels, pagesX, pagesY;
+	long dataStart;
+	VirtualPageTable *pages;
+	GLuint pageTableID, cacheID;
+};
+
+
+class VirtualTextureManager
+{
+public:
+	VirtualTextureManager();
+	~VirtualTextureManager();
+
+	// The virtual texture for a file, opening it if needed.  Returns NULL
+	//    (after printing an error) if it can't be used.
+	VirtualTexture *Add( char *vtFile );
+	inline unsigned int GetNumTextures( void ) const    { return textures.Size(); }
+
+	// Create OpenGL resources, once there is a context
+	void Preprocess( int screenWidth, int screenHeight );
+
+	// Once per frame, after the camera is set up (it draws the scene)
+	void Update( Scene *s );
+
+	inline void SetTilesPerFrame( int tiles )   { tilesPerFrame = tiles; }
+
+	void PrintStats( FILE *f );
+
+private:
+	Array1D< VirtualTexture * > textures;
+	FrameBuffer *feedback;
+	int feedbackWidth, feedbackHeight;
+	GLuint feedbackPBO;
+	Array1D< unsigned char > feedbackPixels;   // Without pixel buffer objects
+	bool feedbackPending;
+	unsigned int frame;
+	int tilesPerFrame;
+	unsigned int tilesUploaded, tilesFailed;
+
+	// The load queue.  The loader thread only looks at it while holding
+	//    the lock, and takes the waiting load with the lowest order.
+	enum { LOAD_FREE, LOAD_WAITING, LOAD_READING, LOAD_READ, LOAD_FAILED };
+	int loadState[VT_MAX_QUEUED_LOADS];
+	VirtualTexture *loadTex[VT_MAX_QUEUED_LOADS];
+	VirtualPage loadPage[VT_MAX_QUEUED_LOADS];
+	int loadSlot[VT_MAX_QUEUED_LOADS];
+	unsigned int loadOrder[VT_MAX_QUEUED_LOADS];
+	unsigned char *loadData[VT_MAX_QUEUED_LOADS];
+	size_t loadDataBytes[VT_MAX_QUEUED_LOADS];
+	unsigned int nextOrder;
+
+	ParallelWorker *loader;
+	ParallelMutex lock;
+
+	static bool LoadStep( void *data );
+	bool LoadNext( void );
+	bool ReadLoad( int i );
+
+	void ReadFeedback( void );
+	void UploadTiles( void );
+	void QueueMissingPages( void );
+	void DrawFeedback( Scene *s );
+};
+
+#endif
@@ -0,0 +1,240 @@
+/***************************************************************************/
+/* virtualTexturePages.cpp                                                 */
+/* ------------                                                            */
+/*                                                                         */
+/* Implements the page table, LRU tile cache, and feedback analysis for    */
+/*     virtual textures.  See the header for usage notes.                  */
+/***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "virtualTexturePages.h"
+
+
+VirtualPageTable::VirtualPageTable( int pagesX, int pagesY, int numLevels, int slotsX, int slotsY ) :
+	pagesX(pagesX), pagesY(pagesY), numLevels(numLevels), slotsX(slotsX), slotsY(slotsY),
+	frame(0), dirtyLevels(0), numResident(0), numEvicted(0)
+{
+	levelOffset[0] = 0;
+	for (int lvl=0; lvl < numLevels; lvl++)
+		levelOffset[lvl+1] = levelOffset[lvl] + (pagesX >> lvl)*(pagesY >> lvl);
+
+	int numPages = levelOffset[numLevels];
+	pageSlot.SetSize( numPages );
+	requestFrame.SetSize( numPages );
+	requestCount.SetSize( numPages );
+	entries.SetSize( 4*numPages );
+	for (int i=0; i < numPages; i++)
+	{
+		pageSlot[i] = -1;
+		requestFrame[i] = requestCount[i] = 0;
+	}
+	memset( entries.GetData(), 0, 4*numPages );
+
+	slotPage.SetSize( slotsX*slotsY );
+	slotMapped.SetSize( slotsX*slotsY );
+	slotLastUsed.SetSize( slotsX*slotsY );
+	for (int i=0; i < slotsX*slotsY; i++)
+	{
+		slotPage[i] = -1;
+		slotMapped[i] = false;
+		slotLastUsed[i] = 0;
+	}
+}
+
+void VirtualPageTable::PageFromIndex( int index, VirtualPage *page ) const
+{
+	int lvl = 0;
+	while (index >= levelOffset[lvl+1]) lvl++;
+	index -= levelOffset[lvl];
+	page->level = lvl;
+	page->x = index % (pagesX >> lvl);
+	page->y = index / (pagesX >> lvl);
+}
+
+void VirtualPageTable::MarkDirty( int level )
+{
+	if (level+1 > dirtyLevels) dirtyLevels = level+1;
+}
+
+// Frames are numbered from 1, so pages never requested (frame 0) aren't
+//    mistaken for pages wanted in the first frame
+void VirtualPageTable::BeginFrame( unsigned int newFrame )
+{
+	frame = newFrame ? newFrame : 1;
+	requested.Clear();
+}
+
+void VirtualPageTable::RequestPage( int level, int x, int y )
+{
+	if (level < 0 || level >= numLevels || x < 0 || y < 0 ||
+		x >= (pagesX >> level) || y >= (pagesY >> level))
+		return;
+
+	// Once a page has been seen this frame, so have all the coarser ones
+	for (; level < numLevels; level++, x >>= 1, y >>= 1)
+	{
+		int idx = PageIndex( level, x, y );
+		if (requestFrame[idx] == frame)
+		{
+			requestCount[idx]++;
+			return;
+		}
+		requestFrame[idx] = frame;
+		requestCount[idx] = 1;
+		requested.Add( idx );
+		if (pageSlot[idx] >= 0)
+			slotLastUsed[ pageSlot[idx] ] = frame;
+	}
+}
+
+void VirtualPageTable::AddFeedback( const unsigned char *pixels, int numPixels, int textureID )
+{
+	// Neighboring pixels mostly want the same page, so skip repeats cheaply
+	unsigned int last = 0xFFFFFFFF;
+	int lastIdx = -1;
+	for (int i=0; i < numPixels; i++, pixels += 4)
+	{
+		if (pixels[3] != textureID) continue;
+		unsigned int pixel = pixels[0] | (pixels[1] << 8) | (pixels[2] << 16);
+		if (pixel == last && lastIdx >= 0)
+		{
+			requestCount[lastIdx]++;
+			continue;
+		}
+		RequestPage( pixels[2], pixels[0], pixels[1] );
+		last = pixel;
+		lastIdx = (pixels[2] < numLevels && pixels[0] < (pagesX >> pixels[2]) && pixels[1] < (pagesY >> pixels[2])) ?
+			      PageIndex( pixels[2], pixels[0], pixels[1] ) : -1;
+	}
+}
+
+typedef struct
+{
+	int level;
+	unsigned int count;
+	int index;
+} MissingPage;
+
+// Coarsest first, then the most seen
+static int CompareMissingPages( const void *a, const void *b )
+{
+	const MissingPage *pa = (const MissingPage *)a, *pb = (const MissingPage *)b;
+	if (pa->level != pb->level) return pb->level - pa->level;
+	if (pa->count != pb->count) return pa->count < pb->count ? 1 : -1;
+	return pa->index - pb->index;
+}
+
+int VirtualPageTable::GetMissingPages( VirtualPage *pages, int maxPages )
+{
+	Array1D< MissingPage > missing;
+	for (unsigned int i=0; i < requested.Size(); i++)
+	{
+		int idx = requested[i];
+		if (pageSlot[idx] >= 0) continue;
+		MissingPage m;
+		VirtualPage p;
+		PageFromIndex( idx, &p );
+		m.level = p.level;
+		m.count = requestCount[idx];
+		m.index = idx;
+		missing.Add( m );
+	}
+	if (missing.Size() > 1)
+		qsort( missing.GetData(), missing.Size(), sizeof( MissingPage ), CompareMissingPages );
+
+	int num = (int)missing.Size() < maxPages ? (int)missing.Size() : maxPages;
+	for (int i=0; i < num; i++)
+		PageFromIndex( missing[i].index, &pages[i] );
+	return num;
+}
+
+int VirtualPageTable::AllocateSlot( const VirtualPage &page )
+{
+	int idx = PageIndex( page );
+	if (pageSlot[idx] >= 0) return pageSlot[idx];
+
+	// A free slot, or else the least recently wanted page that wasn't
+	//    wanted this frame (and isn't the fallback for everything)
+	int slot = -1;
+	for (int i=0; i < slotsX*slotsY && slot < 0; i++)
+		if (slotPage[i] < 0) slot = i;
+	if (slot < 0)
+	{
+		for (int i=0; i < slotsX*slotsY; i++)
+		{
+			if (!slotMapped[i] || slotLastUsed[i] == frame || slotPage[i] >= levelOffset[numLevels-1])
+				continue;
+			if (slot < 0 || slotLastUsed[i] < slotLastUsed[slot])
+				slot = i;
+		}
+		if (slot < 0) return -1;
+
+		VirtualPage old;
+		PageFromIndex( slotPage[slot], &old );
+		pageSlot[ slotPage[slot] ] = -1;
+		MarkDirty( old.level );
+		numResident--;
+		numEvicted++;
+	}
+
+	slotPage[slot] = idx;
+	slotMapped[slot] = false;
+	slotLastUsed[slot] = frame;
+	pageSlot[idx] = slot;
+	return slot;
+}
+
+void VirtualPageTable::MapPage( const VirtualPage &page )
+{
+	int slot = pageSlot[ PageIndex( page ) ];
+	if (slot < 0 || slotMapped[slot]) return;
+	slotMapped[slot] = true;
+	numResident++;
+	MarkDirty( page.level );
+}
+
+void VirtualPageTable::CancelPage( const VirtualPage &page )
+{
+	int idx = PageIndex( page );
+	int slot = pageSlot[idx];
+	if (slot < 0 || slotMapped[slot]) return;
+	slotPage[slot] = -1;
+	pageSlot[idx] = -1;
+}
+
+int VirtualPageTable::GetSlot( int level, int x, int y ) const
+{
+	int slot = pageSlot[ PageIndex( level, x, y ) ];
+	return (slot >= 0 && slotMapped[slot]) ? slot : -1;
+}
+
+// A change at one level only affects the entries of it and finer levels
+//    (which may have been falling back to it), so work from coarse to fine
+int VirtualPageTable::UpdateEntries( void )
+{
+	int changed = dirtyLevels;
+	for (int lvl=dirtyLevels-1; lvl >= 0; lvl--)
+	{
+		int w = pagesX >> lvl, h = pagesY >> lvl;
+		unsigned char *e = &entries[4*levelOffset[lvl]];
+		for (int y=0; y < h; y++)
+			for (int x=0; x < w; x++, e += 4)
+			{
+				int slot = GetSlot( lvl, x, y );
+				if (slot >= 0)
+				{
+					e[0] = (unsigned char)(slot % slotsX);
+					e[1] = (unsigned char)(slot / slotsX);
+					e[2] = (unsigned char)lvl;
+					e[3] = 255;
+				}
+				else if (lvl+1 < numLevels)
+					memcpy( e, &entries[4*PageIndex( lvl+1, x >> 1, y >> 1 )], 4 );
+				else
+					e[0] = e[1] = e[2] = e[3] = 0;
+			}
+	}
+	dirtyLevels = 0;
+	return changed;
+}
@@ -0,0 +1,121 @@
+/***************************************************************************/
+/* virtualTexturePages.h                                                   */
+/* ------------                                                            */
+/*                                                                         */
+/* The bookkeeping half of sparse virtual texturing (see virtualTexture.h):*/
+/*     which tiles ("pages") of a virtual texture are in the physical tile */
+/*     cache and where, which ones the last frame wanted, and the page     */
+/*     table shaders use to find them.  There are no OpenGL calls here, so */
+/*     this can be driven (and checked) without a GPU.                     */
+/*                                                                         */
+/* A virtual texture is pagesX x pagesY pages at level 0, and half that    */
+/*     (in each direction) at each coarser level.  Pages go into "slots"   */
+/*     of a slotsX x slotsY cache.  Each frame:                            */
+/*       1) BeginFrame(), then AddFeedback() with what the feedback pass   */
+/*          saw, marks the pages wanted.  Wanting a page also wants all    */
+/*          the coarser pages covering it, so there is always something    */
+/*          (blurrier) to draw with while it loads.                        */
+/*       2) GetMissingPages() lists the wanted pages not in the cache,     */
+/*          coarsest first, and then the most seen first.                  */
+/*       3) For each page loaded, AllocateSlot() picks a slot (a free one, */
+/*          or the least recently wanted page's), and MapPage() says the   */
+/*          data is there.  Pages wanted this frame are never evicted, and */
+/*          nor is the coarsest level, so allocation can fail (returning   */
+/*          -1) when the cache is too small for what's on screen.          */
+/*       4) UpdateEntries() redoes the page table where residency changed. */
+/*                                                                         */
+/* Feedback pixels are 4 bytes:  page x, page y, level, and the virtual    */
+/*     texture's ID (VT_NO_FEEDBACK where no virtual texture was drawn).   */
+/*     Page table entries are also 4 bytes, for each page of each level:   */
+/*     the x and y of the slot to use, the level of the page in that slot  */
+/*     (the page itself, or the nearest coarser one in the cache), and 255 */
+/*     (or 0 if not even the coarsest level is loaded yet).                */
+/***************************************************************************/
+
+#ifndef __VIRTUALTEXTUREPAGES_H
+#define __VIRTUALTEXTUREPAGES_H
+
+#include "DataTypes/Array1D.h"
+
+// Feedback IDs are a byte, and this one means "nothing here"
+#define VT_NO_FEEDBACK     255
+
+// Page coordinates are a byte in the feedback, so at most 256 pages across
+#define VT_MAX_PAGES       256
+#define VT_MAX_LEVELS      9
+
+typedef struct
+{
+	int level, x, y;
+} VirtualPage;
+
+class VirtualPageTable
+{
+public:
+	VirtualPageTable( int pagesX, int pagesY, int numLevels, int slotsX, int slotsY );
+	~VirtualPageTable() {}
+
+	inline int GetNumLevels( void ) const                 { return numLevels; }
+	inline int GetPagesX( int level ) const               { return pagesX >> level; }
+	inline int GetPagesY( int level ) const               { return pagesY >> level; }
+	inline int GetSlotsX( void ) const                    { return slotsX; }
+	inline int GetSlotsY( void ) const                    { return slotsY; }
+	inline int GetNumSlots( void ) const                  { return slotsX*slotsY; }
+
+	// Step 1:  what's wanted this frame.  Pixels for other IDs (and pages
+	//    outside the texture) are ignored.
+	void BeginFrame( unsigned int frame );
+	void AddFeedback( const unsigned char *pixels, int numPixels, int textureID );
+	void RequestPage( int level, int x, int y );
+
+	// Step 2:  fills in (at most maxPages of) the wanted pages that aren't
+	//    in the cache or being loaded, and returns how many
+	int GetMissingPages( VirtualPage *pages, int maxPages );
+
+	// Step 3:  reserve a slot for loading a page into (or -1 if none can
+	//    be freed), and then either map the page or give the slot back
+	int AllocateSlot( const VirtualPage &page );
+	void MapPage( const VirtualPage &page );
+	void CancelPage( const VirtualPage &page );
+
+	// The slot holding a (loaded) page, or -1
+	int GetSlot( int level, int x, int y ) const;
+	inline bool IsResident( int level, int x, int y ) const    { return GetSlot( level, x, y ) >= 0; }
+
+	// Step 4:  returns n if levels [0, n) of the page table changed
+	int UpdateEntries( void );
+	inline const unsigned char *GetEntries( int level ) const  { return &entries[4*levelOffset[level]]; }
+
+	// Statistics
+	inline unsigned int GetNumRequested( void ) const     { return requested.Size(); }
+	inline unsigned int GetNumResident( void ) const      { return numResident; }
+	inline unsigned int GetNumEvicted( void ) const       { return numEvicted; }
+
+private:
+	int pagesX, pagesY, numLevels, slotsX, slotsY;
+	int levelOffset[VT_MAX_LEVELS+1];
+	unsigned int frame;
+
+	// Per page (all levels, finest first):  its slot (-1 if none), the
+	//    last frame it was wanted in and how often, and its table entry
+	Array1D< int > pageSlot;
+	Array1D< unsigned int > requestFrame, requestCount;
+	Array1D< unsigned char > entries;
+
+	// Per slot:  the page in it (-1 if free), whether its data is there
+	//    yet, and the last frame its page was wanted
+	Array1D< int > slotPage;
+	Array1D< bool > slotMapped;
+	Array1D< unsigned int > slotLastUsed;
+
+	Array1D< int > requested;
+	int dirtyLevels;
+	unsigned int numResident, numEvicted;
+
+	inline int PageIndex( int level, int x, int y ) const      { return levelOffset[level] + y*(pagesX >> level) + x; }
+	inline int PageIndex( const VirtualPage &p ) const         { return PageIndex( p.level, p.x, p.y ); }
+	void PageFromIndex( int index, VirtualPage *page ) const;
+	void MarkDirty( int level );
+};
+
+#endif
@@ -0,0 +1,37 @@
+// The per-frame data the scene uploads once per frame (camera matrices,
+//    lights, shadow map matrix), shared by every shader.  This must match
+//    Scene/frameConstants.h.  Lights are in eye space.
+//
+// The scene compiles its shaders with USE_FRAME_CONSTANTS defined only when
+//    it has the uniform buffer (see Utils/shaderPermutationCache.h).  The
+//    Frame*() functions below work either way, reading the fixed-function
+//    light state (as these shaders always did) without it.
+
+#ifdef USE_FRAME_CONSTANTS
+
+#extension GL_ARB_uniform_buffer_object : enable
+
+struct FrameLight {
+	vec4 position;        // Eye-space position (w = 0 for directional lights)
+	vec4 spotDirection;   // Eye-space, w = cos(spot cutoff)
+	vec4 ambient, diffuse, specular;
+	vec4 attenuation;     // const, linear, quad, spot exponent
+};
+
+layout(std140) uniform FrameConstants {
+	mat4 viewMatrix, projectionMatrix;
+	mat4 inverseViewMatrix, shadowMatrix;
+	vec4 eyePosition;     // World-space eye position
+	vec4 lightInfo;       // x = # lights, y = light intensity multiplier
+	FrameLight light[128];
+};
+
+vec4 FrameLightPosition( int i )  { return light[i].position; }
+float FrameLightIntensity()       { return lightInfo.y; }
+
+#else
+
+vec4 FrameLightPosition( int i )  { return gl_LightSource[i].position; }
+float FrameLightIntensity()       { return 1.0; }   // Scene::GetLightIntensityModifier()
+
+#endif
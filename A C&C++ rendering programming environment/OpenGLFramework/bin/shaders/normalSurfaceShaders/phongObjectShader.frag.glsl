@@ -1,10 +1,12 @@
 
+#include "frameConstants.glsl"
+
 
 // These are colors passed in by the shader.  You can specify these in the scene file.
 uniform vec4 amb, dif, spec, shiny;
 
-// This is either 1 (for true) or 0 (for false)...  Should you use the shadow map?
-uniform float useShadowMap;
+// USE_SHADOW_MAP is #defined when this is compiled for use with a shadow map
+//    (see Utils/shaderPermutationCache.h).
 
 // If using the shadow map, here's where it is specified.
 uniform sampler2DShadow shadowMap;
@@ -29,8 +31,8 @@ vec4 IsPointIlluminated( vec4 smapCoord )
 void main( void )
 {
 	// Get the direction between the current fragment position in eye space (passed down in
-	//   gl_TexCoord[5]) and the eye-space light position.
-	vec3 toLight = normalize( gl_LightSource[0].position.xyz - gl_TexCoord[5].xyz );
+	//   gl_TexCoord[5]) and the eye-space light position (see frameConstants.glsl).
+	vec3 toLight = normalize( FrameLightPosition( 0 ).xyz - gl_TexCoord[5].xyz );
 	
 	// Get the eye-space surface normal at this point (passed down in gl_TexCoord[6])
 	vec3 norm = normalize( gl_TexCoord[6].xyz );
@@ -51,10 +53,14 @@ void main( void )
 	vec4 smapCoord = vec4(1.0);
 		
 	// Determine if this location is lit (look in shadow map, if using that).
-	vec4 lit = ( useShadowMap>0 ? IsPointIlluminated( smapCoord ) : vec4( 1.0 ) );
+#ifdef USE_SHADOW_MAP
+	vec4 lit = IsPointIlluminated( smapCoord );
+#else
+	vec4 lit = vec4( 1.0 );
+#endif
 	
-	// Output the result.  
-	gl_FragColor = amb + lit * (dif*NdotL + spec*specMult);
+	// Output the result, scaled by the scene's light intensity multiplier.
+	gl_FragColor = amb + FrameLightIntensity() * lit * (dif*NdotL + spec*specMult);
 	gl_FragColor.a = 1.0;
 	
 }
\ No newline at end of file
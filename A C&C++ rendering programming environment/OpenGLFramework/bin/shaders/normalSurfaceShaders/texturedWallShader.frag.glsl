@@ -1,9 +1,11 @@
 
+#include "frameConstants.glsl"
+
 // The texture for this object, indexed by gl_TexCoord[0]
 uniform sampler2D       wallTex;
 
-// This is either 1 (for true) or 0 (for false)...  Should you use the shadow map?
-uniform float			useShadowMap;
+// USE_SHADOW_MAP is #defined when this is compiled for use with a shadow map
+//    (see Utils/shaderPermutationCache.h).
 
 // If using the shadow map, here's where it is specified.
 uniform sampler2DShadow shadowMap;
@@ -26,8 +28,8 @@ vec4 IsPointIlluminated( vec4 smapCoord )
 void main( void )
 {
 	// Get the direction between the current fragment position in eye space (passed down in
-	//   gl_TexCoord[5]) and the eye-space light position.
-	vec3 toLight = normalize( gl_LightSource[0].position.xyz - gl_TexCoord[5].xyz );
+	//   gl_TexCoord[5]) and the eye-space light position (see frameConstants.glsl).
+	vec3 toLight = normalize( FrameLightPosition( 0 ).xyz - gl_TexCoord[5].xyz );
 	
 	// Get the eye-space surface normal at this point (passed down in gl_TexCoord[6])
 	vec3 norm = normalize( gl_TexCoord[6].xyz );
@@ -43,8 +45,13 @@ void main( void )
 	vec4 smapCoord = vec4(1.0);
 	
 	// Determine if this location is lit (look in shadow map, if using that).
-	//    The trailing 0.05 is an ambient term.
-	vec4 lit = ( useShadowMap>0 ? IsPointIlluminated( smapCoord )*NdotL : vec4(NdotL) ) + 0.05;
+	//    The trailing 0.05 is an ambient term, and FrameLightIntensity() the
+	//    scene's light intensity multiplier.
+#ifdef USE_SHADOW_MAP
+	vec4 lit = IsPointIlluminated( smapCoord )*NdotL*FrameLightIntensity() + 0.05;
+#else
+	vec4 lit = vec4(NdotL*FrameLightIntensity()) + 0.05;
+#endif
 	
 	// Get the texture color here at this fragment.
 	vec4 color = texture2D( wallTex, gl_TexCoord[0].xy );
@@ -18,8 +18,10 @@ extern Trackball *objBall[4];
 
 extern Scene *scene;
 extern SceneDefinedUI *ui;
+extern FrameGrab *frameGrab;
 extern RenderingData *data;
 double currentTime = 0;
+double movieStartTime = 0;
 
 
 
@@ -28,6 +30,11 @@ void IdleCallback ( void )
 {
 	if (data->param->lightFOV)
 		scene->GetLight( 0 )->SetFOV( *data->param->lightFOV );
+
+	// While recording a movie, time moves a fixed step per frame, so the
+	//    movie is the same however fast (or slow) it was drawn
+	if (frameGrab->IsCapturingMovie())
+		currentTime = movieStartTime + frameGrab->GetMovieTime();
 	scene->PerFrameUpdate( (float)currentTime );
 	glutPostRedisplay();
 }
@@ -54,8 +61,20 @@ bool ApplyUICommand( unsigned int curCommand, int xVal, int yVal )
 		glutPostRedisplay();
 		return true;
 	}
+	else if ( curCommand == ui->Key( UI_TOGGLE_MOVIE_CAPTURE ) )
+	{
+		if (frameGrab->IsCapturingMovie())
+			frameGrab->StopMovie();
+		else if (frameGrab->StartMovie())
+			movieStartTime = currentTime;
+		glutPostRedisplay();
+		return true;
+	}
 	else if ( curCommand == ui->Key( UI_QUIT ) )
 	{
+		// Don't lose captures still waiting to be written
+		frameGrab->StopMovie();
+		frameGrab->Flush();
 		exit(0);
 		return true;
 	}
@@ -26,6 +26,16 @@ void DisplayCallback( void )
 {
 	frameSpeed->StartFrame();
 
+	// Code outside the scene (FBOs, textures, text) changes OpenGL state without
+	//    the state cache's knowledge, so start each frame from a clean slate.
+	glState.Invalidate();
+
+	// Swap in any shaders rebuilt because their files were edited
+	scene->UpdateShaderHotReload();
+
+	// Upload some more of the textures that are still loading
+	scene->UpdateTextureStreaming();
+
 	// Create a shadow map
 	//if (usingAShadowMap)
 	//	scene->CreateShadowMap( data->fbo->shadowMap,           // Draw the shadow map into here
@@ -39,6 +49,11 @@ void DisplayCallback( void )
 	glLoadIdentity();
 	scene->LookAtMatrix();
 	scene->SetupEnabledLightsWithCurrentModelview();
+	scene->UpdateFrameConstants();
+
+	// See which virtual texture pages are needed (drawing into a small FBO
+	//    of its own), and load some more of them
+	scene->UpdateVirtualTextures();
 	
 	// Draw the scene
 	scene->Draw(); 
@@ -58,6 +73,13 @@ void DisplayCallback( void )
 		data->ui->captureScreen = false;
 	}
 
+	// While recording a movie, every frame is captured
+	if (frameGrab->IsCapturingMovie())
+		frameGrab->CaptureMovieFrame();
+
+	// Hand earlier captures, now read back, to the writer thread
+	frameGrab->Update();
+
 	DisplayTimer( frameSpeed->EndFrame(), 1024, 1024 );
 	glFlush();
 	glutSwapBuffers();
@@ -68,7 +90,12 @@ void DisplayCallback( void )
 int main(int argc, char* argv[] )
 {
 	bool verbose = false;
-	char scenefile[ 256 ];
+	char scenefile[ 256 ] = "";
+	char *movieFile = 0;
+	int movieFPS = FRAMEGRAB_MOVIE_FPS;
+	Array1D< char * > convertFrom, convertTo, buildVTFrom, buildVTTo;
+	bool benchSampler = false;
+	char *benchImage = 0;
 	char windowTitle[ 512 ];
 	printf("**************************************************************************\n");
     printf("*                CAD Course Basic OpenGL Scene Loader                 *\n");
@@ -86,11 +113,40 @@ int main(int argc, char* argv[] )
 		if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help") || 
 			!strcmp(argv[i], "-?") || !strcmp(argv[i], "/?") )
 		{
-			printf("Usage: %s <sceneFile>\n", argv[0]);
+			printf("Usage: %s [-v] [-movie <file.y4m|file.rgb|pipe>] [-moviefps <fps>] <sceneFile>\n", argv[0]);
+			printf("       %s -convert <image> <file.ktx> [-convert ...]\n", argv[0]);
+			printf("       %s -buildvt <image> <file.vt> [-buildvt ...]\n", argv[0]);
+			printf("       %s -benchsampler [image]\n", argv[0]);
 			exit(0);
 		}
 		else if (!strcmp(argv[i], "-v") || !strcmp(argv[i], "-verbose"))
 			verbose = true;
+		else if (!strcmp(argv[i], "-movie") && i+1 < argc)
+		{
+			// Where the toggle-movie-capture key records to
+			movieFile = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-moviefps") && i+1 < argc)
+			movieFPS = atoi( argv[++i] );
+		else if (!strcmp(argv[i], "-convert") && i+2 < argc)
+		{
+			// Convert images into ready-to-upload KTX files (with mipmaps)
+			convertFrom.Add( argv[++i] );
+			convertTo.Add( argv[++i] );
+		}
+		else if (!strcmp(argv[i], "-buildvt") && i+2 < argc)
+		{
+			// Cut huge images into tiles for virtual texturing
+			buildVTFrom.Add( argv[++i] );
+			buildVTTo.Add( argv[++i] );
+		}
+		else if (!strcmp(argv[i], "-benchsampler"))
+		{
+			// Time the CPU texture samplers' linear and tiled layouts
+			benchSampler = true;
+			if (i+1 < argc && argv[i+1][0] != '-')
+				benchImage = argv[++i];
+		}
 		else
 		{
 			strncpy( scenefile, argv[i], 255 );
@@ -98,6 +154,41 @@ int main(int argc, char* argv[] )
 		}
 	}
 
+	// The sampler benchmark needs no OpenGL context or scene
+	if (benchSampler)
+		exit( BenchmarkTextureSampler( benchImage ) ? 0 : 1 );
+
+	// Building virtual textures needs nothing else.  (Failures count toward
+	//    the exit status even when images are converted too.)
+	int failed = 0;
+	if (buildVTFrom.Size() > 0)
+	{
+		for (unsigned int i=0; i < buildVTFrom.Size(); i++)
+		{
+			printf("    (-) Building virtual texture '%s' from '%s'...\n", buildVTTo[i], buildVTFrom[i] );
+			if (!BuildVirtualTexture( buildVTFrom[i], buildVTTo[i] ))
+				failed++;
+		}
+		if (convertFrom.Size() == 0) exit( failed ? 1 : 0 );
+	}
+
+	// Converting images needs an OpenGL context (to know what compression
+	//    the card supports), but no scene
+	if (convertFrom.Size() > 0)
+	{
+		glutInit(&argc, argv);
+		glutInitDisplayMode( GLUT_RGBA );
+		glutCreateWindow( "Converting textures" );
+		glewInit();
+		for (unsigned int i=0; i < convertFrom.Size(); i++)
+		{
+			printf("    (-) Converting '%s' to '%s'...\n", convertFrom[i], convertTo[i] );
+			if (!ConvertToTextureContainer( convertFrom[i], convertTo[i], TEXTURE_MIN_LINEAR_MIP_LINEAR ))
+				failed++;
+		}
+		exit( failed ? 1 : 0 );
+	}
+
 	// Load the specified scene from file. 
 	scene = new Scene( scenefile, verbose );
 	sprintf( windowTitle, "Basic Scene Loader (Displaying: %s)", scenefile );
@@ -135,6 +226,7 @@ int main(int argc, char* argv[] )
 	// Other program setup 
 	frameSpeed = new FrameRate( 50 );
 	frameGrab  = new FrameGrab();
+	frameGrab->SetMovieFile( movieFile, movieFPS );
 
 	// Make sure any preprocessing that needs to be done occurs
 	scene->Preprocess();
@@ -51,6 +51,10 @@
 #include "Utils/ImageIO/imageIO.h"
 #include "Utils/framebufferObject.h"
 #include "Utils/frameGrab.h"
+#include "Utils/glStateCache.h"
+#include "Utils/textureContainer.h"
+#include "Utils/virtualTexture.h"
+#include "Utils/textureSamplerBench.h"
 
 #include "Scene/Camera.h"
 #include "Scene/glLight.h"